@@ -0,0 +1,114 @@
+/*
+  Copyright (c) 2014 Auston Sterling
+  See license.txt for copying permission.
+
+  -----Analyzer Class Implementation-----
+  Auston Sterling
+  austonst@gmail.com
+
+  Analyzes a game in the background.
+*/
+
+#include "analyzer.hpp"
+
+namespace c2
+{
+
+  //Marks the middle slot as holding something not yet collected
+  const std::uint8_t FRESH = 4;
+
+  //Analyzes each position handed over until told to quit
+  void* analysis_thread(void* data)
+  {
+    Analyzer* a = static_cast<Analyzer*>(data);
+    pthread_mutex_lock(&a->_lock);
+    while (!a->_quit)
+      {
+        if (a->_waiting)
+          {
+            //Cleared under the lock, so an interrupt for a newer position
+            //can't be lost between here and the search starting
+            GameSnapshot s = a->_next;
+            a->_position = a->_nextPosition;
+            a->_side = decidingSide(s.state);
+            a->_waiting = false;
+            a->_searcher.resume();
+            pthread_mutex_unlock(&a->_lock);
+
+            a->_searcher.analyze(s, SearchLimits());
+
+            pthread_mutex_lock(&a->_lock);
+            continue;
+          }
+        pthread_cond_wait(&a->_wake, &a->_lock);
+      }
+    pthread_mutex_unlock(&a->_lock);
+    return NULL;
+  }
+
+  Analyzer::Analyzer(std::size_t tableEntries) :
+    _searcher(tableEntries), _threadStarted(false), _quit(false),
+    _nextPosition(0), _waiting(false), _position(0), _side(SideType::NONE),
+    _back(0), _front(1), _middle(2)
+  {
+    _searcher.setObserver(this);
+    pthread_mutex_init(&_lock, NULL);
+    pthread_cond_init(&_wake, NULL);
+    _threadStarted = pthread_create(&_thread, NULL, &analysis_thread,
+                                    this) == 0;
+  }
+
+  Analyzer::~Analyzer()
+  {
+    if (_threadStarted)
+      {
+        pthread_mutex_lock(&_lock);
+        _quit = true;
+        _searcher.interrupt();
+        pthread_cond_signal(&_wake);
+        pthread_mutex_unlock(&_lock);
+        pthread_join(_thread, NULL);
+      }
+    pthread_cond_destroy(&_wake);
+    pthread_mutex_destroy(&_lock);
+  }
+
+  void Analyzer::analyze(const GameSnapshot& s, std::uint64_t position)
+  {
+    pthread_mutex_lock(&_lock);
+    _next = s;
+    _nextPosition = position;
+    _waiting = true;
+    _searcher.interrupt();
+    pthread_cond_signal(&_wake);
+    pthread_mutex_unlock(&_lock);
+  }
+
+  void Analyzer::stop()
+  {
+    pthread_mutex_lock(&_lock);
+    _waiting = false;
+    _searcher.interrupt();
+    pthread_mutex_unlock(&_lock);
+  }
+
+  bool Analyzer::latest(Analysis& a)
+  {
+    if (!(_middle.load(std::memory_order_relaxed) & FRESH)) return false;
+    _front = _middle.exchange(_front, std::memory_order_acq_rel) & ~FRESH;
+    a = _slot[_front];
+    return true;
+  }
+
+  void Analyzer::iterationDone(const SearchResult& r)
+  {
+    Analysis& a = _slot[_back];
+    a.position = _position;
+    a.best = r.best;
+    a.score = _side == SideType::BLACK ? -r.score : r.score;
+    a.depth = r.depth;
+    _back = _middle.exchange(_back | FRESH, std::memory_order_acq_rel) &
+      ~FRESH;
+  }
+
+} //Namespace
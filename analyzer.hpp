@@ -0,0 +1,107 @@
+/*
+  Copyright (c) 2014 Auston Sterling
+  See license.txt for copying permission.
+
+  -----Analyzer Class Header-----
+  Auston Sterling
+  austonst@gmail.com
+
+  Analyzes a game in the background, for showing the best call and how the
+  game stands while it is played.
+
+  The client hands over each new position, which interrupts whatever was
+  being analyzed and starts on the new one. The thread searches it deeper
+  and deeper with no time limit, until the next position comes.
+
+  Each finished iteration is published through three slots: the thread
+  fills one, the client reads another, and the third holds the latest
+  finished one between them. Swapping them is a single atomic exchange, so
+  reading the latest analysis never waits on the thread, however deep it
+  is into a search.
+*/
+
+#ifndef _analyzer_hpp_
+#define _analyzer_hpp_
+
+#include <atomic>
+#include <pthread.h>
+
+#include "search.hpp"
+
+namespace c2
+{
+
+  struct Analysis
+  {
+    //Game::hash() of the position analyzed
+    std::uint64_t position;
+
+    //The best call found there
+    GameEvent best;
+
+    //Score in centipawns for white, or near MATE_SCORE
+    int score;
+
+    //Deepest iteration finished
+    unsigned depth;
+  };
+
+  class Analyzer : private SearchObserver
+  {
+  public:
+    //Constructors
+    //Starts the thread, which waits for a position
+    Analyzer(std::size_t tableEntries = 1 << 20);
+    ~Analyzer();
+    Analyzer(const Analyzer&) = delete;
+    Analyzer& operator=(const Analyzer&) = delete;
+
+    //Starts on a new position, dropping the last. Position identifies it
+    //in what is published, and is normally the game's hash().
+    void analyze(const GameSnapshot& s, std::uint64_t position);
+
+    //Stops analyzing until the next position
+    void stop();
+
+    //Collects the latest analysis, returning false if nothing was
+    //published since the last call. Never blocks.
+    bool latest(Analysis& a);
+
+  private:
+    //Waits for positions and analyzes them
+    friend void* analysis_thread(void* data);
+
+    //Thread only. Publishes each iteration as it finishes.
+    virtual void iterationDone(const SearchResult& r);
+
+    Searcher _searcher;
+
+    //Guards the thread's control and the position waiting, never the
+    //slots, and wakes the thread
+    pthread_mutex_t _lock;
+    pthread_cond_t _wake;
+    pthread_t _thread;
+    bool _threadStarted;
+    bool _quit;
+
+    //The latest position, and whether the thread has yet to pick it up
+    GameSnapshot _next;
+    std::uint64_t _nextPosition;
+    bool _waiting;
+
+    //Thread only. The position being analyzed and who decides there.
+    std::uint64_t _position;
+    SideType _side;
+
+    //The three slots, and which is which. The thread owns _back, the
+    //client owns _front, and _middle is swapped by both. FRESH is set in
+    //_middle when it holds something the client hasn't seen.
+    Analysis _slot[3];
+    std::uint8_t _back;
+    std::uint8_t _front;
+    std::atomic<std::uint8_t> _middle;
+  };
+
+} //Namespace
+
+#endif
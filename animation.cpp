@@ -0,0 +1,76 @@
+/*
+  -----Animator Class Implementation-----
+  Auston Sterling
+  austonst@gmail.com
+
+  Implementation of the Animator class.
+*/
+
+#include "animation.hpp"
+
+#include <cmath>
+
+Animator::Animator() :
+  covered_(0)
+{}
+
+void Animator::slide(const Sprite& s, const SDL_Rect& from, const SDL_Rect& to,
+                     std::size_t square, Uint32 now)
+{
+  Animation a = {s, from, to, now, SLIDE_MS, 1ULL << square, false};
+  anim_.push_back(a);
+  covered_ |= a.square;
+}
+
+void Animator::fade(const Sprite& s, const SDL_Rect& at, Uint32 now)
+{
+  Animation a = {s, at, at, now, FADE_MS, 0, true};
+  anim_.push_back(a);
+}
+
+void Animator::finish(Uint32 now)
+{
+  std::size_t kept = 0;
+  covered_ = 0;
+  for (std::size_t i = 0; i < anim_.size(); i++)
+    {
+      if (now - anim_[i].start >= anim_[i].length) continue;
+      covered_ |= anim_[i].square;
+      anim_[kept++] = anim_[i];
+    }
+  anim_.resize(kept);
+}
+
+void Animator::clear()
+{
+  anim_.clear();
+  covered_ = 0;
+}
+
+void Animator::draw(SpriteBatch& batch, Uint32 now) const
+{
+  //Whatever was taken is under whatever took it
+  for (const Animation& a : anim_)
+    {
+      if (!a.fade) continue;
+      float t = progress(a, now);
+      batch.draw(a.sprite, a.to, Uint8(255 * (1 - t)));
+    }
+  for (const Animation& a : anim_)
+    {
+      if (a.fade) continue;
+      float t = progress(a, now);
+      SDL_Rect at = a.to;
+      at.x = a.from.x + std::lround((a.to.x - a.from.x) * t);
+      at.y = a.from.y + std::lround((a.to.y - a.from.y) * t);
+      batch.draw(a.sprite, at);
+    }
+}
+
+float Animator::progress(const Animation& a, Uint32 now)
+{
+  Uint32 elapsed = now - a.start;
+  if (elapsed >= a.length) return 1;
+  float t = float(elapsed) / a.length;
+  return t * t * (3 - 2*t);
+}
@@ -0,0 +1,76 @@
+/*
+  -----Animator Class Header-----
+  Auston Sterling
+  austonst@gmail.com
+
+  Piece sprites moving across the board. A piece that moved slides from the
+  square it left to the square it reached, and a piece that was taken fades
+  out where it stood. Every animation running at once is queued into the same
+  SpriteBatch, so any number of them cost one draw call.
+
+  Animations are drawn over a finished frame and aren't kept anywhere. The
+  square a piece is sliding to should be drawn without it until it lands;
+  covered() says which those are. Times are SDL_GetTicks() milliseconds.
+*/
+
+#ifndef _animation_hpp_
+#define _animation_hpp_
+
+#include "sprite.hpp"
+
+#include <cstdint>
+#include <vector>
+
+//How long pieces take to slide and fade, in milliseconds
+const Uint32 SLIDE_MS = 180;
+const Uint32 FADE_MS = 180;
+
+class Animator
+{
+public:
+  //Constructors
+  Animator();
+
+  //Slides a sprite from one rectangle to another, covering the given square
+  //until it's done
+  void slide(const Sprite& s, const SDL_Rect& from, const SDL_Rect& to,
+             std::size_t square, Uint32 now);
+
+  //Fades a sprite out where it is
+  void fade(const Sprite& s, const SDL_Rect& at, Uint32 now);
+
+  //Drops the animations finished by now
+  void finish(Uint32 now);
+
+  //Drops every animation
+  void clear();
+
+  //Checks if anything is still animating
+  bool active() const {return !anim_.empty();}
+
+  //The squares, one bit each, still waiting for a piece to land on them
+  std::uint64_t covered() const {return covered_;}
+
+  //Queues every animation as it looks now. Fades go under slides.
+  void draw(SpriteBatch& batch, Uint32 now) const;
+
+private:
+  struct Animation
+  {
+    Sprite sprite;
+    SDL_Rect from;
+    SDL_Rect to;
+    Uint32 start;
+    Uint32 length;
+    std::uint64_t square;
+    bool fade;
+  };
+
+  //How far along an animation is, eased in and out, from 0 to 1
+  static float progress(const Animation& a, Uint32 now);
+
+  std::vector<Animation> anim_;
+  std::uint64_t covered_;
+};
+
+#endif
@@ -0,0 +1,179 @@
+/*
+  Copyright (c) 2014 Auston Sterling
+  See license.txt for copying permission.
+
+  -----Archive Class Implementation-----
+  Auston Sterling
+  austonst@gmail.com
+
+  A container file holding many binary GameRecords.
+*/
+
+#include "archive.hpp"
+
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <cstring>
+
+namespace c2
+{
+
+  static const char ARCHIVE_MAGIC[4] = {'C', '2', 'A', 'R'};
+
+  ArchiveWriter::ArchiveWriter() : _file(nullptr), _pos(0) {}
+
+  ArchiveWriter::~ArchiveWriter()
+  {
+    close();
+  }
+
+  bool ArchiveWriter::open(const std::string& path)
+  {
+    close();
+    _file = std::fopen(path.c_str(), "wb");
+    if (!_file) return false;
+
+    //Reserve the header; it gets filled in on close
+    std::uint8_t header[ARCHIVE_HEADER_SIZE];
+    memset(header, 0, sizeof(header));
+    if (std::fwrite(header, 1, sizeof(header), _file) != sizeof(header))
+      {
+        std::fclose(_file);
+        _file = nullptr;
+        return false;
+      }
+    _pos = ARCHIVE_HEADER_SIZE;
+    _offsets.clear();
+    return true;
+  }
+
+  bool ArchiveWriter::add(const GameRecord& rec)
+  {
+    std::vector<std::uint8_t> buf;
+    if (!rec.encode(buf)) return false;
+    return addEncoded(&buf[0], buf.size());
+  }
+
+  bool ArchiveWriter::addEncoded(const std::uint8_t* data, std::size_t size)
+  {
+    if (!_file) return false;
+    if (std::fwrite(data, 1, size, _file) != size) return false;
+    _offsets.push_back(_pos);
+    _pos += size;
+    return true;
+  }
+
+  bool ArchiveWriter::close()
+  {
+    if (!_file) return true;
+
+    //Write the index, with the end of the last record as a sentinel
+    bool ok = true;
+    std::uint64_t indexOffset = _pos;
+    _offsets.push_back(_pos);
+    std::vector<std::uint8_t> index(_offsets.size() * 8);
+    for (std::size_t i = 0; i < _offsets.size(); i++)
+      {
+        putLE(&index[i*8], _offsets[i], 8);
+      }
+    _offsets.pop_back();
+    if (std::fwrite(&index[0], 1, index.size(), _file) != index.size())
+      {
+        ok = false;
+      }
+
+    //Now the real header
+    std::uint8_t header[ARCHIVE_HEADER_SIZE];
+    memset(header, 0, sizeof(header));
+    memcpy(header, ARCHIVE_MAGIC, 4);
+    putLE(header + 4, ARCHIVE_VERSION, 2);
+    putLE(header + 8, _offsets.size(), 8);
+    putLE(header + 16, indexOffset, 8);
+    if (std::fseek(_file, 0, SEEK_SET) != 0 ||
+        std::fwrite(header, 1, sizeof(header), _file) != sizeof(header))
+      {
+        ok = false;
+      }
+
+    if (std::fclose(_file) != 0) ok = false;
+    _file = nullptr;
+    return ok;
+  }
+
+  ArchiveReader::ArchiveReader() :
+    _map(nullptr), _mapSize(0), _count(0), _index(nullptr) {}
+
+  ArchiveReader::~ArchiveReader()
+  {
+    close();
+  }
+
+  bool ArchiveReader::open(const std::string& path)
+  {
+    close();
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0) return false;
+
+    struct stat st;
+    if (fstat(fd, &st) != 0 ||
+        st.st_size < static_cast<off_t>(ARCHIVE_HEADER_SIZE))
+      {
+        ::close(fd);
+        return false;
+      }
+
+    //The mapping keeps the file alive once the descriptor is gone
+    void* map = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    ::close(fd);
+    if (map == MAP_FAILED) return false;
+    _map = static_cast<const std::uint8_t*>(map);
+    _mapSize = st.st_size;
+
+    //Check the header and that the index fits in the file
+    std::uint64_t count = getLE(_map + 8, 8);
+    std::uint64_t indexOffset = getLE(_map + 16, 8);
+    if (memcmp(_map, ARCHIVE_MAGIC, 4) != 0 ||
+        getLE(_map + 4, 2) != ARCHIVE_VERSION ||
+        indexOffset < ARCHIVE_HEADER_SIZE || indexOffset > _mapSize ||
+        (_mapSize - indexOffset) / 8 < count + 1)
+      {
+        close();
+        return false;
+      }
+    _count = count;
+    _index = _map + indexOffset;
+
+    //Most uses walk the archive front to back
+    madvise(map, _mapSize, MADV_SEQUENTIAL);
+    return true;
+  }
+
+  void ArchiveReader::close()
+  {
+    if (_map)
+      {
+        munmap(const_cast<std::uint8_t*>(_map), _mapSize);
+      }
+    _map = nullptr;
+    _mapSize = 0;
+    _count = 0;
+    _index = nullptr;
+  }
+
+  std::uint64_t ArchiveReader::offset(std::size_t i) const
+  {
+    return getLE(_index + i*8, 8);
+  }
+
+  RecordReader ArchiveReader::record(std::size_t i) const
+  {
+    if (i >= _count) return RecordReader();
+    std::uint64_t start = offset(i);
+    std::uint64_t end = offset(i+1);
+    if (start > end || end > _mapSize) return RecordReader();
+    return RecordReader(_map + start, end - start);
+  }
+
+} //Namespace
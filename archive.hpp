@@ -0,0 +1,94 @@
+/*
+  Copyright (c) 2014 Auston Sterling
+  See license.txt for copying permission.
+
+  -----Archive Class Header-----
+  Auston Sterling
+  austonst@gmail.com
+
+  A container file holding many binary GameRecords, plus a reader which maps
+  the file into memory and hands out records without copying them.
+
+  All integers are little-endian.
+  header 32B  - 4B magic "C2AR", 2B version, 2B reserved, 8B record count,
+                8B index offset, 8B reserved
+  records     - encoded GameRecords, back to back
+  index       - (count+1) 8B file offsets; record i spans [off[i], off[i+1])
+*/
+
+#ifndef _archive_hpp_
+#define _archive_hpp_
+
+#include <cstdio>
+#include <string>
+
+#include "gamerecord.hpp"
+
+namespace c2
+{
+
+  const std::uint16_t ARCHIVE_VERSION = 1;
+  const std::size_t ARCHIVE_HEADER_SIZE = 32;
+
+  class ArchiveWriter
+  {
+  public:
+    //Constructors
+    ArchiveWriter();
+    ~ArchiveWriter();
+    ArchiveWriter(const ArchiveWriter&) = delete;
+    ArchiveWriter& operator=(const ArchiveWriter&) = delete;
+
+    //Creates or truncates the file and writes a placeholder header
+    bool open(const std::string& path);
+
+    //Encodes and appends a record. Returns false if it doesn't encode.
+    bool add(const GameRecord& rec);
+
+    //Appends an already encoded record, such as one from an ArchiveReader
+    bool addEncoded(const std::uint8_t* data, std::size_t size);
+
+    //Writes the index and final header. Called by the destructor if needed.
+    bool close();
+
+    std::size_t size() const {return _offsets.size();}
+
+  private:
+    std::FILE* _file;
+    std::uint64_t _pos;
+    std::vector<std::uint64_t> _offsets;
+  };
+
+  class ArchiveReader
+  {
+  public:
+    //Constructors
+    ArchiveReader();
+    ~ArchiveReader();
+    ArchiveReader(const ArchiveReader&) = delete;
+    ArchiveReader& operator=(const ArchiveReader&) = delete;
+
+    //Maps the file and checks its header and index
+    bool open(const std::string& path);
+    void close();
+
+    //Number of records in the archive
+    std::size_t size() const {return _count;}
+
+    //Gets a reader over record i, pointing straight into the mapping.
+    //It stays valid until the archive is closed.
+    RecordReader record(std::size_t i) const;
+
+  private:
+    //Reads index entry i
+    std::uint64_t offset(std::size_t i) const;
+
+    const std::uint8_t* _map;
+    std::size_t _mapSize;
+    std::size_t _count;
+    const std::uint8_t* _index;
+  };
+
+} //Namespace
+
+#endif
@@ -34,6 +34,18 @@ namespace c2
   inline std::uint8_t num(ArmyType a) {return static_cast<std::uint8_t>(a);}
   inline ArmyType toArmy(std::uint8_t n) {return static_cast<ArmyType>(n);}
 
+  //The names of the armies, for any purposes that might need them
+  const std::vector<std::string> ARMY_NAME =
+    {
+      "Classic", //CLASSIC
+      "Nemesis", //NEMESIS
+      "Empowered", //EMPOWERED
+      "Reaper", //REAPER
+      "Two Kings", //TWOKINGS
+      "Animals", //ANIMALS
+      "None" //NONE
+    };
+
   //ARMY_PROMOTE(num(ArmyTpe)) gives you the pieces a pawn of that army
   //can promote to
   const std::vector<std::set<PieceType> > ARMY_PROMOTE =
@@ -0,0 +1,333 @@
+/*
+  -----TextureAtlas Class Implementation-----
+  Auston Sterling
+  austonst@gmail.com
+
+  Implementation of the TextureAtlas class.
+*/
+
+#include "atlas.hpp"
+
+#include <fcntl.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <fstream>
+
+typedef std::chrono::steady_clock Clock;
+typedef std::chrono::duration<double, std::milli> Millis;
+
+//Space left around each image, and the size of the white area
+const int ATLAS_PADDING = 1;
+const int ATLAS_WHITE_SIZE = 4;
+
+//Marks the start of a packed atlas file
+const char ATLAS_MAGIC[8] = {'C', '2', 'A', 'T', 'L', 'A', 'S', '1'};
+
+//Work for one decoding thread: every step-th file from first
+struct DecodeWork
+{
+  const std::vector<std::string>* files;
+  std::vector<SDL_Surface*>* image;
+  std::size_t first;
+  std::size_t step;
+};
+
+//Loads images in one pixel format so they can be copied straight in
+static void* decodeThread(void* arg)
+{
+  DecodeWork* w = static_cast<DecodeWork*>(arg);
+  for (std::size_t i = w->first; i < w->files->size(); i += w->step)
+    {
+      SDL_Surface* loaded = IMG_Load((*w->files)[i].c_str());
+      if (!loaded) continue;
+      (*w->image)[i] = SDL_ConvertSurfaceFormat(loaded,
+                                                SDL_PIXELFORMAT_RGBA8888, 0);
+      SDL_FreeSurface(loaded);
+    }
+  return NULL;
+}
+
+//Reads a 4 byte value from a packed atlas, checking it's within the file
+static bool readWord(const std::uint8_t*& at, const std::uint8_t* end,
+                     std::uint32_t& word)
+{
+  if (end - at < 4) return false;
+  std::memcpy(&word, at, 4);
+  at += 4;
+  return true;
+}
+
+static void writeWord(std::ofstream& out, std::uint32_t word)
+{
+  out.write(reinterpret_cast<const char*>(&word), 4);
+}
+
+TextureAtlas::TextureAtlas() :
+  texture_(nullptr)
+{
+  white_ = {0, 0, 0, 0};
+  times_ = {0, 0, 0};
+}
+
+TextureAtlas::~TextureAtlas()
+{
+  if (texture_) SDL_DestroyTexture(texture_);
+}
+
+bool TextureAtlas::load(SDL_Renderer* rend,
+                        const std::vector<std::string>& files, int width)
+{
+  reset();
+  SDL_Surface* atlas = pack(files, width);
+  bool uploaded = atlas && upload(rend, atlas);
+  if (atlas) SDL_FreeSurface(atlas);
+  if (!uploaded) region_.clear();
+  return uploaded;
+}
+
+bool TextureAtlas::loadPacked(SDL_Renderer* rend, const std::string& path,
+                              const std::vector<std::string>& files)
+{
+  reset();
+  Clock::time_point start = Clock::now();
+  int fd = open(path.c_str(), O_RDONLY);
+  if (fd < 0) return false;
+
+  //Images changed since the atlas was packed make it out of date
+  struct stat st;
+  bool usable = fstat(fd, &st) == 0 && st.st_size > 0;
+  for (std::size_t i = 0; usable && i < files.size(); i++)
+    {
+      struct stat imageSt;
+      if (stat(files[i].c_str(), &imageSt) == 0 &&
+          imageSt.st_mtime > st.st_mtime)
+        {
+          usable = false;
+        }
+    }
+  void* map = usable ?
+    mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0) : MAP_FAILED;
+  close(fd);
+  if (map == MAP_FAILED) return false;
+
+  //Read the header and the table of images
+  const std::uint8_t* at = static_cast<const std::uint8_t*>(map);
+  const std::uint8_t* end = at + st.st_size;
+  std::uint32_t width = 0, height = 0, count = 0;
+  std::uint32_t white[4];
+  bool valid = end - at >= 8 && std::memcmp(at, ATLAS_MAGIC, 8) == 0;
+  at += 8;
+  valid = valid && readWord(at, end, width) && readWord(at, end, height);
+  for (int i = 0; i < 4; i++) valid = valid && readWord(at, end, white[i]);
+  valid = valid && readWord(at, end, count);
+  for (std::uint32_t n = 0; valid && n < count; n++)
+    {
+      std::uint32_t length = 0;
+      valid = readWord(at, end, length) &&
+        std::uint64_t(end - at) >= (std::uint64_t(length) + 3) / 4 * 4;
+      if (!valid) break;
+      std::string name(reinterpret_cast<const char*>(at), length);
+      at += (std::uint64_t(length) + 3) / 4 * 4;
+      std::uint32_t r[4];
+      for (int i = 0; i < 4; i++) valid = valid && readWord(at, end, r[i]);
+      SDL_Rect rect = {int(r[0]), int(r[1]), int(r[2]), int(r[3])};
+      region_[name] = rect;
+    }
+  valid = valid && width > 0 && height > 0 &&
+    std::uint64_t(end - at) >= std::uint64_t(width) * height * 4;
+  for (std::size_t i = 0; valid && i < files.size(); i++)
+    {
+      valid = region_.count(files[i]) > 0;
+    }
+  times_.decode = Millis(Clock::now() - start).count();
+
+  //The pixels go to the texture straight from the file
+  bool uploaded = false;
+  if (valid)
+    {
+      white_ = {int(white[0]), int(white[1]), int(white[2]), int(white[3])};
+      SDL_Surface* atlas = SDL_CreateRGBSurfaceWithFormatFrom(
+        const_cast<std::uint8_t*>(at), width, height, 32, width * 4,
+        SDL_PIXELFORMAT_RGBA8888);
+      if (atlas)
+        {
+          uploaded = upload(rend, atlas);
+          SDL_FreeSurface(atlas);
+        }
+    }
+  munmap(map, st.st_size);
+  if (!uploaded) reset();
+  return uploaded;
+}
+
+bool TextureAtlas::save(const std::string& path,
+                        const std::vector<std::string>& files, int width)
+{
+  reset();
+  SDL_Surface* atlas = pack(files, width);
+  if (!atlas) return false;
+
+  std::ofstream out(path.c_str(), std::ios::binary | std::ios::trunc);
+  out.write(ATLAS_MAGIC, 8);
+  writeWord(out, atlas->w);
+  writeWord(out, atlas->h);
+  writeWord(out, white_.x);
+  writeWord(out, white_.y);
+  writeWord(out, white_.w);
+  writeWord(out, white_.h);
+  writeWord(out, region_.size());
+  for (const std::pair<const std::string, SDL_Rect>& r : region_)
+    {
+      writeWord(out, r.first.size());
+      out.write(r.first.data(), r.first.size());
+      char zeros[4] = {0, 0, 0, 0};
+      out.write(zeros, (4 - r.first.size() % 4) % 4);
+      writeWord(out, r.second.x);
+      writeWord(out, r.second.y);
+      writeWord(out, r.second.w);
+      writeWord(out, r.second.h);
+    }
+
+  //Surfaces may pad their rows, the file doesn't
+  SDL_LockSurface(atlas);
+  for (int y = 0; y < atlas->h; y++)
+    {
+      out.write(static_cast<const char*>(atlas->pixels) + y * atlas->pitch,
+                atlas->w * 4);
+    }
+  SDL_UnlockSurface(atlas);
+  SDL_FreeSurface(atlas);
+  return bool(out);
+}
+
+SDL_Surface* TextureAtlas::pack(const std::vector<std::string>& files,
+                                int width)
+{
+  //Decode on every core. Each thread has its own files, so nothing is
+  //shared until they're joined.
+  Clock::time_point start = Clock::now();
+  std::vector<SDL_Surface*> image(files.size(), nullptr);
+  std::size_t threads = sysconf(_SC_NPROCESSORS_ONLN);
+  threads = std::max<std::size_t>(1, std::min(threads, files.size()));
+  std::vector<DecodeWork> work(threads);
+  std::vector<pthread_t> tids(threads);
+  std::vector<bool> started(threads, false);
+  for (std::size_t i = 0; i < threads; i++)
+    {
+      work[i].files = &files;
+      work[i].image = &image;
+      work[i].first = i;
+      work[i].step = threads;
+      started[i] = pthread_create(&tids[i], NULL, &decodeThread,
+                                  &work[i]) == 0;
+
+      //Do the work here if the thread couldn't be made
+      if (!started[i]) decodeThread(&work[i]);
+    }
+  for (std::size_t i = 0; i < threads; i++)
+    {
+      if (started[i]) pthread_join(tids[i], NULL);
+    }
+
+  //Everything that couldn't be used is reported at once
+  for (std::size_t i = 0; i < files.size(); i++)
+    {
+      if (!image[i] || image[i]->w + 2*ATLAS_PADDING > width)
+        {
+          missing_.push_back(files[i]);
+          if (image[i]) SDL_FreeSurface(image[i]);
+          image[i] = nullptr;
+        }
+    }
+  Clock::time_point decoded = Clock::now();
+  times_.decode = Millis(decoded - start).count();
+
+  //Rows pack best with the tallest images first
+  std::vector<std::size_t> order;
+  for (std::size_t i = 0; i < files.size(); i++)
+    {
+      if (image[i]) order.push_back(i);
+    }
+  std::stable_sort(order.begin(), order.end(),
+                   [&image](std::size_t a, std::size_t b)
+                   {return image[a]->h > image[b]->h;});
+
+  //Lay out the rows. The white area goes after everything else.
+  std::vector<SDL_Rect> place(files.size());
+  int x = 0, y = 0, rowHeight = 0;
+  for (std::size_t n = 0; n <= order.size(); n++)
+    {
+      int w = ATLAS_WHITE_SIZE, h = ATLAS_WHITE_SIZE;
+      if (n < order.size())
+        {
+          w = image[order[n]]->w;
+          h = image[order[n]]->h;
+        }
+      if (x + w + 2*ATLAS_PADDING > width)
+        {
+          x = 0;
+          y += rowHeight;
+          rowHeight = 0;
+        }
+      SDL_Rect r = {x + ATLAS_PADDING, y + ATLAS_PADDING, w, h};
+      if (n < order.size()) place[order[n]] = r;
+      else white_ = r;
+      x += w + 2*ATLAS_PADDING;
+      rowHeight = std::max(rowHeight, h + 2*ATLAS_PADDING);
+    }
+  int height = y + rowHeight;
+
+  //Copy everything in, keeping alpha as it is rather than blending
+  SDL_Surface* atlas = SDL_CreateRGBSurfaceWithFormat(0, width, height, 32,
+                                                      SDL_PIXELFORMAT_RGBA8888);
+  if (atlas)
+    {
+      SDL_FillRect(atlas, NULL, SDL_MapRGBA(atlas->format, 0, 0, 0, 0));
+      SDL_FillRect(atlas, &white_,
+                   SDL_MapRGBA(atlas->format, 255, 255, 255, 255));
+      for (std::size_t i : order)
+        {
+          SDL_SetSurfaceBlendMode(image[i], SDL_BLENDMODE_NONE);
+          SDL_BlitSurface(image[i], NULL, atlas, &place[i]);
+          region_[files[i]] = place[i];
+        }
+    }
+
+  for (std::size_t i = 0; i < image.size(); i++)
+    {
+      if (image[i]) SDL_FreeSurface(image[i]);
+    }
+  times_.pack = Millis(Clock::now() - decoded).count();
+  return atlas;
+}
+
+bool TextureAtlas::upload(SDL_Renderer* rend, SDL_Surface* atlas)
+{
+  Clock::time_point start = Clock::now();
+  texture_ = SDL_CreateTextureFromSurface(rend, atlas);
+  if (texture_) SDL_SetTextureBlendMode(texture_, SDL_BLENDMODE_BLEND);
+  times_.upload = Millis(Clock::now() - start).count();
+  return texture_ != nullptr;
+}
+
+void TextureAtlas::reset()
+{
+  if (texture_) SDL_DestroyTexture(texture_);
+  texture_ = nullptr;
+  region_.clear();
+  missing_.clear();
+  white_ = {0, 0, 0, 0};
+  times_ = {0, 0, 0};
+}
+
+Sprite TextureAtlas::sprite(const std::string& file) const
+{
+  std::map<std::string, SDL_Rect>::const_iterator it = region_.find(file);
+  if (it == region_.end() || !texture_) return Sprite();
+  return Sprite(texture_, it->second);
+}
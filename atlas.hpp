@@ -0,0 +1,116 @@
+/*
+  -----TextureAtlas Class Header-----
+  Auston Sterling
+  austonst@gmail.com
+
+  Every image the client draws, packed into one texture when it starts so
+  that drawing never has to switch textures.
+
+  Images are placed in rows, tallest first, with a pixel of space around
+  each so that filtering never blends in a neighbour. A small white area is
+  added for drawing solid colours. Images are looked up by the file they
+  were loaded from.
+
+  PNGs are decoded on one thread per core. Only making the texture happens
+  on the calling thread, which must be the one drawing.
+
+  A packed atlas can be saved to a file and loaded again by mapping it into
+  memory, which skips decoding entirely. The file holds the pixels as they
+  go to the texture, in the byte order of the machine that saved it, so it
+  is meant to be made where it is used. It is ignored if any image is newer
+  than it.
+
+  Packed atlas file format:
+  "C2ATLAS1"
+  Width, height, then the white area's x, y, w, h: 4 bytes each
+  Number of images: 4 bytes
+  For each image:
+    Length of the file name: 4 bytes
+    The file name, padded with zeros to a multiple of 4 bytes
+    x, y, w, h: 4 bytes each
+  Pixels: width*height RGBA8888 values, 4 bytes each
+*/
+
+#ifndef _atlas_hpp_
+#define _atlas_hpp_
+
+#include "sprite.hpp"
+
+#include <SDL_image.h>
+#include <cstdint>
+#include <map>
+#include <string>
+#include <vector>
+
+//The widest an atlas is made
+const int ATLAS_WIDTH = 1024;
+
+//How long each part of the last load took, in milliseconds. A packed atlas
+//spends its decode time mapping and checking the file, and packs nothing.
+struct AtlasTimes
+{
+  double decode;
+  double pack;
+  double upload;
+};
+
+class TextureAtlas
+{
+public:
+  //Constructors
+  TextureAtlas();
+  ~TextureAtlas();
+  TextureAtlas(const TextureAtlas&) = delete;
+  TextureAtlas& operator=(const TextureAtlas&) = delete;
+
+  //Loads the images and packs them into a new texture, replacing any before.
+  //Images that can't be loaded are left out and listed by missing().
+  //Returns false if the texture couldn't be made.
+  bool load(SDL_Renderer* rend, const std::vector<std::string>& files,
+            int width = ATLAS_WIDTH);
+
+  //Loads an atlas saved by save(), replacing any before. Returns false,
+  //leaving nothing loaded, if the file is missing or damaged, lacks any of
+  //the given files, or is older than any of them.
+  bool loadPacked(SDL_Renderer* rend, const std::string& path,
+                  const std::vector<std::string>& files);
+
+  //Decodes and packs the images as load() does and saves them for
+  //loadPacked(). Needs no renderer. Images that can't be loaded are left
+  //out and listed by missing(). Returns false if the file couldn't be made.
+  bool save(const std::string& path, const std::vector<std::string>& files,
+            int width = ATLAS_WIDTH);
+
+  //The sprite for an image, which is empty if it wasn't loaded
+  Sprite sprite(const std::string& file) const;
+
+  //An opaque white sprite for drawing solid colours
+  Sprite white() const {return Sprite(texture_, white_);}
+
+  //Accessors
+  SDL_Texture* texture() const {return texture_;}
+  const std::vector<std::string>& missing() const {return missing_;}
+  const AtlasTimes& times() const {return times_;}
+
+private:
+  //Decodes and lays out the images into one surface, which the caller
+  //frees. Null if it couldn't be made.
+  SDL_Surface* pack(const std::vector<std::string>& files, int width);
+
+  //Makes the texture from a packed surface
+  bool upload(SDL_Renderer* rend, SDL_Surface* atlas);
+
+  //Forgets everything loaded
+  void reset();
+
+  SDL_Texture* texture_;
+
+  //Where each image ended up
+  std::map<std::string, SDL_Rect> region_;
+  SDL_Rect white_;
+
+  std::vector<std::string> missing_;
+  AtlasTimes times_;
+};
+
+#endif
@@ -0,0 +1,81 @@
+/*
+  Copyright (c) 2014 Auston Sterling
+  See license.txt for copying permission.
+
+  -----Atlas Packing Tool-----
+  Auston Sterling
+  austonst@gmail.com
+
+  Decodes and packs the client's images once, saving them where the client
+  looks for a packed atlas so it can start without decoding any PNGs. Run it
+  again after changing any image; until then the client sees the atlas is
+  out of date and decodes the images as usual.
+
+  chess2-atlas [-d directory] [-o output]
+
+  Images are read from images/ in the given directory, and the atlas is
+  written relative to it too.
+*/
+
+#include "boardview.hpp"
+
+#include <unistd.h>
+#include <iostream>
+
+static void usage()
+{
+  std::cerr << "Usage:\n"
+            << "  chess2-atlas [-d directory] [-o output]\n";
+}
+
+int main(int argc, char* argv[])
+{
+  std::string directory;
+  std::string output = ATLAS_FILE;
+  for (int i = 1; i < argc; i++)
+    {
+      std::string arg = argv[i];
+      if (arg == "-d" && i+1 < argc)
+        {
+          directory = argv[++i];
+        }
+      else if (arg == "-o" && i+1 < argc)
+        {
+          output = argv[++i];
+        }
+      else
+        {
+          usage();
+          return 1;
+        }
+    }
+  if (!directory.empty() && chdir(directory.c_str()) != 0)
+    {
+      std::cerr << "Could not change to " << directory << "\n";
+      return 1;
+    }
+
+  //Only surfaces are made, so no video is needed
+  IMG_Init(IMG_INIT_PNG);
+  TextureAtlas atlas;
+  bool saved = atlas.save(output, IMAGE_FILES);
+  IMG_Quit();
+
+  const std::vector<std::string>& missing = atlas.missing();
+  if (!missing.empty())
+    {
+      std::cerr << "Missing " << missing.size() << " images:";
+      for (const std::string& file : missing) std::cerr << " " << file;
+      std::cerr << "\n";
+    }
+  if (!saved)
+    {
+      std::cerr << "Could not write " << output << "\n";
+      return 1;
+    }
+  std::cout << "Packed " << IMAGE_FILES.size() - missing.size()
+            << " images into " << output << " (decode "
+            << atlas.times().decode << " ms, pack " << atlas.times().pack
+            << " ms)\n";
+  return missing.empty() ? 0 : 1;
+}
@@ -72,7 +72,9 @@ namespace c2
       }
 
     //Determine the PieceType
+    //An empty square has none to look for
     ret.type() = PieceType::NONE;
+    if (ret.side() == SideType::NONE) return ret;
     for (size_t i = 0; i < PIECE_TYPES; i++)
       {
         if (b & _type[i])
@@ -159,6 +161,19 @@ namespace c2
     _type[num(type)] |= bit;
   }
   
+  void BitBoard::place(const Piece& p)
+  {
+    if (!p.pos().isValid() || p.type() == PieceType::NONE ||
+        p.side() == SideType::NONE)
+      {
+        return;
+      }
+    destroy(p.pos());
+    std::uint64_t bit = posToBit(p.pos());
+    _side[num(p.side())] |= bit;
+    _type[num(p.type())] |= bit;
+  }
+
   bool BitBoard::move(const Move& m)
   {
     uint64_t startBit = posToBit(m.start);
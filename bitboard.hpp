@@ -36,6 +36,8 @@ namespace c2
     void destroy(Position p);
 
     void promote(Position pos, PieceType type);
+
+    void place(const Piece& p);
     
     bool move(const Move& m);
 
@@ -51,6 +51,10 @@ namespace c2
     //Every board must provide a function for promoting a pawn
     virtual void promote(Position pos, PieceType type) = 0;
 
+    //Every board must be able to put a piece down anywhere, replacing
+    //whatever was there. Used to set up positions other than the start.
+    virtual void place(const Piece& p) = 0;
+
     //Every Board must provide a move function
     //If a piece moves to a spot with another piece, destroy the old piece
     virtual bool move(const Move& m) = 0;
@@ -0,0 +1,574 @@
+/*
+  -----BoardView Class Implementation-----
+  Auston Sterling
+  austonst@gmail.com
+
+  Implementation of the BoardView class.
+*/
+
+#include "boardview.hpp"
+
+#include <algorithm>
+#include <cstdlib>
+
+using namespace c2;
+
+const std::vector<std::string> IMAGE_FILES = {
+  "images/board.png", "images/pieces.png", "images/move.png",
+  "images/button_quit.png", "images/button_really.png",
+  "images/button_cancel.png", "images/button_start.png",
+  "images/button_skipking.png",
+  "images/button_c.png", "images/button_e.png", "images/button_n.png",
+  "images/button_r.png", "images/button_a.png", "images/button_2.png",
+  "images/button_sel_c.png", "images/button_sel_e.png",
+  "images/button_sel_n.png", "images/button_sel_r.png",
+  "images/button_sel_a.png", "images/button_sel_2.png",
+  "images/state_move.png", "images/state_kingmove.png",
+  "images/state_duel.png", "images/state_bid.png", "images/state_promote.png",
+  "images/state_whitewin.png", "images/state_blackwin.png",
+  "images/state_draw.png",
+  "images/stone_none.png", "images/stone_white.png", "images/stone_black.png"
+};
+
+//A tile in the piece image. White pieces are in even rows, with the black
+//version of each just below.
+struct SpriteCell
+{
+  int column;
+  int row;
+};
+
+//The tile for each piece type, in PieceType order
+constexpr SpriteCell PIECE_SPRITE[PIECE_TYPES + 1] = {
+  {5, 0}, //CLA_PAWN
+  {2, 0}, //CLA_ROOK
+  {4, 0}, //CLA_KNIGHT
+  {3, 0}, //CLA_BISHOP
+  {1, 0}, //CLA_QUEEN
+  {0, 0}, //CLA_KING
+  {5, 2}, //NEM_PAWN
+  {1, 2}, //NEM_QUEEN
+  {0, 0}, //ANY_KING
+  {2, 2}, //EMP_ROOK
+  {4, 2}, //EMP_KNIGHT
+  {3, 2}, //EMP_BISHOP
+  {1, 0}, //EMP_QUEEN
+  {1, 2}, //RPR_REAPER
+  {2, 2}, //RPR_GHOST
+  {0, 2}, //TKG_WARRKING
+  {4, 2}, //ANI_WILDHORSE
+  {3, 2}, //ANI_TIGER
+  {2, 2}, //ANI_ELEPHANT
+  {1, 2}, //ANI_JUNGQUEEN
+  {0, 0}  //NONE; if you see glitchy simple white kings, check this!
+};
+
+//Returns the part of the piece image showing a piece
+static SDL_Rect pieceRect(const Piece& p)
+{
+  const SpriteCell& cell = PIECE_SPRITE[std::min<int>(num(p.type()),
+                                                      PIECE_TYPES)];
+  int row = cell.row + (p.side() == SideType::BLACK ? 1 : 0);
+  SDL_Rect srcRec = {cell.column * TILE_SIZE, row * TILE_SIZE,
+                     TILE_SIZE, TILE_SIZE};
+  return srcRec;
+}
+
+//The most pieces a change can bring onto the board and still be animated.
+//Anything bigger, like the armies being set up, just appears.
+const int MAX_ANIMATED_ARRIVALS = 2;
+
+//The score bar runs down the sidebar's edge, filled from the bottom for
+//white. Scores past the range, like a mate, fill it completely.
+const int EVAL_BAR_WIDTH = 6;
+const int EVAL_BAR_RANGE = 800;
+const SDL_Color EVAL_BAR_WHITE = {235, 235, 235, 255};
+const SDL_Color EVAL_BAR_BLACK = {40, 40, 40, 255};
+
+//The best move tints both its squares and runs a trail of dots between
+//them, ending in a larger one
+const SDL_Color BEST_MOVE_TINT = {255, 170, 0, 80};
+const SDL_Color BEST_MOVE_TRAIL = {255, 140, 0, 200};
+const int BEST_MOVE_DOTS = 6;
+const int BEST_MOVE_DOT_SIZE = 6;
+const int BEST_MOVE_HEAD_SIZE = 14;
+
+//Where a square is drawn, given as y*8 + x counting from 0
+static SDL_Rect squareRect(std::size_t square)
+{
+  SDL_Rect rect = {int(square%8) * TILE_SIZE + BORDER_WIDTH,
+                   (7 - int(square/8)) * TILE_SIZE + BORDER_WIDTH,
+                   TILE_SIZE, TILE_SIZE};
+  return rect;
+}
+
+//Draws one square of the board: the board under it, any piece on it, and
+//the move marker if it's a possible move
+static void drawSquare(SpriteBatch& batch, const Sprite& boardSprite,
+                       const Sprite& pieceSprite, const Sprite& moveSprite,
+                       Position pos, const Piece& p, bool marked)
+{
+  //Convert position to screen coordinates
+  SDL_Rect destRec;
+  destRec.x = (pos.x()-1) * TILE_SIZE + BORDER_WIDTH;
+  destRec.y = (8-pos.y()) * TILE_SIZE + BORDER_WIDTH;
+  destRec.w = destRec.h = TILE_SIZE;
+
+  //The board image is stretched over the board, so scale into it
+  int boardW = boardSprite.rect.w, boardH = boardSprite.rect.h;
+  SDL_Rect boardRec;
+  boardRec.x = destRec.x * boardW / BOARD_WIDTH;
+  boardRec.y = destRec.y * boardH / BOARD_HEIGHT;
+  boardRec.w = (destRec.x + TILE_SIZE) * boardW / BOARD_WIDTH - boardRec.x;
+  boardRec.h = (destRec.y + TILE_SIZE) * boardH / BOARD_HEIGHT - boardRec.y;
+  batch.draw(boardSprite.part(boardRec), destRec);
+
+  if (p.type() != PieceType::NONE && pieceSprite.valid())
+    {
+      batch.draw(pieceSprite.part(pieceRect(p)), destRec);
+    }
+
+  if (marked && moveSprite.valid())
+    {
+      SDL_Rect srcRec = {0, 0, TILE_SIZE, TILE_SIZE};
+      batch.draw(moveSprite.part(srcRec), destRec);
+    }
+}
+
+BoardView::BoardView(Renderer& r, bool whiteControl, bool blackControl) :
+  rend_(r),
+  whiteControl_(whiteControl),
+  blackControl_(blackControl),
+  batch_(r.sdl()),
+  frame_(nullptr),
+  shownMarks_(0),
+  shownCovered_(0),
+  redrawAll_(true),
+  exposed_(false),
+  copies_(0),
+  animated_(false),
+  packedAtlas_(false),
+  showAnalysis_(false),
+  analysisChanged_(false)
+{
+  SDL_Color whiteColor = {255, 255, 255, 255};
+  sidebar_.setWidth(SIDEBAR_WIDTH);
+  sidebar_.setHeight(BOARD_HEIGHT);
+  sidebar_.setBGColor(whiteColor);
+}
+
+BoardView::~BoardView()
+{
+  if (frame_) SDL_DestroyTexture(frame_);
+}
+
+bool BoardView::load()
+{
+  //Load every image into one atlas, so each frame is one batch
+  packedAtlas_ = atlas_.loadPacked(rend_.sdl(), ATLAS_FILE, IMAGE_FILES);
+  if (!packedAtlas_ && !atlas_.load(rend_.sdl(), IMAGE_FILES)) return false;
+  batch_.setFillSprite(atlas_.white());
+
+  //Load the board and piece images
+  boardTex_ = atlas_.sprite("images/board.png");
+  pieceTex_ = atlas_.sprite("images/pieces.png");
+  moveTex_ = atlas_.sprite("images/move.png");
+
+  //Everything drawn is kept in a target texture, so only what changes needs
+  //drawing again. Without render target support, changes redraw it all.
+  frame_ = SDL_CreateTexture(rend_.sdl(), SDL_PIXELFORMAT_RGBA8888,
+                             SDL_TEXTUREACCESS_TARGET,
+                             BOARD_WIDTH + SIDEBAR_WIDTH, BOARD_HEIGHT);
+  if (!frame_) SDL_ClearError();
+
+  //Put a header image at the top
+  //TODO THIS
+
+  //Make a quit button and an initially invisible follow-up confirmation button
+  //Both should be the heaviest objects
+  Sidebar::iterator button = sidebar_.createObject(2000, "quit");
+  button->resizeAndRespace(1);
+  Sprite quitTex = atlas_.sprite("images/button_quit.png");
+  button->setTexture(0, quitTex);
+  button->respace();
+
+  button = sidebar_.createObject(2000, "quitConfirm");
+  button->resizeAndRespace(2);
+  Sprite reallyTex = atlas_.sprite("images/button_really.png");
+  Sprite cancelTex = atlas_.sprite("images/button_cancel.png");
+  button->setTexture(0, reallyTex);
+  button->setTexture(1, cancelTex);
+  button->respace(SpacingType::SQUISH_CENTER, 10);
+  button->setVisibility(false);
+
+  //Create army selection objects, set visibility depending on control
+  //10 weight puts them pretty high up
+  armyTex_.assign(NUM_ARMIES, Sprite());
+  armySelTex_.assign(NUM_ARMIES, Sprite());
+  armyTex_[num(ArmyType::CLASSIC)] = atlas_.sprite("images/button_c.png");
+  armySelTex_[num(ArmyType::CLASSIC)] = atlas_.sprite("images/button_sel_c.png");
+  armyTex_[num(ArmyType::EMPOWERED)] = atlas_.sprite("images/button_e.png");
+  armySelTex_[num(ArmyType::EMPOWERED)] = atlas_.sprite("images/button_sel_e.png");
+  armyTex_[num(ArmyType::NEMESIS)] = atlas_.sprite("images/button_n.png");
+  armySelTex_[num(ArmyType::NEMESIS)] = atlas_.sprite("images/button_sel_n.png");
+  armyTex_[num(ArmyType::REAPER)] = atlas_.sprite("images/button_r.png");
+  armySelTex_[num(ArmyType::REAPER)] = atlas_.sprite("images/button_sel_r.png");
+  armyTex_[num(ArmyType::ANIMALS)] = atlas_.sprite("images/button_a.png");
+  armySelTex_[num(ArmyType::ANIMALS)] = atlas_.sprite("images/button_sel_a.png");
+  armyTex_[num(ArmyType::TWOKINGS)] = atlas_.sprite("images/button_2.png");
+  armySelTex_[num(ArmyType::TWOKINGS)] = atlas_.sprite("images/button_sel_2.png");
+  
+  SidebarObject buildSBO(armyTex_, SIDEBAR_WIDTH, SpacingType::UNIFORM);
+  buildSBO.prepareForInsert(10, "whiteArmy");
+  buildSBO.setVisibility(whiteControl_);
+  sidebar_.insertObject(buildSBO);
+
+  buildSBO.prepareForInsert(10, "blackArmy");
+  buildSBO.setVisibility(blackControl_);
+  sidebar_.insertObject(buildSBO);
+
+  //Create start object to lock in army selection and try to start the game
+  //Weight is 15 to appear below army selection
+  //Button always starts visible
+  button = sidebar_.createObject(15, "start");
+  button->resizeAndRespace(1);
+  Sprite startTex = atlas_.sprite("images/button_start.png");
+  button->setTexture(0, startTex);
+  button->respace();
+
+  //Create game status tracker, showing player's armies, whose turn it is,
+  //and some state information
+  button = sidebar_.createObject(15, "state");
+  stateObj_ = button;
+  button->resizeAndRespace(3);
+  button->setVertAlign(VertAlignType::CENTER);
+  statusTex_.assign(NUM_GAMESTATES, Sprite());
+  //Move texture
+  statusTex_[num(GameStateType::WHITE_MOVE)] = atlas_.sprite("images/state_move.png");
+  statusTex_[num(GameStateType::BLACK_MOVE)] = statusTex_[num(GameStateType::WHITE_MOVE)];
+  //King move texture
+  statusTex_[num(GameStateType::WHITE_KINGMOVE)] = atlas_.sprite("images/state_kingmove.png");
+  statusTex_[num(GameStateType::BLACK_KINGMOVE)] = statusTex_[num(GameStateType::WHITE_KINGMOVE)];
+  //Duel texture
+  statusTex_[num(GameStateType::WHITE_DUEL)] = atlas_.sprite("images/state_duel.png");
+  statusTex_[num(GameStateType::BLACK_DUEL)] = statusTex_[num(GameStateType::WHITE_DUEL)];
+  //Bid texture
+  statusTex_[num(GameStateType::BOTH_BID)] = atlas_.sprite("images/state_bid.png");
+  statusTex_[num(GameStateType::WHITE_BID)] = statusTex_[num(GameStateType::BOTH_BID)];
+  statusTex_[num(GameStateType::BLACK_BID)] = statusTex_[num(GameStateType::BOTH_BID)];
+  //Promote texture
+  statusTex_[num(GameStateType::WHITE_PROMOTE)] = atlas_.sprite("images/state_promote.png");
+  statusTex_[num(GameStateType::BLACK_PROMOTE)] = statusTex_[num(GameStateType::WHITE_PROMOTE)];
+  //White win texture
+  statusTex_[num(GameStateType::WHITE_WIN_CHECKMATE)] = atlas_.sprite("images/state_whitewin.png");
+  statusTex_[num(GameStateType::WHITE_WIN_MIDLINE)] = statusTex_[num(GameStateType::WHITE_WIN_CHECKMATE)];
+  //Black win texture
+  statusTex_[num(GameStateType::BLACK_WIN_CHECKMATE)] = atlas_.sprite("images/state_blackwin.png");
+  statusTex_[num(GameStateType::BLACK_WIN_MIDLINE)] = statusTex_[num(GameStateType::BLACK_WIN_CHECKMATE)];
+  //Draw texture
+  statusTex_[num(GameStateType::DRAW_THREEFOLD)] = atlas_.sprite("images/state_draw.png");
+  statusTex_[num(GameStateType::DRAW_FIFTYMOVE)] = statusTex_[num(GameStateType::DRAW_THREEFOLD)];
+
+  //No textures are initially set since none are yet known
+  button->setVisibility(false);
+
+  //Create king move skip object
+  //Weight of 30 to put it below most things
+  button = sidebar_.createObject(30, "skipking");
+  skipKingObj_ = button;
+  button->resizeAndRespace(1);
+  Sprite skipKingTex = atlas_.sprite("images/button_skipking.png");
+  button->setTexture(0, skipKingTex);
+  button->respace();
+  button->setVisibility(false);
+
+  //Create stone tracking objects
+  //Weight of 16 and 17 put them right below state
+  stoneNoneTex_ = atlas_.sprite("images/stone_none.png");
+  stoneWhiteTex_ = atlas_.sprite("images/stone_white.png");
+  stoneBlackTex_ = atlas_.sprite("images/stone_black.png");
+  SidebarObject stonesObj(std::vector<Sprite>(6, stoneNoneTex_),
+                          SIDEBAR_WIDTH, SpacingType::SQUISH_CENTER, 5);
+  stonesObj.setVisibility(false);
+  sidebar_.insertObject(stonesObj, 16, "blackstones");
+  sidebar_.insertObject(stonesObj, 17, "whitestones");
+  blackStonesObj_ = sidebar_.object(16, "blackstones");
+  whiteStonesObj_ = sidebar_.object(17, "whitestones");
+  redrawAll_ = true;
+  return true;
+}
+
+const Sprite& BoardView::armySprite(std::size_t army, bool selected) const
+{
+  return selected ? armySelTex_[army] : armyTex_[army];
+}
+
+void BoardView::update(const ViewState& s)
+{
+  //Update sidebar status depending on state
+  Sidebar::iterator statusObject = stateObj_;
+  statusObject->setTexture(1, statusTex_[num(s.state)]);
+  if (s.state == GameStateType::WHITE_MOVE)
+    {
+      int armyIndex = num(s.whiteArmy);
+      statusObject->setTexture(0, armySelTex_[armyIndex]);
+      armyIndex = num(s.blackArmy);
+      statusObject->setTexture(2, armyTex_[armyIndex]);
+    }
+  else if (s.state == GameStateType::BLACK_MOVE)
+    {
+      int armyIndex = num(s.whiteArmy);
+      statusObject->setTexture(0, armyTex_[armyIndex]);
+      armyIndex = num(s.blackArmy);
+      statusObject->setTexture(2, armySelTex_[armyIndex]);
+    }
+  statusObject->respace(SpacingType::UNIFORM);
+
+  //If we are in a king move, the sidebar skip button needs to be visible
+  if ((s.state == GameStateType::WHITE_KINGMOVE && whiteControl_) ||
+      (s.state == GameStateType::BLACK_KINGMOVE && blackControl_))
+    {
+      skipKingObj_->setVisibility(true);
+    }
+  else
+    {
+      skipKingObj_->setVisibility(false);
+    }
+
+  //Update number of stones
+  for (size_t i = 0; i < s.whiteStones; i++)
+    {
+      whiteStonesObj_->setTexture(i, stoneWhiteTex_);
+    }
+  for (size_t i = s.whiteStones; i < 6; i++)
+    {
+      whiteStonesObj_->setTexture(i, stoneNoneTex_);
+    }
+  for (size_t i = 0; i < s.blackStones; i++)
+    {
+      blackStonesObj_->setTexture(i, stoneBlackTex_);
+    }
+  for (size_t i = s.blackStones; i < 6; i++)
+    {
+      blackStonesObj_->setTexture(i, stoneNoneTex_);
+    }
+}
+
+void BoardView::setAnimated(bool a)
+{
+  animated_ = a;
+  if (!a) anim_.clear();
+}
+
+bool BoardView::draw(const Board& board, const std::set<Position>& moves)
+{
+  Uint32 now = SDL_GetTicks();
+
+  //Find the squares that look different from when they were last drawn
+  std::uint64_t marks = 0;
+  for (Position i : moves)
+    {
+      if (i.isValid()) marks |= 1ULL << ((i.y()-1)*8 + (i.x()-1));
+    }
+  Piece before[64];
+  std::uint64_t dirtySquares = 0;
+  std::uint64_t gained = 0;
+  std::uint64_t lost = 0;
+  for (char y = 1; y < 9; y++)
+    {
+      for (char x = 1; x < 9; x++)
+        {
+          std::size_t square = (y-1)*8 + (x-1);
+          Piece p = board(Position(x, y));
+          if (p.type() != shownPiece_[square].type() ||
+              p.side() != shownPiece_[square].side())
+            {
+              dirtySquares |= 1ULL << square;
+              before[square] = shownPiece_[square];
+              if (before[square].type() != PieceType::NONE)
+                {
+                  lost |= 1ULL << square;
+                }
+              if (p.type() != PieceType::NONE) gained |= 1ULL << square;
+              shownPiece_[square] = p;
+            }
+        }
+    }
+  dirtySquares |= marks ^ shownMarks_;
+  shownMarks_ = marks;
+
+  //Squares a piece is sliding to stay empty until it lands
+  anim_.finish(now);
+  if (animated_ && (gained || lost)) animate(before, gained, lost, now);
+  std::uint64_t covered = anim_.covered();
+  dirtySquares |= covered ^ shownCovered_;
+  shownCovered_ = covered;
+  bool animating = anim_.active();
+
+  //Without a cached frame, any change means drawing everything
+  if (!frame_ && (dirtySquares || sidebar_.dirty() || exposed_ || animating ||
+                  analysisChanged_))
+    {
+      redrawAll_ = true;
+    }
+
+  //Bring the cached frame up to date
+  bool drawn = false;
+  if (frame_) SDL_SetRenderTarget(rend_.sdl(), frame_);
+  if (redrawAll_)
+    {
+      SDL_Rect boardDst = {0, 0, BOARD_WIDTH, BOARD_HEIGHT};
+      batch_.draw(boardTex_, boardDst);
+      dirtySquares = ~std::uint64_t(0);
+    }
+  for (std::size_t square = 0; square < 64; square++)
+    {
+      if (!(dirtySquares >> square & 1)) continue;
+      drawSquare(batch_, boardTex_, pieceTex_, moveTex_,
+                 Position(square%8 + 1, square/8 + 1),
+                 covered >> square & 1 ? Piece() : shownPiece_[square],
+                 marks >> square & 1);
+      drawn = true;
+    }
+
+  //Draw sidebar
+  if (redrawAll_)
+    {
+      sidebar_.render(batch_, BOARD_WIDTH, 0);
+      drawn = true;
+    }
+  else if (sidebar_.renderChanges(batch_, BOARD_WIDTH, 0))
+    {
+      drawn = true;
+    }
+
+  //Everything queued goes out as one draw call
+  batch_.flush();
+
+  //Finalize drawing, only if there's something new to show
+  if (frame_) SDL_SetRenderTarget(rend_.sdl(), NULL);
+  bool shown = drawn || exposed_ || animating || analysisChanged_;
+  if (shown)
+    {
+      if (frame_)
+        {
+          SDL_RenderCopy(rend_.sdl(), frame_, NULL, NULL);
+          copies_++;
+        }
+
+      //The analysis goes under anything moving
+      if (showAnalysis_)
+        {
+          drawAnalysis();
+          batch_.flush();
+        }
+
+      //Moving pieces go over the frame, all in one batch
+      if (animating)
+        {
+          anim_.draw(batch_, now);
+          batch_.flush();
+        }
+      rend_.present();
+    }
+  redrawAll_ = false;
+  exposed_ = false;
+  analysisChanged_ = false;
+  return shown;
+}
+
+void BoardView::setAnalysis(const Analysis& a)
+{
+  if (showAnalysis_ && a.score == analysis_.score &&
+      sameEvent(a.best, analysis_.best))
+    {
+      return;
+    }
+  analysis_ = a;
+  showAnalysis_ = true;
+  analysisChanged_ = true;
+}
+
+void BoardView::clearAnalysis()
+{
+  if (!showAnalysis_) return;
+  showAnalysis_ = false;
+  analysisChanged_ = true;
+}
+
+void BoardView::drawAnalysis()
+{
+  SDL_Rect bar = {BOARD_WIDTH, 0, EVAL_BAR_WIDTH, BOARD_HEIGHT};
+  batch_.fill(bar, EVAL_BAR_BLACK);
+  int score = std::max(-EVAL_BAR_RANGE,
+                       std::min(analysis_.score, EVAL_BAR_RANGE));
+  bar.h = BOARD_HEIGHT * (score + EVAL_BAR_RANGE) / (2*EVAL_BAR_RANGE);
+  bar.y = BOARD_HEIGHT - bar.h;
+  batch_.fill(bar, EVAL_BAR_WHITE);
+
+  //Only moves can be shown on the board, and skipping a king move can't
+  const Move& m = analysis_.best.move;
+  if (analysis_.best.type != EventType::MOVE || !m.start.isValid() ||
+      !m.end.isValid())
+    {
+      return;
+    }
+  SDL_Rect from = squareRect((m.start.y()-1)*8 + (m.start.x()-1));
+  SDL_Rect to = squareRect((m.end.y()-1)*8 + (m.end.x()-1));
+  batch_.fill(from, BEST_MOVE_TINT);
+  batch_.fill(to, BEST_MOVE_TINT);
+  for (int i = 1; i <= BEST_MOVE_DOTS; i++)
+    {
+      int size = i == BEST_MOVE_DOTS ? BEST_MOVE_HEAD_SIZE : BEST_MOVE_DOT_SIZE;
+      int x = from.x + (to.x - from.x) * i / BEST_MOVE_DOTS;
+      int y = from.y + (to.y - from.y) * i / BEST_MOVE_DOTS;
+      SDL_Rect dot = {x + (TILE_SIZE - size)/2, y + (TILE_SIZE - size)/2,
+                      size, size};
+      batch_.fill(dot, BEST_MOVE_TRAIL);
+    }
+}
+
+void BoardView::animate(const Piece* before, std::uint64_t gained,
+                        std::uint64_t lost, Uint32 now)
+{
+  //A new change cuts short whatever was still moving
+  anim_.clear();
+  int arrivals = 0;
+  for (std::uint64_t g = gained; g; g &= g - 1) arrivals++;
+  if (arrivals > MAX_ANIMATED_ARRIVALS) return;
+
+  //Each arrival came from the nearest square that lost a piece like it
+  for (std::size_t to = 0; to < 64; to++)
+    {
+      if (!(gained >> to & 1)) continue;
+      const Piece& p = shownPiece_[to];
+      std::size_t from = 64;
+      int nearest = 8;
+      for (std::size_t sq = 0; sq < 64; sq++)
+        {
+          if (!(lost >> sq & 1) || sq == to ||
+              before[sq].type() != p.type() || before[sq].side() != p.side())
+            {
+              continue;
+            }
+          int dist = std::max(std::abs(int(sq%8) - int(to%8)),
+                              std::abs(int(sq/8) - int(to/8)));
+          if (dist < nearest)
+            {
+              nearest = dist;
+              from = sq;
+            }
+        }
+      if (from == 64) continue;
+      anim_.slide(pieceTex_.part(pieceRect(p)), squareRect(from),
+                  squareRect(to), to, now);
+      lost &= ~(1ULL << from);
+    }
+
+  //Whatever else was lost was taken
+  for (std::size_t sq = 0; sq < 64; sq++)
+    {
+      if (!(lost >> sq & 1)) continue;
+      anim_.fade(pieceTex_.part(pieceRect(before[sq])), squareRect(sq), now);
+    }
+}
@@ -0,0 +1,176 @@
+/*
+  -----BoardView Class Header-----
+  Auston Sterling
+  austonst@gmail.com
+
+  Everything the client shows: the board, its pieces, the possible moves of
+  a selected piece and the sidebar. The view draws through any Renderer, so
+  the same drawing can be shown in a window or timed without a display.
+
+  Drawing is kept in a target texture between frames, and draw() only draws
+  the squares and sidebar objects that changed since the last frame. Each
+  frame is sent to the renderer as one batch from a single texture atlas.
+
+  With animation on, a change of a move's size is animated: a piece that
+  moved slides from the nearest square that lost a piece like it, and pieces
+  that vanished fade out. Animations are drawn over the kept frame, which
+  shows the squares they're heading for empty until they land.
+
+  An analysis of the game can be shown over the board too: a bar beside it
+  for the score and a trail marking the best move. Like animations, it's
+  drawn over the kept frame, so changing it redraws nothing under it.
+*/
+
+#ifndef _boardview_hpp_
+#define _boardview_hpp_
+
+#include "analyzer.hpp"
+#include "animation.hpp"
+#include "atlas.hpp"
+#include "renderer.hpp"
+#include "sidebar.hpp"
+#include "board.hpp"
+#include "game.hpp"
+
+#include <set>
+
+const int BOARD_WIDTH = 405;
+const int BOARD_HEIGHT = 405;
+const int BORDER_WIDTH = 2;
+const int TILE_SIZE = 50;
+const int SIDEBAR_WIDTH = 200;
+
+//Every image drawn, packed into one atlas by BoardView::load
+extern const std::vector<std::string> IMAGE_FILES;
+
+//Where chess2-atlas saves the packed images, for BoardView::load to use
+//instead of decoding them when it's there and up to date
+const std::string ATLAS_FILE = "images/atlas.c2atlas";
+
+//What the sidebar shows about a game
+struct ViewState
+{
+  c2::GameStateType state;
+  c2::ArmyType whiteArmy;
+  c2::ArmyType blackArmy;
+  std::uint8_t whiteStones;
+  std::uint8_t blackStones;
+};
+
+class BoardView
+{
+public:
+  //Constructors
+  //Control decides which sides' army selection and buttons are shown
+  BoardView(Renderer& r, bool whiteControl, bool blackControl);
+  ~BoardView();
+  BoardView(const BoardView&) = delete;
+  BoardView& operator=(const BoardView&) = delete;
+
+  //Turns animation of changes to the board on or off. It starts off.
+  void setAnimated(bool a);
+  bool animated() const {return animated_;}
+
+  //Checks if anything is still animating, so more frames are needed
+  bool animating() const {return anim_.active();}
+
+  //Loads the images, from ATLAS_FILE if it can, and lays out the sidebar.
+  //Returns false if the images couldn't be put into a texture.
+  bool load();
+
+  //Checks if load() used ATLAS_FILE rather than decoding the images
+  bool packedAtlas() const {return packedAtlas_;}
+
+  //Accessors
+  Sidebar& sidebar() {return sidebar_;}
+  const TextureAtlas& atlas() const {return atlas_;}
+
+  //Totals so far, counting the copy of the kept frame to the screen
+  std::size_t drawCalls() const {return batch_.drawCalls() + copies_;}
+  std::size_t textureSwitches() const
+  {return batch_.textureSwitches() + 2*copies_;}
+  std::size_t sprites() const {return batch_.sprites();}
+
+  //The army selection button for an army, highlighted or not
+  const Sprite& armySprite(std::size_t army, bool selected) const;
+
+  //Brings the sidebar's state, stones and buttons in line with a game.
+  //Only after load().
+  void update(const ViewState& s);
+
+  //Draws whatever changed since the last frame and shows it, returning
+  //true if a frame was shown. While animating, every call shows a frame.
+  bool draw(const c2::Board& board, const std::set<c2::Position>& moves);
+
+  //Shows an analysis over the board until cleared. An analysis that
+  //doesn't change what's shown doesn't need a new frame.
+  void setAnalysis(const c2::Analysis& a);
+  void clearAnalysis();
+
+  //The next draw draws everything, for when the target texture was lost
+  void invalidate() {redrawAll_ = true;}
+
+  //The next draw shows a frame even if nothing changed, for when the
+  //window needs showing again
+  void expose() {exposed_ = true;}
+
+private:
+  Renderer& rend_;
+  bool whiteControl_;
+  bool blackControl_;
+
+  TextureAtlas atlas_;
+  SpriteBatch batch_;
+  Sidebar sidebar_;
+
+  //Everything drawn is kept here. Null without render target support, in
+  //which case a change redraws it all.
+  SDL_Texture* frame_;
+
+  //Sprites swapped in and out as the game goes
+  Sprite boardTex_;
+  Sprite pieceTex_;
+  Sprite moveTex_;
+  std::vector<Sprite> armyTex_;
+  std::vector<Sprite> armySelTex_;
+  std::vector<Sprite> statusTex_;
+  Sprite stoneNoneTex_;
+  Sprite stoneWhiteTex_;
+  Sprite stoneBlackTex_;
+
+  //The sidebar objects changed every frame, kept from load()
+  Sidebar::iterator stateObj_;
+  Sidebar::iterator skipKingObj_;
+  Sidebar::iterator whiteStonesObj_;
+  Sidebar::iterator blackStonesObj_;
+
+  //What each square showed when last drawn, to tell which need redrawing
+  c2::Piece shownPiece_[64];
+  std::uint64_t shownMarks_;
+  std::uint64_t shownCovered_;
+  bool redrawAll_;
+  bool exposed_;
+
+  //Times the kept frame was copied to the screen
+  std::size_t copies_;
+
+  Animator anim_;
+  bool animated_;
+
+  bool packedAtlas_;
+
+  //The analysis shown, if any, and whether it changed since the last frame
+  c2::Analysis analysis_;
+  bool showAnalysis_;
+  bool analysisChanged_;
+
+  //Starts animating a change from the pieces shown before, given the
+  //squares which gained a piece and which lost one
+  void animate(const c2::Piece* before, std::uint64_t gained,
+               std::uint64_t lost, Uint32 now);
+
+  //Queues the analysis bar and best move marks
+  void drawAnalysis();
+};
+
+#endif
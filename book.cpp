@@ -0,0 +1,449 @@
+/*
+  Copyright (c) 2014 Auston Sterling
+  See license.txt for copying permission.
+
+  -----OpeningBook Class Implementation-----
+  Auston Sterling
+  austonst@gmail.com
+
+  An opening book built from archived games and self-play.
+*/
+
+#include "book.hpp"
+#include "bitboard.hpp"
+#include "search.hpp"
+
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <cstring>
+#include <algorithm>
+#include <random>
+
+namespace c2
+{
+
+  static const char BOOK_MAGIC[4] = {'C', '2', 'B', 'K'};
+
+  //Moves made at random at the start of each self-play game
+  static const std::size_t SELF_PLAY_RANDOM_MOVES = 4;
+
+  //Calls made before a self-play game is given up as unfinished
+  static const std::size_t SELF_PLAY_MAX_CALLS = 400;
+
+  //Transposition table entries for each self-play searcher
+  static const std::size_t SELF_PLAY_TABLE_ENTRIES = 1 << 16;
+
+  static bool moreGames(const BookEntry& a, const BookEntry& b)
+  {
+    return a.games > b.games;
+  }
+
+  //Adds the opening moves of one finished game to stats
+  static bool countRecord(RecordReader rec, std::size_t depth, BookStats& stats)
+  {
+    if (!rec.isValid() || !isGameOver(rec.result())) return false;
+
+    //Results are stored from the point of view of the side moving
+    SideType winner = SideType::NONE;
+    switch (rec.result())
+      {
+      case GameStateType::WHITE_WIN_CHECKMATE:
+      case GameStateType::WHITE_WIN_MIDLINE:
+        winner = SideType::WHITE;
+        break;
+      case GameStateType::BLACK_WIN_CHECKMATE:
+      case GameStateType::BLACK_WIN_MIDLINE:
+        winner = SideType::BLACK;
+        break;
+      default:
+        break;
+      }
+
+    BitBoard board;
+    Game g(&board);
+    if (rec.start(g) != GameReturnType::SUCCESS) return false;
+
+    GameEvent e;
+    std::size_t plies = 0;
+    while (plies < depth)
+      {
+        std::uint64_t key = g.transpositionHash();
+        if (!rec.next(g, e)) break;
+        if (e.type != EventType::MOVE) continue;
+        plies++;
+
+        BookEntry& entry = stats[BookKey(key, packMove(e.move))];
+        if (entry.games == 0)
+          {
+            entry.key = key;
+            entry.move = e.move;
+          }
+        entry.games++;
+        if (winner == e.move.side) entry.wins++;
+        else if (winner == SideType::NONE) entry.draws++;
+      }
+    return true;
+  }
+
+  OpeningBook::OpeningBook() : _map(nullptr), _mapSize(0), _count(0) {}
+
+  OpeningBook::~OpeningBook()
+  {
+    close();
+  }
+
+  bool OpeningBook::open(const std::string& path)
+  {
+    close();
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0) return false;
+
+    struct stat st;
+    if (fstat(fd, &st) != 0 ||
+        st.st_size < static_cast<off_t>(BOOK_HEADER_SIZE))
+      {
+        ::close(fd);
+        return false;
+      }
+
+    void* map = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    ::close(fd);
+    if (map == MAP_FAILED) return false;
+    _map = static_cast<const std::uint8_t*>(map);
+    _mapSize = st.st_size;
+
+    std::uint64_t count = getLE(_map + 8, 8);
+    if (memcmp(_map, BOOK_MAGIC, 4) != 0 ||
+        getLE(_map + 4, 2) != BOOK_VERSION ||
+        (_mapSize - BOOK_HEADER_SIZE) / BOOK_ENTRY_SIZE < count)
+      {
+        close();
+        return false;
+      }
+    _count = count;
+
+    //Lookups jump around the file
+    madvise(map, _mapSize, MADV_RANDOM);
+    return true;
+  }
+
+  void OpeningBook::close()
+  {
+    if (_map)
+      {
+        munmap(const_cast<std::uint8_t*>(_map), _mapSize);
+      }
+    _map = nullptr;
+    _mapSize = 0;
+    _count = 0;
+  }
+
+  BookEntry OpeningBook::entry(std::size_t i) const
+  {
+    const std::uint8_t* p = _map + BOOK_HEADER_SIZE + i*BOOK_ENTRY_SIZE;
+    BookEntry e;
+    e.key = getLE(p, 8);
+    e.move = unpackMove(getLE(p + 8, 4));
+    e.games = getLE(p + 12, 4);
+    e.wins = getLE(p + 16, 4);
+    e.draws = getLE(p + 20, 4);
+    return e;
+  }
+
+  std::vector<BookEntry> OpeningBook::find(std::uint64_t key) const
+  {
+    //Binary search for the first entry with this key
+    std::size_t low = 0, high = _count;
+    while (low < high)
+      {
+        std::size_t mid = low + (high - low) / 2;
+        std::uint64_t k = getLE(_map + BOOK_HEADER_SIZE + mid*BOOK_ENTRY_SIZE, 8);
+        if (k < key) low = mid + 1;
+        else high = mid;
+      }
+
+    std::vector<BookEntry> ret;
+    for (std::size_t i = low; i < _count; i++)
+      {
+        BookEntry e = entry(i);
+        if (e.key != key) break;
+        ret.push_back(e);
+      }
+    std::stable_sort(ret.begin(), ret.end(), moreGames);
+    return ret;
+  }
+
+  bool OpeningBook::choose(Game& g, Move& m, std::uint64_t random) const
+  {
+    if (!isMoveState(g.state())) return false;
+    std::vector<BookEntry> entries = find(g.transpositionHash());
+    if (entries.empty()) return false;
+
+    //A hash collision could suggest a move that can't be made here
+    std::vector<Move> legal = g.legalMoves();
+    std::vector<BookEntry> usable;
+    std::uint64_t total = 0;
+    for (std::size_t i = 0; i < entries.size(); i++)
+      {
+        for (std::size_t j = 0; j < legal.size(); j++)
+          {
+            if (packMove(legal[j]) == packMove(entries[i].move))
+              {
+                usable.push_back(entries[i]);
+                total += entries[i].weight();
+                break;
+              }
+          }
+      }
+    if (usable.empty()) return false;
+
+    std::uint64_t pick = random % total;
+    for (std::size_t i = 0; i < usable.size(); i++)
+      {
+        if (pick < usable[i].weight())
+          {
+            m = usable[i].move;
+            return true;
+          }
+        pick -= usable[i].weight();
+      }
+    m = usable.back().move;
+    return true;
+  }
+
+  //Work for one builder thread: every threads-th record from first
+  struct BookWork
+  {
+    const ArchiveReader* archive;
+    std::size_t first;
+    std::size_t step;
+    std::size_t depth;
+    std::size_t used;
+    BookStats stats;
+  };
+
+  static void* bookThread(void* arg)
+  {
+    BookWork* w = static_cast<BookWork*>(arg);
+    for (std::size_t i = w->first; i < w->archive->size(); i += w->step)
+      {
+        if (countRecord(w->archive->record(i), w->depth, w->stats)) w->used++;
+      }
+    return NULL;
+  }
+
+  //Work for one self-play thread: every step-th game from first
+  struct SelfPlayWork
+  {
+    std::size_t games;
+    std::size_t first;
+    std::size_t step;
+    std::size_t depth;
+    const SearchLimits* limits;
+    std::uint64_t seed;
+    std::size_t used;
+    BookStats stats;
+  };
+
+  //Plays one game of s against itself into rec, returning whether it
+  //finished
+  static bool playSelf(Searcher& s, ArmyType white, ArmyType black,
+                       const SearchLimits& limits, std::mt19937_64& random,
+                       GameRecord& rec)
+  {
+    BitBoard board;
+    Game g(&board, white, black);
+    rec.clear(white, black);
+    if (g.start() != GameReturnType::SUCCESS) return false;
+
+    std::size_t moves = 0;
+    for (std::size_t calls = 0; calls < SELF_PLAY_MAX_CALLS; calls++)
+      {
+        if (isGameOver(g.state())) return true;
+        GameEvent e;
+        if (isMoveState(g.state()) && moves < SELF_PLAY_RANDOM_MOVES)
+          {
+            std::vector<GameEvent> choices = gameChoices(g);
+            if (choices.empty()) return false;
+            e = choices[random() % choices.size()];
+          }
+        else
+          {
+            SearchResult r = s.search(g, decidingSide(g.state()), limits);
+            if (r.best.side == SideType::NONE) return false;
+            e = r.best;
+          }
+        if (!succeeded(applyEvent(g, e))) return false;
+
+        //Bids forced by a duel are made by the duel itself
+        switch (e.type)
+          {
+          case EventType::MOVE:
+            rec.move(e.move);
+            moves++;
+            break;
+          case EventType::DUEL:
+            rec.startDuel(e.value != 0);
+            break;
+          case EventType::BID:
+            rec.bid(e.side, e.value);
+            break;
+          case EventType::PROMOTE:
+            rec.promote(static_cast<PieceType>(e.value));
+            break;
+          }
+      }
+    return isGameOver(g.state());
+  }
+
+  static void* selfPlayThread(void* arg)
+  {
+    SelfPlayWork* w = static_cast<SelfPlayWork*>(arg);
+    Searcher s(SELF_PLAY_TABLE_ENTRIES);
+    GameRecord rec;
+    std::vector<std::uint8_t> encoded;
+    for (std::size_t i = w->first; i < w->games; i += w->step)
+      {
+        ArmyType white = toArmy(i % NUM_ARMIES);
+        ArmyType black = toArmy(i / NUM_ARMIES % NUM_ARMIES);
+        std::mt19937_64 random(w->seed + i);
+        if (!playSelf(s, white, black, *w->limits, random, rec)) continue;
+
+        encoded.clear();
+        if (rec.encode(encoded) &&
+            countRecord(RecordReader(&encoded[0], encoded.size()), w->depth,
+                        w->stats))
+          {
+            w->used++;
+          }
+      }
+    return NULL;
+  }
+
+  BookBuilder::BookBuilder() : _depth(16), _minGames(1), _threads(1) {}
+
+  std::size_t BookBuilder::addArchive(const ArchiveReader& archive)
+  {
+    //Each worker keeps its own statistics so nothing is shared until the end
+    std::vector<BookWork> work(_threads);
+    std::vector<pthread_t> tids(_threads);
+    std::vector<bool> started(_threads, false);
+    for (std::size_t i = 0; i < _threads; i++)
+      {
+        work[i].archive = &archive;
+        work[i].first = i;
+        work[i].step = _threads;
+        work[i].depth = _depth;
+        work[i].used = 0;
+        started[i] = pthread_create(&tids[i], NULL, &bookThread, &work[i]) == 0;
+
+        //Do the work here if the thread couldn't be made
+        if (!started[i]) bookThread(&work[i]);
+      }
+
+    std::size_t used = 0;
+    for (std::size_t i = 0; i < _threads; i++)
+      {
+        if (started[i]) pthread_join(tids[i], NULL);
+        used += work[i].used;
+        merge(work[i].stats);
+      }
+    return used;
+  }
+
+  std::size_t BookBuilder::addSelfPlay(std::size_t games,
+                                       const SearchLimits& limits,
+                                       std::uint64_t seed)
+  {
+    //Each worker plays with its own searcher and keeps its own statistics
+    std::vector<SelfPlayWork> work(_threads);
+    std::vector<pthread_t> tids(_threads);
+    std::vector<bool> started(_threads, false);
+    for (std::size_t i = 0; i < _threads; i++)
+      {
+        work[i].games = games;
+        work[i].first = i;
+        work[i].step = _threads;
+        work[i].depth = _depth;
+        work[i].limits = &limits;
+        work[i].seed = seed;
+        work[i].used = 0;
+        started[i] = pthread_create(&tids[i], NULL, &selfPlayThread,
+                                    &work[i]) == 0;
+
+        //Do the work here if the thread couldn't be made
+        if (!started[i]) selfPlayThread(&work[i]);
+      }
+
+    std::size_t used = 0;
+    for (std::size_t i = 0; i < _threads; i++)
+      {
+        if (started[i]) pthread_join(tids[i], NULL);
+        used += work[i].used;
+        merge(work[i].stats);
+      }
+    return used;
+  }
+
+  void BookBuilder::merge(const BookStats& stats)
+  {
+    for (BookStats::const_iterator it = stats.begin(); it != stats.end(); ++it)
+      {
+        BookEntry& e = _stats[it->first];
+        if (e.games == 0)
+          {
+            e = it->second;
+            continue;
+          }
+        e.games += it->second.games;
+        e.wins += it->second.wins;
+        e.draws += it->second.draws;
+      }
+  }
+
+  bool BookBuilder::addRecord(RecordReader rec)
+  {
+    return countRecord(rec, _depth, _stats);
+  }
+
+  bool BookBuilder::write(const std::string& path) const
+  {
+    std::FILE* f = std::fopen(path.c_str(), "wb");
+    if (!f) return false;
+
+    //The map is already sorted by key, then move
+    std::vector<std::uint8_t> body;
+    std::uint64_t count = 0;
+    for (BookStats::const_iterator it = _stats.begin(); it != _stats.end(); ++it)
+      {
+        const BookEntry& e = it->second;
+        if (e.games < _minGames) continue;
+        std::size_t at = body.size();
+        body.resize(at + BOOK_ENTRY_SIZE);
+        putLE(&body[at], e.key, 8);
+        putLE(&body[at + 8], packMove(e.move), 4);
+        putLE(&body[at + 12], e.games, 4);
+        putLE(&body[at + 16], e.wins, 4);
+        putLE(&body[at + 20], e.draws, 4);
+        count++;
+      }
+
+    std::uint8_t header[BOOK_HEADER_SIZE];
+    memset(header, 0, sizeof(header));
+    memcpy(header, BOOK_MAGIC, 4);
+    putLE(header + 4, BOOK_VERSION, 2);
+    putLE(header + 8, count, 8);
+
+    bool ok = std::fwrite(header, 1, sizeof(header), f) == sizeof(header);
+    if (ok && !body.empty())
+      {
+        ok = std::fwrite(&body[0], 1, body.size(), f) == body.size();
+      }
+    if (std::fclose(f) != 0) ok = false;
+    return ok;
+  }
+
+} //Namespace
@@ -0,0 +1,137 @@
+/*
+  Copyright (c) 2014 Auston Sterling
+  See license.txt for copying permission.
+
+  -----OpeningBook Class Header-----
+  Auston Sterling
+  austonst@gmail.com
+
+  An opening book built from archived games and games the searcher plays
+  against itself. Positions are looked up by Game::transpositionHash(),
+  which includes both armies, so every matchup keeps its own statistics
+  without any extra bookkeeping.
+
+  All integers are little-endian.
+  header 16B  - 4B magic "C2BK", 2B version, 2B reserved, 8B entry count
+  entries     - 24B each, sorted by key:
+                8B position hash, 4B packMove() of the move, 4B games played,
+                4B games won by the side making the move, 4B games drawn
+*/
+
+#ifndef _book_hpp_
+#define _book_hpp_
+
+#include <string>
+#include <vector>
+#include <map>
+
+#include "archive.hpp"
+
+namespace c2
+{
+
+  struct SearchLimits;
+
+  const std::uint16_t BOOK_VERSION = 1;
+  const std::size_t BOOK_HEADER_SIZE = 16;
+  const std::size_t BOOK_ENTRY_SIZE = 24;
+
+  struct BookEntry
+  {
+    std::uint64_t key;
+    Move move;
+    std::uint32_t games;
+    std::uint32_t wins;
+    std::uint32_t draws;
+
+    //How strongly this move should be favored, from its results
+    std::uint64_t weight() const {return 2*std::uint64_t(wins) + draws + 1;}
+  };
+
+  class OpeningBook
+  {
+  public:
+    //Constructors
+    OpeningBook();
+    ~OpeningBook();
+    OpeningBook(const OpeningBook&) = delete;
+    OpeningBook& operator=(const OpeningBook&) = delete;
+
+    //Maps the book file and checks its header
+    bool open(const std::string& path);
+    void close();
+
+    //Number of entries in the book
+    std::size_t size() const {return _count;}
+
+    //Gets every entry for a position hash, most played first
+    std::vector<BookEntry> find(std::uint64_t key) const;
+
+    //Picks a book move that is legal in g, weighted by results.
+    //random is any random number; the same one gives the same choice.
+    //Returns false if the position isn't in the book.
+    bool choose(Game& g, Move& m, std::uint64_t random) const;
+
+  private:
+    //Reads entry i
+    BookEntry entry(std::size_t i) const;
+
+    const std::uint8_t* _map;
+    std::size_t _mapSize;
+    std::size_t _count;
+  };
+
+  //Position hash and packed move
+  typedef std::pair<std::uint64_t, std::uint32_t> BookKey;
+  typedef std::map<BookKey, BookEntry> BookStats;
+
+  class BookBuilder
+  {
+  public:
+    //Constructors
+    BookBuilder();
+
+    //Only moves in the first plies of each game are counted
+    void setDepth(std::size_t plies) {_depth = plies;}
+
+    //Moves seen in fewer games than this are left out of the book
+    void setMinGames(std::uint32_t games) {_minGames = games;}
+
+    //Number of worker threads used by addArchive
+    void setThreads(std::size_t threads) {_threads = threads ? threads : 1;}
+
+    //Counts every finished game in the archive, split across the workers.
+    //Returns the number of games used.
+    std::size_t addArchive(const ArchiveReader& archive);
+
+    //Counts one game. Returns false if it isn't finished or doesn't decode.
+    bool addRecord(RecordReader rec);
+
+    //Plays games of the searcher against itself, split across the workers,
+    //and counts every one that finishes. Games go through each matchup in
+    //turn, and open with a few random moves from seed so they differ.
+    //Returns the number of games used.
+    std::size_t addSelfPlay(std::size_t games, const SearchLimits& limits,
+                            std::uint64_t seed);
+
+    //Number of distinct position and move pairs seen so far
+    std::size_t size() const {return _stats.size();}
+
+    //Writes out the book, leaving out rarely played moves
+    bool write(const std::string& path) const;
+
+  private:
+    //Adds statistics counted by a worker
+    void merge(const BookStats& stats);
+
+    std::size_t _depth;
+    std::uint32_t _minGames;
+    std::size_t _threads;
+
+    //Statistics so far, kept in book order
+    BookStats _stats;
+  };
+
+} //Namespace
+
+#endif
@@ -0,0 +1,156 @@
+/*
+  Copyright (c) 2014 Auston Sterling
+  See license.txt for copying permission.
+
+  -----Opening Book Tool-----
+  Auston Sterling
+  austonst@gmail.com
+
+  Builds opening books from game archives and self-play, and shows what
+  they hold.
+
+  chess2-book build <book> [archive]... [-d plies] [-m mingames]
+                    [-t threads] [-p games] [-s depth] [-r seed]
+  chess2-book show <book> <white army> <black army>
+
+  With -p, that many games are also played by the searcher against itself,
+  searching each call to the given depth, and counted along with any
+  archives.
+*/
+
+#include "book.hpp"
+#include "bitboard.hpp"
+#include "search.hpp"
+
+#include <iostream>
+#include <cstdlib>
+#include <unistd.h>
+
+using namespace c2;
+
+static void usage()
+{
+  std::cerr << "Usage:\n"
+            << "  chess2-book build <book> [archive]... [-d plies] "
+            << "[-m mingames]\n"
+            << "                    [-t threads] [-p games] [-s depth] "
+            << "[-r seed]\n"
+            << "  chess2-book show <book> <white army> <black army>\n";
+}
+
+static ArmyType armyByName(const std::string& name)
+{
+  for (std::size_t i = 0; i < NUM_ARMIES; i++)
+    {
+      if (ARMY_NAME[i] == name) return toArmy(i);
+    }
+  return ArmyType::NONE;
+}
+
+static int build(int argc, char* argv[])
+{
+  BookBuilder builder;
+  std::size_t threads = sysconf(_SC_NPROCESSORS_ONLN);
+  std::size_t selfPlay = 0;
+  std::uint64_t seed = 1;
+  SearchLimits limits;
+  limits.maxDepth = 2;
+  std::string bookPath = argv[2];
+  std::vector<std::string> archives;
+  for (int i = 3; i < argc; i++)
+    {
+      std::string arg = argv[i];
+      if ((arg == "-d" || arg == "-m" || arg == "-t" || arg == "-p" ||
+           arg == "-s" || arg == "-r") && i+1 < argc)
+        {
+          long v = std::atol(argv[++i]);
+          if (v < 0) v = 0;
+          if (arg == "-d") builder.setDepth(v);
+          else if (arg == "-m") builder.setMinGames(v);
+          else if (arg == "-p") selfPlay = v;
+          else if (arg == "-s") limits.maxDepth = v ? v : 1;
+          else if (arg == "-r") seed = v;
+          else threads = v;
+        }
+      else
+        {
+          archives.push_back(arg);
+        }
+    }
+  builder.setThreads(threads);
+
+  std::size_t games = 0;
+  for (std::size_t i = 0; i < archives.size(); i++)
+    {
+      ArchiveReader archive;
+      if (!archive.open(archives[i]))
+        {
+          std::cerr << "Could not open archive " << archives[i] << "\n";
+          return 1;
+        }
+      games += builder.addArchive(archive);
+    }
+  if (selfPlay)
+    {
+      std::size_t played = builder.addSelfPlay(selfPlay, limits, seed);
+      std::cout << played << " of " << selfPlay << " self-play games "
+                << "finished\n";
+      games += played;
+    }
+
+  if (!builder.write(bookPath))
+    {
+      std::cerr << "Could not write book " << bookPath << "\n";
+      return 1;
+    }
+  std::cout << games << " games, " << builder.size()
+            << " position/move pairs\n";
+  return 0;
+}
+
+static int show(int argc, char* argv[])
+{
+  if (argc != 5)
+    {
+      usage();
+      return 1;
+    }
+  ArmyType white = armyByName(argv[3]);
+  ArmyType black = armyByName(argv[4]);
+  if (white == ArmyType::NONE || black == ArmyType::NONE)
+    {
+      std::cerr << "Unknown army\n";
+      return 1;
+    }
+
+  OpeningBook book;
+  if (!book.open(argv[2]))
+    {
+      std::cerr << "Could not open book " << argv[2] << "\n";
+      return 1;
+    }
+
+  BitBoard board;
+  Game g(&board, white, black);
+  g.start();
+  std::vector<BookEntry> entries = book.find(g.transpositionHash());
+  std::cout << book.size() << " entries, " << entries.size()
+            << " for the opening position\n";
+  for (std::size_t i = 0; i < entries.size(); i++)
+    {
+      const BookEntry& e = entries[i];
+      std::cout << "  " << e.move.start.notation() << "-"
+                << e.move.end.notation() << "  games " << e.games
+                << "  won " << e.wins << "  drawn " << e.draws << "\n";
+    }
+  return 0;
+}
+
+int main(int argc, char* argv[])
+{
+  std::string cmd = argc > 1 ? argv[1] : "";
+  if (cmd == "build" && argc > 3) return build(argc, argv);
+  if (cmd == "show") return show(argc, argv);
+  usage();
+  return 1;
+}
@@ -0,0 +1,159 @@
+/*
+  Copyright (c) 2014 Auston Sterling
+  See license.txt for copying permission.
+
+  -----Bot Class Implementation-----
+  Auston Sterling
+  austonst@gmail.com
+
+  A computer player deciding on a thread of its own.
+*/
+
+#include "bot.hpp"
+
+namespace c2
+{
+
+  //A call in the queue: 1B type, 4B move (see packMove), 1B side, 1B value
+  const std::size_t DECISION_SIZE = 7;
+
+  //Room for more calls than are ever waiting at once
+  const std::size_t DECISION_QUEUE_SIZE = 16;
+
+  //Decides on each position handed over until told to quit
+  void* bot_thread(void* data)
+  {
+    Bot* b = static_cast<Bot*>(data);
+    pthread_mutex_lock(&b->_lock);
+    while (!b->_quit)
+      {
+        if (b->_waiting)
+          {
+            //Cleared under the lock, so an interrupt for a newer position
+            //can't be lost between here and the search starting
+            GameSnapshot s = b->_next;
+            std::uint64_t position = b->_nextPosition;
+            std::uint32_t gen = b->_gen;
+            b->_waiting = false;
+            b->_searcher->resume();
+            pthread_mutex_unlock(&b->_lock);
+
+            SearchResult r = SearchResult();
+            r.best.side = SideType::NONE;
+            bool restored = b->_game.restore(s) == GameReturnType::SUCCESS;
+            if (restored) r = b->_searcher->search(b->_game, b->_side,
+                                                   b->_limits);
+
+            //A search cut short for a newer position isn't worth posting,
+            //and one that found no call has nothing to post
+            pthread_mutex_lock(&b->_lock);
+            if (restored && gen == b->_gen && r.best.side != SideType::NONE)
+              {
+                std::uint8_t m[DECISION_SIZE];
+                m[0] = static_cast<std::uint8_t>(r.best.type);
+                putLE(m + 1, packMove(r.best.move), 4);
+                m[5] = static_cast<std::uint8_t>(r.best.side);
+                m[6] = r.best.value;
+                b->_decisions.push(m, DECISION_SIZE, position);
+              }
+            continue;
+          }
+        pthread_cond_wait(&b->_wake, &b->_lock);
+      }
+    pthread_mutex_unlock(&b->_lock);
+    return NULL;
+  }
+
+  Bot::Bot() :
+    _side(SideType::NONE), _book(nullptr), _tablebase(nullptr),
+    _threadStarted(false), _quit(false), _nextPosition(0), _waiting(false),
+    _gen(0),
+    _decisions(DECISION_QUEUE_SIZE), _game(&_board)
+  {
+    pthread_mutex_init(&_lock, NULL);
+    pthread_cond_init(&_wake, NULL);
+  }
+
+  Bot::~Bot()
+  {
+    if (_threadStarted)
+      {
+        pthread_mutex_lock(&_lock);
+        _quit = true;
+        _searcher->interrupt();
+        pthread_cond_signal(&_wake);
+        pthread_mutex_unlock(&_lock);
+        pthread_join(_thread, NULL);
+      }
+    pthread_cond_destroy(&_wake);
+    pthread_mutex_destroy(&_lock);
+  }
+
+  bool Bot::start(SideType side, const SearchLimits& limits)
+  {
+    if (_threadStarted || side == SideType::NONE) return false;
+    _side = side;
+    _limits = limits;
+    _searcher.reset(new Searcher);
+    _searcher->setBook(_book);
+    _searcher->setTablebase(_tablebase);
+    _threadStarted = pthread_create(&_thread, NULL, &bot_thread, this) == 0;
+    return _threadStarted;
+  }
+
+  void Bot::hideBid(GameSnapshot& s) const
+  {
+    if (_side == SideType::WHITE && s.state == GameStateType::WHITE_BID)
+      {
+        s.blackBet = 3;
+        s.state = GameStateType::BOTH_BID;
+      }
+    else if (_side == SideType::BLACK && s.state == GameStateType::BLACK_BID)
+      {
+        s.whiteBet = 3;
+        s.state = GameStateType::BOTH_BID;
+      }
+  }
+
+  bool Bot::toDecide(GameStateType s) const
+  {
+    return _side != SideType::NONE && decidingSide(s, _side) == _side;
+  }
+
+  void Bot::think(const GameSnapshot& s, std::uint64_t position)
+  {
+    if (!_threadStarted) return;
+    pthread_mutex_lock(&_lock);
+    _next = s;
+    hideBid(_next);
+    _nextPosition = position;
+    _waiting = true;
+    _gen++;
+    _searcher->interrupt();
+    pthread_cond_signal(&_wake);
+    pthread_mutex_unlock(&_lock);
+  }
+
+  void Bot::stop()
+  {
+    if (!_threadStarted) return;
+    pthread_mutex_lock(&_lock);
+    _waiting = false;
+    _gen++;
+    _searcher->interrupt();
+    pthread_mutex_unlock(&_lock);
+  }
+
+  bool Bot::decision(GameEvent& e, std::uint64_t& position)
+  {
+    MessageSlot slot;
+    if (!_decisions.pop(slot)) return false;
+    e.type = static_cast<EventType>(slot.data[0]);
+    e.move = unpackMove(getLE(slot.data + 1, 4));
+    e.side = static_cast<SideType>(slot.data[5]);
+    e.value = slot.data[6];
+    position = slot.stamp;
+    return true;
+  }
+
+} //Namespace
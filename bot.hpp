@@ -0,0 +1,111 @@
+/*
+  Copyright (c) 2014 Auston Sterling
+  See license.txt for copying permission.
+
+  -----Bot Class Header-----
+  Auston Sterling
+  austonst@gmail.com
+
+  A computer player for one side, deciding on a thread of its own so
+  whatever is showing the game never waits on it.
+
+  Whenever the bot's side has a call to make, the client hands over the
+  position. The thread searches it within the time allowed for each call and
+  posts the call it decides on through a queue, with the position it was
+  for. The client collects calls from the queue when it likes and makes
+  them on its game, dropping any for a position that has since changed.
+
+  Nothing is started until start(), so a Bot can be kept around without
+  costing anything in a game it doesn't play.
+*/
+
+#ifndef _bot_hpp_
+#define _bot_hpp_
+
+#include <memory>
+#include <pthread.h>
+
+#include "messagequeue.hpp"
+#include "search.hpp"
+
+namespace c2
+{
+
+  class Bot
+  {
+  public:
+    //Constructors
+    Bot();
+    ~Bot();
+    Bot(const Bot&) = delete;
+    Bot& operator=(const Bot&) = delete;
+
+    //An opening book to play from and endgame tables to play endings from,
+    //neither of which is owned. Only before start().
+    void setBook(const OpeningBook* book) {_book = book;}
+    void setTablebase(const Tablebase* tb) {_tablebase = tb;}
+
+    //Starts the thread, playing side within limits for each call
+    //Returns false if it couldn't be started or already was
+    bool start(SideType side, const SearchLimits& limits);
+
+    //Accessors
+    bool running() const {return _threadStarted;}
+    SideType side() const {return _side;}
+
+    //Checks if the bot has the next call to make in a state. When both
+    //sides are yet to bid, the bot makes its bid.
+    bool toDecide(GameStateType s) const;
+
+    //Starts deciding the call to make in a position, dropping anything
+    //still being decided. Position identifies it in what is posted, and is
+    //normally the game's hash(). A bid the other side has already made is
+    //kept from the bot, which bids as if neither side had.
+    void think(const GameSnapshot& s, std::uint64_t position);
+
+    //Drops anything being decided
+    void stop();
+
+    //Collects the next call posted and the position it was for, returning
+    //false if there is none. Never blocks.
+    bool decision(GameEvent& e, std::uint64_t& position);
+
+  private:
+    //Waits for positions and decides on them
+    friend void* bot_thread(void* data);
+
+    //Takes back the other side's bid if it was made and ours wasn't
+    void hideBid(GameSnapshot& s) const;
+
+    SideType _side;
+    SearchLimits _limits;
+    const OpeningBook* _book;
+    const Tablebase* _tablebase;
+    std::unique_ptr<Searcher> _searcher;
+
+    //Guards everything below that the thread and client share, apart from
+    //the queue, and wakes the thread
+    pthread_mutex_t _lock;
+    pthread_cond_t _wake;
+    pthread_t _thread;
+    bool _threadStarted;
+    bool _quit;
+
+    //The latest position, whether the thread has yet to pick it up, and
+    //a count of positions handed over or dropped so far
+    GameSnapshot _next;
+    std::uint64_t _nextPosition;
+    bool _waiting;
+    std::uint32_t _gen;
+
+    //Calls decided, from the thread to the client
+    MessageQueue _decisions;
+
+    //Thread only. The game being decided on.
+    BitBoard _board;
+    Game _game;
+  };
+
+} //Namespace
+
+#endif
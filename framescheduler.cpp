@@ -0,0 +1,59 @@
+/*
+  -----FrameScheduler Class Implementation-----
+  Auston Sterling
+  austonst@gmail.com
+
+  Implementation of the FrameScheduler class.
+*/
+
+#include "framescheduler.hpp"
+
+FrameScheduler::FrameScheduler(const Renderer& r) :
+  vsync_(false),
+  rate_(DEFAULT_REFRESH_RATE),
+  last_(0)
+{
+  SDL_RendererInfo info;
+  if (r.sdl() && SDL_GetRendererInfo(r.sdl(), &info) == 0)
+    {
+      vsync_ = (info.flags & SDL_RENDERER_PRESENTVSYNC) != 0;
+    }
+
+  //Headless renderers have no display to follow
+  SDL_DisplayMode mode;
+  int display = r.window() ? SDL_GetWindowDisplayIndex(r.window()) : -1;
+  if (display >= 0 && SDL_GetCurrentDisplayMode(display, &mode) == 0 &&
+      mode.refresh_rate > 0)
+    {
+      rate_ = mode.refresh_rate;
+    }
+
+  period_ = SDL_GetPerformanceFrequency() / rate_;
+
+  //With vsync, present does the last of the waiting. Starting a quarter
+  //frame early leaves time to draw without missing the refresh.
+  slack_ = vsync_ ? period_ / 4 : 0;
+}
+
+Uint32 FrameScheduler::wait(bool animating, Uint32 idle) const
+{
+  if (!animating) return idle;
+  Uint64 now = SDL_GetPerformanceCounter();
+  Uint64 next = last_ + period_ - slack_;
+  if (now >= next) return 0;
+  //Rounded up, so the loop doesn't spin through the last millisecond
+  Uint64 freq = SDL_GetPerformanceFrequency();
+  Uint64 ms = ((next - now) * 1000 + freq - 1) / freq;
+  return ms < idle ? Uint32(ms) : idle;
+}
+
+bool FrameScheduler::due(bool animating) const
+{
+  if (!animating) return true;
+  return SDL_GetPerformanceCounter() >= last_ + period_ - slack_;
+}
+
+void FrameScheduler::shown()
+{
+  last_ = SDL_GetPerformanceCounter();
+}
@@ -0,0 +1,57 @@
+/*
+  -----FrameScheduler Class Header-----
+  Auston Sterling
+  austonst@gmail.com
+
+  Paces the client's frames while something is animating. Frames are spaced
+  by the display's refresh period. A renderer that waits for vsync already
+  blocks in present until the display refreshes, so the scheduler wakes the
+  loop a little early and lets present do the precise waiting. Without vsync,
+  the scheduler's own timer is all the pacing there is.
+
+  Neither takes any time when nothing is animating: the loop sleeps until an
+  event comes, just as it would without a scheduler.
+*/
+
+#ifndef _framescheduler_hpp_
+#define _framescheduler_hpp_
+
+#include "renderer.hpp"
+
+//Used when the display doesn't say how fast it refreshes
+const int DEFAULT_REFRESH_RATE = 60;
+
+class FrameScheduler
+{
+public:
+  //Constructors
+  //Looks at the renderer and its window to decide how to pace frames
+  FrameScheduler(const Renderer& r);
+
+  //Accessors
+  bool vsync() const {return vsync_;}
+  int refreshRate() const {return rate_;}
+
+  //How long the loop may wait for events before the next frame is due,
+  //never more than idle. Only frames while animating are waited for.
+  Uint32 wait(bool animating, Uint32 idle) const;
+
+  //Checks if it's time for another frame. Frames that aren't animating,
+  //like those showing a click, are always due.
+  bool due(bool animating) const;
+
+  //Records that a frame was just shown
+  void shown();
+
+private:
+  bool vsync_;
+  int rate_;
+
+  //In performance counter ticks: the time between frames, how early a frame
+  //can be started, and when the last one was shown
+  Uint64 period_;
+  Uint64 slack_;
+  Uint64 last_;
+};
+
+#endif
@@ -14,13 +14,86 @@
 #include "piece.hpp"
 
 #include <cmath>
+#include <algorithm>
 
 namespace c2
 {
 
+  //The bit for a square in a 64 bit square set, a1 first
+  static std::uint64_t squareBit(Position p)
+  {
+    return 1ULL << ((p.y()-1)*8 + (p.x()-1));
+  }
+
+  //Random numbers for Game::hash, one per feature value
+  struct ZobristKeys
+  {
+    std::uint64_t piece[PIECE_TYPES][2][64];
+    std::uint64_t state[NUM_GAMESTATES];
+    std::uint64_t army[2][NUM_ARMIES+1];
+    std::uint64_t stones[2][7];
+    std::uint64_t bet[2][4];
+    std::uint64_t castle[4];
+    std::uint64_t doubleStep[64];
+    std::uint64_t enPassant[9];
+    std::uint64_t kingTurn;
+    std::uint64_t fiftyMove[101];
+  };
+
+  //splitmix64, which is plenty random for hash keys
+  static std::uint64_t nextKey(std::uint64_t& seed)
+  {
+    std::uint64_t z = (seed += 0x9E3779B97F4A7C15ULL);
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+    return z ^ (z >> 31);
+  }
+
+  static ZobristKeys makeZobristKeys()
+  {
+    //A fixed seed keeps hashes the same between runs, so they can be stored
+    ZobristKeys z;
+    std::uint64_t seed = 0xC4E552C4E552ULL;
+    for (std::size_t i = 0; i < PIECE_TYPES; i++)
+      for (std::size_t j = 0; j < 2; j++)
+        for (std::size_t k = 0; k < 64; k++)
+          z.piece[i][j][k] = nextKey(seed);
+    for (std::size_t i = 0; i < NUM_GAMESTATES; i++)
+      z.state[i] = nextKey(seed);
+    for (std::size_t i = 0; i < 2; i++)
+      {
+        for (std::size_t j = 0; j < NUM_ARMIES+1; j++)
+          z.army[i][j] = nextKey(seed);
+        for (std::size_t j = 0; j < 7; j++)
+          z.stones[i][j] = nextKey(seed);
+        for (std::size_t j = 0; j < 4; j++)
+          z.bet[i][j] = nextKey(seed);
+      }
+    for (std::size_t i = 0; i < 4; i++)
+      z.castle[i] = nextKey(seed);
+    for (std::size_t i = 0; i < 64; i++)
+      z.doubleStep[i] = nextKey(seed);
+    for (std::size_t i = 0; i < 9; i++)
+      z.enPassant[i] = nextKey(seed);
+    z.kingTurn = nextKey(seed);
+
+    //Drawn last so the keys above, and any hashes stored with them, stay
+    //the same
+    for (std::size_t i = 0; i < 101; i++)
+      z.fiftyMove[i] = nextKey(seed);
+    return z;
+  }
+
+  static const ZobristKeys& zobrist()
+  {
+    static const ZobristKeys keys = makeZobristKeys();
+    return keys;
+  }
+
   //Immediately sets up a game
   Game::Game(Board* b, ArmyType white, ArmyType black) :
-    _board(b), _whiteArmy(white), _blackArmy(black), _dummy(false)
+    _board(b), _whiteArmy(white), _blackArmy(black), _dummy(false),
+    _shareMoves(true), _keepMoves(true), _observer(nullptr)
   {
     //Check which inputs are properly set
     //Choose the corresponding game state
@@ -29,7 +102,9 @@ namespace c2
 
   //Sets up the board but requires armies to be set later
   Game::Game(Board* b) : _board(b), _whiteArmy(ArmyType::NONE),
-                         _blackArmy(ArmyType::NONE), _dummy(false)
+                         _blackArmy(ArmyType::NONE), _dummy(false),
+                         _shareMoves(true), _keepMoves(true),
+                         _observer(nullptr)
   {
     if (b)
       {
@@ -44,7 +119,8 @@ namespace c2
   //Sets up a game, but requires a Board to be passed in later
   Game::Game() :
     _board(nullptr), _whiteArmy(ArmyType::NONE), _blackArmy(ArmyType::NONE),
-    _state(GameStateType::SET_BOARD), _dummy(false) {}
+    _state(GameStateType::SET_BOARD), _dummy(false), _shareMoves(true),
+    _keepMoves(true), _observer(nullptr) {}
 
   void Game::setPreGameState()
   {
@@ -150,16 +226,107 @@ namespace c2
     _whiteBet = 3;
     _blackBet = 3;
     _moves.clear();
+    _touched = 0;
+    _isKingTurn = false;
     _whiteKingCastle = _whiteQueenCastle =
       _blackKingCastle = _blackQueenCastle = true;
     _fiftyMoveRule = 0;
+    _legal.reset();
 
     //Update state
     _state = GameStateType::WHITE_MOVE;
     return GameReturnType::SUCCESS;
   }
 
+  GameSnapshot Game::snapshot() const
+  {
+    GameSnapshot s;
+    s.state = _state;
+    s.whiteArmy = _whiteArmy;
+    s.blackArmy = _blackArmy;
+    s.whiteStones = _whiteStones;
+    s.blackStones = _blackStones;
+    s.whiteBet = _whiteBet;
+    s.blackBet = _blackBet;
+    s.whiteKingCastle = _whiteKingCastle;
+    s.whiteQueenCastle = _whiteQueenCastle;
+    s.blackKingCastle = _blackKingCastle;
+    s.blackQueenCastle = _blackQueenCastle;
+    s.isKingTurn = _isKingTurn;
+    s.fiftyMoveRule = _fiftyMoveRule;
+    s.touched = _touched;
+    if (!_moves.empty()) s.lastMove = _moves.back();
+    s.currentMove = _currentMove;
+    s.justTaken = _justTaken;
+
+    if (_board && _state >= GameStateType::WHITE_MOVE)
+      {
+        for (char y = 1; y < 9; y++)
+          {
+            for (char x = 1; x < 9; x++)
+              {
+                Piece p = (*_board)(Position(x,y));
+                if (p.type() != PieceType::NONE) s.pieces.push_back(p);
+              }
+          }
+      }
+    return s;
+  }
+
+  GameReturnType Game::restore(const GameSnapshot& s,
+                               const std::vector<Move>* legal)
+  {
+    if (!_board) return GameReturnType::INVALID_STATE;
+    if (s.state < GameStateType::WHITE_MOVE ||
+        s.whiteArmy == ArmyType::NONE || s.blackArmy == ArmyType::NONE)
+      {
+        return GameReturnType::INVALID_PARAM;
+      }
+
+    _board->clear();
+    for (std::size_t i = 0; i < s.pieces.size(); i++)
+      {
+        _board->place(s.pieces[i]);
+      }
+    _state = s.state;
+    _whiteArmy = s.whiteArmy;
+    _blackArmy = s.blackArmy;
+    _whiteStones = s.whiteStones;
+    _blackStones = s.blackStones;
+    _whiteBet = s.whiteBet;
+    _blackBet = s.blackBet;
+    _whiteKingCastle = s.whiteKingCastle;
+    _whiteQueenCastle = s.whiteQueenCastle;
+    _blackKingCastle = s.blackKingCastle;
+    _blackQueenCastle = s.blackQueenCastle;
+    _isKingTurn = s.isKingTurn;
+    _fiftyMoveRule = s.fiftyMoveRule;
+    _touched = s.touched;
+    _moves.clear();
+    if (s.lastMove.type != PieceType::NONE) _moves.push_back(s.lastMove);
+    _currentMove = s.currentMove;
+    _justTaken = s.justTaken;
+    _legal.reset();
+    if (legal && isMoveState(_state))
+      {
+        std::shared_ptr<LegalMoves> known = std::make_shared<LegalMoves>();
+        for (auto i = legal->begin(); i != legal->end(); i++) known->add(*i);
+        _legal = known;
+      }
+    return GameReturnType::SUCCESS;
+  }
+
   GameReturnType Game::move(const Move& m)
+  {
+    GameReturnType r = makeMove(m);
+    if (_observer && !_dummy && succeeded(r))
+      {
+        _observer->moved(*this, m);
+      }
+    return r;
+  }
+
+  GameReturnType Game::makeMove(const Move& m)
   {
     //Verify state
     if ((m.side == SideType::WHITE &&
@@ -210,6 +377,7 @@ namespace c2
           {
             return GameReturnType::INVALID_STATE;
           }
+        _legal.reset();
         return GameReturnType::SUCCESS;
       }
 
@@ -218,10 +386,25 @@ namespace c2
       {
         return GameReturnType::INVALID_MOVE;
       }
-    std::set<Position> possMoves = possibleMoves(m.start);
-    if (possMoves.find(m.end) == possMoves.end())
+    //Look the move up in this turn's moves, which are usually known already.
+    //The piece was checked above, so only the squares need to match.
+    //Dummy games, and games not keeping moves, only check this one move.
+    if (!_legal && !_dummy && _keepMoves) findLegal();
+    if (_legal)
       {
-        return GameReturnType::INVALID_MOVE;
+        if (!_legal->contains(m.start, m.end))
+          {
+            return GameReturnType::INVALID_MOVE;
+          }
+      }
+    else
+      {
+        std::set<Position> possMoves = reachableMoves(m.start);
+        if (possMoves.find(m.end) == possMoves.end() ||
+            (!_dummy && !keepsKingSafe(currentPiece, m.end)))
+          {
+            return GameReturnType::INVALID_MOVE;
+          }
       }
 
     //If this is a kingmove, verify that it is in fact the king moving
@@ -236,10 +419,12 @@ namespace c2
 
     //The move looks good, let's carry it out
     //See if there's a piece at the end of the move getting taken, then move
+    _legal.reset();
     _justTaken = (*_board)(m.end);
     _currentMove = m;
     _board->move(m);
     _moves.push_back(m);
+    _touched |= squareBit(m.start) | squareBit(m.end);
 
     //If this is a warrior king "moving" to the same spot, it's a whirlwind
     if (m.type == PieceType::TKG_WARRKING && m.start == m.end)
@@ -513,26 +698,55 @@ namespace c2
     //In some odd situations, the person who just moved could have put himself
     //in check. In this case, the opponent immediately wins.
     //If any enemy piece can move to friendly king, that's mate
-    if (!_dummy)
+    //The opponent's moves found here are kept for their coming turn, and in
+    //moveCache() for anyone reaching this position again. A game not keeping
+    //moves stops looking at the first reply.
+    std::shared_ptr<const LegalMoves> enemyMoves;
+    if (!_dummy && !_keepMoves)
       {
-        std::list<Position> enemyPos = _board->getPieces(otherSide(m.side));
-        std::vector<Position> friendKing = _board->getKing(m.side);
-        SideType winner = m.side;
-        for (auto i = enemyPos.begin(); i != enemyPos.end(); i++)
+        SideType winner = mateWinner(m.side);
+        if (winner == SideType::WHITE)
+          {
+            _state = GameStateType::WHITE_WIN_CHECKMATE;
+            return;
+          }
+        else if (winner == SideType::BLACK)
           {
-            //If the opponent's piece can move, the opponent is not mated
-            std::set<Position> poss = possibleMoves(*i);
-            if (poss.size() != 0)
+            _state = GameStateType::BLACK_WIN_CHECKMATE;
+            return;
+          }
+      }
+    else if (!_dummy)
+      {
+        SideType enemy = otherSide(m.side);
+        std::uint64_t key = legalKey(enemy, false);
+        if (_shareMoves) enemyMoves = moveCache().find(key);
+        if (!enemyMoves)
+          {
+            std::shared_ptr<LegalMoves> found = std::make_shared<LegalMoves>();
+            std::list<Position> enemyPos = _board->getPieces(enemy);
+            for (auto i = enemyPos.begin(); i != enemyPos.end(); i++)
               {
-                //If that piece can move to the mover's king, mover is mated
-                for (auto j = friendKing.begin(); j != friendKing.end(); j++)
+                std::set<Position> poss = possibleMoves(*i);
+                PieceType type = (*_board)(*i).type();
+                for (auto j = poss.begin(); j != poss.end(); j++)
                   {
-                    if (poss.find(*j) != poss.end())
-                      {
-                        winner = otherSide(m.side);
-                      }
+                    found->add(Move(*i, *j, type, enemy));
                   }
-                if (winner == m.side) winner = SideType::NONE;
+              }
+            if (_shareMoves) moveCache().insert(key, found);
+            enemyMoves = found;
+          }
+
+        //If the opponent has a move, they aren't mated, and if one of them
+        //takes the mover's king, the mover is
+        std::vector<Position> friendKing = _board->getKing(m.side);
+        SideType winner = enemyMoves->moves.empty() ? m.side : SideType::NONE;
+        for (auto j = friendKing.begin(); j != friendKing.end(); j++)
+          {
+            for (std::size_t i = 0; i < 64; i++)
+              {
+                if (enemyMoves->dests[i] & squareBit(*j)) winner = enemy;
               }
           }
         
@@ -634,6 +848,14 @@ namespace c2
               }
           }
       }
+
+    //If the opponent moves next, we already know what they can do
+    if (enemyMoves &&
+        ((m.side == SideType::WHITE && _state == GameStateType::BLACK_MOVE) ||
+         (m.side == SideType::BLACK && _state == GameStateType::WHITE_MOVE)))
+      {
+        _legal = enemyMoves;
+      }
   }
 
   GameReturnType Game::startDuel(bool d)
@@ -645,10 +867,12 @@ namespace c2
         return GameReturnType::INVALID_STATE;
       }
 
+    _legal.reset();
     if (!d)
       {
         //Skipping the duel, we finish up the end of turn things
         endTurnThings();
+        if (_observer && !_dummy) _observer->duelChosen(*this, false);
         return GameReturnType::SUCCESS;
       }
     //Compare the ranks of the two pieces for extra cost possibility
@@ -671,6 +895,7 @@ namespace c2
     //Duel starts, begin bidding
     GameStateType duelState = _state;
     _state = GameStateType::BOTH_BID;
+    if (_observer && !_dummy) _observer->duelChosen(*this, true);
 
     //If the attacker has no stones, the duel is imediately resolved with
     //defender spending one stone
@@ -727,6 +952,7 @@ namespace c2
       {
         return GameReturnType::INVALID_PARAM;
       }
+    _legal.reset();
 
     //If both have bid, resolve
     if (_whiteBet < 3 && _blackBet < 3)
@@ -771,6 +997,7 @@ namespace c2
         _state = GameStateType::BLACK_BID;
       }
 
+    if (_observer && !_dummy) _observer->bid(*this, side, stones);
     return GameReturnType::SUCCESS;
   }
 
@@ -801,23 +1028,43 @@ namespace c2
       }
 
     //Replace the piece
+    _legal.reset();
     _board->promote(_currentMove.end, newType);
 
     //Update state
     endTurnThings();
+    if (_observer && !_dummy) _observer->promoted(*this, newType);
     return GameReturnType::SUCCESS;
   }
   
-  //This'll be a fun one...
   std::set<Position> Game::possibleMoves(Position pos)
+  {
+    //The remaining moves are all good unless the king would be checked after
+    std::set<Position> moves = reachableMoves(pos);
+    if (_dummy) return moves;
+    Piece p = (*_board)(pos);
+    for (auto i = moves.begin(); i != moves.end();)
+      {
+        if (keepsKingSafe(p, *i))
+          {
+            ++i;
+          }
+        else
+          {
+            moves.erase(i++);
+          }
+      }
+    return moves;
+  }
+
+  //This'll be a fun one...
+  std::set<Position> Game::reachableMoves(Position pos)
   {
     //Get a bunch of data one time so it can just be reused
     Board* b = _board;
     Piece p = (*b)(pos);
     SideType sf = p.side();
     SideType se = otherSide(sf);
-    std::list<Position> friendPos = b->getPieces(sf);
-    std::vector<Position> enemyKings = b->getKing(se);
     
     //If this is an empowered piece, see what extra move types it has
     std::list<MoveType> types = MOVE_TYPES[num(p.type())];
@@ -849,6 +1096,7 @@ namespace c2
     
     //Get the possible moves for this piece
     std::set<Position> moves;
+    std::vector<Position> enemyKings;
     for (auto mt = types.begin(); mt != types.end(); mt++)
       {
         switch (*mt)
@@ -867,14 +1115,7 @@ namespace c2
                 }
 
               //If we have never moved, we can take two steps
-              bool nevermoved = true;
-              for (size_t i = 0; i < _moves.size(); i++)
-                {
-                  if (_moves[i].start == p.pos() || _moves[i].end == p.pos())
-                    {
-                      nevermoved = false;
-                    }
-                }
+              bool nevermoved = !(_touched & squareBit(p.pos()));
               Position twosteps(0,pawnDir+pawnDir);
               if (canForward &&(p.pos() + twosteps).isValid() && nevermoved &&
                   (*b)(p.pos() + twosteps).type() == PieceType::NONE)
@@ -912,6 +1153,7 @@ namespace c2
 
           case MoveType::PAWN_NEM:
             //Nemesis pawns may be able to make nemesis moves
+            enemyKings = b->getKing(se);
             for (size_t j = 0; j < enemyKings.size(); j++)
               {
                 //Let's just cycle over all eight options
@@ -1277,67 +1519,256 @@ namespace c2
           }
       }
 
-    //The remaining moves are all good unless the king would be checked after
+    return moves;
+  }
+
+  bool Game::keepsKingSafe(const Piece& p, Position dest)
+  {
     //Make game copy, make move on copy, call possibleMoves for enemy to see
-    // if checked, if so, can't make that move
-    if (!_dummy)
+    //if checked, if so, can't make that move
+    SideType sf = p.side();
+    SideType se = otherSide(sf);
+    Game gCopy = *this;
+    gCopy._board = _board->clone();
+    gCopy._dummy = true;
+    gCopy._legal.reset();
+    if (sf == SideType::WHITE)
+      {
+        gCopy._state = GameStateType::WHITE_MOVE;
+      }
+    else
+      {
+        gCopy._state = GameStateType::BLACK_MOVE;
+      }
+    gCopy.move(Move(p.pos(), dest, p.type(), sf));
+
+    //Special cases requiring manual progress through endTurnThings:
+    //A pinned tiger taking a piece needs to resolve the duel to get back
+    if (p.type() == PieceType::ANI_TIGER &&
+        (gCopy.state() == GameStateType::BLACK_DUEL ||
+         gCopy.state() == GameStateType::WHITE_DUEL))
+      {
+        gCopy.startDuel(true);
+
+        //The attacker can make the move even if he could or will lose
+        //the duel, so assume attacker win
+        gCopy.bid(se, 0);
+        gCopy.bid(sf, 0);
+      }
+
+    std::vector<Position> friendKings = gCopy._board->getKing(sf);
+    std::list<Position> enemyPos = gCopy._board->getPieces(se);
+    bool safe = true;
+    for (auto j = enemyPos.begin(); j != enemyPos.end() && safe; j++)
       {
-        for (auto i = moves.begin(); i != moves.end();)
+        std::set<Position> enemyMoves = gCopy.reachableMoves(*j);
+        for (size_t k = 0; k < friendKings.size(); k++)
           {
-            //Make the move
-            Game gCopy = *this;
-            gCopy._board = b->clone();
-            gCopy._dummy = true;
-            if (p.side() == SideType::WHITE)
+            //If the enemy piece can move to the king, it's check
+            if (enemyMoves.find(friendKings[k]) != enemyMoves.end())
               {
-                gCopy._state = GameStateType::WHITE_MOVE;
+                safe = false;
               }
-            else
+          }
+      }
+    delete gCopy._board;
+    return safe;
+  }
+
+  SideType Game::mateWinner(SideType mover)
+  {
+    //Only replies onto a king, and the first reply found, need checking
+    SideType enemy = otherSide(mover);
+    std::uint64_t kings = 0;
+    std::vector<Position> friendKing = _board->getKing(mover);
+    for (auto j = friendKing.begin(); j != friendKing.end(); j++)
+      {
+        kings |= squareBit(*j);
+      }
+
+    bool canReply = false;
+    std::list<Position> enemyPos = _board->getPieces(enemy);
+    for (auto i = enemyPos.begin(); i != enemyPos.end(); i++)
+      {
+        Piece p = (*_board)(*i);
+        std::set<Position> reach = reachableMoves(*i);
+        for (auto j = reach.begin(); j != reach.end(); j++)
+          {
+            bool takesKing = (kings & squareBit(*j)) != 0;
+            if ((takesKing || !canReply) && keepsKingSafe(p, *j))
               {
-                gCopy._state = GameStateType::BLACK_MOVE;
+                if (takesKing) return enemy;
+                canReply = true;
               }
-            gCopy.move(Move(pos, *i, p.type(), p.side()));
+          }
+      }
+    return canReply ? SideType::NONE : mover;
+  }
+
+  std::vector<Move> Game::legalMoves()
+  {
+    std::shared_ptr<const LegalMoves> legal = findLegal();
+    if (!legal) return std::vector<Move>();
+    return legal->moves;
+  }
+
+  std::shared_ptr<const LegalMoves> Game::findLegal()
+  {
+    //Figure out who is moving and whether only kings may move
+    SideType side;
+    bool kingTurn = false;
+    switch (_state)
+      {
+      case GameStateType::WHITE_MOVE:
+        side = SideType::WHITE;
+        break;
+      case GameStateType::BLACK_MOVE:
+        side = SideType::BLACK;
+        break;
+      case GameStateType::WHITE_KINGMOVE:
+        side = SideType::WHITE;
+        kingTurn = true;
+        break;
+      case GameStateType::BLACK_KINGMOVE:
+        side = SideType::BLACK;
+        kingTurn = true;
+        break;
+      default:
+        return nullptr;
+      }
+    if (_legal) return _legal;
+
+    //Dummy games skip the check test, so their moves must not be shared
+    std::uint64_t key = 0;
+    if (!_dummy && _shareMoves)
+      {
+        key = legalKey(side, kingTurn);
+        _legal = moveCache().find(key);
+        if (_legal) return _legal;
+      }
+
+    //Gather the destinations of each piece in board order
+    std::shared_ptr<LegalMoves> ret = std::make_shared<LegalMoves>();
+    std::list<Position> pieces = _board->getPieces(side);
+    for (auto i = pieces.begin(); i != pieces.end(); i++)
+      {
+        Piece p = (*_board)(*i);
+        if (kingTurn && p.type() != PieceType::TKG_WARRKING) continue;
+        std::set<Position> dests = possibleMoves(*i);
+        for (auto j = dests.begin(); j != dests.end(); j++)
+          {
+            ret->add(Move(*i, *j, p.type(), side));
+          }
+      }
 
-            //Special cases requiring manual progress through endTurnThings:
-            //A pinned tiger taking a piece needs to resolve the duel to get back
-            if (p.type() == PieceType::ANI_TIGER &&
-                (gCopy.state() == GameStateType::BLACK_DUEL ||
-                 gCopy.state() == GameStateType::WHITE_DUEL))
+    //A king turn can always be skipped
+    if (kingTurn)
+      {
+        std::vector<Position> kings = _board->getKing(side);
+        if (!kings.empty())
+          {
+            ret->add(Move(kings[0], KINGMOVE_SKIP_POS,
+                          PieceType::TKG_WARRKING, side));
+          }
+      }
+    if (!_dummy && _shareMoves) moveCache().insert(key, ret);
+    _legal = ret;
+    return _legal;
+  }
+
+  std::uint64_t Game::hash() const
+  {
+    std::uint64_t h = transpositionHash();
+    if (!_board || _state < GameStateType::WHITE_MOVE) return h;
+    return h ^ zobrist().fiftyMove[std::min<std::uint8_t>(_fiftyMoveRule, 100)];
+  }
+
+  std::uint64_t Game::transpositionHash() const
+  {
+    const ZobristKeys& z = zobrist();
+    std::uint64_t h = z.state[num(_state)];
+    if (!_board || _state < GameStateType::WHITE_MOVE)
+      {
+        return h ^ z.army[0][num(_whiteArmy)] ^ z.army[1][num(_blackArmy)];
+      }
+    h ^= positionHash();
+    if (_isKingTurn) h ^= z.kingTurn;
+
+    //Mid-turn states also depend on the capture being resolved
+    if (!isMoveState(_state) && !isGameOver(_state))
+      {
+        h ^= z.bet[0][std::min<std::uint8_t>(_whiteBet, 3)];
+        h ^= z.bet[1][std::min<std::uint8_t>(_blackBet, 3)];
+        std::uint64_t seed = (std::uint64_t(packMove(_currentMove)) << 32) ^
+          (std::uint64_t(num(_justTaken.type())) << 8) ^
+          num(_justTaken.side());
+        h ^= nextKey(seed);
+      }
+    return h;
+  }
+
+  std::uint64_t Game::legalKey(SideType side, bool kingTurn) const
+  {
+    //Only the side and the kind of turn matter, so each gets its own state
+    GameStateType listing;
+    if (side == SideType::WHITE)
+      {
+        listing = kingTurn ? GameStateType::WHITE_KINGMOVE :
+          GameStateType::WHITE_MOVE;
+      }
+    else
+      {
+        listing = kingTurn ? GameStateType::BLACK_KINGMOVE :
+          GameStateType::BLACK_MOVE;
+      }
+    return positionHash() ^ zobrist().state[num(listing)];
+  }
+
+  std::uint64_t Game::positionHash() const
+  {
+    const ZobristKeys& z = zobrist();
+    std::uint64_t h = z.army[0][num(_whiteArmy)] ^ z.army[1][num(_blackArmy)];
+
+    //Pieces, noting which pawns could still take two steps
+    for (char y = 1; y < 9; y++)
+      {
+        for (char x = 1; x < 9; x++)
+          {
+            Piece p = (*_board)(Position(x,y));
+            if (p.type() == PieceType::NONE || p.side() == SideType::NONE)
               {
-                gCopy.startDuel(true);
-                
-                //The attacker can make the move even if he could or will lose
-                //the duel, so assume attacker win
-                gCopy.bid(se, 0);
-                gCopy.bid(sf, 0);
+                continue;
               }
-            
-            std::vector<Position> friendKings = gCopy._board->getKing(sf);
-            std::list<Position> enemyPos = gCopy._board->getPieces(se);
-            bool needToInc = true;
-            for (auto j = enemyPos.begin(); j != enemyPos.end();)
+            std::size_t square = (y-1)*8 + (x-1);
+            h ^= z.piece[num(p.type())][num(p.side())][square];
+            if ((p.type() == PieceType::CLA_PAWN ||
+                 p.type() == PieceType::NEM_PAWN) &&
+                !(_touched & squareBit(p.pos())))
               {
-                std::set<Position> enemyMoves = gCopy.possibleMoves(*j);
-                for (size_t k = 0; k < friendKings.size(); k++)
-                  {
-                    //If the enemy piece can move to the king, it's check
-                    if (enemyMoves.find(friendKings[k]) != enemyMoves.end())
-                      {
-                        moves.erase(i++);
-                        needToInc = false;
-                        j = enemyPos.end();
-                        break;
-                      }
-                  }
-                if (needToInc) j++;
+                h ^= z.doubleStep[square];
               }
-            if (needToInc) ++i;
-            delete gCopy._board;
           }
       }
 
-    //Finally, remaining moves can be returned
-    return moves;
+    h ^= z.stones[0][std::min<std::uint8_t>(_whiteStones, 6)];
+    h ^= z.stones[1][std::min<std::uint8_t>(_blackStones, 6)];
+    if (_whiteKingCastle) h ^= z.castle[0];
+    if (_whiteQueenCastle) h ^= z.castle[1];
+    if (_blackKingCastle) h ^= z.castle[2];
+    if (_blackQueenCastle) h ^= z.castle[3];
+
+    //A pawn that just took two steps can be taken en passant
+    if (!_moves.empty())
+      {
+        const Move& last = _moves.back();
+        if ((last.type == PieceType::CLA_PAWN ||
+             last.type == PieceType::NEM_PAWN) &&
+            std::abs(last.start.y() - last.end.y()) == 2)
+          {
+            h ^= z.enPassant[std::size_t(last.end.x())];
+          }
+      }
+    return h;
   }
 
   std::uint8_t Game::stones(SideType side) const
@@ -13,8 +13,11 @@
 #ifndef _game_hpp_
 #define _game_hpp_
 
+#include <memory>
+
 #include "army.hpp"
 #include "board.hpp"
+#include "movecache.hpp"
 
 namespace c2
 {
@@ -48,6 +51,36 @@ namespace c2
   };
   inline std::uint8_t num(GameStateType s) {return static_cast<std::uint8_t>(s);}
 
+  //Quick global functions for telling what a state is waiting on
+  inline bool isMoveState(GameStateType s)
+  {
+    return s == GameStateType::WHITE_MOVE || s == GameStateType::BLACK_MOVE ||
+      s == GameStateType::WHITE_KINGMOVE || s == GameStateType::BLACK_KINGMOVE;
+  }
+  inline bool isKingMoveState(GameStateType s)
+  {
+    return s == GameStateType::WHITE_KINGMOVE ||
+      s == GameStateType::BLACK_KINGMOVE;
+  }
+  inline bool isDuelState(GameStateType s)
+  {
+    return s == GameStateType::WHITE_DUEL || s == GameStateType::BLACK_DUEL;
+  }
+  inline bool isBidState(GameStateType s)
+  {
+    return s == GameStateType::BOTH_BID || s == GameStateType::WHITE_BID ||
+      s == GameStateType::BLACK_BID;
+  }
+  inline bool isPromoteState(GameStateType s)
+  {
+    return s == GameStateType::WHITE_PROMOTE ||
+      s == GameStateType::BLACK_PROMOTE;
+  }
+  inline bool isGameOver(GameStateType s)
+  {
+    return s >= GameStateType::WHITE_WIN_CHECKMATE;
+  }
+
   enum class GameReturnType : std::uint8_t
   {
     SUCCESS,
@@ -63,10 +96,56 @@ namespace c2
     GAME_OVER_DRAW
   };
 
+  //Game over returns still mean the call itself went through
+  inline bool succeeded(GameReturnType r)
+  {
+    return r == GameReturnType::SUCCESS ||
+      r == GameReturnType::GAME_OVER_WHITE_WIN ||
+      r == GameReturnType::GAME_OVER_BLACK_WIN ||
+      r == GameReturnType::GAME_OVER_DRAW;
+  }
+
   //This is usually an invalid position, but telling a 2kings king to move here
   //during a king turn will instruct the game to skip that king turn.
   const Position KINGMOVE_SKIP_POS(9, 9);
 
+  //Everything about a game in progress except its move history, enough to
+  //carry on playing from the same point with Game::restore
+  struct GameSnapshot
+  {
+    GameStateType state;
+    ArmyType whiteArmy;
+    ArmyType blackArmy;
+    std::uint8_t whiteStones;
+    std::uint8_t blackStones;
+
+    //Bets in a duel, 3 if not made
+    std::uint8_t whiteBet;
+    std::uint8_t blackBet;
+
+    bool whiteKingCastle;
+    bool whiteQueenCastle;
+    bool blackKingCastle;
+    bool blackQueenCastle;
+    bool isKingTurn;
+    std::uint8_t fiftyMoveRule;
+
+    //Squares moved from or to so far, see Game::_touched
+    std::uint64_t touched;
+
+    //The last move made, for en passant. Type NONE if there was none.
+    Move lastMove;
+
+    //The move being resolved and what it took, during duels and promotions
+    Move currentMove;
+    Piece justTaken;
+
+    //Every piece on the board
+    std::vector<Piece> pieces;
+  };
+
+  class GameObserver;
+
   class Game
   {
   public:
@@ -102,10 +181,45 @@ namespace c2
     //Promotes a pawn if one just reached the back
     GameReturnType promote(PieceType newType);
 
+    //Copies out the whole state of a game in progress
+    GameSnapshot snapshot() const;
+
+    //Replaces the board and state with a snapshot. Needs a board, and the
+    //snapshot must be from a game that has started. Move history is lost,
+    //apart from the last move. If the legal moves in the snapshot are
+    //already known, passing them in saves working them out again.
+    GameReturnType restore(const GameSnapshot& s,
+                           const std::vector<Move>* legal = nullptr);
+
+    //Registers an observer to hear about every successful state change
+    //Pass nullptr to stop observing. The observer is not owned.
+    void setObserver(GameObserver* o) {_observer = o;}
+
+    //Whether legal moves are shared with other games through moveCache().
+    //On by default. Games that visit positions no real game reaches, such
+    //as a tablebase solver's, turn it off so they don't crowd the cache.
+    void setShareMoves(bool share) {_shareMoves = share;}
+
+    //Whether every legal move is worked out at the end of each turn and
+    //kept for the next, see legalMoves(). On by default. Games that only
+    //replay calls, such as one reading games back, turn it off: a move is
+    //then checked on its own, and the checkmate test stops at the first
+    //reply. legalMoves() still works, building the list when asked.
+    void setKeepMoves(bool keep) {_keepMoves = keep;}
+
     //Other helpful functions
     //Provides the set of possible positions a piece can move to
     std::set<Position> possibleMoves(Position pos);
 
+    //Provides every legal move for the side currently moving, in a fixed
+    //order: pieces by board square, then destinations by board square.
+    //During a king turn this is the king moves followed by the skip move.
+    //Empty when the game is not waiting on a move.
+    //The list is kept for the rest of the turn. It is usually already built
+    //by the checkmate test at the end of the previous turn, and positions
+    //seen before in any game find it in moveCache().
+    std::vector<Move> legalMoves();
+
     //Accessors
     GameStateType state() const {return _state;}
     std::uint8_t stones(SideType side) const;
@@ -113,8 +227,46 @@ namespace c2
     ArmyType army(SideType side) const;
     size_t numMoves() const {return _moves.size();}
     Move getMove(size_t i) const {return _moves[i];}
+    Piece justTaken() const {return _justTaken;}
+
+    //A 64 bit Zobrist hash of everything that decides how play can go on
+    //from here: pieces, state, armies, stones, castling, en passant, which
+    //pawns can still double step, any pending duel and the fifty move
+    //counter. Only move counts are left out.
+    std::uint64_t hash() const;
+
+    //The same, but without the fifty move counter, so positions reached
+    //by different move orders match. For opening books and search tables.
+    std::uint64_t transpositionHash() const;
     
   private:
+    //The body of move(), which notifies the observer on success
+    GameReturnType makeMove(const Move& m);
+
+    //The part of hash() that is down to the position alone: pieces, armies,
+    //stones, castling and en passant
+    std::uint64_t positionHash() const;
+
+    //The key in moveCache() for the moves a side has here, or only its kings
+    //for a king turn, whoever's turn it actually is
+    std::uint64_t legalKey(SideType side, bool kingTurn) const;
+
+    //The squares a piece could move to if its own kings' safety didn't
+    //matter, which is possibleMoves() without the check test
+    std::set<Position> reachableMoves(Position pos);
+
+    //The check test: whether moving a piece to dest leaves no enemy piece
+    //able to reach one of its side's kings
+    bool keepsKingSafe(const Piece& p, Position dest);
+
+    //The checkmate test at the end of mover's turn, without working out
+    //every reply. Returns the side that has won, or NONE.
+    SideType mateWinner(SideType mover);
+
+    //Finds the moves for the side to move, from moveCache() if it has them.
+    //Null if the game is not waiting on a move.
+    std::shared_ptr<const LegalMoves> findLegal();
+
     //Helper for pre-game state settings
     //Call after changing the board or armies
     void setPreGameState();
@@ -141,6 +293,10 @@ namespace c2
     //Complete move history
     std::vector<Move> _moves;
 
+    //Squares that any move has started or ended on, one bit per square
+    //A pawn can only take two steps if its square is untouched
+    std::uint64_t _touched;
+
     //Current player bets, if duelling
     //A 3 indicates that no choice has been made yet
     std::uint8_t _whiteBet;
@@ -166,6 +322,34 @@ namespace c2
     //If this is set, this is a dummy game set up for possibleMoves
     //and no further recursion should be made.
     bool _dummy;
+
+    //Whether moveCache() is used, see setShareMoves()
+    bool _shareMoves;
+
+    //Whether each turn's legal moves are worked out up front, see
+    //setKeepMoves()
+    bool _keepMoves;
+
+    //Every legal move for the current turn, or null if not yet known
+    std::shared_ptr<const LegalMoves> _legal;
+
+    //Told about each successful call, unless this is a dummy game
+    GameObserver* _observer;
+  };
+
+  //Implement this to follow a game as it is played, for example to write it
+  //out as it goes. Each function is called after the Game has been updated.
+  //A duel against an attacker with no stones is resolved with forced bids,
+  //which are reported after the duel itself.
+  class GameObserver
+  {
+  public:
+    virtual ~GameObserver() {};
+    virtual void moved(const Game& /*g*/, const Move& /*m*/) {}
+    virtual void duelChosen(const Game& /*g*/, bool /*d*/) {}
+    virtual void bid(const Game& /*g*/, SideType /*side*/,
+                     std::uint8_t /*stones*/) {}
+    virtual void promoted(const Game& /*g*/, PieceType /*newType*/) {}
   };
 
 } //Namespace
@@ -0,0 +1,338 @@
+/*
+  Copyright (c) 2014 Auston Sterling
+  See license.txt for copying permission.
+
+  -----GameRecord Class Implementation-----
+  Auston Sterling
+  austonst@gmail.com
+
+  A compact, replayable record of a game of Chess 2.
+*/
+
+#include "gamerecord.hpp"
+#include "bitboard.hpp"
+
+namespace c2
+{
+
+  static bool sameMove(const Move& m1, const Move& m2)
+  {
+    return m1.start == m2.start && m1.end == m2.end &&
+      m1.type == m2.type && m1.side == m2.side;
+  }
+
+  GameReturnType applyEvent(Game& g, const GameEvent& e)
+  {
+    switch (e.type)
+      {
+      case EventType::MOVE: return g.move(e.move);
+      case EventType::DUEL: return g.startDuel(e.value != 0);
+      case EventType::BID: return g.bid(e.side, e.value);
+      case EventType::PROMOTE: return g.promote(static_cast<PieceType>(e.value));
+      }
+    return GameReturnType::INVALID_PARAM;
+  }
+
+  void putVarint(std::vector<std::uint8_t>& out, std::uint64_t v)
+  {
+    while (v >= 0x80)
+      {
+        out.push_back(0x80 | (v & 0x7F));
+        v >>= 7;
+      }
+    out.push_back(v);
+  }
+
+  bool getVarint(const std::uint8_t* data, std::size_t size, std::size_t& pos,
+                 std::uint64_t& v)
+  {
+    v = 0;
+    for (int shift = 0; shift < 64; shift += 7)
+      {
+        if (pos >= size) return false;
+        std::uint8_t b = data[pos++];
+        v |= std::uint64_t(b & 0x7F) << shift;
+        if (!(b & 0x80)) return true;
+      }
+    return false;
+  }
+
+  void putLE(std::uint8_t* out, std::uint64_t v, std::size_t bytes)
+  {
+    for (std::size_t i = 0; i < bytes; i++)
+      {
+        out[i] = v & 0xFF;
+        v >>= 8;
+      }
+  }
+
+  std::uint64_t getLE(const std::uint8_t* in, std::size_t bytes)
+  {
+    std::uint64_t v = 0;
+    for (std::size_t i = bytes; i > 0; i--)
+      {
+        v = (v << 8) | in[i-1];
+      }
+    return v;
+  }
+
+  GameRecord::GameRecord(ArmyType white, ArmyType black) :
+    _whiteArmy(white), _blackArmy(black) {}
+
+  void GameRecord::move(const Move& m)
+  {
+    GameEvent e;
+    e.type = EventType::MOVE;
+    e.move = m;
+    e.side = m.side;
+    e.value = 0;
+    _events.push_back(e);
+  }
+
+  void GameRecord::startDuel(bool d)
+  {
+    GameEvent e;
+    e.type = EventType::DUEL;
+    e.side = SideType::NONE;
+    e.value = d ? 1 : 0;
+    _events.push_back(e);
+  }
+
+  void GameRecord::bid(SideType side, std::uint8_t stones)
+  {
+    GameEvent e;
+    e.type = EventType::BID;
+    e.side = side;
+    e.value = stones;
+    _events.push_back(e);
+  }
+
+  void GameRecord::promote(PieceType newType)
+  {
+    GameEvent e;
+    e.type = EventType::PROMOTE;
+    e.side = SideType::NONE;
+    e.value = num(newType);
+    _events.push_back(e);
+  }
+
+  ArmyType GameRecord::army(SideType side) const
+  {
+    if (side == SideType::WHITE) return _whiteArmy;
+    if (side == SideType::BLACK) return _blackArmy;
+    return ArmyType::NONE;
+  }
+
+  void GameRecord::clear(ArmyType white, ArmyType black)
+  {
+    _whiteArmy = white;
+    _blackArmy = black;
+    _events.clear();
+  }
+
+  GameReturnType GameRecord::replay(Game& g) const
+  {
+    GameReturnType r = g.setArmy(SideType::WHITE, _whiteArmy);
+    if (r != GameReturnType::SUCCESS) return r;
+    r = g.setArmy(SideType::BLACK, _blackArmy);
+    if (r != GameReturnType::SUCCESS) return r;
+    r = g.start();
+    if (r != GameReturnType::SUCCESS) return r;
+
+    for (std::size_t i = 0; i < _events.size(); i++)
+      {
+        //Bids forced by a duel against a stoneless attacker were already
+        //made by startDuel, so there is nothing left to apply
+        if (_events[i].type == EventType::BID && !isBidState(g.state()))
+          {
+            continue;
+          }
+        r = applyEvent(g, _events[i]);
+        if (!succeeded(r)) return r;
+      }
+    return GameReturnType::SUCCESS;
+  }
+
+  bool GameRecord::encode(std::vector<std::uint8_t>& out) const
+  {
+    if (_whiteArmy == ArmyType::NONE || _blackArmy == ArmyType::NONE)
+      {
+        return false;
+      }
+
+    BitBoard board;
+    Game g(&board, _whiteArmy, _blackArmy);
+    if (g.start() != GameReturnType::SUCCESS) return false;
+
+    //Encode the body first so the header can hold the event count
+    std::vector<std::uint8_t> body;
+    std::size_t count = 0;
+    for (std::size_t i = 0; i < _events.size(); i++)
+      {
+        const GameEvent& e = _events[i];
+        GameStateType s = g.state();
+
+        //Forced bids, see replay()
+        if (e.type == EventType::BID && !isBidState(s)) continue;
+
+        if (isMoveState(s))
+          {
+            if (e.type != EventType::MOVE) return false;
+            std::vector<Move> legal = g.legalMoves();
+            std::size_t index = 0;
+            while (index < legal.size() && !sameMove(legal[index], e.move))
+              {
+                index++;
+              }
+            if (index == legal.size()) return false;
+            putVarint(body, index);
+          }
+        else if (isDuelState(s))
+          {
+            if (e.type != EventType::DUEL) return false;
+            body.push_back(e.value ? 1 : 0);
+          }
+        else if (isBidState(s))
+          {
+            if (e.type != EventType::BID) return false;
+            body.push_back((num(e.side) << 2) | (e.value & 0x03));
+          }
+        else if (isPromoteState(s))
+          {
+            if (e.type != EventType::PROMOTE) return false;
+            body.push_back(e.value);
+          }
+        else
+          {
+            return false;
+          }
+
+        if (!succeeded(applyEvent(g, e))) return false;
+        count++;
+      }
+
+    out.push_back(num(_whiteArmy) | (num(_blackArmy) << 4));
+    out.push_back(num(g.state()));
+    putVarint(out, count);
+    out.insert(out.end(), body.begin(), body.end());
+    return true;
+  }
+
+  RecordReader::RecordReader(const std::uint8_t* data, std::size_t size) :
+    _data(data), _size(size), _valid(false), _whiteArmy(ArmyType::NONE),
+    _blackArmy(ArmyType::NONE), _result(GameStateType::SET_BOARD),
+    _numEvents(0), _pos(0), _bodyStart(0), _eventsRead(0)
+  {
+    if (!_data || _size < 3) return;
+
+    //Check that the header makes sense before trusting it
+    std::uint8_t white = _data[0] & 0x0F;
+    std::uint8_t black = _data[0] >> 4;
+    if (white >= NUM_ARMIES || black >= NUM_ARMIES ||
+        _data[1] >= NUM_GAMESTATES)
+      {
+        return;
+      }
+    std::size_t pos = 2;
+    std::uint64_t count;
+    if (!getVarint(_data, _size, pos, count)) return;
+
+    _whiteArmy = toArmy(white);
+    _blackArmy = toArmy(black);
+    _result = static_cast<GameStateType>(_data[1]);
+    _numEvents = count;
+    _bodyStart = _pos = pos;
+    _valid = true;
+  }
+
+  ArmyType RecordReader::army(SideType side) const
+  {
+    if (side == SideType::WHITE) return _whiteArmy;
+    if (side == SideType::BLACK) return _blackArmy;
+    return ArmyType::NONE;
+  }
+
+  GameReturnType RecordReader::start(Game& g)
+  {
+    if (!_valid) return GameReturnType::INVALID_PARAM;
+    _pos = _bodyStart;
+    _eventsRead = 0;
+
+    GameReturnType r = g.setArmy(SideType::WHITE, _whiteArmy);
+    if (r != GameReturnType::SUCCESS) return r;
+    r = g.setArmy(SideType::BLACK, _blackArmy);
+    if (r != GameReturnType::SUCCESS) return r;
+    return g.start();
+  }
+
+  bool RecordReader::next(Game& g, GameEvent& e)
+  {
+    if (!_valid || _eventsRead >= _numEvents) return false;
+
+    GameStateType s = g.state();
+    e.side = SideType::NONE;
+    e.value = 0;
+    e.move = Move();
+    if (isMoveState(s))
+      {
+        std::uint64_t index;
+        if (!getVarint(_data, _size, _pos, index)) return false;
+        std::vector<Move> legal = g.legalMoves();
+        if (index >= legal.size()) return false;
+        e.type = EventType::MOVE;
+        e.move = legal[index];
+        e.side = e.move.side;
+      }
+    else
+      {
+        if (_pos >= _size) return false;
+        std::uint8_t b = _data[_pos++];
+        if (isDuelState(s))
+          {
+            e.type = EventType::DUEL;
+            e.value = b;
+          }
+        else if (isBidState(s))
+          {
+            e.type = EventType::BID;
+            e.side = static_cast<SideType>(b >> 2);
+            e.value = b & 0x03;
+          }
+        else if (isPromoteState(s))
+          {
+            e.type = EventType::PROMOTE;
+            e.value = b;
+          }
+        else
+          {
+            return false;
+          }
+      }
+
+    if (!succeeded(applyEvent(g, e))) return false;
+    _eventsRead++;
+    return true;
+  }
+
+  bool RecordReader::decode(Game& g, GameRecord& rec)
+  {
+    if (start(g) != GameReturnType::SUCCESS) return false;
+    rec.clear(_whiteArmy, _blackArmy);
+
+    GameEvent e;
+    while (next(g, e))
+      {
+        switch (e.type)
+          {
+          case EventType::MOVE: rec.move(e.move); break;
+          case EventType::DUEL: rec.startDuel(e.value != 0); break;
+          case EventType::BID: rec.bid(e.side, e.value); break;
+          case EventType::PROMOTE:
+            rec.promote(static_cast<PieceType>(e.value));
+            break;
+          }
+      }
+    return _eventsRead == _numEvents;
+  }
+
+} //Namespace
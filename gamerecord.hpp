@@ -0,0 +1,151 @@
+/*
+  Copyright (c) 2014 Auston Sterling
+  See license.txt for copying permission.
+
+  -----GameRecord Class Header-----
+  Auston Sterling
+  austonst@gmail.com
+
+  A compact, replayable record of a game of Chess 2.
+
+  A record is the two armies followed by every event that happened: moves
+  (including king turn moves and skips), duel decisions, bids and promotions.
+  The binary form leans on the Game state machine to know what kind of event
+  comes next, so no event needs a tag:
+
+  header       - 1B white army | black army << 4, 1B final GameStateType,
+                 varint number of events
+  *_MOVE       - varint index into Game::legalMoves()
+  *_KINGMOVE   - varint index into Game::legalMoves() (skip is the last entry)
+  *_DUEL       - 1B (0 == no, 1 == yes)
+  *_BID        - 1B side << 2 | stones
+  *_PROMOTE    - 1B PieceType
+
+  Varints are 7 bits per byte, low bits first, high bit set on all but the
+  last byte. Almost every move index fits in one byte.
+*/
+
+#ifndef _gamerecord_hpp_
+#define _gamerecord_hpp_
+
+#include <vector>
+
+#include "game.hpp"
+
+namespace c2
+{
+
+  enum class EventType : std::uint8_t
+  {
+    MOVE,
+    DUEL,
+    BID,
+    PROMOTE
+  };
+
+  //One state-progressing call made on a Game
+  struct GameEvent
+  {
+    EventType type;
+
+    //MOVE: the move made
+    Move move;
+
+    //BID: the side bidding
+    SideType side;
+
+    //DUEL: 0 or 1, BID: stones, PROMOTE: the PieceType
+    std::uint8_t value;
+  };
+
+  class GameRecord
+  {
+  public:
+    //Constructors
+    GameRecord(ArmyType white = ArmyType::NONE,
+               ArmyType black = ArmyType::NONE);
+
+    //Appending events, mirroring the Game functions
+    //These do no checking; encode() will fail on an illegal record
+    void move(const Move& m);
+    void startDuel(bool d);
+    void bid(SideType side, std::uint8_t stones);
+    void promote(PieceType newType);
+
+    //Accessors
+    ArmyType army(SideType side) const;
+    const std::vector<GameEvent>& events() const {return _events;}
+    void clear(ArmyType white, ArmyType black);
+
+    //Sets up the armies on a game and starts it, then applies events
+    //Returns the first failing return, or SUCCESS
+    GameReturnType replay(Game& g) const;
+
+    //Appends the binary form onto out. The record is replayed on a scratch
+    //board to find move indices. Returns false if any event is illegal.
+    bool encode(std::vector<std::uint8_t>& out) const;
+
+  private:
+    ArmyType _whiteArmy;
+    ArmyType _blackArmy;
+    std::vector<GameEvent> _events;
+  };
+
+  //Walks a binary record in place, decoding each event against a Game
+  class RecordReader
+  {
+  public:
+    //Constructors
+    //The data is not copied and must outlive the reader
+    RecordReader(const std::uint8_t* data = nullptr, std::size_t size = 0);
+
+    //Header fields, available without any replaying
+    bool isValid() const {return _valid;}
+    ArmyType army(SideType side) const;
+    GameStateType result() const {return _result;}
+    std::size_t numEvents() const {return _numEvents;}
+    const std::uint8_t* data() const {return _data;}
+    std::size_t size() const {return _size;}
+
+    //Sets the armies on a fresh game and starts it
+    GameReturnType start(Game& g);
+
+    //Decodes the next event, applies it to g and stores it in e
+    //Returns false at the end of the record or on corrupt data
+    bool next(Game& g, GameEvent& e);
+
+    //Decodes the whole record into a GameRecord using g as scratch
+    bool decode(Game& g, GameRecord& rec);
+
+  private:
+    const std::uint8_t* _data;
+    std::size_t _size;
+
+    //Header contents
+    bool _valid;
+    ArmyType _whiteArmy;
+    ArmyType _blackArmy;
+    GameStateType _result;
+    std::size_t _numEvents;
+
+    //Decoding progress
+    std::size_t _pos;
+    std::size_t _bodyStart;
+    std::size_t _eventsRead;
+  };
+
+  //Makes the call on g that an event stands for
+  GameReturnType applyEvent(Game& g, const GameEvent& e);
+
+  //Varint helpers, shared with the archive format
+  void putVarint(std::vector<std::uint8_t>& out, std::uint64_t v);
+  bool getVarint(const std::uint8_t* data, std::size_t size, std::size_t& pos,
+                 std::uint64_t& v);
+
+  //Fixed width little-endian helpers for the file formats
+  void putLE(std::uint8_t* out, std::uint64_t v, std::size_t bytes);
+  std::uint64_t getLE(const std::uint8_t* in, std::size_t bytes);
+
+} //Namespace
+
+#endif
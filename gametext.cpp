@@ -0,0 +1,574 @@
+/*
+  Copyright (c) 2014 Auston Sterling
+  See license.txt for copying permission.
+
+  -----GameText Class Implementation-----
+  Auston Sterling
+  austonst@gmail.com
+
+  A human readable game format in the spirit of PGN.
+*/
+
+#include "gametext.hpp"
+
+#include <sstream>
+
+namespace c2
+{
+
+  //Longest line written, not counting the newline
+  static const std::size_t TEXT_LINE_WIDTH = 79;
+
+  static std::string resultText(GameStateType s)
+  {
+    if (s == GameStateType::WHITE_WIN_CHECKMATE ||
+        s == GameStateType::WHITE_WIN_MIDLINE)
+      {
+        return "1-0";
+      }
+    if (s == GameStateType::BLACK_WIN_CHECKMATE ||
+        s == GameStateType::BLACK_WIN_MIDLINE)
+      {
+        return "0-1";
+      }
+    if (s == GameStateType::DRAW_THREEFOLD ||
+        s == GameStateType::DRAW_FIFTYMOVE)
+      {
+        return "1/2-1/2";
+      }
+    return "*";
+  }
+
+  static bool isResult(const std::string& t)
+  {
+    return t == "1-0" || t == "0-1" || t == "1/2-1/2" || t == "*";
+  }
+
+  //Reads a square like e4 at t[i], advancing i
+  static bool readSquare(const std::string& t, std::size_t& i, Position& p)
+  {
+    if (i + 2 > t.length() || t[i] < 'a' || t[i] > 'h' ||
+        t[i+1] < '1' || t[i+1] > '8')
+      {
+        return false;
+      }
+    p = Position(t[i] - 'a' + 1, t[i+1] - '1' + 1);
+    i += 2;
+    return true;
+  }
+
+  //Puts a backslash before anything that would end a tag value early, which
+  //readTag() takes out again
+  static std::string escapeTag(const std::string& value)
+  {
+    std::string out;
+    for (std::size_t i = 0; i < value.size(); i++)
+      {
+        if (value[i] == '"' || value[i] == '\\' || value[i] == '\n')
+          {
+            out += '\\';
+          }
+        out += value[i];
+      }
+    return out;
+  }
+
+  GameTextWriter::GameTextWriter(std::ostream& out) :
+    _out(out), _column(0), _moveNumber(1), _kingTurnNext(false),
+    _finished(false), _whiteBid(3), _blackBid(3) {}
+
+  void GameTextWriter::setTag(const std::string& name, const std::string& value)
+  {
+    _tags.push_back(std::make_pair(name, value));
+  }
+
+  void GameTextWriter::begin(const Game& g)
+  {
+    for (auto i = _tags.begin(); i != _tags.end(); i++)
+      {
+        _out << '[' << i->first << " \"" << escapeTag(i->second) << "\"]\n";
+      }
+    _out << "[WhiteArmy \"" << ARMY_NAME[num(g.army(SideType::WHITE))]
+         << "\"]\n";
+    _out << "[BlackArmy \"" << ARMY_NAME[num(g.army(SideType::BLACK))]
+         << "\"]\n\n";
+
+    _column = 0;
+    _moveNumber = 1;
+    _kingTurnNext = isKingMoveState(g.state());
+    _finished = false;
+    _whiteBid = _blackBid = 3;
+  }
+
+  void GameTextWriter::end(const Game& g)
+  {
+    if (_finished) return;
+    write(resultText(g.state()), false);
+    _out << "\n\n";
+    _out.flush();
+    _finished = true;
+  }
+
+  void GameTextWriter::moved(const Game& g, const Move& m)
+  {
+    if (_finished) return;
+
+    std::string token;
+    if (_kingTurnNext)
+      {
+        token = "&";
+      }
+    else if (m.side == SideType::WHITE)
+      {
+        std::stringstream ss;
+        ss << _moveNumber++ << '.';
+        write(ss.str(), false);
+      }
+
+    if (m.end == KINGMOVE_SKIP_POS)
+      {
+        token += "--";
+      }
+    else
+      {
+        if (PIECE_LETTER[num(m.type)] != ' ')
+          {
+            token += PIECE_LETTER[num(m.type)];
+          }
+        token += m.start.notation();
+        token += g.justTaken().type() == PieceType::NONE ? '-' : 'x';
+        token += m.end.notation();
+      }
+    write(token, false);
+
+    _kingTurnNext = isKingMoveState(g.state());
+    checkOver(g);
+  }
+
+  void GameTextWriter::duelChosen(const Game& g, bool d)
+  {
+    if (_finished) return;
+    if (!d)
+      {
+        write("[-]", true);
+      }
+    _whiteBid = _blackBid = 3;
+    _kingTurnNext = isKingMoveState(g.state());
+    checkOver(g);
+  }
+
+  void GameTextWriter::bid(const Game& g, SideType side, std::uint8_t stones)
+  {
+    if (_finished) return;
+    if (side == SideType::WHITE) _whiteBid = stones;
+    if (side == SideType::BLACK) _blackBid = stones;
+
+    //Both bids go out together once known
+    if (_whiteBid < 3 && _blackBid < 3)
+      {
+        std::stringstream ss;
+        ss << '[' << int(_whiteBid) << '/' << int(_blackBid) << ']';
+        write(ss.str(), true);
+        _whiteBid = _blackBid = 3;
+      }
+    _kingTurnNext = isKingMoveState(g.state());
+    checkOver(g);
+  }
+
+  void GameTextWriter::promoted(const Game& g, PieceType newType)
+  {
+    if (_finished) return;
+    write(std::string("=") + PIECE_LETTER[num(newType)], true);
+    _kingTurnNext = isKingMoveState(g.state());
+    checkOver(g);
+  }
+
+  void GameTextWriter::write(const std::string& token, bool attach)
+  {
+    if (!attach && _column > 0)
+      {
+        if (_column + 1 + token.length() > TEXT_LINE_WIDTH)
+          {
+            _out << '\n';
+            _column = 0;
+          }
+        else
+          {
+            _out << ' ';
+            _column++;
+          }
+      }
+    _out << token;
+    _column += token.length();
+  }
+
+  void GameTextWriter::checkOver(const Game& g)
+  {
+    if (!isGameOver(g.state())) return;
+    end(g);
+  }
+
+  GameTextReader::GameTextReader(std::size_t bufferSize) :
+    _file(nullptr), _ownFile(false), _buf(bufferSize), _begin(0), _end(0),
+    _line(1) {}
+
+  GameTextReader::~GameTextReader()
+  {
+    if (_ownFile && _file) std::fclose(_file);
+  }
+
+  bool GameTextReader::open(const std::string& path)
+  {
+    std::FILE* f = std::fopen(path.c_str(), "rb");
+    if (!f) return false;
+    attach(f);
+    _ownFile = true;
+    return true;
+  }
+
+  void GameTextReader::attach(std::FILE* f)
+  {
+    if (_ownFile && _file) std::fclose(_file);
+    _file = f;
+    _ownFile = false;
+    _begin = _end = 0;
+    _line = 1;
+  }
+
+  int GameTextReader::peek()
+  {
+    if (_begin == _end)
+      {
+        if (!_file || _buf.empty()) return -1;
+        _begin = 0;
+        _end = std::fread(&_buf[0], 1, _buf.size(), _file);
+        if (_end == 0) return -1;
+      }
+    return static_cast<unsigned char>(_buf[_begin]);
+  }
+
+  int GameTextReader::get()
+  {
+    int c = peek();
+    if (c >= 0)
+      {
+        _begin++;
+        if (c == '\n') _line++;
+      }
+    return c;
+  }
+
+  void GameTextReader::skipSpace()
+  {
+    while (true)
+      {
+        int c = peek();
+        if (c == '{')
+          {
+            get();
+            while (c >= 0 && c != '}') c = get();
+            continue;
+          }
+        if (c != ' ' && c != '\t' && c != '\n' && c != '\r')
+          {
+            return;
+          }
+        get();
+      }
+  }
+
+  bool GameTextReader::readToken()
+  {
+    _token.clear();
+    skipSpace();
+    int c = peek();
+    while (c >= 0 && c != ' ' && c != '\t' && c != '\n' && c != '\r' &&
+           c != '{')
+      {
+        _token += static_cast<char>(get());
+        c = peek();
+      }
+    return !_token.empty();
+  }
+
+  bool GameTextReader::readTag()
+  {
+    //[Name "Value"], where the value may contain spaces, and a backslash
+    //before any character, even a newline, takes it as it is
+    if (get() != '[') return false;
+    std::string name, value;
+    int c = get();
+    while (c >= 0 && c != ' ' && c != ']' && c != '\n')
+      {
+        name += static_cast<char>(c);
+        c = get();
+      }
+    while (c == ' ') c = get();
+    if (c != '"') return false;
+    c = get();
+    while (c >= 0 && c != '"' && c != '\n')
+      {
+        if (c == '\\') c = get();
+        if (c >= 0) value += static_cast<char>(c);
+        c = get();
+      }
+    if (c != '"') return false;
+    while (peek() == ' ') get();
+    if (get() != ']') return false;
+    _tags.push_back(std::make_pair(name, value));
+    return true;
+  }
+
+  TextReadType GameTextReader::next(GameRecord& rec)
+  {
+    _tags.clear();
+    _result.clear();
+    _error.clear();
+
+    skipSpace();
+    if (peek() < 0) return TextReadType::END_OF_INPUT;
+
+    //Tags come first
+    while (peek() == '[')
+      {
+        if (!readTag()) return fail("Malformed tag");
+        skipSpace();
+      }
+
+    ArmyType army[2] = {ArmyType::NONE, ArmyType::NONE};
+    for (auto i = _tags.begin(); i != _tags.end(); i++)
+      {
+        int side = -1;
+        if (i->first == "WhiteArmy") side = 0;
+        if (i->first == "BlackArmy") side = 1;
+        if (side < 0) continue;
+        for (std::uint8_t a = 0; a < NUM_ARMIES; a++)
+          {
+            if (ARMY_NAME[a] == i->second) army[side] = toArmy(a);
+          }
+      }
+    if (army[0] == ArmyType::NONE || army[1] == ArmyType::NONE)
+      {
+        return fail("Missing or unknown army tag");
+      }
+
+    //Play the movetext out on a fresh game
+    //Only the moves played are checked, not every move there was
+    Game g(&_board, army[0], army[1]);
+    g.setKeepMoves(false);
+    if (g.start() != GameReturnType::SUCCESS) return fail("Could not start");
+    rec.clear(army[0], army[1]);
+    while (true)
+      {
+        skipSpace();
+        if (peek() == '[') return fail("Missing result");
+        if (!readToken()) return fail("Unexpected end of input");
+
+        if (isResult(_token))
+          {
+            //A finished game must agree with its result, but an unfinished
+            //one may have been resigned or adjourned
+            if (isGameOver(g.state()) && _token != resultText(g.state()))
+              {
+                _error = "Result does not match the game";
+                return TextReadType::INVALID_GAME;
+              }
+            _result = _token;
+            return TextReadType::GAME;
+          }
+
+        //Move numbers are only there for people
+        if (_token[_token.length()-1] == '.') continue;
+
+        if (!playToken(g, rec)) return fail(_error);
+      }
+  }
+
+  bool GameTextReader::playToken(Game& g, GameRecord& rec)
+  {
+    const std::string& t = _token;
+    std::size_t i = 0;
+    if (isGameOver(g.state()))
+      {
+        _error = "Move after the end of the game";
+        return false;
+      }
+
+    //A duel or promotion left pending is only fine at the end of a game
+    if (isDuelState(g.state()))
+      {
+        _error = "Missing duel annotation";
+        return false;
+      }
+    if (isPromoteState(g.state()))
+      {
+        _error = "Missing promotion";
+        return false;
+      }
+
+    //King turns must be marked, and only king turns
+    bool kingTurn = t[0] == '&';
+    if (kingTurn) i++;
+    if (kingTurn != isKingMoveState(g.state()))
+      {
+        _error = kingTurn ? "King turn out of place" : "Missing king turn";
+        return false;
+      }
+
+    //The game checks the move itself, so all that is needed to make it is
+    //the piece on its start square
+    SideType side = g.state() == GameStateType::WHITE_MOVE ||
+      g.state() == GameStateType::WHITE_KINGMOVE ? SideType::WHITE :
+      SideType::BLACK;
+    Move m;
+    if (t.compare(i, std::string::npos, "--") == 0)
+      {
+        std::vector<Position> kings = _board.getKing(side);
+        if (!kingTurn || kings.empty())
+          {
+            _error = "Skip outside of a king turn";
+            return false;
+          }
+        m = Move(kings[0], KINGMOVE_SKIP_POS, PieceType::TKG_WARRKING, side);
+        i = t.length();
+      }
+    else
+      {
+        char letter = ' ';
+        if (i < t.length() && t[i] >= 'A' && t[i] <= 'Z') letter = t[i++];
+        Position start, end;
+        if (!readSquare(t, i, start) || i >= t.length() ||
+            (t[i] != '-' && t[i] != 'x'))
+          {
+            _error = "Malformed move";
+            return false;
+          }
+        i++;
+        if (!readSquare(t, i, end))
+          {
+            _error = "Malformed move";
+            return false;
+          }
+
+        Piece piece = _board(start);
+        if (piece.side() != side)
+          {
+            _error = "Illegal move";
+            return false;
+          }
+        m = Move(start, end, piece.type(), side);
+        if (letter != PIECE_LETTER[num(m.type)])
+          {
+            _error = "Wrong piece letter";
+            return false;
+          }
+      }
+
+    if (!succeeded(g.move(m)))
+      {
+        _error = "Illegal move";
+        return false;
+      }
+    rec.move(m);
+
+    //Duel annotation
+    bool duel = isDuelState(g.state());
+    if (i < t.length() && t[i] == '[')
+      {
+        if (!duel)
+          {
+            _error = "Duel annotation without a duel";
+            return false;
+          }
+        if (t.compare(i, 3, "[-]") == 0)
+          {
+            g.startDuel(false);
+            rec.startDuel(false);
+            i += 3;
+          }
+        else if (i + 5 <= t.length() && t[i+2] == '/' && t[i+4] == ']' &&
+                 t[i+1] >= '0' && t[i+1] <= '2' && t[i+3] >= '0' &&
+                 t[i+3] <= '2')
+          {
+            if (g.startDuel(true) != GameReturnType::SUCCESS)
+              {
+                _error = "Duel could not start";
+                return false;
+              }
+            rec.startDuel(true);
+
+            //The bids were already made if the attacker had no stones
+            if (isBidState(g.state()))
+              {
+                std::uint8_t white = t[i+1] - '0';
+                std::uint8_t black = t[i+3] - '0';
+                if (g.bid(SideType::WHITE, white) != GameReturnType::SUCCESS ||
+                    g.bid(SideType::BLACK, black) != GameReturnType::SUCCESS)
+                  {
+                    _error = "Invalid bid";
+                    return false;
+                  }
+                rec.bid(SideType::WHITE, white);
+                rec.bid(SideType::BLACK, black);
+              }
+            i += 5;
+          }
+        else
+          {
+            _error = "Malformed duel annotation";
+            return false;
+          }
+      }
+
+    //Promotion
+    bool promote = isPromoteState(g.state());
+    if (i < t.length() && t[i] == '=')
+      {
+        if (!promote || i + 2 != t.length())
+          {
+            _error = "Misplaced promotion";
+            return false;
+          }
+        SideType side = g.state() == GameStateType::WHITE_PROMOTE ?
+          SideType::WHITE : SideType::BLACK;
+        const std::set<PieceType>& options = ARMY_PROMOTE[num(g.army(side))];
+        PieceType type = PieceType::NONE;
+        for (auto k = options.begin(); k != options.end(); k++)
+          {
+            if (PIECE_LETTER[num(*k)] == t[i+1]) type = *k;
+          }
+        if (g.promote(type) != GameReturnType::SUCCESS)
+          {
+            _error = "Invalid promotion";
+            return false;
+          }
+        rec.promote(type);
+        i += 2;
+      }
+
+    if (i != t.length())
+      {
+        _error = "Unexpected characters after move";
+        return false;
+      }
+    return true;
+  }
+
+  TextReadType GameTextReader::fail(const std::string& why)
+  {
+    std::stringstream ss;
+    ss << why << " near line " << _line;
+    _error = ss.str();
+
+    //Skip to this game's result, stopping early at the next game's tags
+    while (true)
+      {
+        skipSpace();
+        if (peek() < 0 || peek() == '[') break;
+        readToken();
+        if (isResult(_token)) break;
+      }
+    return TextReadType::INVALID_GAME;
+  }
+
+} //Namespace
@@ -0,0 +1,160 @@
+/*
+  Copyright (c) 2014 Auston Sterling
+  See license.txt for copying permission.
+
+  -----GameText Class Header-----
+  Auston Sterling
+  austonst@gmail.com
+
+  A human readable game format in the spirit of PGN.
+
+  A game is a block of tags followed by movetext and a result:
+    [Event "Casual"]
+    [WhiteArmy "Animals"]
+    [BlackArmy "Two Kings"]
+
+    1. e2-e4 e7-e5 &Ke8-e7 2. Ng1xe5[1/0] &-- 3. Bf1-b5 Qd8xd2[-] ...
+    1-0
+
+  Moves are long algebraic: the piece letter (none for pawns), the start
+  square, '-' or 'x' for a capture, then the end square. Letters follow the
+  classic piece each one replaces in its army, so an elephant is an R.
+  A warrior king whirlwind goes from its square to the same square.
+  After a capture that offered a duel comes [-] if it was declined, or
+  [white/black] with the stones each side bid. A promotion is written as =Q.
+  Two Kings king turns are prefixed with '&', and &-- skips one.
+  The result is 1-0, 0-1, 1/2-1/2, or * for an unfinished game.
+  Comments in {braces} are ignored.
+
+  To export a GameRecord, attach a writer to a game and replay the record.
+*/
+
+#ifndef _gametext_hpp_
+#define _gametext_hpp_
+
+#include <ostream>
+#include <cstdio>
+#include <utility>
+
+#include "gamerecord.hpp"
+#include "bitboard.hpp"
+
+namespace c2
+{
+
+  typedef std::vector<std::pair<std::string, std::string> > TagList;
+
+  //Writes a game out as it is played
+  class GameTextWriter : public GameObserver
+  {
+  public:
+    //Constructors
+    GameTextWriter(std::ostream& out);
+
+    //Adds a tag to be written by begin(). Army tags are added there too.
+    void setTag(const std::string& name, const std::string& value);
+
+    //Writes out the tags. Call once both armies are set.
+    void begin(const Game& g);
+
+    //Ends the movetext with * if the game has not ended on its own
+    void end(const Game& g);
+
+    //Observer functions, writing each event as it happens
+    void moved(const Game& g, const Move& m);
+    void duelChosen(const Game& g, bool d);
+    void bid(const Game& g, SideType side, std::uint8_t stones);
+    void promoted(const Game& g, PieceType newType);
+
+  private:
+    //Writes a token, starting a new line first if it would be too long
+    //Attached tokens continue the previous one without a space
+    void write(const std::string& token, bool attach);
+
+    //Writes the result if the game is over
+    void checkOver(const Game& g);
+
+    std::ostream& _out;
+    TagList _tags;
+    std::size_t _column;
+    unsigned _moveNumber;
+    bool _kingTurnNext;
+    bool _finished;
+
+    //Bids seen in the current duel, 3 when not yet made
+    std::uint8_t _whiteBid;
+    std::uint8_t _blackBid;
+  };
+
+  enum class TextReadType : std::uint8_t
+  {
+    GAME,
+    INVALID_GAME,
+    END_OF_INPUT
+  };
+
+  //Reads games one at a time through a fixed size buffer, validating each
+  //one by playing it out on a Game
+  class GameTextReader
+  {
+  public:
+    //Constructors
+    GameTextReader(std::size_t bufferSize = 1 << 16);
+    ~GameTextReader();
+    GameTextReader(const GameTextReader&) = delete;
+    GameTextReader& operator=(const GameTextReader&) = delete;
+
+    //Opens a file to read from
+    bool open(const std::string& path);
+
+    //Reads from an already open file, which is not closed afterwards
+    void attach(std::FILE* f);
+
+    //Reads the next game into rec. An invalid game is skipped up to its
+    //result and error() says what was wrong with it.
+    TextReadType next(GameRecord& rec);
+
+    //Information about the last game read
+    const TagList& tags() const {return _tags;}
+    const std::string& result() const {return _result;}
+    const std::string& error() const {return _error;}
+    std::size_t line() const {return _line;}
+
+  private:
+    //Character access, refilling the buffer as needed. -1 at the end.
+    int peek();
+    int get();
+
+    //Skips whitespace and comments
+    void skipSpace();
+
+    //Reads the next whitespace delimited token into _token
+    bool readToken();
+
+    //Reads a [Name "Value"] tag
+    bool readTag();
+
+    //Handles one movetext token, returning false if the game is invalid
+    bool playToken(Game& g, GameRecord& rec);
+
+    //Marks the game invalid and skips the rest of it
+    TextReadType fail(const std::string& why);
+
+    std::FILE* _file;
+    bool _ownFile;
+    std::vector<char> _buf;
+    std::size_t _begin;
+    std::size_t _end;
+    std::size_t _line;
+
+    std::string _token;
+    TagList _tags;
+    std::string _result;
+    std::string _error;
+
+    BitBoard _board;
+  };
+
+} //Namespace
+
+#endif
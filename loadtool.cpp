@@ -0,0 +1,272 @@
+/*
+  Copyright (c) 2014 Auston Sterling
+  See license.txt for copying permission.
+
+  -----Lobby Load Tool-----
+  Auston Sterling
+  austonst@gmail.com
+
+  Floods a game server's lobby with players to see how fast it matches
+  them. Each player connects, sends a seek message with a random rating and
+  army, and hangs up once told its game. A new player takes its place until
+  the total is reached.
+
+  chess2-load [-h host] [-p port] [-c players at once] [-n players]
+              [-r lowest rating] [-R highest rating]
+*/
+
+#include "netgame.hpp"
+
+#include <sys/socket.h>
+#include <sys/epoll.h>
+#include <sys/resource.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <netdb.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <cerrno>
+#include <cstring>
+#include <algorithm>
+#include <chrono>
+#include <iostream>
+#include <memory>
+#include <random>
+#include <vector>
+
+using namespace c2;
+
+typedef std::chrono::steady_clock Clock;
+
+//A player being simulated
+struct LoadPlayer
+{
+  LoadPlayer() : fd(-1), in(0), connected(false) {}
+
+  int fd;
+  FrameReader in;
+  bool connected;
+  Clock::time_point sought;
+};
+
+static void usage()
+{
+  std::cerr << "Usage:\n"
+            << "  chess2-load [-h host] [-p port] [-c players at once] "
+            << "[-n players]\n"
+            << "              [-r lowest rating] [-R highest rating]\n";
+}
+
+//Starts connecting a player, returning false if that failed
+static bool start(LoadPlayer& p, int epollFd, const addrinfo* addr)
+{
+  p.fd = socket(addr->ai_family, addr->ai_socktype | SOCK_NONBLOCK,
+                addr->ai_protocol);
+  if (p.fd < 0) return false;
+
+  //Hanging up resets the connection, so thousands of players don't leave
+  //thousands of ports waiting to close
+  linger hard;
+  hard.l_onoff = 1;
+  hard.l_linger = 0;
+  setsockopt(p.fd, SOL_SOCKET, SO_LINGER, &hard, sizeof(hard));
+  int yes = 1;
+  setsockopt(p.fd, IPPROTO_TCP, TCP_NODELAY, &yes, sizeof(yes));
+
+  if (connect(p.fd, addr->ai_addr, addr->ai_addrlen) < 0 &&
+      errno != EINPROGRESS)
+    {
+      close(p.fd);
+      p.fd = -1;
+      return false;
+    }
+  epoll_event ev;
+  ev.events = EPOLLOUT | EPOLLIN;
+  ev.data.ptr = &p;
+  p.connected = false;
+  p.in.clear();
+  return epoll_ctl(epollFd, EPOLL_CTL_ADD, p.fd, &ev) == 0;
+}
+
+static void finish(LoadPlayer& p)
+{
+  if (p.fd >= 0) close(p.fd);
+  p.fd = -1;
+}
+
+int main(int argc, char* argv[])
+{
+  std::string host = "127.0.0.1";
+  std::string port = DEFAULT_PORT;
+  std::size_t parallel = 256;
+  std::size_t total = 20000;
+  long lowest = 1000;
+  long highest = 2000;
+  for (int i = 1; i < argc; i++)
+    {
+      std::string arg = argv[i];
+      if (arg == "-h" && i+1 < argc)
+        {
+          host = argv[++i];
+        }
+      else if (arg == "-p" && i+1 < argc)
+        {
+          port = argv[++i];
+        }
+      else if (arg == "-c" && i+1 < argc)
+        {
+          long v = std::atol(argv[++i]);
+          parallel = v > 1 ? v : 2;
+        }
+      else if (arg == "-n" && i+1 < argc)
+        {
+          long v = std::atol(argv[++i]);
+          total = v > 0 ? v : 1;
+        }
+      else if (arg == "-r" && i+1 < argc)
+        {
+          lowest = std::atol(argv[++i]);
+        }
+      else if (arg == "-R" && i+1 < argc)
+        {
+          highest = std::atol(argv[++i]);
+        }
+      else
+        {
+          usage();
+          return 1;
+        }
+    }
+  lowest = std::max(0L, std::min(lowest, 0xFFFFL));
+  highest = std::max(lowest, std::min(highest, 0xFFFFL));
+  parallel = std::min(parallel, total);
+
+  //Every player needs a descriptor, so take as many as we're allowed
+  rlimit files;
+  if (getrlimit(RLIMIT_NOFILE, &files) == 0 && files.rlim_cur < files.rlim_max)
+    {
+      files.rlim_cur = files.rlim_max;
+      setrlimit(RLIMIT_NOFILE, &files);
+    }
+
+  addrinfo hints;
+  memset(&hints, 0, sizeof(hints));
+  hints.ai_family = AF_UNSPEC;
+  hints.ai_socktype = SOCK_STREAM;
+  addrinfo* addr;
+  if (getaddrinfo(host.c_str(), port.c_str(), &hints, &addr) != 0)
+    {
+      std::cerr << "Could not find " << host << "\n";
+      return 1;
+    }
+  int epollFd = epoll_create1(0);
+  if (epollFd < 0)
+    {
+      std::cerr << "Could not create the event loop\n";
+      return 1;
+    }
+
+  std::mt19937 random(std::random_device{}());
+  std::uniform_int_distribution<int> ratings(lowest, highest);
+  std::uniform_int_distribution<int> armies(0, num(ArmyType::NONE));
+
+  //Players are kept in place, as epoll points to them
+  std::unique_ptr<LoadPlayer[]> players(new LoadPlayer[parallel]);
+  std::size_t started = 0;
+  std::size_t matched = 0;
+  std::size_t failed = 0;
+  std::vector<double> waits;
+  waits.reserve(total);
+  Clock::time_point begin = Clock::now();
+  Clock::time_point last = begin;
+  for (std::size_t i = 0; i < parallel; i++)
+    {
+      started++;
+      if (!start(players[i], epollFd, addr)) failed++;
+    }
+
+  //Players left over at the end may have nobody near enough to match, so
+  //stop once nothing happens for a while
+  const int SETTLE_MS = 2000;
+  epoll_event events[256];
+  while (matched + failed < total)
+    {
+      int n = epoll_wait(epollFd, events, 256, SETTLE_MS);
+      if (n < 0 && errno == EINTR) continue;
+      if (n <= 0) break;
+
+      for (int i = 0; i < n; i++)
+        {
+          LoadPlayer& p = *static_cast<LoadPlayer*>(events[i].data.ptr);
+          if (p.fd < 0) continue;
+          bool done = false;
+          bool ok = true;
+
+          if (!p.connected && (events[i].events & (EPOLLOUT | EPOLLERR)))
+            {
+              //Seek first, so the server sends us to the lobby
+              std::uint8_t m[] =
+                {MAGIC_NUM, 0x0F, 3, 0, 0, 0,
+                 MAGIC_NUM, 0x07, 2, NET_VERSION >> 8, NET_VERSION & 0xFF};
+              int rating = ratings(random);
+              m[3] = rating >> 8;
+              m[4] = rating & 0xFF;
+              m[5] = armies(random);
+              p.connected = true;
+              p.sought = Clock::now();
+              ok = write(p.fd, m, sizeof(m)) == ssize_t(sizeof(m));
+
+              epoll_event ev;
+              ev.events = EPOLLIN;
+              ev.data.ptr = &p;
+              epoll_ctl(epollFd, EPOLL_CTL_MOD, p.fd, &ev);
+            }
+          else if (events[i].events & (EPOLLIN | EPOLLHUP | EPOLLERR))
+            {
+              //Done once the server says which game we're in
+              ok = p.in.fill(p.fd) > 0;
+              std::size_t size;
+              const std::uint8_t* m;
+              while (ok && !done && (m = p.in.next(size)))
+                {
+                  done = m[1] == 0x09;
+                }
+            }
+
+          if (!ok || done)
+            {
+              if (done)
+                {
+                  matched++;
+                  last = Clock::now();
+                  std::chrono::duration<double, std::milli> wait =
+                    last - p.sought;
+                  waits.push_back(wait.count());
+                }
+              else
+                {
+                  failed++;
+                }
+              finish(p);
+              if (started < total)
+                {
+                  started++;
+                  if (!start(p, epollFd, addr)) failed++;
+                }
+            }
+        }
+    }
+  std::chrono::duration<double> elapsed = last - begin;
+  for (std::size_t i = 0; i < parallel; i++) finish(players[i]);
+  close(epollFd);
+  freeaddrinfo(addr);
+
+  std::cout << matched << " of " << total << " players matched in "
+            << elapsed.count() << " s, " << failed << " failed\n";
+  if (waits.empty()) return 1;
+  std::sort(waits.begin(), waits.end());
+  std::cout << matched / elapsed.count() << " players matched/s, wait p50 "
+            << waits[waits.size() / 2] << " ms, p99 "
+            << waits[waits.size() * 99 / 100] << " ms\n";
+  return 0;
+}
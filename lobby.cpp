@@ -0,0 +1,158 @@
+/*
+  Copyright (c) 2014 Auston Sterling
+  See license.txt for copying permission.
+
+  -----Lobby Class Implementation-----
+  Auston Sterling
+  austonst@gmail.com
+
+  Matches players waiting for a game by rating.
+*/
+
+#include "lobby.hpp"
+
+#include <algorithm>
+
+namespace c2
+{
+
+  //How many buckets away a player will accept others from by now
+  static std::size_t reach(const Seeker& s,
+                           std::chrono::steady_clock::time_point now)
+  {
+    return std::min<std::size_t>(LOBBY_MAX_SPREAD,
+                                 1 + (now - s.since) / LOBBY_WIDEN_TIME);
+  }
+
+  Lobby::Lobby() : _buckets(0xFFFF / LOBBY_BUCKET_WIDTH + 1), _nextTicket(0)
+  {
+  }
+
+  bool Lobby::seek(int fd, std::uint16_t rating, ArmyType army,
+                   Seeker& opponent)
+  {
+    std::chrono::steady_clock::time_point now =
+      std::chrono::steady_clock::now();
+    std::size_t home = rating / LOBBY_BUCKET_WIDTH;
+
+    //Nearest buckets first, so the closest match is taken
+    for (std::size_t d = 0; d <= LOBBY_MAX_SPREAD; d++)
+      {
+        //Of the buckets this far away, the player who has waited longest
+        std::deque<Seeker>* best = nullptr;
+        for (std::size_t i = 0; i < (d ? 2 : 1); i++)
+          {
+            if (i == 0 && d > home) continue;
+            std::size_t b = i == 0 ? home - d : home + d;
+            if (b >= _buckets.size()) continue;
+
+            std::deque<Seeker>& bucket = _buckets[b];
+            prune(bucket);
+            if (bucket.empty()) continue;
+            const Seeker& s = bucket.front();
+            if (d > reach(s, now)) continue;
+            if (!best || s.since < best->front().since) best = &bucket;
+          }
+        if (best)
+          {
+            opponent = best->front();
+            best->pop_front();
+            _tickets.erase(opponent.fd);
+            return true;
+          }
+      }
+
+    //Nobody will have them yet, so they wait
+    Seeker s;
+    s.fd = fd;
+    s.rating = rating;
+    s.army = army;
+    s.since = now;
+    s.ticket = _nextTicket++;
+    _tickets[fd] = s.ticket;
+    _buckets[home].push_back(s);
+    return false;
+  }
+
+  bool Lobby::match(Seeker& first, Seeker& second)
+  {
+    if (_tickets.size() < 2) return false;
+    std::chrono::steady_clock::time_point now =
+      std::chrono::steady_clock::now();
+
+    //Anyone arriving next to a waiting player is matched straight away, so
+    //only the front of each bucket can be waiting. Of the fronts, find the
+    //longest waiting who will have someone now, and who they're nearest.
+    std::deque<Seeker>* older = nullptr;
+    std::deque<Seeker>* nearest = nullptr;
+    for (std::size_t home = 0; home < _buckets.size(); home++)
+      {
+        std::deque<Seeker>& bucket = _buckets[home];
+        prune(bucket);
+        if (bucket.empty()) continue;
+        const Seeker& s = bucket.front();
+        if (older && older->front().since <= s.since) continue;
+
+        std::deque<Seeker>* found = nullptr;
+        std::size_t r = reach(s, now);
+        for (std::size_t d = 1; d <= r && !found; d++)
+          {
+            for (std::size_t i = 0; i < 2; i++)
+              {
+                if (i == 0 && d > home) continue;
+                std::size_t b = i == 0 ? home - d : home + d;
+                if (b >= _buckets.size()) continue;
+                prune(_buckets[b]);
+                if (_buckets[b].empty()) continue;
+                if (!found || _buckets[b].front().since < found->front().since)
+                  {
+                    found = &_buckets[b];
+                  }
+              }
+          }
+        if (found)
+          {
+            older = &bucket;
+            nearest = found;
+          }
+      }
+    if (!older) return false;
+
+    first = older->front();
+    older->pop_front();
+    _tickets.erase(first.fd);
+    second = nearest->front();
+    nearest->pop_front();
+    _tickets.erase(second.fd);
+    return true;
+  }
+
+  bool Lobby::leave(int fd)
+  {
+    return _tickets.erase(fd) > 0;
+  }
+
+  void Lobby::clear(std::vector<int>& fds)
+  {
+    for (std::unordered_map<int, std::uint64_t>::iterator it =
+           _tickets.begin(); it != _tickets.end(); ++it)
+      {
+        fds.push_back(it->first);
+      }
+    _tickets.clear();
+    for (std::size_t i = 0; i < _buckets.size(); i++) _buckets[i].clear();
+  }
+
+  bool Lobby::current(const Seeker& s) const
+  {
+    std::unordered_map<int, std::uint64_t>::const_iterator it =
+      _tickets.find(s.fd);
+    return it != _tickets.end() && it->second == s.ticket;
+  }
+
+  void Lobby::prune(std::deque<Seeker>& bucket)
+  {
+    while (!bucket.empty() && !current(bucket.front())) bucket.pop_front();
+  }
+
+} //Namespace
@@ -0,0 +1,104 @@
+/*
+  Copyright (c) 2014 Auston Sterling
+  See license.txt for copying permission.
+
+  -----Lobby Class Header-----
+  Auston Sterling
+  austonst@gmail.com
+
+  Matches players waiting for a game by rating.
+
+  Waiting players are kept in buckets of similar rating, oldest first. A
+  player arriving is matched with the oldest player in the nearest bucket
+  that will have them. Neighbouring buckets always will, and a player
+  waiting longer will accept players from further away, so nobody waits
+  for an exact match forever. Matches are made as players arrive, and
+  between players already waiting by a pass the server makes every
+  LOBBY_MATCH_INTERVAL, as they come to accept each other.
+
+  Players are known by a descriptor. Those leaving are forgotten straight
+  away and their places in the buckets are skipped over later, so both
+  joining and leaving take constant time.
+
+  The lobby does no locking. The server only uses it from the thread that
+  accepts connections.
+*/
+
+#ifndef _lobby_hpp_
+#define _lobby_hpp_
+
+#include <chrono>
+#include <cstdint>
+#include <deque>
+#include <unordered_map>
+#include <vector>
+
+#include "army.hpp"
+
+namespace c2
+{
+
+  //Range of ratings in each bucket
+  const std::uint16_t LOBBY_BUCKET_WIDTH = 50;
+
+  //Furthest apart in buckets two players can be matched, and how long a
+  //player waits before accepting players one bucket further away
+  const std::size_t LOBBY_MAX_SPREAD = 8;
+  const std::chrono::seconds LOBBY_WIDEN_TIME(5);
+
+  //How often waiting players are checked against each other
+  const std::chrono::seconds LOBBY_MATCH_INTERVAL(1);
+
+  //A player waiting for a game
+  struct Seeker
+  {
+    int fd;
+    std::uint16_t rating;
+    ArmyType army;
+    std::chrono::steady_clock::time_point since;
+
+    //Tells this wait apart from any other by the same descriptor
+    std::uint64_t ticket;
+  };
+
+  class Lobby
+  {
+  public:
+    //Constructors
+    Lobby();
+
+    //Adds a player to the lobby, unless a waiting player will have them.
+    //Returns true and fills in the opponent, who has left the lobby, if so.
+    bool seek(int fd, std::uint16_t rating, ArmyType army, Seeker& opponent);
+
+    //Matches the longest waiting player who will now have another waiting
+    //player with the nearest of them. Returns true and fills in both, who
+    //have left the lobby, if there was a match.
+    bool match(Seeker& first, Seeker& second);
+
+    //Takes a player out of the lobby. Returns false if they weren't in it.
+    bool leave(int fd);
+
+    //Takes every player out of the lobby, adding their descriptors to fds
+    void clear(std::vector<int>& fds);
+
+    //Number of players waiting
+    std::size_t waiting() const {return _tickets.size();}
+
+  private:
+    //Whether a player is still waiting in this place
+    bool current(const Seeker& s) const;
+
+    //Drops places given up from the front of a bucket
+    void prune(std::deque<Seeker>& bucket);
+
+    std::vector<std::deque<Seeker> > _buckets;
+
+    //The ticket of every waiting player by descriptor
+    std::unordered_map<int, std::uint64_t> _tickets;
+    std::uint64_t _nextTicket;
+  };
+
+} //Namespace
+
+#endif
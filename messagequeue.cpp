@@ -0,0 +1,64 @@
+/*
+  Copyright (c) 2014 Auston Sterling
+  See license.txt for copying permission.
+
+  -----MessageQueue Class Implementation-----
+  Auston Sterling
+  austonst@gmail.com
+
+  A bounded single producer, single consumer queue of small messages.
+*/
+
+#include "messagequeue.hpp"
+
+#include <cstring>
+
+namespace c2
+{
+
+  MessageQueue::MessageQueue(std::size_t capacity) : _head(0), _tail(0)
+  {
+    std::size_t size = 1;
+    while (size < capacity) size *= 2;
+    _slots.resize(size);
+    _mask = size - 1;
+  }
+
+  bool MessageQueue::push(const std::uint8_t* data, std::size_t size,
+                          std::uint64_t stamp)
+  {
+    if (size > MESSAGE_SLOT_SIZE) return false;
+
+    //Only we write the tail, so it can be read relaxed
+    std::size_t tail = _tail.load(std::memory_order_relaxed);
+    if (tail - _head.load(std::memory_order_acquire) > _mask) return false;
+
+    MessageSlot& slot = _slots[tail & _mask];
+    slot.size = size;
+    memcpy(slot.data, data, size);
+    slot.stamp = stamp;
+
+    //Publish the slot only once it is filled in
+    _tail.store(tail + 1, std::memory_order_release);
+    return true;
+  }
+
+  bool MessageQueue::pop(MessageSlot& slot)
+  {
+    std::size_t head = _head.load(std::memory_order_relaxed);
+    if (head == _tail.load(std::memory_order_acquire)) return false;
+
+    slot = _slots[head & _mask];
+
+    //Hand the slot back only once it has been copied out
+    _head.store(head + 1, std::memory_order_release);
+    return true;
+  }
+
+  bool MessageQueue::empty() const
+  {
+    return _head.load(std::memory_order_acquire) ==
+      _tail.load(std::memory_order_acquire);
+  }
+
+} //Namespace
@@ -0,0 +1,73 @@
+/*
+  Copyright (c) 2014 Auston Sterling
+  See license.txt for copying permission.
+
+  -----MessageQueue Class Header-----
+  Auston Sterling
+  austonst@gmail.com
+
+  A bounded queue of small messages, passed from exactly one producing
+  thread to exactly one consuming thread without locks.
+
+  Messages are copied into slots allocated up front, so pushing never
+  allocates. The producer only writes the tail index and the consumer only
+  writes the head index, each on its own cache line.
+*/
+
+#ifndef _messagequeue_hpp_
+#define _messagequeue_hpp_
+
+#include <atomic>
+#include <cstdint>
+#include <cstddef>
+#include <vector>
+
+namespace c2
+{
+
+  //Room in each slot, enough for any message in the protocol
+  const std::size_t MESSAGE_SLOT_SIZE = 16;
+
+  struct MessageSlot
+  {
+    std::uint8_t size;
+    std::uint8_t data[MESSAGE_SLOT_SIZE];
+
+    //Whatever the producer wants to pass along, such as when it was queued
+    std::uint64_t stamp;
+  };
+
+  class MessageQueue
+  {
+  public:
+    //Constructors
+    //Capacity is rounded up to a power of two
+    MessageQueue(std::size_t capacity = 256);
+    MessageQueue(const MessageQueue&) = delete;
+    MessageQueue& operator=(const MessageQueue&) = delete;
+
+    //Producer only. Returns false if the queue is full or the message
+    //doesn't fit in a slot.
+    bool push(const std::uint8_t* data, std::size_t size,
+              std::uint64_t stamp = 0);
+
+    //Consumer only. Returns false if the queue is empty.
+    bool pop(MessageSlot& slot);
+
+    //Safe from either side, though the answer may be out of date
+    bool empty() const;
+
+  private:
+    std::vector<MessageSlot> _slots;
+    std::size_t _mask;
+
+    //Next slot to pop, written by the consumer
+    alignas(64) std::atomic<std::size_t> _head;
+
+    //Next slot to push, written by the producer
+    alignas(64) std::atomic<std::size_t> _tail;
+  };
+
+} //Namespace
+
+#endif
@@ -32,4 +32,22 @@ namespace c2
     return false;
   }
   
+  std::uint32_t packMove(const Move& m)
+  {
+    return std::uint32_t(m.start.x() & 0x0F) |
+      std::uint32_t(m.start.y() & 0x0F) << 4 |
+      std::uint32_t(m.end.x() & 0x0F) << 8 |
+      std::uint32_t(m.end.y() & 0x0F) << 12 |
+      std::uint32_t(num(m.type)) << 16 |
+      std::uint32_t(num(m.side)) << 24;
+  }
+
+  Move unpackMove(std::uint32_t v)
+  {
+    return Move(Position(v & 0x0F, (v >> 4) & 0x0F),
+                Position((v >> 8) & 0x0F, (v >> 12) & 0x0F),
+                static_cast<PieceType>((v >> 16) & 0xFF),
+                static_cast<SideType>((v >> 24) & 0xFF));
+  }
+
 } //namespace
@@ -42,6 +42,12 @@ namespace c2
 
   bool operator<(const Move& m1, const Move& m2);
 
+  //Packs a move into 32 bits and back, for storing or hashing moves
+  //Bytes from low to high: start x | start y << 4, end x | end y << 4,
+  //type, side
+  std::uint32_t packMove(const Move& m);
+  Move unpackMove(std::uint32_t v);
+
 } //namespace
 
 #endif
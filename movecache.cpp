@@ -0,0 +1,102 @@
+/*
+  Copyright (c) 2014 Auston Sterling
+  See license.txt for copying permission.
+
+  -----MoveCache Class Implementation-----
+  Auston Sterling
+  austonst@gmail.com
+
+  Every legal move for one turn, and a table of them shared by every Game
+  in the process.
+*/
+
+#include "movecache.hpp"
+
+#include <cstring>
+
+namespace c2
+{
+
+  //The index of a square, or 64 if it is off the board
+  static std::size_t squareIndex(const Position& p)
+  {
+    if (!p.isValid()) return 64;
+    return (p.y()-1)*8 + (p.x()-1);
+  }
+
+  LegalMoves::LegalMoves()
+  {
+    memset(dests, 0, sizeof(dests));
+  }
+
+  void LegalMoves::add(const Move& m)
+  {
+    moves.push_back(m);
+
+    //Skipping a king turn ends off the board, and is only in the list
+    std::size_t start = squareIndex(m.start);
+    std::size_t end = squareIndex(m.end);
+    if (start < 64 && end < 64) dests[start] |= 1ULL << end;
+  }
+
+  bool LegalMoves::contains(const Position& start, const Position& end) const
+  {
+    std::size_t s = squareIndex(start);
+    std::size_t e = squareIndex(end);
+    return s < 64 && e < 64 && (dests[s] >> e & 1);
+  }
+
+  MoveCache::MoveCache(std::size_t capacity) : _hits(0), _misses(0)
+  {
+    std::size_t size = 1;
+    while (size < capacity) size *= 2;
+    _entries.resize(size);
+    _mask = size - 1;
+    for (std::size_t i = 0; i < MOVE_CACHE_LOCKS; i++)
+      {
+        pthread_mutex_init(&_locks[i], NULL);
+      }
+  }
+
+  MoveCache::~MoveCache()
+  {
+    for (std::size_t i = 0; i < MOVE_CACHE_LOCKS; i++)
+      {
+        pthread_mutex_destroy(&_locks[i]);
+      }
+  }
+
+  std::shared_ptr<const LegalMoves> MoveCache::find(std::uint64_t key)
+  {
+    std::size_t slot = key & _mask;
+    pthread_mutex_t* lock = &_locks[slot % MOVE_CACHE_LOCKS];
+    pthread_mutex_lock(lock);
+    std::shared_ptr<const LegalMoves> found;
+    if (_entries[slot].key == key) found = _entries[slot].moves;
+    pthread_mutex_unlock(lock);
+
+    if (found) _hits.fetch_add(1, std::memory_order_relaxed);
+    else _misses.fetch_add(1, std::memory_order_relaxed);
+    return found;
+  }
+
+  void MoveCache::insert(std::uint64_t key,
+                         const std::shared_ptr<const LegalMoves>& moves)
+  {
+    //The old entry is released outside the lock
+    std::size_t slot = key & _mask;
+    std::shared_ptr<const LegalMoves> old = moves;
+    pthread_mutex_t* lock = &_locks[slot % MOVE_CACHE_LOCKS];
+    pthread_mutex_lock(lock);
+    _entries[slot].key = key;
+    _entries[slot].moves.swap(old);
+    pthread_mutex_unlock(lock);
+  }
+
+  MoveCache& moveCache()
+  {
+    static MoveCache cache;
+    return cache;
+  }
+
+} //Namespace
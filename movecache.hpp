@@ -0,0 +1,101 @@
+/*
+  Copyright (c) 2014 Auston Sterling
+  See license.txt for copying permission.
+
+  -----MoveCache Class Header-----
+  Auston Sterling
+  austonst@gmail.com
+
+  Every legal move for one turn, and a table of them shared by every Game
+  in the process, so a position seen before doesn't need its moves found
+  again. Finding them means trying each move on a copy of the game, which
+  is by far the slowest part of making a move.
+
+  The table is direct mapped on a 64 bit key made from the position, so it
+  never grows and a new entry replaces whatever was in its slot. Slots are
+  guarded by a small set of locks, so threads seldom wait on each other.
+  Two positions sharing a key would share moves, which is as unlikely as
+  for any other use of the hashes.
+*/
+
+#ifndef _movecache_hpp_
+#define _movecache_hpp_
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <vector>
+#include <pthread.h>
+
+#include "move.hpp"
+
+namespace c2
+{
+
+  //Entries in the shared table, and locks guarding them
+  const std::size_t MOVE_CACHE_SIZE = 1 << 14;
+  const std::size_t MOVE_CACHE_LOCKS = 64;
+
+  //The legal moves for one turn, in the order Game::legalMoves gives them,
+  //along with each piece's destinations as a square set for quick checks
+  struct LegalMoves
+  {
+    //Constructors
+    LegalMoves();
+
+    //Adds a move to both
+    void add(const Move& m);
+
+    //Whether a move from start to end is among them. The piece at start is
+    //not checked.
+    bool contains(const Position& start, const Position& end) const;
+
+    std::vector<Move> moves;
+
+    //Bit b of dests[s] is set if the piece on square s can move to square
+    //b, counting a1 as 0 and h8 as 63
+    std::uint64_t dests[64];
+  };
+
+  class MoveCache
+  {
+  public:
+    //Constructors
+    //Capacity is rounded up to a power of two
+    MoveCache(std::size_t capacity = MOVE_CACHE_SIZE);
+    ~MoveCache();
+    MoveCache(const MoveCache&) = delete;
+    MoveCache& operator=(const MoveCache&) = delete;
+
+    //The moves stored for a key, or null
+    std::shared_ptr<const LegalMoves> find(std::uint64_t key);
+
+    //Stores moves for a key, replacing whatever shared its slot
+    void insert(std::uint64_t key,
+                const std::shared_ptr<const LegalMoves>& moves);
+
+    //Lookups that found something and that didn't, so far
+    std::uint64_t hits() const {return _hits;}
+    std::uint64_t misses() const {return _misses;}
+
+  private:
+    struct Entry
+    {
+      std::uint64_t key;
+      std::shared_ptr<const LegalMoves> moves;
+    };
+
+    std::vector<Entry> _entries;
+    std::size_t _mask;
+    pthread_mutex_t _locks[MOVE_CACHE_LOCKS];
+
+    std::atomic<std::uint64_t> _hits;
+    std::atomic<std::uint64_t> _misses;
+  };
+
+  //The table shared by every Game
+  MoveCache& moveCache();
+
+} //Namespace
+
+#endif
@@ -0,0 +1,212 @@
+/*
+  Copyright (c) 2014 Auston Sterling
+  See license.txt for copying permission.
+
+  -----MoveHighlighter Class Implementation-----
+  Auston Sterling
+  austonst@gmail.com
+
+  Works out which squares to highlight for a selected piece on a thread of
+  its own.
+*/
+
+#include "movehighlighter.hpp"
+
+namespace c2
+{
+
+  //Answers turns first, then requests, until told to stop
+  void* highlight_thread(void* data)
+  {
+    MoveHighlighter* h = static_cast<MoveHighlighter*>(data);
+    pthread_mutex_lock(&h->_lock);
+    while (!h->_stop)
+      {
+        if (h->_turnWaiting)
+          {
+            //The slow part is done unlocked, so the client never waits on it
+            GameSnapshot s = h->_turn;
+            std::uint32_t gen = h->_turnGen;
+            h->_turnWaiting = false;
+            pthread_mutex_unlock(&h->_lock);
+
+            std::shared_ptr<LegalMoves> legal(new LegalMoves);
+            bool restored = h->_game.restore(s) == GameReturnType::SUCCESS;
+            if (restored)
+              {
+                std::vector<Move> moves = h->_game.legalMoves();
+                for (std::size_t i = 0; i < moves.size(); i++)
+                  {
+                    legal->add(moves[i]);
+                  }
+              }
+
+            pthread_mutex_lock(&h->_lock);
+            h->_gameGen = restored ? gen : 0;
+            if (gen == h->_turnGen)
+              {
+                h->_legal = legal;
+                h->_legalGen = gen;
+              }
+            continue;
+          }
+
+        if (h->_requestWaiting)
+          {
+            Piece p = h->_request;
+            std::uint32_t gen = h->_requestGen;
+            std::uint32_t turn = h->_turnGen;
+            h->_requestWaiting = false;
+
+            //The side to move is answered from its legal moves, which are
+            //known by now as turns come first. The other side's pieces
+            //just show where they could go.
+            std::set<Position> moves;
+            if (p.side() == h->_turnSide)
+              {
+                if (h->known()) moves = h->destinations(*h->_legal, p.pos());
+              }
+            else if (h->_gameGen == turn)
+              {
+                pthread_mutex_unlock(&h->_lock);
+                moves = h->_game.possibleMoves(p.pos());
+                pthread_mutex_lock(&h->_lock);
+              }
+
+            if (gen == h->_requestGen && turn == h->_turnGen)
+              {
+                h->_answer.swap(moves);
+                h->_answerGen = gen;
+                h->_answered = true;
+              }
+            continue;
+          }
+
+        pthread_cond_wait(&h->_wake, &h->_lock);
+      }
+    pthread_mutex_unlock(&h->_lock);
+    return NULL;
+  }
+
+  MoveHighlighter::MoveHighlighter() :
+    _threadStarted(false), _stop(false), _turnGen(0),
+    _turnSide(SideType::NONE), _turnWaiting(false), _requestGen(0),
+    _requestWaiting(false), _legalGen(0), _answerGen(0), _answered(false),
+    _game(&_board), _gameGen(0)
+  {
+    pthread_mutex_init(&_lock, NULL);
+    pthread_cond_init(&_wake, NULL);
+    _threadStarted = pthread_create(&_thread, NULL, &highlight_thread,
+                                    this) == 0;
+  }
+
+  MoveHighlighter::~MoveHighlighter()
+  {
+    if (_threadStarted)
+      {
+        pthread_mutex_lock(&_lock);
+        _stop = true;
+        pthread_cond_signal(&_wake);
+        pthread_mutex_unlock(&_lock);
+        pthread_join(_thread, NULL);
+      }
+    pthread_cond_destroy(&_wake);
+    pthread_mutex_destroy(&_lock);
+  }
+
+  void MoveHighlighter::newTurn(const GameSnapshot& s)
+  {
+    SideType side = SideType::NONE;
+    if (s.state == GameStateType::WHITE_MOVE ||
+        s.state == GameStateType::WHITE_KINGMOVE)
+      {
+        side = SideType::WHITE;
+      }
+    else if (s.state == GameStateType::BLACK_MOVE ||
+             s.state == GameStateType::BLACK_KINGMOVE)
+      {
+        side = SideType::BLACK;
+      }
+
+    pthread_mutex_lock(&_lock);
+    _turnGen++;
+    _turn = s;
+    _turnSide = side;
+    _turnWaiting = true;
+    _requestWaiting = false;
+    _answered = false;
+    pthread_cond_signal(&_wake);
+    pthread_mutex_unlock(&_lock);
+  }
+
+  bool MoveHighlighter::request(const Piece& p, std::set<Position>& moves)
+  {
+    pthread_mutex_lock(&_lock);
+    _requestGen++;
+    _answered = false;
+    if (p.side() == _turnSide && known())
+      {
+        moves = destinations(*_legal, p.pos());
+        _requestWaiting = false;
+        pthread_mutex_unlock(&_lock);
+        return true;
+      }
+
+    _request = p;
+    _requestWaiting = true;
+    pthread_cond_signal(&_wake);
+    pthread_mutex_unlock(&_lock);
+    return false;
+  }
+
+  void MoveHighlighter::cancel()
+  {
+    pthread_mutex_lock(&_lock);
+    _requestGen++;
+    _requestWaiting = false;
+    _answered = false;
+    pthread_mutex_unlock(&_lock);
+  }
+
+  bool MoveHighlighter::result(std::set<Position>& moves)
+  {
+    //Cheap enough to call every frame, as the thread is seldom holding this
+    pthread_mutex_lock(&_lock);
+    bool fresh = _answered && _answerGen == _requestGen;
+    if (fresh)
+      {
+        moves.swap(_answer);
+        _answer.clear();
+        _answered = false;
+      }
+    pthread_mutex_unlock(&_lock);
+    return fresh;
+  }
+
+  bool MoveHighlighter::ready()
+  {
+    pthread_mutex_lock(&_lock);
+    bool r = known();
+    pthread_mutex_unlock(&_lock);
+    return r;
+  }
+
+  bool MoveHighlighter::known() const
+  {
+    return _legal && _legalGen == _turnGen;
+  }
+
+  std::set<Position> MoveHighlighter::destinations(const LegalMoves& legal,
+                                                   const Position& pos)
+  {
+    std::set<Position> moves;
+    if (!pos.isValid()) return moves;
+    std::uint64_t dests = legal.dests[(pos.y()-1)*8 + (pos.x()-1)];
+    for (int b = 0; b < 64; b++)
+      {
+        if (dests >> b & 1) moves.insert(Position(b%8 + 1, b/8 + 1));
+      }
+    return moves;
+  }
+
+} //Namespace
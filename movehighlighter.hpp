@@ -0,0 +1,117 @@
+/*
+  Copyright (c) 2014 Auston Sterling
+  See license.txt for copying permission.
+
+  -----MoveHighlighter Class Header-----
+  Auston Sterling
+  austonst@gmail.com
+
+  Works out which squares to highlight for a selected piece on a thread of
+  its own, so a slow position never holds up drawing.
+
+  At the start of each turn the client hands over a snapshot of the game,
+  and every legal move of the side to move is found straight away. Once
+  they are known, picking one of that side's pieces is answered on the
+  spot. Anything else, such as a piece picked before the moves are found or
+  one of the other side's pieces, is queued for the thread and collected
+  later with result().
+
+  Each turn and each request is given a generation. Work for a turn or
+  request that has since been replaced is thrown away rather than shown.
+*/
+
+#ifndef _movehighlighter_hpp_
+#define _movehighlighter_hpp_
+
+#include <atomic>
+#include <memory>
+#include <set>
+#include <pthread.h>
+
+#include "bitboard.hpp"
+#include "game.hpp"
+#include "movecache.hpp"
+
+namespace c2
+{
+
+  class MoveHighlighter
+  {
+  public:
+    //Constructors
+    //Starts the thread
+    MoveHighlighter();
+    ~MoveHighlighter();
+    MoveHighlighter(const MoveHighlighter&) = delete;
+    MoveHighlighter& operator=(const MoveHighlighter&) = delete;
+
+    //Starts on the moves for a new turn, dropping everything from the last.
+    //The snapshot must be from a game that has started.
+    void newTurn(const GameSnapshot& s);
+
+    //Asks where a piece can go. If that is already known, moves is filled
+    //in and true is returned. Otherwise the request replaces any earlier
+    //one still waiting, and its answer comes from result().
+    bool request(const Piece& p, std::set<Position>& moves);
+
+    //Drops any request still waiting
+    void cancel();
+
+    //Collects the answer to the last request, returning false if it isn't
+    //ready or there is none
+    bool result(std::set<Position>& moves);
+
+    //Whether every move for this turn has been found
+    bool ready();
+
+    //Accessors
+    std::uint32_t turnGeneration() const {return _turnGen;}
+    std::uint32_t requestGeneration() const {return _requestGen;}
+
+  private:
+    //Waits for turns and requests and answers them
+    friend void* highlight_thread(void* data);
+
+    //Lock held. Whether the moves for the current turn are known.
+    bool known() const;
+
+    //The squares a piece can reach in a set of legal moves
+    static std::set<Position> destinations(const LegalMoves& legal,
+                                           const Position& pos);
+
+    //Guards everything below that isn't atomic, and wakes the thread
+    pthread_mutex_t _lock;
+    pthread_cond_t _wake;
+    pthread_t _thread;
+    bool _threadStarted;
+    bool _stop;
+
+    //The latest turn, and whether the thread has yet to pick it up
+    std::atomic<std::uint32_t> _turnGen;
+    GameSnapshot _turn;
+    SideType _turnSide;
+    bool _turnWaiting;
+
+    //The latest request, and whether the thread has yet to pick it up
+    std::atomic<std::uint32_t> _requestGen;
+    Piece _request;
+    bool _requestWaiting;
+
+    //The moves found for a turn, and which turn that was
+    std::shared_ptr<const LegalMoves> _legal;
+    std::uint32_t _legalGen;
+
+    //The answer to a request, and which request that was
+    std::set<Position> _answer;
+    std::uint32_t _answerGen;
+    bool _answered;
+
+    //Thread only. A copy of the game for the turn being worked on.
+    BitBoard _board;
+    Game _game;
+    std::uint32_t _gameGen;
+  };
+
+} //Namespace
+
+#endif
@@ -0,0 +1,693 @@
+/*
+  Copyright (c) 2014 Auston Sterling
+  See license.txt for copying permission.
+
+  -----Network Benchmark Tool-----
+  Auston Sterling
+  austonst@gmail.com
+
+  Plays many games at once through a game server over loopback, to measure
+  how fast and how promptly it passes messages on.
+
+  Each game is two connections speaking the NetGame protocol. They choose
+  random armies and play random legal moves, declining every duel, each
+  call followed by a hash message as a NetGame would send. The next call is
+  made once the opponent has received the last one, at most at the rate
+  asked for. A game that ends, or reaches the most calls allowed, is
+  replaced by a new one.
+
+  Latency is from a call being written to the opponent reading it, through
+  the server. Unless a host is given, the server is started in a child
+  process, so its CPU time can be read. For a server started elsewhere,
+  give its pid for the same.
+
+  chess2-netbench [-h host] [-p port] [-P server pid] [-s shards]
+                  [-g games] [-r calls per second per game] [-t seconds]
+                  [-m most calls per game]
+*/
+
+#include "server.hpp"
+
+#include <sys/socket.h>
+#include <sys/epoll.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <netdb.h>
+#include <unistd.h>
+#include <cerrno>
+#include <csignal>
+#include <cstring>
+#include <algorithm>
+#include <chrono>
+#include <fstream>
+#include <iterator>
+#include <iostream>
+#include <list>
+#include <memory>
+#include <queue>
+#include <random>
+#include <sstream>
+#include <unordered_map>
+#include <vector>
+
+using namespace c2;
+
+typedef std::chrono::steady_clock Clock;
+
+struct BenchGame;
+
+//One player's connection
+struct BenchConn
+{
+  BenchConn() : fd(-1), in(4096), game(nullptr), side(0),
+                connected(false), closed(false) {}
+
+  int fd;
+  FrameReader in;
+
+  //The game once the server has said which it is, and which side we are
+  BenchGame* game;
+  std::size_t side;
+
+  bool connected;
+  bool closed;
+};
+
+//A game between two of our connections
+struct BenchGame
+{
+  BenchGame() : game(&board), calls(0), queued(false), over(false)
+  {
+    conns[0] = conns[1] = nullptr;
+  }
+
+  BitBoard board;
+  Game game;
+  BenchConn* conns[2];
+
+  //Calls made so far, and when the last was sent
+  std::uint32_t calls;
+  Clock::time_point sent;
+
+  //Whether the next call is waiting in the queue of calls due
+  bool queued;
+
+  bool over;
+};
+
+static GameServer* running = nullptr;
+
+static void interrupted(int)
+{
+  if (running) running->stop();
+}
+
+static void usage()
+{
+  std::cerr << "Usage:\n"
+            << "  chess2-netbench [-h host] [-p port] [-P server pid] "
+            << "[-s shards]\n"
+            << "                  [-g games] [-r calls per second per game] "
+            << "[-t seconds]\n"
+            << "                  [-m most calls per game]\n";
+}
+
+//CPU seconds used by a process so far, or -1 if it can't be read
+static double cpuSeconds(pid_t pid)
+{
+  std::ostringstream path;
+  path << "/proc/" << pid << "/stat";
+  std::ifstream in(path.str().c_str());
+  std::string stat;
+  if (!std::getline(in, stat)) return -1;
+
+  //The name can hold spaces, so count fields from after it. User and
+  //system time are the 14th and 15th.
+  std::size_t close = stat.rfind(')');
+  if (close == std::string::npos) return -1;
+  std::istringstream fields(stat.substr(close + 2));
+  std::string skip;
+  for (int i = 3; i < 14; i++) fields >> skip;
+  double user, system;
+  if (!(fields >> user >> system)) return -1;
+  return (user + system) / sysconf(_SC_CLK_TCK);
+}
+
+//Starts a server in a child process, returning its pid or -1
+static pid_t startServer(const std::string& port, std::size_t shards)
+{
+  pid_t pid = fork();
+  if (pid != 0) return pid;
+
+  GameServer server;
+  if (shards) server.setShards(shards);
+  if (!server.listen(port)) _exit(1);
+  running = &server;
+  std::signal(SIGINT, interrupted);
+  std::signal(SIGPIPE, SIG_IGN);
+  _exit(server.run() ? 0 : 1);
+}
+
+class NetBench
+{
+public:
+  NetBench(const addrinfo* addr, std::size_t games, double rate,
+           std::uint32_t maxCalls) :
+    _addr(addr), _games(games), _maxCalls(maxCalls),
+    _random(std::random_device{}()), _relayed(0), _frames(0), _finished(0),
+    _failed(0)
+  {
+    _interval = rate > 0 ?
+      std::chrono::duration_cast<Clock::duration>
+      (std::chrono::duration<double>(1 / rate)) : Clock::duration(0);
+    _epollFd = epoll_create1(0);
+  }
+
+  ~NetBench()
+  {
+    for (std::list<std::unique_ptr<BenchConn> >::iterator it =
+           _conns.begin(); it != _conns.end(); ++it)
+      {
+        if ((*it)->fd >= 0) ::close((*it)->fd);
+      }
+    if (_epollFd >= 0) ::close(_epollFd);
+  }
+
+  //Plays until the time is up. Returns false if nothing could be started.
+  bool run(Clock::duration length)
+  {
+    if (_epollFd < 0) return false;
+    for (std::size_t i = 0; i < _games; i++) startGame();
+
+    Clock::time_point end = Clock::now() + length;
+    epoll_event events[256];
+    while (Clock::now() < end)
+      {
+        //Sleep until the next call is due, or the end
+        Clock::time_point wake = end;
+        if (!_due.empty()) wake = std::min(wake, _due.top().first);
+        int timeout = std::chrono::duration_cast<std::chrono::milliseconds>
+          (wake - Clock::now()).count();
+        int n = epoll_wait(_epollFd, events, 256, std::max(timeout, 0));
+        if (n < 0 && errno != EINTR) return false;
+
+        for (int i = 0; i < n; i++)
+          {
+            BenchConn* c = static_cast<BenchConn*>(events[i].data.ptr);
+            if (c->closed) continue;
+            if (!c->connected) connected(c);
+            else readable(c);
+          }
+
+        Clock::time_point now = Clock::now();
+        while (!_due.empty() && _due.top().first <= now)
+          {
+            BenchGame* g = _due.top().second;
+            _due.pop();
+            g->queued = false;
+            if (!g->over) act(g);
+          }
+        sweep();
+      }
+    return true;
+  }
+
+  //Results
+  std::uint64_t relayed() const {return _relayed;}
+  std::uint64_t frames() const {return _frames;}
+  std::uint64_t finished() const {return _finished;}
+  std::uint64_t failed() const {return _failed;}
+  std::vector<std::uint32_t>& latencies() {return _latencies;}
+
+private:
+  //Opens the two connections for a game. The server pairs connections in
+  //the order they speak, so they may end up in different games, which is
+  //fine as long as there is always an even number.
+  void startGame()
+  {
+    for (std::size_t i = 0; i < 2; i++)
+      {
+        BenchConn* c = new BenchConn;
+        _conns.push_back(std::unique_ptr<BenchConn>(c));
+        c->fd = socket(_addr->ai_family, _addr->ai_socktype | SOCK_NONBLOCK,
+                       _addr->ai_protocol);
+        int yes = 1;
+        linger hard;
+        hard.l_onoff = 1;
+        hard.l_linger = 0;
+        setsockopt(c->fd, IPPROTO_TCP, TCP_NODELAY, &yes, sizeof(yes));
+        setsockopt(c->fd, SOL_SOCKET, SO_LINGER, &hard, sizeof(hard));
+        epoll_event ev;
+        ev.events = EPOLLOUT | EPOLLIN;
+        ev.data.ptr = c;
+        if (c->fd < 0 ||
+            (connect(c->fd, _addr->ai_addr, _addr->ai_addrlen) < 0 &&
+             errno != EINPROGRESS) ||
+            epoll_ctl(_epollFd, EPOLL_CTL_ADD, c->fd, &ev) != 0)
+          {
+            fail(c);
+          }
+      }
+  }
+
+  void connected(BenchConn* c)
+  {
+    const std::uint8_t version[] =
+      {MAGIC_NUM, 0x07, 2, NET_VERSION >> 8, NET_VERSION & 0xFF};
+    c->connected = true;
+    epoll_event ev;
+    ev.events = EPOLLIN;
+    ev.data.ptr = c;
+    if (!write(c, version, sizeof(version)) ||
+        epoll_ctl(_epollFd, EPOLL_CTL_MOD, c->fd, &ev) != 0)
+      {
+        fail(c);
+      }
+  }
+
+  void readable(BenchConn* c)
+  {
+    ssize_t got = c->in.fill(c->fd);
+    if (got < 0 && (errno == EAGAIN || errno == EINTR)) return;
+    if (got <= 0)
+      {
+        fail(c);
+        return;
+      }
+
+    std::size_t size;
+    const std::uint8_t* m;
+    while (!c->closed && (m = c->in.next(size)))
+      {
+        if (m[1] == 0x09 && size == HEADER_SIZE + 4 && !c->game)
+          {
+            joined(c, getBE32(m + HEADER_SIZE));
+          }
+        else if (m[1] <= 5 && c->game)
+          {
+            //The opponent's call arrived, so the next can be made
+            BenchGame* g = c->game;
+            Clock::time_point now = Clock::now();
+            _latencies.push_back
+              (std::chrono::duration_cast<std::chrono::microseconds>
+               (now - g->sent).count());
+            _relayed++;
+            Clock::time_point due = std::max(now, g->sent + _interval);
+            if (due <= now) act(g);
+            else
+              {
+                g->queued = true;
+                _due.push(std::make_pair(due, g));
+              }
+          }
+        else if (m[1] == 0x0C)
+          {
+            //We never differ from the server, so a resync is a failure
+            fail(c);
+          }
+      }
+    if (c->in.corrupt()) fail(c);
+  }
+
+  //Puts a connection in its game, starting the game once both are there.
+  //The first to hear plays white.
+  void joined(BenchConn* c, std::uint32_t id)
+  {
+    std::unordered_map<std::uint32_t, BenchConn*>::iterator it =
+      _waiting.find(id);
+    if (it == _waiting.end())
+      {
+        _waiting[id] = c;
+        return;
+      }
+    BenchConn* white = it->second;
+    _waiting.erase(it);
+
+    BenchGame* g = new BenchGame;
+    _benchGames.push_back(std::unique_ptr<BenchGame>(g));
+    g->conns[0] = white;
+    g->conns[1] = c;
+    white->game = c->game = g;
+    white->side = 0;
+    c->side = 1;
+    act(g);
+  }
+
+  //Makes the next call in a game, from whichever side's turn it is
+  void act(BenchGame* g)
+  {
+    GameStateType state = g->game.state();
+    if (isGameOver(state) || g->calls >= _maxCalls)
+      {
+        end(g);
+        return;
+      }
+
+    std::uint8_t m[MAX_FRAME_SIZE];
+    std::size_t side = 0;
+    m[0] = MAGIC_NUM;
+    if (state == GameStateType::BOTH_CHOOSE_ARMY ||
+        state == GameStateType::WHITE_CHOOSE_ARMY ||
+        state == GameStateType::BLACK_CHOOSE_ARMY)
+      {
+        side = state == GameStateType::BLACK_CHOOSE_ARMY ? 1 : 0;
+        std::uniform_int_distribution<int> armies(0, num(ArmyType::NONE) - 1);
+        m[1] = 0x00;
+        m[3] = side;
+        m[4] = armies(_random);
+      }
+    else if (state == GameStateType::CONFIRM_START)
+      {
+        m[1] = 0x01;
+      }
+    else if (isMoveState(state))
+      {
+        side = state == GameStateType::WHITE_MOVE ||
+          state == GameStateType::WHITE_KINGMOVE ? 0 : 1;
+        std::vector<Move> legal = g->game.legalMoves();
+        if (legal.empty())
+          {
+            end(g);
+            return;
+          }
+        std::uniform_int_distribution<std::size_t> pick(0, legal.size() - 1);
+        const Move& mv = legal[pick(_random)];
+        m[1] = 0x02;
+        m[3] = mv.start.x();
+        m[4] = mv.start.y();
+        m[5] = mv.end.x();
+        m[6] = mv.end.y();
+        m[7] = num(mv.type);
+        m[8] = num(mv.side);
+      }
+    else if (isDuelState(state))
+      {
+        side = state == GameStateType::WHITE_DUEL ? 0 : 1;
+        m[1] = 0x03;
+        m[3] = 0;
+      }
+    else if (isPromoteState(state))
+      {
+        side = state == GameStateType::WHITE_PROMOTE ? 0 : 1;
+        const std::set<PieceType>& types = ARMY_PROMOTE
+          [num(g->game.army(side ? SideType::BLACK : SideType::WHITE))];
+        std::uniform_int_distribution<std::size_t> pick(0, types.size() - 1);
+        std::set<PieceType>::const_iterator type = types.begin();
+        std::advance(type, pick(_random));
+        m[1] = 0x05;
+        m[3] = num(*type);
+      }
+    else
+      {
+        //Bids only follow a duel, and we decline them all
+        end(g);
+        return;
+      }
+    m[2] = messageLength(m[1]) - HEADER_SIZE;
+    std::size_t size = messageLength(m[1]);
+    if (!succeeded(applyMessage(g->game, m)))
+      {
+        end(g);
+        return;
+      }
+    g->calls++;
+
+    //The call and its hash go out together, as a NetGame would send them
+    std::uint8_t* h = m + size;
+    h[0] = MAGIC_NUM;
+    h[1] = 0x0B;
+    h[2] = 12;
+    putBE(h + HEADER_SIZE, g->calls, 4);
+    putBE(h + HEADER_SIZE + 4, g->game.hash(), 8);
+    size += HEADER_SIZE + 12;
+
+    g->sent = Clock::now();
+    if (!write(g->conns[side], m, size)) return;
+    _frames += 2;
+  }
+
+  //Writes all of a message, failing the connection if it won't go
+  bool write(BenchConn* c, const std::uint8_t* m, std::size_t size)
+  {
+    //Messages are tiny and one is in flight per game, so the socket buffer
+    //never fills
+    if (::write(c->fd, m, size) != ssize_t(size))
+      {
+        fail(c);
+        return false;
+      }
+    return true;
+  }
+
+  //Finishes a game normally and starts another
+  void end(BenchGame* g)
+  {
+    g->over = true;
+    _finished++;
+    for (std::size_t i = 0; i < 2; i++) close(g->conns[i]);
+    startGame();
+  }
+
+  //Something went wrong with a connection, so its game is abandoned
+  void fail(BenchConn* c)
+  {
+    _failed++;
+    if (c->game)
+      {
+        c->game->over = true;
+        close(c->game->conns[0]);
+        close(c->game->conns[1]);
+      }
+    else
+      {
+        close(c);
+      }
+    startGame();
+  }
+
+  void close(BenchConn* c)
+  {
+    if (c->closed) return;
+    c->closed = true;
+    if (c->fd < 0) return;
+    epoll_ctl(_epollFd, EPOLL_CTL_DEL, c->fd, nullptr);
+    ::close(c->fd);
+    c->fd = -1;
+  }
+
+  //Cleans up after a batch of events, once nothing can point to them
+  void sweep()
+  {
+    for (std::unordered_map<std::uint32_t, BenchConn*>::iterator it =
+           _waiting.begin(); it != _waiting.end(); )
+      {
+        if (it->second->closed) it = _waiting.erase(it);
+        else ++it;
+      }
+    for (std::list<std::unique_ptr<BenchConn> >::iterator it =
+           _conns.begin(); it != _conns.end(); )
+      {
+        if ((*it)->closed) it = _conns.erase(it);
+        else ++it;
+      }
+    for (std::list<std::unique_ptr<BenchGame> >::iterator it =
+           _benchGames.begin(); it != _benchGames.end(); )
+      {
+        if ((*it)->over && !(*it)->queued) it = _benchGames.erase(it);
+        else ++it;
+      }
+  }
+
+  static std::uint32_t getBE32(const std::uint8_t* in)
+  {
+    return (std::uint32_t(in[0]) << 24) | (std::uint32_t(in[1]) << 16) |
+      (std::uint32_t(in[2]) << 8) | in[3];
+  }
+
+  static void putBE(std::uint8_t* out, std::uint64_t v, std::size_t bytes)
+  {
+    for (std::size_t i = bytes; i > 0; i--)
+      {
+        out[i-1] = v & 0xFF;
+        v >>= 8;
+      }
+  }
+
+  const addrinfo* _addr;
+  std::size_t _games;
+  Clock::duration _interval;
+  std::uint32_t _maxCalls;
+  int _epollFd;
+  std::mt19937 _random;
+
+  std::list<std::unique_ptr<BenchConn> > _conns;
+  std::list<std::unique_ptr<BenchGame> > _benchGames;
+
+  //Connections told their game, waiting for the other player to be
+  std::unordered_map<std::uint32_t, BenchConn*> _waiting;
+
+  //Games whose next call is held back to keep to the rate, soonest first
+  typedef std::pair<Clock::time_point, BenchGame*> Due;
+  std::priority_queue<Due, std::vector<Due>, std::greater<Due> > _due;
+
+  std::uint64_t _relayed;
+  std::uint64_t _frames;
+  std::uint64_t _finished;
+  std::uint64_t _failed;
+  std::vector<std::uint32_t> _latencies;
+};
+
+int main(int argc, char* argv[])
+{
+  std::string host;
+  std::string port = DEFAULT_PORT;
+  pid_t serverPid = -1;
+  std::size_t shards = 0;
+  std::size_t games = 100;
+  double rate = 0;
+  double seconds = 10;
+  std::uint32_t maxCalls = 400;
+  for (int i = 1; i < argc; i++)
+    {
+      std::string arg = argv[i];
+      if (arg == "-h" && i+1 < argc)
+        {
+          host = argv[++i];
+        }
+      else if (arg == "-p" && i+1 < argc)
+        {
+          port = argv[++i];
+        }
+      else if (arg == "-P" && i+1 < argc)
+        {
+          serverPid = std::atol(argv[++i]);
+        }
+      else if (arg == "-s" && i+1 < argc)
+        {
+          long v = std::atol(argv[++i]);
+          shards = v > 0 ? v : 1;
+        }
+      else if (arg == "-g" && i+1 < argc)
+        {
+          long v = std::atol(argv[++i]);
+          games = v > 0 ? v : 1;
+        }
+      else if (arg == "-r" && i+1 < argc)
+        {
+          rate = std::atof(argv[++i]);
+        }
+      else if (arg == "-t" && i+1 < argc)
+        {
+          seconds = std::atof(argv[++i]);
+        }
+      else if (arg == "-m" && i+1 < argc)
+        {
+          long v = std::atol(argv[++i]);
+          maxCalls = v > 0 ? v : 1;
+        }
+      else
+        {
+          usage();
+          return 1;
+        }
+    }
+  std::signal(SIGPIPE, SIG_IGN);
+
+  //Every game needs two descriptors here, and two more in the server
+  rlimit files;
+  if (getrlimit(RLIMIT_NOFILE, &files) == 0 && files.rlim_cur < files.rlim_max)
+    {
+      files.rlim_cur = files.rlim_max;
+      setrlimit(RLIMIT_NOFILE, &files);
+    }
+
+  bool ownServer = host.empty();
+  if (ownServer)
+    {
+      host = "127.0.0.1";
+      serverPid = startServer(port, shards);
+      if (serverPid < 0)
+        {
+          std::cerr << "Could not start a server\n";
+          return 1;
+        }
+    }
+
+  addrinfo hints;
+  memset(&hints, 0, sizeof(hints));
+  hints.ai_family = AF_UNSPEC;
+  hints.ai_socktype = SOCK_STREAM;
+  addrinfo* addr;
+  if (getaddrinfo(host.c_str(), port.c_str(), &hints, &addr) != 0)
+    {
+      std::cerr << "Could not find " << host << "\n";
+      if (ownServer) kill(serverPid, SIGKILL);
+      return 1;
+    }
+
+  //Wait for our own server to start listening
+  bool up = !ownServer;
+  for (int tries = 0; !up && tries < 100; tries++)
+    {
+      int fd = socket(addr->ai_family, addr->ai_socktype, addr->ai_protocol);
+      up = fd >= 0 && connect(fd, addr->ai_addr, addr->ai_addrlen) == 0;
+      if (fd >= 0) close(fd);
+      if (!up) usleep(20000);
+    }
+  if (!up)
+    {
+      std::cerr << "Server did not start on port " << port << "\n";
+      kill(serverPid, SIGKILL);
+      waitpid(serverPid, nullptr, 0);
+      freeaddrinfo(addr);
+      return 1;
+    }
+
+  double cpuBefore = serverPid > 0 ? cpuSeconds(serverPid) : -1;
+  Clock::time_point begin = Clock::now();
+  bool ok;
+  std::vector<std::uint32_t> latencies;
+  NetBench bench(addr, games, rate, maxCalls);
+  ok = bench.run(std::chrono::duration_cast<Clock::duration>
+                 (std::chrono::duration<double>(seconds)));
+  std::chrono::duration<double> elapsed = Clock::now() - begin;
+  double cpuAfter = serverPid > 0 ? cpuSeconds(serverPid) : -1;
+  latencies.swap(bench.latencies());
+
+  std::cout << games << " games at once, " << bench.finished()
+            << " finished, " << bench.failed() << " connections failed\n";
+  std::cout << bench.frames() << " messages sent, " << bench.relayed()
+            << " calls relayed in " << elapsed.count() << " s\n";
+  std::cout << bench.frames() / elapsed.count() << " messages/s, "
+            << bench.relayed() / elapsed.count() << " calls relayed/s\n";
+  if (!latencies.empty())
+    {
+      std::sort(latencies.begin(), latencies.end());
+      std::size_t n = latencies.size();
+      std::cout << "Relay latency us: p50 " << latencies[n / 2]
+                << ", p99 " << latencies[n * 99 / 100]
+                << ", p999 " << latencies[n * 999 / 1000]
+                << ", max " << latencies[n - 1] << "\n";
+    }
+  if (cpuBefore >= 0 && cpuAfter >= 0)
+    {
+      double used = cpuAfter - cpuBefore;
+      std::cout << "Server CPU " << used << " s, "
+                << 100 * used / elapsed.count() << "% of one core\n";
+    }
+
+  if (ownServer)
+    {
+      kill(serverPid, SIGINT);
+      waitpid(serverPid, nullptr, 0);
+    }
+  freeaddrinfo(addr);
+  if (!ok)
+    {
+      std::cerr << "The event loop failed\n";
+      return 1;
+    }
+  return latencies.empty() ? 1 : 0;
+}
@@ -0,0 +1,79 @@
+/*
+  Copyright (c) 2014 Auston Sterling
+  See license.txt for copying permission.
+
+  -----FrameReader Class Implementation-----
+  Auston Sterling
+  austonst@gmail.com
+
+  Framing for the network protocol, shared by clients and the server.
+*/
+
+#include "netframe.hpp"
+
+#include <sys/uio.h>
+#include <cstring>
+#include <algorithm>
+
+namespace c2
+{
+
+  FrameReader::FrameReader(std::size_t capacity) :
+    _head(0), _tail(0), _corrupt(false)
+  {
+    std::size_t size = 1;
+    while (size < capacity || size < 2 * MAX_FRAME_SIZE) size *= 2;
+    _buffer.resize(size);
+    _mask = size - 1;
+  }
+
+  ssize_t FrameReader::fill(int fd)
+  {
+    //Start from the beginning whenever we can, so frames rarely wrap
+    if (_head == _tail) _head = _tail = 0;
+
+    //The free space is at most two pieces, either side of the end
+    std::size_t space = _buffer.size() - (_tail - _head);
+    std::size_t start = _tail & _mask;
+    std::size_t first = std::min(space, _buffer.size() - start);
+    iovec iov[2];
+    iov[0].iov_base = &_buffer[start];
+    iov[0].iov_len = first;
+    iov[1].iov_base = &_buffer[0];
+    iov[1].iov_len = space - first;
+
+    ssize_t got = readv(fd, iov, iov[1].iov_len ? 2 : 1);
+    if (got > 0) _tail += got;
+    return got;
+  }
+
+  const std::uint8_t* FrameReader::next(std::size_t& size)
+  {
+    if (_corrupt || buffered() < HEADER_SIZE) return nullptr;
+    if (at(0) != MAGIC_NUM)
+      {
+        _corrupt = true;
+        return nullptr;
+      }
+    std::size_t length = HEADER_SIZE + at(2);
+    if (buffered() < length) return nullptr;
+
+    const std::uint8_t* frame;
+    std::size_t start = _head & _mask;
+    if (start + length <= _buffer.size())
+      {
+        frame = &_buffer[start];
+      }
+    else
+      {
+        std::size_t first = _buffer.size() - start;
+        memcpy(_scratch, &_buffer[start], first);
+        memcpy(_scratch + first, &_buffer[0], length - first);
+        frame = _scratch;
+      }
+    _head += length;
+    size = length;
+    return frame;
+  }
+
+} //Namespace
@@ -0,0 +1,90 @@
+/*
+  Copyright (c) 2014 Auston Sterling
+  See license.txt for copying permission.
+
+  -----FrameReader Class Header-----
+  Auston Sterling
+  austonst@gmail.com
+
+  Framing for the network protocol, shared by clients and the server.
+
+  Every frame starts with a three byte header:
+  1B magic number (0xCE, it's the hex values in the word chess)
+  1B frame type
+  1B payload length
+  followed by the payload. The length lets a reader find the end of a frame
+  without knowing its type, so frames are never read piece by piece.
+
+  The reader keeps a ring buffer per connection, fills it with as much as
+  the socket has in one call, then hands out every complete frame in place.
+*/
+
+#ifndef _netframe_hpp_
+#define _netframe_hpp_
+
+#include <cstdint>
+#include <cstddef>
+#include <string>
+#include <vector>
+#include <sys/types.h>
+
+namespace c2
+{
+
+  typedef std::vector<std::uint8_t> Message;
+  const std::string DEFAULT_PORT = "38519";
+  const std::uint8_t MAGIC_NUM = 0xCE;
+  const std::uint16_t NET_VERSION = 2;
+  const std::size_t HEADER_SIZE = 3;
+  const std::size_t MAX_FRAME_SIZE = HEADER_SIZE + 255;
+
+  class FrameReader
+  {
+  public:
+    //Constructors
+    //Capacity is rounded up to a power of two of at least two frames
+    FrameReader(std::size_t capacity = 1 << 16);
+
+    //Reads as much as fd has and there is room for, in one call.
+    //Returns what read() would: the bytes read, 0 if the peer hung up, or -1
+    //with errno set.
+    ssize_t fill(int fd);
+
+    //The next complete frame, or nullptr if there isn't one yet. The frame
+    //stays valid until the next fill().
+    const std::uint8_t* next(std::size_t& size);
+
+    //Set once the data stops making sense as frames, after which next()
+    //never returns anything
+    bool corrupt() const {return _corrupt;}
+
+    //Bytes received but not yet handed out
+    std::size_t buffered() const {return _tail - _head;}
+
+    //Throws away everything buffered, for a new connection. Keeps the
+    //buffer, so nothing is allocated.
+    void clear() {_head = _tail = 0; _corrupt = false;}
+
+  private:
+    //A byte some way past the head
+    std::uint8_t at(std::size_t offset) const
+    {
+      return _buffer[(_head + offset) & _mask];
+    }
+
+    std::vector<std::uint8_t> _buffer;
+    std::size_t _mask;
+
+    //Positions of the oldest and newest bytes, which only ever grow
+    std::size_t _head;
+    std::size_t _tail;
+
+    //A frame that wraps around the end of the buffer is copied here
+    std::uint8_t _scratch[MAX_FRAME_SIZE];
+
+    bool _corrupt;
+  };
+
+} //Namespace
+
+#endif
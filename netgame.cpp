@@ -16,7 +16,13 @@
 #include <netdb.h>
 #include <arpa/inet.h>
 #include <unistd.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/uio.h>
+#include <cerrno>
 #include <cstring>
+#include <chrono>
+#include <algorithm>
 
 
 #include <iostream>
@@ -24,10 +30,249 @@
 namespace c2
 {
 
+  static std::uint64_t steadyNanos()
+  {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>
+      (std::chrono::steady_clock::now().time_since_epoch()).count();
+  }
+
+  //Writes every slot with one writev, unless the socket takes less
+  static bool sendSlots(int fd, const MessageSlot* slots, std::size_t count)
+  {
+    iovec iov[NET_SEND_BATCH];
+    for (std::size_t i = 0; i < count; i++)
+      {
+        iov[i].iov_base = const_cast<std::uint8_t*>(slots[i].data);
+        iov[i].iov_len = slots[i].size;
+      }
+
+    iovec* next = iov;
+    while (count > 0)
+      {
+        ssize_t sent = writev(fd, next, count);
+        if (sent < 0 && errno == EINTR) continue;
+        if (sent <= 0) return false;
+
+        //Skip past whatever was written
+        while (count > 0 && std::size_t(sent) >= next->iov_len)
+          {
+            sent -= next->iov_len;
+            next++;
+            count--;
+          }
+        if (count > 0)
+          {
+            next->iov_base = static_cast<std::uint8_t*>(next->iov_base) + sent;
+            next->iov_len -= sent;
+          }
+      }
+    return true;
+  }
+
+  //Writes a message straight to the socket, from the thread
+  static bool writeAll(int fd, const std::uint8_t* m, std::size_t size)
+  {
+    while (size > 0)
+      {
+        ssize_t sent = write(fd, m, size);
+        if (sent < 0 && errno == EINTR) continue;
+        if (sent <= 0) return false;
+        m += sent;
+        size -= sent;
+      }
+    return true;
+  }
+
+  std::size_t messageLength(std::uint8_t type)
+  {
+    //Snapshots vary in length, so are listed as 0
+    static const std::size_t payloads[] =
+      {2, 0, 6, 1, 2, 1, 1, 2, 0, 4, 4, 12, 4, 12, 16, 3};
+    if (type >= sizeof(payloads) / sizeof(payloads[0])) return 0;
+    if (type == 8) return 0;
+    return HEADER_SIZE + payloads[type];
+  }
+
+  GameReturnType applyMessage(Game& g, const std::uint8_t* m)
+  {
+    const std::uint8_t* p = m + HEADER_SIZE;
+    switch (m[1])
+      {
+      case 0: //setArmy
+        return g.setArmy(static_cast<SideType>(p[0]),
+                         static_cast<ArmyType>(p[1]));
+      case 1: //start
+        return g.start();
+      case 2: //move
+        return g.move(Move(Position(p[0], p[1]), Position(p[2], p[3]),
+                           static_cast<PieceType>(p[4]),
+                           static_cast<SideType>(p[5])));
+      case 3: //startDuel
+        return g.startDuel(p[0] != 0);
+      case 4: //bid
+        return g.bid(static_cast<SideType>(p[0]), p[1]);
+      case 5: //promote
+        return g.promote(static_cast<PieceType>(p[0]));
+      default:
+        return GameReturnType::INVALID_PARAM;
+      }
+  }
+
+  static void putBE(std::uint8_t* out, std::uint64_t v, std::size_t bytes)
+  {
+    for (std::size_t i = bytes; i > 0; i--)
+      {
+        out[i-1] = v & 0xFF;
+        v >>= 8;
+      }
+  }
+
+  static std::uint64_t getBE(const std::uint8_t* in, std::size_t bytes)
+  {
+    std::uint64_t v = 0;
+    for (std::size_t i = 0; i < bytes; i++)
+      {
+        v = (v << 8) | in[i];
+      }
+    return v;
+  }
+
+  static void putPiece(std::uint8_t* out, const Piece& p)
+  {
+    out[0] = num(p.type());
+    out[1] = (p.pos().x() & 0xF) | (p.pos().y() << 4);
+    out[2] = num(p.side());
+  }
+
+  static bool getPiece(const std::uint8_t* in, Piece& p)
+  {
+    if (in[0] > num(PieceType::NONE) || in[2] > num(SideType::NONE))
+      {
+        return false;
+      }
+    p = Piece(static_cast<PieceType>(in[0]), Position(in[1] & 0xF, in[1] >> 4),
+              static_cast<SideType>(in[2]));
+    return true;
+  }
+
+  static const std::size_t SNAPSHOT_FIXED_SIZE = 28;
+  static const std::size_t SNAPSHOT_PIECE_SIZE = 3;
+
+  std::size_t snapshotFrame(const GameSnapshot& s, std::uint8_t* out)
+  {
+    //There are never more pieces than squares, so this always fits
+    std::size_t count = std::min<std::size_t>(s.pieces.size(), 64);
+    std::uint8_t* p = out + HEADER_SIZE;
+    p[0] = num(s.state);
+    p[1] = num(s.whiteArmy) | (num(s.blackArmy) << 4);
+    p[2] = s.whiteStones;
+    p[3] = s.blackStones;
+    p[4] = s.whiteBet;
+    p[5] = s.blackBet;
+    p[6] = s.whiteKingCastle | (s.whiteQueenCastle << 1) |
+      (s.blackKingCastle << 2) | (s.blackQueenCastle << 3) |
+      (s.isKingTurn << 4);
+    p[7] = s.fiftyMoveRule;
+    putBE(p + 8, s.touched, 8);
+    putBE(p + 16, packMove(s.lastMove), 4);
+    putBE(p + 20, packMove(s.currentMove), 4);
+    putPiece(p + 24, s.justTaken);
+    p[27] = count;
+    for (std::size_t i = 0; i < count; i++)
+      {
+        putPiece(p + SNAPSHOT_FIXED_SIZE + SNAPSHOT_PIECE_SIZE * i,
+                 s.pieces[i]);
+      }
+
+    std::size_t payload = SNAPSHOT_FIXED_SIZE + SNAPSHOT_PIECE_SIZE * count;
+    out[0] = MAGIC_NUM;
+    out[1] = 0x08;
+    out[2] = payload;
+    return HEADER_SIZE + payload;
+  }
+
+  bool readSnapshotFrame(const std::uint8_t* m, std::size_t size,
+                         GameSnapshot& s)
+  {
+    const std::uint8_t* p = m + HEADER_SIZE;
+    if (size < HEADER_SIZE + SNAPSHOT_FIXED_SIZE || m[1] != 0x08 ||
+        size != HEADER_SIZE + SNAPSHOT_FIXED_SIZE +
+        SNAPSHOT_PIECE_SIZE * p[27])
+      {
+        return false;
+      }
+    if (p[0] >= NUM_GAMESTATES || (p[1] & 0xF) > num(ArmyType::NONE) ||
+        (p[1] >> 4) > num(ArmyType::NONE))
+      {
+        return false;
+      }
+
+    s.state = static_cast<GameStateType>(p[0]);
+    s.whiteArmy = toArmy(p[1] & 0xF);
+    s.blackArmy = toArmy(p[1] >> 4);
+    s.whiteStones = p[2];
+    s.blackStones = p[3];
+    s.whiteBet = p[4];
+    s.blackBet = p[5];
+    s.whiteKingCastle = p[6] & 1;
+    s.whiteQueenCastle = (p[6] >> 1) & 1;
+    s.blackKingCastle = (p[6] >> 2) & 1;
+    s.blackQueenCastle = (p[6] >> 3) & 1;
+    s.isKingTurn = (p[6] >> 4) & 1;
+    s.fiftyMoveRule = p[7];
+    s.touched = getBE(p + 8, 8);
+    s.lastMove = unpackMove(getBE(p + 16, 4));
+    s.currentMove = unpackMove(getBE(p + 20, 4));
+    if (!getPiece(p + 24, s.justTaken)) return false;
+    s.pieces.resize(p[27]);
+    for (std::size_t i = 0; i < s.pieces.size(); i++)
+      {
+        if (!getPiece(p + SNAPSHOT_FIXED_SIZE + SNAPSHOT_PIECE_SIZE * i,
+                      s.pieces[i]))
+          {
+            return false;
+          }
+      }
+    return true;
+  }
+
   NetGame::NetGame(Board* b, std::string ip, std::string port) :
+    _in(4096),
     _sockfd(-1),
-    _killThread(false)
+    _killThread(false),
+    _threadStarted(false),
+    _sentMessages(0),
+    _sendMicros(0),
+    _maxSendMicros(0),
+    _gameId(0),
+    _host(false),
+    _calls(0),
+    _replaying(false),
+    _resumeCalls(0),
+    _awaitingSnapshot(false),
+    _resyncCalls(0),
+    _desyncs(0),
+    _hasSession(false),
+    _openingSize(0)
   {
+    pthread_mutex_init(&_gameLock, NULL);
+    for (std::size_t i = 0; i < NET_RESEND_HISTORY; i++)
+      {
+        _sent[i].size = 0;
+        _sent[i].stamp = ~std::uint64_t(0);
+      }
+
+    //The thread never blocks on writing to the pipe
+    if (pipe(_wakePipe) == 0)
+      {
+        fcntl(_wakePipe[0], F_SETFL, O_NONBLOCK);
+        fcntl(_wakePipe[1], F_SETFL, O_NONBLOCK);
+      }
+    else
+      {
+        _wakePipe[0] = _wakePipe[1] = -1;
+      }
+
     setBoard(b);
     if (ip.length() > 0)
       {
@@ -35,6 +280,175 @@ namespace c2
       }
   }
 
+  NetGame::~NetGame()
+  {
+    disconnect();
+    if (_threadStarted) pthread_join(_thread, NULL);
+    if (_sockfd >= 0) close(_sockfd);
+    if (_wakePipe[0] >= 0) close(_wakePipe[0]);
+    if (_wakePipe[1] >= 0) close(_wakePipe[1]);
+    pthread_mutex_destroy(&_gameLock);
+  }
+
+  void NetGame::disconnect()
+  {
+    _killThread = true;
+    std::uint8_t b = 0;
+    ssize_t r = write(_wakePipe[1], &b, 1);
+    (void)r;
+  }
+
+  void NetGame::sendCall(const std::uint8_t* m, std::size_t size)
+  {
+    send(m, size);
+    MessageSlot& kept = _sent[_calls % NET_RESEND_HISTORY];
+    memcpy(kept.data, m, size);
+    kept.size = size;
+    kept.stamp = _calls;
+
+    std::uint8_t om[HEADER_SIZE + 12] = {MAGIC_NUM, 0x0B, 12};
+    putBE(om + HEADER_SIZE, ++_calls, 4);
+    putBE(om + HEADER_SIZE + 4, _game.hash(), 8);
+    send(om, sizeof(om));
+  }
+
+  bool NetGame::desynced()
+  {
+    _desyncs++;
+    if (_host) return sendResync();
+
+    //Ask the host for its game
+    std::uint8_t om[HEADER_SIZE + 4] = {MAGIC_NUM, 0x0C, 4};
+    putBE(om + HEADER_SIZE, _calls, 4);
+    return writeAll(_sockfd, om, sizeof(om));
+  }
+
+  bool NetGame::sendResync()
+  {
+    //Calls already in the snapshot mustn't follow it
+    if (!flushQueue()) return false;
+
+    std::uint8_t om[HEADER_SIZE + 4 + MAX_FRAME_SIZE] = {MAGIC_NUM, 0x0C, 4};
+    putBE(om + HEADER_SIZE, _calls, 4);
+    std::size_t size = snapshotFrame(_game.snapshot(), om + HEADER_SIZE + 4);
+    return writeAll(_sockfd, om, HEADER_SIZE + 4 + size);
+  }
+
+  bool NetGame::resync(const std::uint8_t* m, std::size_t size)
+  {
+    //Snapshots are only taken from the host, after it said one is coming
+    if (_host || !_awaitingSnapshot) return true;
+    _awaitingSnapshot = false;
+
+    GameSnapshot s;
+    if (!readSnapshotFrame(m, size, s)) return false;
+    if (_game.restore(s) != GameReturnType::SUCCESS) return false;
+    _calls = _resyncCalls;
+    return true;
+  }
+
+  std::uint64_t NetGame::hash() const
+  {
+    pthread_mutex_lock(&_gameLock);
+    std::uint64_t h = _game.hash();
+    pthread_mutex_unlock(&_gameLock);
+    return h;
+  }
+
+  std::set<Position> NetGame::possibleMoves(Position pos)
+  {
+    pthread_mutex_lock(&_gameLock);
+    std::set<Position> moves = _game.possibleMoves(pos);
+    pthread_mutex_unlock(&_gameLock);
+    return moves;
+  }
+
+  GameStateType NetGame::state() const
+  {
+    pthread_mutex_lock(&_gameLock);
+    GameStateType s = _game.state();
+    pthread_mutex_unlock(&_gameLock);
+    return s;
+  }
+
+  std::uint8_t NetGame::stones(SideType side) const
+  {
+    pthread_mutex_lock(&_gameLock);
+    std::uint8_t n = _game.stones(side);
+    pthread_mutex_unlock(&_gameLock);
+    return n;
+  }
+
+  ArmyType NetGame::army(SideType side) const
+  {
+    pthread_mutex_lock(&_gameLock);
+    ArmyType a = _game.army(side);
+    pthread_mutex_unlock(&_gameLock);
+    return a;
+  }
+
+  GameSnapshot NetGame::snapshot() const
+  {
+    pthread_mutex_lock(&_gameLock);
+    GameSnapshot s = _game.snapshot();
+    pthread_mutex_unlock(&_gameLock);
+    return s;
+  }
+
+  bool NetGame::replay(std::uint32_t serverCalls)
+  {
+    _replaying = false;
+    if (serverCalls >= _resumeCalls) return true;
+
+    //Only our own calls can be missing, and only the last few are kept
+    for (std::uint32_t i = serverCalls; i < _resumeCalls; i++)
+      {
+        if (_sent[i % NET_RESEND_HISTORY].stamp != i) return desynced();
+      }
+    for (std::uint32_t i = serverCalls; i < _resumeCalls; i++)
+      {
+        const MessageSlot& kept = _sent[i % NET_RESEND_HISTORY];
+        if (!writeAll(_sockfd, kept.data, kept.size)) return false;
+      }
+
+    //Calls made since come with hashes of their own
+    if (_calls != _resumeCalls) return true;
+    std::uint8_t om[HEADER_SIZE + 12] = {MAGIC_NUM, 0x0B, 12};
+    putBE(om + HEADER_SIZE, _calls, 4);
+    putBE(om + HEADER_SIZE + 4, _game.hash(), 8);
+    return writeAll(_sockfd, om, sizeof(om));
+  }
+
+  NetLatency NetGame::sendLatency() const
+  {
+    NetLatency l;
+    l.messages = _sentMessages;
+    l.totalMicros = _sendMicros;
+    l.maxMicros = _maxSendMicros;
+    return l;
+  }
+
+  bool NetGame::startThread()
+  {
+    if (_threadStarted || _wakePipe[0] < 0) return false;
+    _killThread = false;
+    _threadStarted = pthread_create(&_thread, NULL, &connect_thread, this) == 0;
+    return _threadStarted;
+  }
+
+  void NetGame::send(const std::uint8_t* m, std::size_t size)
+  {
+    //If the thread can't keep up, the peer won't be in sync any more
+    if (!_outMessage.push(m, size, steadyNanos()))
+      {
+        disconnect();
+        return;
+      }
+    std::uint8_t b = 0;
+    ssize_t r = write(_wakePipe[1], &b, 1);
+    (void)r;
+  }
+
   bool NetGame::connectStart(std::string ip, std::string port)
   {
     //Set up addrinfo struct
@@ -79,16 +493,61 @@ namespace c2
       }
 
     //Create a thread to handle the communication
-    pthread_t tid;
-    _killThread = false;
-    if (pthread_create(&tid, NULL, &connect_thread, this) != 0)
+    _host = false;
+    if (!startThread())
       {
         close(_sockfd);
+        _sockfd = -1;
         return false;
       }
     return true;
   }
 
+  bool NetGame::resume(std::string ip, std::string port)
+  {
+    if (!_hasSession) return false;
+
+    //Finish off the old connection
+    disconnect();
+    if (_threadStarted) pthread_join(_thread, NULL);
+    _threadStarted = false;
+    if (_sockfd >= 0) close(_sockfd);
+    _sockfd = -1;
+    _in.clear();
+    _awaitingSnapshot = false;
+
+    //Whatever was still queued is sent again from what we kept, once the
+    //server says how far it got
+    MessageSlot dropped;
+    while (_outMessage.pop(dropped)) {}
+
+    std::uint8_t* m = _opening;
+    m[0] = MAGIC_NUM;
+    m[1] = 0x0E;
+    m[2] = 16;
+    memcpy(m + HEADER_SIZE, _session, sizeof(_session));
+    pthread_mutex_lock(&_gameLock);
+    putBE(m + HEADER_SIZE + 12, _calls, 4);
+    _replaying = true;
+    _resumeCalls = _calls;
+    pthread_mutex_unlock(&_gameLock);
+    _openingSize = HEADER_SIZE + 16;
+    return connectStart(ip, port);
+  }
+
+  bool NetGame::seek(std::string ip, std::uint16_t rating, ArmyType army,
+                     std::string port)
+  {
+    std::uint8_t* m = _opening;
+    m[0] = MAGIC_NUM;
+    m[1] = 0x0F;
+    m[2] = 3;
+    putBE(m + HEADER_SIZE, rating, 2);
+    m[HEADER_SIZE + 2] = num(army);
+    _openingSize = HEADER_SIZE + 3;
+    return connectStart(ip, port);
+  }
+
   bool NetGame::listenStart(std::string port)
   {
     //Set up addrinfo struct
@@ -154,10 +613,8 @@ namespace c2
         close(_sockfd);
         _sockfd = csock;
         connected = true;
-        pthread_t tid;
-        _killThread = false;
-        
-        if (pthread_create(&tid, NULL, &connect_thread, this) != 0) return false;
+        _host = true;
+        if (!startThread()) return false;
       }
     return true;
   }
@@ -167,172 +624,197 @@ namespace c2
     NetGame* ng = static_cast<NetGame*>(self);
 
     //We believe a connection has been established.
-    //Start by sending a version message, then begin regular behavior
-    Message om;
-    om.push_back(MAGIC_NUM);
-    om.push_back(0x07);
-    om.push_back(NET_VERSION >> 8);
-    om.push_back(0xFF & NET_VERSION);
-    ng->_outMessage.push(om);
-
-    //Set up fp set for select
-    fd_set readfs;
-    FD_ZERO(&readfs);
-    FD_SET(ng->_sockfd, &readfs);
-    timeval fstime;
-    fstime.tv_sec = 0;
-    fstime.tv_usec = 100000;
+    //A resume or seek message has to come before anything else
+    if (ng->_openingSize)
+      {
+        if (!writeAll(ng->_sockfd, ng->_opening, ng->_openingSize))
+          {
+            ng->_killThread = true;
+          }
+        ng->_openingSize = 0;
+      }
+
+    //Start by sending a version message, then begin regular behavior. It
+    //is written here rather than queued, as only the caller pushes there.
+    const std::uint8_t version[] =
+      {MAGIC_NUM, 0x07, 2, NET_VERSION >> 8, 0xFF & NET_VERSION};
+    if (!ng->_killThread && !writeAll(ng->_sockfd, version, sizeof(version)))
+      {
+        ng->_killThread = true;
+      }
+
+    //Wake up for the peer or for our own messages, and for nothing else
+    pollfd fds[2];
+    fds[0].fd = ng->_sockfd;
+    fds[0].events = POLLIN;
+    fds[1].fd = ng->_wakePipe[0];
+    fds[1].events = POLLIN;
 
     //Main loop
     while (!ng->_killThread)
       {
-        //Check for incoming messages
-        fd_set updatedfs = readfs;
-        select(ng->_sockfd+1, &updatedfs, nullptr, nullptr, &fstime);
+        //There is nothing to do until one of them is ready, so no timeout
+        if (poll(fds, 2, -1) < 0)
+          {
+            if (errno == EINTR) continue;
+            break;
+          }
+
+        //Empty the pipe, the queue itself says what there is to send
+        if (fds[1].revents & POLLIN)
+          {
+            std::uint8_t drain[64];
+            while (read(ng->_wakePipe[0], drain, sizeof(drain)) > 0) {}
+          }
 
-        bool gotMessage = false;
-        Message im(100, '\0');
-        std::size_t rec = 0;
-        if (FD_ISSET(ng->_sockfd, &updatedfs))
+        //Take everything the peer has sent in one read, then handle every
+        //whole message in it
+        if (fds[0].revents & (POLLIN | POLLHUP | POLLERR))
           {
-            do
+            ssize_t got = ng->_in.fill(ng->_sockfd);
+            if (got <= 0)
               {
-                ssize_t err = read(ng->_sockfd, (&im[rec]), HEADER_SIZE-rec);
-                if (err < 0)
-                  {
-                    perror("Error reading from socket: ");
-                    return nullptr;
-                  }
-                rec += err;
+                //Either an error or the peer hung up
+                if (got < 0 && errno == EINTR) continue;
+                if (got < 0) perror("Error reading from socket: ");
+                break;
               }
-            while (rec < HEADER_SIZE && rec > 0);
           }
 
-        //If we did get a header, get the rest and process it
-        if (rec >= HEADER_SIZE)
+        std::size_t size;
+        const std::uint8_t* im;
+        pthread_mutex_lock(&ng->_gameLock);
+        while (!ng->_killThread && (im = ng->_in.next(size)))
           {
-            gotMessage = true;
-            
-            //If the magic number is wrong, bail for now
-            //NOTE: Make this more intelligent later!
-            if (im[0] != MAGIC_NUM)
+            //Snapshots vary in length, so are checked as they're read
+            if (im[1] == 8)
+              {
+                if (!ng->resync(im, size)) ng->_killThread = true;
+                continue;
+              }
+
+            //Known messages must be the right size, others are skipped
+            std::size_t length = messageLength(im[1]);
+            if (length == 0) continue;
+            if (length != size)
               {
+                ng->_killThread = true;
                 break;
               }
 
             //Handle the message depending on type
             //NOTE: Find a better way to resolve non-success returns
+            const std::uint8_t* p = im + HEADER_SIZE;
             switch (im[1])
               {
-              case 0: //setArmy
+              case 6: //state
                 {
-                  while (rec < 4)
-                    {
-                      rec += read(ng->_sockfd, (&im[rec]), 4-rec);
-                    }
-                  GameReturnType r = ng->_game.setArmy(static_cast<SideType>(im[2]),
-                                                       static_cast<ArmyType>(im[3]));
-                  if (r != GameReturnType::SUCCESS) ng->_killThread = true;
+                  if (p[0] != num(ng->_game.state())) ng->_killThread = true;
                   break;
                 }
-                
-              case 1: //start
+
+              case 7: //version
                 {
-                  GameReturnType r = ng->_game.start();
-                  if (r != GameReturnType::SUCCESS) ng->_killThread = true;
+                  std::uint16_t otherVer = (p[0] << 8) + p[1];
+                  if (NET_VERSION != otherVer) ng->_killThread = true;
                   break;
                 }
-                
-              case 2: //move
+
+              case 9: //game
                 {
-                  while (rec < 8)
-                    {
-                      rec += read(ng->_sockfd, (&im[rec]), 8-rec);
-                    }
-                  Move m(Position(im[2],im[3]),Position(im[4],im[5]),
-                         static_cast<PieceType>(im[6]),
-                         static_cast<SideType>(im[7]));
-                  GameReturnType r = ng->_game.move(m);
-                  if (r != GameReturnType::SUCCESS) ng->_killThread = true;
+                  ng->_gameId = getBE(p, 4);
                   break;
                 }
-                
-              case 3: //startDuel
+
+              case 11: //hash
                 {
-                  while (rec < 3)
+                  //The first after resuming says what the server missed
+                  if (ng->_replaying && !ng->replay(getBE(p, 4)))
                     {
-                      rec += read(ng->_sockfd, (&im[rec]), 3-rec);
+                      ng->_killThread = true;
+                      break;
                     }
-                  GameReturnType r = ng->_game.startDuel(im[2]==0?false:true);
-                  if (r != GameReturnType::SUCCESS) ng->_killThread = true;
-                  break;
-                }
-                
-              case 4: //bid
-                {
-                  while (rec < 4)
+
+                  //Only comparable once both have made the same calls
+                  if (getBE(p, 4) == ng->_calls &&
+                      getBE(p + 4, 8) != ng->_game.hash() && !ng->desynced())
                     {
-                      rec += read(ng->_sockfd, (&im[rec]), 4-rec);
+                      ng->_killThread = true;
                     }
-                  GameReturnType r = ng->_game.bid(static_cast<SideType>(im[2]),
-                                                   im[3]);
-                  if (r != GameReturnType::SUCCESS) ng->_killThread = true;
                   break;
                 }
-                
-              case 5: //promote
+
+              case 12: //resync
                 {
-                  while (rec < 3)
+                  if (ng->_host)
+                    {
+                      if (!ng->sendResync()) ng->_killThread = true;
+                    }
+                  else
                     {
-                      rec += read(ng->_sockfd, (&im[rec]), 3-rec);
+                      ng->_awaitingSnapshot = true;
+                      ng->_resyncCalls = getBE(p, 4);
                     }
-                  GameReturnType r = ng->_game.promote(static_cast<PieceType>(im[2]));
-                  if (r != GameReturnType::SUCCESS) ng->_killThread = true;
                   break;
                 }
-                
-              case 6: //state
+
+              case 13: //session
                 {
-                  while (rec < 3)
-                    {
-                      rec += read(ng->_sockfd, (&im[rec]), 3-rec);
-                    }
-                  if (im[2] != num(ng->_game.state())) ng->_killThread = true;
+                  memcpy(ng->_session, p, sizeof(ng->_session));
+                  ng->_hasSession = true;
                   break;
                 }
 
-              case 7: //version
+              default:
                 {
-                  while (rec < 4)
-                    {
-                      rec += read(ng->_sockfd, (&im[rec]), 4-rec);
-                    }
-                  std::uint16_t otherVer = (im[2] << 8) + im[3];
-                  if (NET_VERSION != otherVer) ng->_killThread = true;
+                  //A call that doesn't go through means the games differ
+                  GameReturnType r = applyMessage(ng->_game, im);
+                  if (succeeded(r)) ng->_calls++;
+                  else if (!ng->desynced()) ng->_killThread = true;
                   break;
                 }
-                
-              default: break;
               }
           }
+        pthread_mutex_unlock(&ng->_gameLock);
+
+        //If the magic number is wrong, bail for now
+        //NOTE: Make this more intelligent later!
+        if (ng->_in.corrupt()) break;
 
-        //If we received a message, don't send anything until we're sure the
-        //incoming queue is clear
-        if (gotMessage) continue;
-        
-        //Send all outgoing messages
-        while (!ng->_outMessage.empty())
+        //Send all outgoing messages. They were applied to our game when
+        //they were queued, so they don't need to wait on incoming ones,
+        //unless calls from before resuming have to go first.
+        if (!ng->_killThread && !ng->_replaying && !ng->flushQueue()) break;
+      }
+    ng->_killThread = true;
+    return nullptr;
+  }
+
+  bool NetGame::flushQueue()
+  {
+    //As few writes as possible
+    MessageSlot om[NET_SEND_BATCH];
+    std::size_t count = 0;
+    while (true)
+      {
+        bool more = _outMessage.pop(om[count]);
+        if (more) count++;
+        if (count == 0) break;
+        if (more && count < NET_SEND_BATCH) continue;
+
+        if (!sendSlots(_sockfd, om, count)) return false;
+        std::uint64_t now = steadyNanos();
+        for (std::size_t i = 0; i < count; i++)
           {
-            om = ng->_outMessage.front();
-            ng->_outMessage.pop();
-            std::size_t sent = 0;
-            while (sent < om.size())
-              {
-                sent += write(ng->_sockfd, &om[sent], om.size() - sent);
-              }
+            std::uint64_t micros = (now - om[i].stamp) / 1000;
+            _sentMessages++;
+            _sendMicros += micros;
+            if (micros > _maxSendMicros) _maxSendMicros = micros;
           }
+        count = 0;
+        if (!more) break;
       }
-    return nullptr;
+    return true;
   }
 
   GameReturnType NetGame::setBoard(Board* b)
@@ -343,91 +825,83 @@ namespace c2
 
   GameReturnType NetGame::setArmy(SideType side, ArmyType army)
   {
+    pthread_mutex_lock(&_gameLock);
     GameReturnType r = _game.setArmy(side, army);
-    if (r != GameReturnType::SUCCESS) return r;
-
-    Message om;
-    om.push_back(MAGIC_NUM);
-    om.push_back(0x00);
-    om.push_back(num(side));
-    om.push_back(num(army));
-    _outMessage.push(om);
-
+    if (r == GameReturnType::SUCCESS)
+      {
+        const std::uint8_t om[] = {MAGIC_NUM, 0x00, 2, num(side), num(army)};
+        sendCall(om, sizeof(om));
+      }
+    pthread_mutex_unlock(&_gameLock);
     return r;
   }
 
   GameReturnType NetGame::start()
   {
+    pthread_mutex_lock(&_gameLock);
     GameReturnType r = _game.start();
-    if (r != GameReturnType::SUCCESS) return r;
-
-    Message om;
-    om.push_back(MAGIC_NUM);
-    om.push_back(0x01);
-    _outMessage.push(om);
-
+    if (r == GameReturnType::SUCCESS)
+      {
+        const std::uint8_t om[] = {MAGIC_NUM, 0x01, 0};
+        sendCall(om, sizeof(om));
+      }
+    pthread_mutex_unlock(&_gameLock);
     return r;
   }
 
   GameReturnType NetGame::move(const Move& m)
   {
+    pthread_mutex_lock(&_gameLock);
     GameReturnType r = _game.move(m);
-    if (r != GameReturnType::SUCCESS) return r;
-
-    Message om;
-    om.push_back(MAGIC_NUM);
-    om.push_back(0x02);
-    om.push_back(m.start.x());
-    om.push_back(m.start.y());
-    om.push_back(m.end.x());
-    om.push_back(m.end.y());
-    om.push_back(num(m.type));
-    om.push_back(num(m.side));
-    _outMessage.push(om);
-
+    if (succeeded(r))
+      {
+        const std::uint8_t om[] =
+          {MAGIC_NUM, 0x02, 6, std::uint8_t(m.start.x()),
+           std::uint8_t(m.start.y()), std::uint8_t(m.end.x()),
+           std::uint8_t(m.end.y()), num(m.type), num(m.side)};
+        sendCall(om, sizeof(om));
+      }
+    pthread_mutex_unlock(&_gameLock);
     return r;
   }
 
   GameReturnType NetGame::startDuel(bool d)
   {
+    pthread_mutex_lock(&_gameLock);
     GameReturnType r = _game.startDuel(d);
-    if (r != GameReturnType::SUCCESS) return r;
-
-    Message om;
-    om.push_back(MAGIC_NUM);
-    om.push_back(0x03);
-    om.push_back(d?0x01:0x00);
-    _outMessage.push(om);
-
+    if (succeeded(r))
+      {
+        const std::uint8_t om[] =
+          {MAGIC_NUM, 0x03, 1, std::uint8_t(d ? 0x01 : 0x00)};
+        sendCall(om, sizeof(om));
+      }
+    pthread_mutex_unlock(&_gameLock);
     return r;
   }
 
   GameReturnType NetGame::bid(SideType side, std::uint8_t stones)
   {
+    pthread_mutex_lock(&_gameLock);
     GameReturnType r = _game.bid(side, stones);
-    if (r != GameReturnType::SUCCESS) return r;
-
-    Message om;
-    om.push_back(MAGIC_NUM);
-    om.push_back(0x04);
-    om.push_back(num(side));
-    om.push_back(stones);
-    _outMessage.push(om);
-
+    if (succeeded(r))
+      {
+        const std::uint8_t om[] = {MAGIC_NUM, 0x04, 2, num(side), stones};
+        sendCall(om, sizeof(om));
+      }
+    pthread_mutex_unlock(&_gameLock);
     return r;
   }
 
   GameReturnType NetGame::promote(PieceType newType)
   {
+    pthread_mutex_lock(&_gameLock);
     GameReturnType r = _game.promote(newType);
-    if (r != GameReturnType::SUCCESS) return r;
-
-    Message om;
-    om.push_back(MAGIC_NUM);
-    om.push_back(0x03);
-    om.push_back(num(newType));
-    _outMessage.push(om);
-
+    if (succeeded(r))
+      {
+        const std::uint8_t om[] = {MAGIC_NUM, 0x05, 1, num(newType)};
+        sendCall(om, sizeof(om));
+      }
+    pthread_mutex_unlock(&_gameLock);
     return r;
   }
 
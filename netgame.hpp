@@ -10,12 +10,13 @@
   two players on separate clients.
 
   It is assmed that a Board* will be set before connecting, so setBoard is local
-  Messages start with one byte, 0xCE (it's the hex values in the word chess)
-  The second byte represents the function applied or type of status message
+  Messages are frames as described in netframe.hpp. The frame type is the
+  function applied or type of status message
   0 = setArmy, 1 = start, 2 = move, 3 = startDuel, 4 = bid, 5 = promote
-  6 = state, 7 = version
+  6 = state, 7 = version, 8 = snapshot, 9 = game, 10 = watch, 11 = hash,
+  12 = resync, 13 = session, 14 = resume, 15 = seek
 
-  Followed by:
+  With payloads:
   setArmy 2B   - 1B side, 1B army
   start 0B     - none
   move 6B      - 1B startx, 1B starty, 1B endx, 1B endy, 1B type, 1B side
@@ -24,33 +25,99 @@
   promote 1B   - 1B type
   state 1B     - 1B state
   version 2B   - 2B version big-endian
+  snapshot     - a GameSnapshot, see snapshotFrame()
+  game 4B      - 4B id big-endian, sent by a server to say which game it is
+  watch 4B     - 4B id big-endian, sent to a server to spectate that game
+  hash 12B     - 4B calls made on the game so far, 8B Game::hash(), both
+                 big-endian
+  resync 4B    - 4B calls made on the game so far big-endian
+  session 12B  - 4B game id, 8B secret, sent by a server as the token for
+                 getting back into the game
+  resume 16B   - 12B token, 4B calls made on the game so far, sent to a
+                 server as the first message on a new connection
+  seek 3B      - 2B rating big-endian, 1B army wanted, sent to a server as
+                 the first message to be matched through its lobby
+
+  Each side sends a hash after every call it makes. A side that has made
+  the same number of calls checks it against its own game, and if the
+  two differ the games are resynced. The host is always right: it sends a
+  resync message followed by a snapshot of its game, which the other side
+  restores. A client that notices first sends a resync message to ask for
+  this. A call that won't go through is treated the same way. A server
+  acts as the host for both of its players.
+
+  After resuming, the hash a server sends says how many calls it has. If
+  we made calls it never got, we send them again, then anything queued
+  since the connection dropped. The last few of our calls are kept for
+  this, and if the server is further behind than that we ask to resync.
+
+  Frames of other types are skipped, so later versions can add them.
+  Version 1 had no length byte. Its version message reads as an empty
+  version frame here, and ours as the wrong version there, so the two
+  refuse each other cleanly.
 */
 
 #ifndef _netgame_hpp_
 #define _netgame_hpp_
 
 #include <cstdio>
-#include <queue>
+#include <atomic>
 #include <vector>
 #include <string>
+#include <pthread.h>
 
 #include "game.hpp"
+#include "messagequeue.hpp"
+#include "netframe.hpp"
 
 namespace c2
 {
 
-  typedef std::vector<std::uint8_t> Message;
-  const std::string DEFAULT_PORT = "38519";
-  const std::uint8_t MAGIC_NUM = 0xCE;
-  const std::uint16_t NET_VERSION = 1;
-  const std::size_t HEADER_SIZE = 2;
+  //Most messages sent with one write
+  const std::size_t NET_SEND_BATCH = 32;
+
+  //Calls of our own kept to send again after resuming
+  const std::size_t NET_RESEND_HISTORY = 32;
+
+  //Length of a whole message, header included, from its type byte
+  //Returns 0 for a type that doesn't exist or has no fixed length
+  std::size_t messageLength(std::uint8_t type);
+
+  //Makes the call on g that a complete message stands for
+  //Messages other than calls give INVALID_PARAM
+  GameReturnType applyMessage(Game& g, const std::uint8_t* m);
+
+  //Writes a snapshot message into out, which needs MAX_FRAME_SIZE bytes,
+  //and returns its length. Payload:
+  //1B state, 1B white army | black army << 4, 1B white stones,
+  //1B black stones, 1B white bet, 1B black bet,
+  //1B castling and king turn flags, 1B fifty move count,
+  //8B touched big-endian, 4B last move, 4B current move (see packMove),
+  //3B piece just taken, 1B piece count, 3B per piece
+  //Pieces are 1B type, 1B x | y << 4, 1B side.
+  std::size_t snapshotFrame(const GameSnapshot& s, std::uint8_t* out);
+
+  //Reads a snapshot message back. Returns false if it doesn't make sense.
+  bool readSnapshotFrame(const std::uint8_t* m, std::size_t size,
+                         GameSnapshot& s);
   
+  //How long messages took from being queued to being written to the socket
+  struct NetLatency
+  {
+    std::uint64_t messages;
+    std::uint64_t totalMicros;
+    std::uint64_t maxMicros;
+  };
+
   class NetGame
   {
   public:
     //Constructors
     NetGame(Board* b = nullptr, std::string ip = std::string(),
             std::string port = DEFAULT_PORT);
+    ~NetGame();
+    NetGame(const NetGame&) = delete;
+    NetGame& operator=(const NetGame&) = delete;
 
     //Network functions
     //Connects to the specified address and starts a thread
@@ -60,11 +127,37 @@ namespace c2
     bool listenStart(std::string port = DEFAULT_PORT);
 
     //Disconnects from a running connection
-    void disconnect() {_killThread = true;}
+    void disconnect();
+
+    //Reconnects to a server after the connection dropped, taking our seat
+    //back with the token it gave us. The server catches our game up, and
+    //anything we sent that didn't get through is sent again.
+    bool resume(std::string ip, std::string port = DEFAULT_PORT);
+
+    //Connects to a server's lobby to be matched against a player of about
+    //the same rating. The server chooses both armies, giving each side the
+    //one it asked for unless it was NONE.
+    bool seek(std::string ip, std::uint16_t rating, ArmyType army,
+              std::string port = DEFAULT_PORT);
+
+    //Whether a server has given us a token to resume with
+    bool canResume() const {return _hasSession;}
 
     //Check if the thread has been killed
     bool connected() {return !_killThread;}
 
+    //Time taken to get our messages onto the wire so far
+    NetLatency sendLatency() const;
+
+    //The id a server gave this game, for spectators to ask for it by
+    //0 until a server has sent one
+    std::uint32_t gameId() const {return _gameId;}
+
+    //Hash of our copy of the game, and the number of times it was found to
+    //differ from the peer's
+    std::uint64_t hash() const;
+    std::uint32_t desyncs() const {return _desyncs;}
+
     //Main state-progressing functions
     //Sets the board pointer. This can only be done before CONFIRM_START
     GameReturnType setBoard(Board* b);
@@ -87,30 +180,114 @@ namespace c2
     //Promotes a pawn if one just reached the back
     GameReturnType promote(PieceType newType);
 
-    //Pass through to the game itself
-    std::set<Position> possibleMoves(Position pos) {return _game.possibleMoves(pos);}
-    GameStateType state() {return _game.state();}
-    std::uint8_t stones(SideType side) const {return _game.stones(side);}
-    ArmyType army(SideType side) const {return _game.army(side);}
+    //Pass through to the game itself, which the thread may be changing
+    std::set<Position> possibleMoves(Position pos);
+    GameStateType state() const;
+    std::uint8_t stones(SideType side) const;
+    ArmyType army(SideType side) const;
+    GameSnapshot snapshot() const;
     
   private:
     //Handles the back and forth communication
     friend void* connect_thread(void* data);
 
+    //Starts the thread once _sockfd is connected
+    bool startThread();
+
+    //Queues a message for the thread to send and wakes it up
+    void send(const std::uint8_t* m, std::size_t size);
+
+    //Queues a call we made and the hash message following it, and keeps
+    //it to send again after resuming. Needs _gameLock.
+    void sendCall(const std::uint8_t* m, std::size_t size);
+
+    //Thread only. Writes out everything queued, returning false if the
+    //connection failed.
+    bool flushQueue();
+
+    //Thread only, with _gameLock held. Resyncs after the games are found
+    //to differ, returning false if the connection should be dropped.
+    bool desynced();
+
+    //Thread only, with _gameLock held. Sends a resync message and a
+    //snapshot of our game.
+    bool sendResync();
+
+    //Thread only, with _gameLock held. Restores the snapshot message the
+    //host said was coming.
+    bool resync(const std::uint8_t* m, std::size_t size);
+
+    //Thread only, with _gameLock held. Sends the calls a server we resumed
+    //with is missing, given how many it has.
+    bool replay(std::uint32_t serverCalls);
+
     //The game itself, which we're synchronizing
     Game _game;
 
-    //The queue of messages going out
-    std::queue<Message> _outMessage;
+    //Guards _game and _calls. The caller holds it while making a call and
+    //queueing its messages, and the thread while handling what the peer
+    //sent, so calls and hashes go out in the order they were made.
+    mutable pthread_mutex_t _gameLock;
+
+    //Messages going out, pushed by the caller and popped by the thread
+    MessageQueue _outMessage;
+
+    //Data coming in, only touched by the thread
+    FrameReader _in;
 
     //The socket fd
     int _sockfd;
 
+    //A byte written to the pipe wakes the thread up, so new messages and
+    //disconnects are acted on straight away
+    int _wakePipe[2];
+
     //The IP address of the peer
     //std::vector<std::uint8_t> _address;
 
     //When set, the thread will kill itself asap
-    bool _killThread;
+    std::atomic<bool> _killThread;
+
+    pthread_t _thread;
+    bool _threadStarted;
+
+    //Totals for sendLatency(), written by the thread
+    std::atomic<std::uint64_t> _sentMessages;
+    std::atomic<std::uint64_t> _sendMicros;
+    std::atomic<std::uint64_t> _maxSendMicros;
+
+    std::atomic<std::uint32_t> _gameId;
+
+    //Whether we listened for the connection, which makes our game the one
+    //that is right when the two differ
+    bool _host;
+
+    //Calls made on the game by either side, for matching up hashes
+    std::uint32_t _calls;
+
+    //Our own recent calls, each stamped with its number among all calls
+    MessageSlot _sent[NET_RESEND_HISTORY];
+
+    //Set by resume() until the server's first hash, along with our call
+    //count when we resumed. The queue isn't flushed in between, so calls
+    //sent again go out ahead of any made since.
+    bool _replaying;
+    std::uint32_t _resumeCalls;
+
+    //Set between a resync message from the host and its snapshot, along
+    //with the host's call count
+    bool _awaitingSnapshot;
+    std::uint32_t _resyncCalls;
+
+    std::atomic<std::uint32_t> _desyncs;
+
+    //The token from the server's session message, written by the thread
+    std::atomic<bool> _hasSession;
+    std::uint8_t _session[12];
+
+    //A resume or seek message for the thread to send before anything else
+    std::uint8_t _opening[HEADER_SIZE + 16];
+    std::size_t _openingSize;
     
   };
 
@@ -52,6 +52,13 @@ namespace c2
   //Quick global function for determining the rank of a piece
   std::uint8_t pieceRank(PieceType type);
 
+  //Whether a piece is some army's king, the piece that can be checkmated
+  inline bool isKing(PieceType t)
+  {
+    return t == PieceType::CLA_KING || t == PieceType::ANY_KING ||
+      t == PieceType::TKG_WARRKING;
+  }
+
   //The names of the pieces, for any purposes that might need them
   const std::vector<std::string> PIECE_NAME =
     {
@@ -78,6 +85,11 @@ namespace c2
       "None"//NONE
     };
 
+  //The letter for each PieceType, after the classic piece it replaces in its
+  //army, with ' ' for pawns
+  //IMPORTANT: The order here must match the PieceType order
+  const char PIECE_LETTER[] = " RNBQK QKRNBQQRKNBRQ ";
+
   //The possible ways of moving, broken down to base components
   enum class MoveType : std::uint8_t
     {
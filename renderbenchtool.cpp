@@ -0,0 +1,282 @@
+/*
+  Copyright (c) 2014 Auston Sterling
+  See license.txt for copying permission.
+
+  -----Render Benchmark Tool-----
+  Auston Sterling
+  austonst@gmail.com
+
+  Times the client's drawing without a display. Games are replayed through
+  a BoardView drawing into memory, one frame per event, with an extra frame
+  before each move showing the moving piece's possible moves as if it had
+  been clicked. Reports frame times, draw calls and texture switches.
+
+  Games come from a text game file, or are played at random if none is
+  given. Images are loaded from images/ in the directory given by -d.
+
+  chess2-renderbench [games file] [-n random games] [-s seed] [-d directory]
+                     [-F]
+
+  -F redraws everything every frame, as the client did before it kept its
+  frames, for comparison.
+*/
+
+#include "boardview.hpp"
+#include "gametext.hpp"
+
+#include <SDL_image.h>
+#include <unistd.h>
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <random>
+
+using namespace c2;
+
+typedef std::chrono::steady_clock Clock;
+
+//Random games stop here if they haven't ended
+const std::size_t RANDOM_GAME_EVENTS = 400;
+
+static void usage()
+{
+  std::cerr << "Usage:\n"
+            << "  chess2-renderbench [games file] [-n random games] [-s seed] "
+            << "[-d directory]\n"
+            << "                     [-F]\n";
+}
+
+//Plays a game with every choice made at random
+static void randomGame(std::mt19937& random, GameRecord& rec)
+{
+  std::uniform_int_distribution<int> armies(0, NUM_ARMIES-1);
+  ArmyType white = toArmy(armies(random));
+  ArmyType black = toArmy(armies(random));
+  rec.clear(white, black);
+
+  BitBoard board;
+  Game g(&board, white, black);
+  g.start();
+  while (rec.events().size() < RANDOM_GAME_EVENTS && !isGameOver(g.state()))
+    {
+      GameStateType s = g.state();
+      if (isMoveState(s))
+        {
+          std::vector<Move> legal = g.legalMoves();
+          if (legal.empty()) break;
+          Move m = legal[random() % legal.size()];
+          if (!succeeded(g.move(m))) break;
+          rec.move(m);
+        }
+      else if (isDuelState(s))
+        {
+          bool d = random() % 2;
+          if (!succeeded(g.startDuel(d))) break;
+          rec.startDuel(d);
+        }
+      else if (isBidState(s))
+        {
+          SideType side = s == GameStateType::BLACK_BID ?
+            SideType::BLACK : SideType::WHITE;
+          std::uint8_t most = std::min<std::uint8_t>(g.stones(side), 2);
+          std::uint8_t stones = random() % (most + 1);
+          if (!succeeded(g.bid(side, stones))) break;
+          rec.bid(side, stones);
+        }
+      else if (isPromoteState(s))
+        {
+          ArmyType army = s == GameStateType::WHITE_PROMOTE ? white : black;
+          const std::set<PieceType>& types = ARMY_PROMOTE[num(army)];
+          std::set<PieceType>::const_iterator it = types.begin();
+          std::advance(it, random() % types.size());
+          if (!succeeded(g.promote(*it))) break;
+          rec.promote(*it);
+        }
+      else
+        {
+          break;
+        }
+    }
+}
+
+//Frame times for the whole run, in microseconds
+struct FrameStats
+{
+  std::vector<double> micros;
+};
+
+//Updates and draws one frame, timing it
+static void frame(BoardView& view, const Game& g, const Board& board,
+                  const std::set<Position>& moves, bool full,
+                  FrameStats& stats)
+{
+  ViewState vs;
+  vs.state = g.state();
+  vs.whiteArmy = g.army(SideType::WHITE);
+  vs.blackArmy = g.army(SideType::BLACK);
+  vs.whiteStones = g.stones(SideType::WHITE);
+  vs.blackStones = g.stones(SideType::BLACK);
+
+  Clock::time_point start = Clock::now();
+  if (full) view.invalidate();
+  view.update(vs);
+  view.draw(board, moves);
+  std::chrono::duration<double, std::micro> took = Clock::now() - start;
+  stats.micros.push_back(took.count());
+}
+
+//Replays a game, drawing a frame for each event
+static void replay(BoardView& view, const GameRecord& rec, bool full,
+                   FrameStats& stats)
+{
+  BitBoard board;
+  Game g(&board);
+  g.setArmy(SideType::WHITE, rec.army(SideType::WHITE));
+  g.setArmy(SideType::BLACK, rec.army(SideType::BLACK));
+  if (!succeeded(g.start())) return;
+
+  std::set<Position> none;
+  frame(view, g, board, none, full, stats);
+  for (const GameEvent& e : rec.events())
+    {
+      //Pick the piece up first, as a player would
+      if (e.type == EventType::MOVE && e.move.start.isValid())
+        {
+          std::set<Position> moves = g.possibleMoves(e.move.start);
+          frame(view, g, board, moves, full, stats);
+        }
+      if (!succeeded(applyEvent(g, e))) break;
+      frame(view, g, board, none, full, stats);
+    }
+}
+
+int main(int argc, char* argv[])
+{
+  std::string gamesPath;
+  std::string directory;
+  std::size_t randomGames = 1;
+  unsigned seed = 1;
+  bool full = false;
+  for (int i = 1; i < argc; i++)
+    {
+      std::string arg = argv[i];
+      if (arg == "-n" && i+1 < argc)
+        {
+          long v = std::atol(argv[++i]);
+          randomGames = v > 0 ? v : 1;
+        }
+      else if (arg == "-s" && i+1 < argc)
+        {
+          seed = std::atol(argv[++i]);
+        }
+      else if (arg == "-d" && i+1 < argc)
+        {
+          directory = argv[++i];
+        }
+      else if (arg == "-F")
+        {
+          full = true;
+        }
+      else if (arg[0] != '-' && gamesPath.empty())
+        {
+          gamesPath = arg;
+        }
+      else
+        {
+          usage();
+          return 1;
+        }
+    }
+
+  //Collect the games before changing directory, so the path still works
+  std::vector<GameRecord> games;
+  if (!gamesPath.empty())
+    {
+      GameTextReader reader;
+      if (!reader.open(gamesPath))
+        {
+          std::cerr << "Could not open " << gamesPath << "\n";
+          return 1;
+        }
+      GameRecord rec;
+      TextReadType r;
+      while ((r = reader.next(rec)) != TextReadType::END_OF_INPUT)
+        {
+          if (r == TextReadType::GAME) games.push_back(rec);
+        }
+    }
+  else
+    {
+      std::mt19937 random(seed);
+      games.resize(randomGames);
+      for (std::size_t i = 0; i < randomGames; i++)
+        {
+          randomGame(random, games[i]);
+        }
+    }
+  if (games.empty())
+    {
+      std::cerr << "No games to replay\n";
+      return 1;
+    }
+  if (!directory.empty() && chdir(directory.c_str()) != 0)
+    {
+      std::cerr << "Could not change to " << directory << "\n";
+      return 1;
+    }
+
+  //Nothing is shown, so SDL needn't look for a display
+  setenv("SDL_VIDEODRIVER", "dummy", 0);
+  if (SDL_Init(SDL_INIT_VIDEO) < 0)
+    {
+      std::cerr << "SDL_Init failed: " << SDL_GetError() << "\n";
+      return 1;
+    }
+  IMG_Init(IMG_INIT_PNG);
+
+  int status = 0;
+  {
+    HeadlessRenderer renderer(BOARD_WIDTH + SIDEBAR_WIDTH, BOARD_HEIGHT);
+    BoardView view(renderer, true, true);
+    if (!renderer.isValid() || !view.load())
+      {
+        std::cerr << "Could not set up drawing: " << SDL_GetError() << "\n";
+        status = 1;
+      }
+    else
+      {
+        if (!view.atlas().missing().empty())
+          {
+            std::cerr << view.atlas().missing().size()
+                      << " images missing, run from the source directory "
+                      << "or use -d\n";
+          }
+
+        FrameStats stats;
+        Clock::time_point start = Clock::now();
+        for (std::size_t i = 0; i < games.size(); i++)
+          {
+            replay(view, games[i], full, stats);
+          }
+        std::chrono::duration<double> elapsed = Clock::now() - start;
+
+        std::size_t frames = stats.micros.size();
+        std::sort(stats.micros.begin(), stats.micros.end());
+        std::cout << games.size() << " games, " << frames << " frames in "
+                  << elapsed.count() << " s"
+                  << (full ? ", redrawing everything" : "") << "\n"
+                  << "frame time p50 " << stats.micros[frames / 2]
+                  << " us, p99 " << stats.micros[frames * 99 / 100]
+                  << " us, max " << stats.micros.back() << " us\n"
+                  << "per frame: " << double(view.drawCalls()) / frames
+                  << " draw calls, " << double(view.textureSwitches()) / frames
+                  << " texture switches, " << double(view.sprites()) / frames
+                  << " sprites\n";
+      }
+  }
+
+  IMG_Quit();
+  SDL_Quit();
+  return status;
+}
@@ -0,0 +1,50 @@
+/*
+  -----Renderer Class Implementation-----
+  Auston Sterling
+  austonst@gmail.com
+
+  Implementation of the Renderer classes.
+*/
+
+#include "renderer.hpp"
+
+WindowRenderer::WindowRenderer(const std::string& title, int w, int h,
+                               Uint32 flags) :
+  window_(nullptr),
+  rend_(nullptr)
+{
+  window_ = SDL_CreateWindow(title.c_str(), SDL_WINDOWPOS_UNDEFINED,
+                             SDL_WINDOWPOS_UNDEFINED, w, h, 0);
+  if (window_) rend_ = SDL_CreateRenderer(window_, -1, flags);
+}
+
+WindowRenderer::~WindowRenderer()
+{
+  if (rend_) SDL_DestroyRenderer(rend_);
+  if (window_) SDL_DestroyWindow(window_);
+}
+
+void WindowRenderer::present()
+{
+  SDL_RenderPresent(rend_);
+}
+
+HeadlessRenderer::HeadlessRenderer(int w, int h) :
+  surface_(nullptr),
+  rend_(nullptr)
+{
+  surface_ = SDL_CreateRGBSurfaceWithFormat(0, w, h, 32,
+                                            SDL_PIXELFORMAT_RGBA8888);
+  if (surface_) rend_ = SDL_CreateSoftwareRenderer(surface_);
+}
+
+HeadlessRenderer::~HeadlessRenderer()
+{
+  if (rend_) SDL_DestroyRenderer(rend_);
+  if (surface_) SDL_FreeSurface(surface_);
+}
+
+void HeadlessRenderer::present()
+{
+  SDL_RenderPresent(rend_);
+}
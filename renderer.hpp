@@ -0,0 +1,80 @@
+/*
+  -----Renderer Class Header-----
+  Auston Sterling
+  austonst@gmail.com
+
+  Somewhere for the client to draw. Everything is drawn through an
+  SDL_Renderer; this decides where that renderer comes from and what
+  showing a finished frame means.
+
+  A WindowRenderer draws into a window on the screen. A HeadlessRenderer
+  draws into a surface in memory with SDL's software renderer, so drawing
+  can be run and timed on machines with no display. Pair it with SDL's
+  dummy video driver if SDL has to be initialized at all.
+*/
+
+#ifndef _renderer_hpp_
+#define _renderer_hpp_
+
+#include <SDL.h>
+#include <string>
+
+class Renderer
+{
+public:
+  virtual ~Renderer() {}
+
+  //The SDL renderer to draw with, or null if it couldn't be made
+  virtual SDL_Renderer* sdl() const = 0;
+
+  //The window being drawn into, or null if there is none
+  virtual SDL_Window* window() const {return nullptr;}
+
+  //Shows the frame drawn so far
+  virtual void present() = 0;
+
+  //Checks if the renderer can be drawn with
+  bool isValid() const {return sdl() != nullptr;}
+};
+
+class WindowRenderer : public Renderer
+{
+public:
+  //Constructors
+  WindowRenderer(const std::string& title, int w, int h, Uint32 flags = 0);
+  ~WindowRenderer();
+  WindowRenderer(const WindowRenderer&) = delete;
+  WindowRenderer& operator=(const WindowRenderer&) = delete;
+
+  SDL_Renderer* sdl() const {return rend_;}
+  SDL_Window* window() const {return window_;}
+  void present();
+
+private:
+  SDL_Window* window_;
+  SDL_Renderer* rend_;
+};
+
+class HeadlessRenderer : public Renderer
+{
+public:
+  //Constructors
+  HeadlessRenderer(int w, int h);
+  ~HeadlessRenderer();
+  HeadlessRenderer(const HeadlessRenderer&) = delete;
+  HeadlessRenderer& operator=(const HeadlessRenderer&) = delete;
+
+  SDL_Renderer* sdl() const {return rend_;}
+
+  //The software renderer queues up drawing, so this is where it happens
+  void present();
+
+  //The pixels drawn so far
+  SDL_Surface* surface() const {return surface_;}
+
+private:
+  SDL_Surface* surface_;
+  SDL_Renderer* rend_;
+};
+
+#endif
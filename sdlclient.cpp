@@ -7,28 +7,95 @@
   austonst@gmail.com
 
   A client for Sirlin's Chess 2 using SDL.
+
+  chess2-sdl [localcontrol ip] [-b side] [-a army] [-t milliseconds]
+
+  With -b, the computer plays side in place of a player here, using the
+  given army and time for each call. Given only -b, the player here plays
+  the other side against it.
 */
 
 #include <SDL.h>
 #include <SDL_image.h>
+#include <chrono>
+#include <cstdlib>
 #include <iostream>
 #include <map>
 #include <memory>
 #include "netgame.hpp"
+#include "movehighlighter.hpp"
+#include "analyzer.hpp"
+#include "bot.hpp"
 #include "bitboard.hpp"
-#include "sidebar.hpp"
+#include "boardview.hpp"
+#include "framescheduler.hpp"
 #include <sstream>
 
 
 using namespace c2;
 
-const int BOARD_WIDTH = 405;
-const int BOARD_HEIGHT = 405;
-const int BORDER_WIDTH = 2;
-const int TILE_SIZE = 50;
-const int SIDEBAR_WIDTH = 200;
+typedef std::chrono::steady_clock Clock;
+typedef std::chrono::duration<double, std::milli> Millis;
+
+//How long to sleep waiting for events. Changes made by the network thread,
+//highlights from the highlighter's thread, analysis and the bot's calls
+//don't send events, so the loop wakes up now and then to look for them,
+//more often while waiting on a thread. Animation frames come sooner, when
+//the frame scheduler says.
+const Uint32 IDLE_WAIT_MS = 50;
+const Uint32 BUSY_WAIT_MS = 5;
+
+//Time the bot takes for each call unless told otherwise
+const std::uint64_t DEFAULT_BOT_MOVE_MS = 2000;
+
+//Times the bot is asked again for a call the game refused before one is
+//chosen for it
+const unsigned BOT_CALL_TRIES = 3;
+
+//Where the bot looks for an opening book built by chess2-book, and for
+//endgame tables generated by chess2-tb
+const std::string BOT_BOOK_FILE = "openings.book";
+const std::string BOT_TABLE_DIR = "tables";
+
+//Makes a call on the game, as the bot decided it
+static GameReturnType makeCall(NetGame& ng, const GameEvent& e)
+{
+  switch (e.type)
+    {
+    case EventType::MOVE: return ng.move(e.move);
+    case EventType::DUEL: return ng.startDuel(e.value != 0);
+    case EventType::BID: return ng.bid(e.side, e.value);
+    case EventType::PROMOTE:
+      return ng.promote(static_cast<PieceType>(e.value));
+    }
+  return GameReturnType::INVALID_PARAM;
+}
 
-typedef std::shared_ptr<SDL_Texture> TexPtr;
+//Describes a call the bot decided on, for the log
+static std::string callText(const GameEvent& e)
+{
+  std::stringstream ss;
+  switch (e.type)
+    {
+    case EventType::MOVE:
+      ss << "move " << char('a' + e.move.start.x() - 1)
+         << int(e.move.start.y()) << "-" << char('a' + e.move.end.x() - 1)
+         << int(e.move.end.y());
+      break;
+    case EventType::DUEL:
+      ss << (e.value != 0 ? "duel" : "refusal to duel");
+      break;
+    case EventType::BID:
+      ss << "bid of " << int(e.value) << " stones";
+      break;
+    case EventType::PROMOTE:
+      ss << "promotion to ";
+      if (e.value < PIECE_TYPES) ss << PIECE_NAME[e.value];
+      else ss << "piece " << int(e.value);
+      break;
+    }
+  return ss.str();
+}
 
 //Returns 0 on X or error, or i+1 if button[i] was pressed
 int dialogBox(const std::string& text, const std::vector<std::string>& button,
@@ -75,11 +142,31 @@ int dialogBox(const std::string& text, const std::vector<std::string>& button,
 
 int main(int argc, char* argv[])
 {
-  std::string arg_localSide, arg_ip;
-  if (argc == 3)
+  //Bot options can go anywhere, leaving the usual two arguments
+  std::string arg_localSide, arg_ip, arg_bot;
+  std::string arg_botArmy = ARMY_NAME[num(ArmyType::CLASSIC)];
+  std::uint64_t botMoveTime = DEFAULT_BOT_MOVE_MS;
+  std::vector<std::string> positional;
+  for (int i = 1; i < argc; i++)
     {
-      arg_localSide = argv[1];
-      arg_ip = argv[2];
+      std::string arg = argv[i];
+      if (arg == "-b" && i+1 < argc) arg_bot = argv[++i];
+      else if (arg == "-a" && i+1 < argc) arg_botArmy = argv[++i];
+      else if (arg == "-t" && i+1 < argc)
+        {
+          botMoveTime = std::strtoull(argv[++i], NULL, 10);
+        }
+      else positional.push_back(arg);
+    }
+  if (positional.size() == 2)
+    {
+      arg_localSide = positional[0];
+      arg_ip = positional[1];
+    }
+  else if (positional.empty() && !arg_bot.empty())
+    {
+      arg_localSide = "both";
+      arg_ip = "no";
     }
   else
     {
@@ -99,7 +186,36 @@ int main(int argc, char* argv[])
       return 1;
     }
 
+  //The bot takes over one of the sides controlled here
+  SideType botSide = SideType::NONE;
+  ArmyType botArmy = ArmyType::NONE;
+  if (!arg_bot.empty())
+    {
+      if (arg_bot == "white" && whiteControl) botSide = SideType::WHITE;
+      else if (arg_bot == "black" && blackControl) botSide = SideType::BLACK;
+      else
+        {
+          std::cerr << "The bot must play \"white\" or \"black\", and only a "
+                    << "side controlled here!\n";
+          return 1;
+        }
+      for (std::size_t i = 0; i < NUM_ARMIES; i++)
+        {
+          if (ARMY_NAME[i] == arg_botArmy) botArmy = toArmy(i);
+        }
+      if (botArmy == ArmyType::NONE || botMoveTime == 0)
+        {
+          std::cerr << "The bot needs an army such as \"Classic\" and a time "
+                    << "for each call in milliseconds!\n";
+          return 1;
+        }
+      if (botSide == SideType::WHITE) whiteControl = false;
+      else blackControl = false;
+    }
+
   //Initialize all SDL subsystems
+  //Each part of starting up is timed
+  Clock::time_point startTime = Clock::now();
   if (SDL_Init(SDL_INIT_VIDEO) < 0)
     {
       std::cerr << "SDL_Init failed: " << SDL_GetError() << "\n";
@@ -114,14 +230,14 @@ int main(int argc, char* argv[])
   }
 
   //Set up the screen
-  SDL_Window* screen = SDL_CreateWindow("SDL Chess 2", SDL_WINDOWPOS_UNDEFINED,
-                                        SDL_WINDOWPOS_UNDEFINED,
-                                        BOARD_WIDTH + SIDEBAR_WIDTH,
-                                        BOARD_HEIGHT, 0);
-  if (!screen) return 1;
-  
-  SDL_Renderer* rend = SDL_CreateRenderer(screen, -1, 0);
-  if (!rend) return 1;
+  //Both are let go before SDL shuts down, so they're kept in pointers
+  Clock::time_point sdlTime = Clock::now();
+  std::unique_ptr<WindowRenderer> renderer(
+    new WindowRenderer("SDL Chess 2", BOARD_WIDTH + SIDEBAR_WIDTH,
+                       BOARD_HEIGHT, SDL_RENDERER_PRESENTVSYNC));
+  if (!renderer->isValid()) return 1;
+  SDL_Window* screen = renderer->window();
+  SDL_Renderer* rend = renderer->sdl();
   
   std::string errnew = SDL_GetError();
   if (errnew.length() > 0)
@@ -135,132 +251,53 @@ int main(int argc, char* argv[])
     }
   SDL_SetRenderDrawColor(rend, 0, 0, 0, 255);
 
-  //Load the board and piece images
-  TexPtr boardTex(IMG_LoadTexture(rend, "images/board.png"), SDL_DestroyTexture);
-  TexPtr pieceTex(IMG_LoadTexture(rend, "images/pieces.png"), SDL_DestroyTexture);
-  TexPtr moveTex(IMG_LoadTexture(rend, "images/move.png"), SDL_DestroyTexture);
-
-  //Create a sidebar
-  SDL_Color whiteColor = {255, 255, 255, 255};
-  Sidebar sidebar(SIDEBAR_WIDTH, BOARD_HEIGHT, whiteColor);
+  //Load the images and build the sidebar
+  Clock::time_point windowTime = Clock::now();
+  std::unique_ptr<BoardView> viewPtr(new BoardView(*renderer, whiteControl,
+                                                   blackControl));
+  BoardView& view = *viewPtr;
+  if (!view.load())
+    {
+      std::cerr << "Could not load images: " << SDL_GetError() << "\n";
+      return 1;
+    }
+  Clock::time_point loadTime = Clock::now();
 
-  //Put a header image at the top
-  //TODO THIS
+  //Every image that couldn't be loaded is reported together
+  const std::vector<std::string>& missing = view.atlas().missing();
+  if (!missing.empty())
+    {
+      std::cerr << "Missing " << missing.size() << " images:";
+      for (const std::string& file : missing) std::cerr << " " << file;
+      std::cerr << "\n";
+    }
 
-  //Make a quit button and an initially invisible follow-up confirmation button
-  //Both should be the heaviest objects
-  Sidebar::iterator button = sidebar.createObject(2000, "quit");
-  button->resizeAndRespace(1);
-  TexPtr quitTex(IMG_LoadTexture(rend, "images/button_quit.png"), SDL_DestroyTexture);
-  button->setTexture(0, quitTex);
-  button->respace();
-
-  button = sidebar.createObject(2000, "quitConfirm");
-  button->resizeAndRespace(2);
-  TexPtr reallyTex(IMG_LoadTexture(rend, "images/button_really.png"), SDL_DestroyTexture);
-  TexPtr cancelTex(IMG_LoadTexture(rend, "images/button_cancel.png"), SDL_DestroyTexture);
-  button->setTexture(0, reallyTex);
-  button->setTexture(1, cancelTex);
-  button->respace(SpacingType::SQUISH_CENTER, 10);
-  button->setVisibility(false);
-
-  //Create army selection objects, set visibility depending on control
-  //10 weight puts them pretty high up
-  std::vector<TexPtr> armyTex(NUM_ARMIES, nullptr);
-  std::vector<TexPtr> armySelTex(NUM_ARMIES, nullptr);
-  armyTex[num(ArmyType::CLASSIC)].reset(IMG_LoadTexture(rend, "images/button_c.png"), SDL_DestroyTexture);
-  armySelTex[num(ArmyType::CLASSIC)].reset(IMG_LoadTexture(rend, "images/button_sel_c.png"), SDL_DestroyTexture);
-  armyTex[num(ArmyType::EMPOWERED)].reset(IMG_LoadTexture(rend, "images/button_e.png"), SDL_DestroyTexture);
-  armySelTex[num(ArmyType::EMPOWERED)].reset(IMG_LoadTexture(rend, "images/button_sel_e.png"), SDL_DestroyTexture);
-  armyTex[num(ArmyType::NEMESIS)].reset(IMG_LoadTexture(rend, "images/button_n.png"), SDL_DestroyTexture);
-  armySelTex[num(ArmyType::NEMESIS)].reset(IMG_LoadTexture(rend, "images/button_sel_n.png"), SDL_DestroyTexture);
-  armyTex[num(ArmyType::REAPER)].reset(IMG_LoadTexture(rend, "images/button_r.png"), SDL_DestroyTexture);
-  armySelTex[num(ArmyType::REAPER)].reset(IMG_LoadTexture(rend, "images/button_sel_r.png"), SDL_DestroyTexture);
-  armyTex[num(ArmyType::ANIMALS)].reset(IMG_LoadTexture(rend, "images/button_a.png"), SDL_DestroyTexture);
-  armySelTex[num(ArmyType::ANIMALS)].reset(IMG_LoadTexture(rend, "images/button_sel_a.png"), SDL_DestroyTexture);
-  armyTex[num(ArmyType::TWOKINGS)].reset(IMG_LoadTexture(rend, "images/button_2.png"), SDL_DestroyTexture);
-  armySelTex[num(ArmyType::TWOKINGS)].reset(IMG_LoadTexture(rend, "images/button_sel_2.png"), SDL_DestroyTexture);
-  
-  SidebarObject buildSBO(armyTex, SIDEBAR_WIDTH, SpacingType::UNIFORM);
-  buildSBO.prepareForInsert(10, "whiteArmy");
-  buildSBO.setVisibility(whiteControl);
-  sidebar.insertObject(buildSBO);
-
-  buildSBO.prepareForInsert(10, "blackArmy");
-  buildSBO.setVisibility(blackControl);
-  sidebar.insertObject(buildSBO);
-
-  //Create start object to lock in army selection and try to start the game
-  //Weight is 15 to appear below army selection
-  //Button always starts visible
-  button = sidebar.createObject(15, "start");
-  button->resizeAndRespace(1);
-  TexPtr startTex(IMG_LoadTexture(rend, "images/button_start.png"), SDL_DestroyTexture);
-  button->setTexture(0, startTex);
-  button->respace();
-
-  //Create game status tracker, showing player's armies, whose turn it is,
-  //and some state information
-  button = sidebar.createObject(15, "state");
-  button->resizeAndRespace(3);
-  button->setVertAlign(VertAlignType::CENTER);
-  std::vector<TexPtr> statusTex(NUM_GAMESTATES, nullptr);
-  //Move texture
-  statusTex[num(GameStateType::WHITE_MOVE)].reset(IMG_LoadTexture(rend, "images/state_move.png"), SDL_DestroyTexture);
-  statusTex[num(GameStateType::BLACK_MOVE)] = statusTex[num(GameStateType::WHITE_MOVE)];
-  //King move texture
-  statusTex[num(GameStateType::WHITE_KINGMOVE)].reset(IMG_LoadTexture(rend, "images/state_kingmove.png"), SDL_DestroyTexture);
-  statusTex[num(GameStateType::BLACK_KINGMOVE)] = statusTex[num(GameStateType::WHITE_KINGMOVE)];
-  //Duel texture
-  statusTex[num(GameStateType::WHITE_DUEL)].reset(IMG_LoadTexture(rend, "images/state_duel.png"), SDL_DestroyTexture);
-  statusTex[num(GameStateType::BLACK_DUEL)] = statusTex[num(GameStateType::WHITE_DUEL)];
-  //Bid texture
-  statusTex[num(GameStateType::BOTH_BID)].reset(IMG_LoadTexture(rend, "images/state_bid.png"), SDL_DestroyTexture);
-  statusTex[num(GameStateType::WHITE_BID)] = statusTex[num(GameStateType::BOTH_BID)];
-  statusTex[num(GameStateType::BLACK_BID)] = statusTex[num(GameStateType::BOTH_BID)];
-  //Promote texture
-  statusTex[num(GameStateType::WHITE_PROMOTE)].reset(IMG_LoadTexture(rend, "images/state_promote.png"), SDL_DestroyTexture);
-  statusTex[num(GameStateType::BLACK_PROMOTE)] = statusTex[num(GameStateType::WHITE_PROMOTE)];
-  //White win texture
-  statusTex[num(GameStateType::WHITE_WIN_CHECKMATE)].reset(IMG_LoadTexture(rend, "images/state_whitewin.png"), SDL_DestroyTexture);
-  statusTex[num(GameStateType::WHITE_WIN_MIDLINE)] = statusTex[num(GameStateType::WHITE_WIN_CHECKMATE)];
-  //Black win texture
-  statusTex[num(GameStateType::BLACK_WIN_CHECKMATE)].reset(IMG_LoadTexture(rend, "images/state_blackwin.png"), SDL_DestroyTexture);
-  statusTex[num(GameStateType::BLACK_WIN_MIDLINE)] = statusTex[num(GameStateType::BLACK_WIN_CHECKMATE)];
-  //Draw texture
-  statusTex[num(GameStateType::DRAW_THREEFOLD)].reset(IMG_LoadTexture(rend, "images/state_draw.png"), SDL_DestroyTexture);
-  statusTex[num(GameStateType::DRAW_FIFTYMOVE)] = statusTex[num(GameStateType::DRAW_THREEFOLD)];
-
-  //No textures are initially set since none are yet known
-  button->setVisibility(false);
-
-  //Create king move skip object
-  //Weight of 30 to put it below most things
-  button = sidebar.createObject(30, "skipking");
-  button->resizeAndRespace(1);
-  TexPtr skipKingTex(IMG_LoadTexture(rend, "images/button_skipking.png"), SDL_DestroyTexture);
-  button->setTexture(0, skipKingTex);
-  button->respace();
-  button->setVisibility(false);
-
-  //Create stone tracking objects
-  //Weight of 16 and 17 put them right below state
-  TexPtr stoneNoneTex(IMG_LoadTexture(rend, "images/stone_none.png"), SDL_DestroyTexture);
-  TexPtr stoneWhiteTex(IMG_LoadTexture(rend, "images/stone_white.png"), SDL_DestroyTexture);
-  TexPtr stoneBlackTex(IMG_LoadTexture(rend, "images/stone_black.png"), SDL_DestroyTexture);
-  SidebarObject stonesObj(std::vector<TexPtr>(6, stoneNoneTex),
-                          SIDEBAR_WIDTH, SpacingType::SQUISH_CENTER, 5);
-  stonesObj.setVisibility(false);
-  sidebar.insertObject(stonesObj, 16, "blackstones");
-  sidebar.insertObject(stonesObj, 17, "whitestones");
+  const AtlasTimes& atlasTimes = view.atlas().times();
+  double imageMs = atlasTimes.decode + atlasTimes.pack + atlasTimes.upload;
+  std::cout << "Started in " << Millis(loadTime - startTime).count()
+            << " ms: SDL " << Millis(sdlTime - startTime).count()
+            << ", window " << Millis(windowTime - sdlTime).count()
+            << ", images " << imageMs
+            << (view.packedAtlas() ? " (packed atlas: map " : " (decode ")
+            << atlasTimes.decode << ", pack " << atlasTimes.pack
+            << ", upload " << atlasTimes.upload << "), sidebar "
+            << Millis(loadTime - windowTime).count() - imageMs << std::endl;
+  Sidebar& sidebar = view.sidebar();
+  view.setAnimated(true);
+  FrameScheduler scheduler(*renderer);
 
   //Put other stuff here, like side selection
   //TODO THIS
 
   //Look at args to determine networky stuff and set up game
+  //The game's board is changed by the network thread as the other player's
+  //calls come in, so everything here draws and picks from shown instead, a
+  //copy taken under the game's lock whenever the game changes
   std::string ip;
   BitBoard board;
   NetGame ng(&board);
+  BitBoard shown;
+  std::uint64_t shownHash = 0;
   if (std::string(arg_ip) == "host")
     {
       std::cout << "Listening for connections..." << std::endl;
@@ -301,7 +338,41 @@ int main(int argc, char* argv[])
   SidebarClickResponse mouseDownClick;
   Piece selectedPiece;
   std::set<Position> moves;
-  int timer = SDL_GetTicks();
+  MoveHighlighter highlighter;
+  bool highlightPending = false;
+  std::uint64_t turnHash = 0;
+
+  //Pressing A analyzes the game in the background. The analyzer is only
+  //made the first time, as its table is large.
+  std::unique_ptr<Analyzer> analyzer;
+  bool analyzing = false;
+  std::uint64_t analyzedHash = 0;
+  GameStateType analyzedState = GameStateType::SET_BOARD;
+
+  //The bot is asked for a call whenever its side has one to make. It plays
+  //its openings from the book and its endings from the tables if there are
+  //any.
+  OpeningBook book;
+  Tablebase tables;
+  Bot bot;
+  if (botSide != SideType::NONE)
+    {
+      if (book.open(BOT_BOOK_FILE)) bot.setBook(&book);
+      if (tables.open(BOT_TABLE_DIR)) bot.setTablebase(&tables);
+      SearchLimits botLimits;
+      botLimits.moveTime = botMoveTime;
+      if (!bot.start(botSide, botLimits))
+        {
+          std::cerr << "Failed to start the bot.\n";
+          return 1;
+        }
+    }
+  bool botThinking = false;
+  std::uint64_t botHash = 0;
+  GameStateType botState = GameStateType::SET_BOARD;
+  std::uint64_t refusedHash = 0;
+  unsigned refused = 0;
+
   bool quit = false;
   while (!quit)
     {
@@ -310,10 +381,31 @@ int main(int argc, char* argv[])
       bool lClick = false;
       bool rClick = false;
       bool sidebarClick = false;
-      while (SDL_PollEvent(&e))
+      bool toggleAnalysis = false;
+      //Sleep until something happens, then take every event waiting
+      Uint32 wait = highlightPending || botThinking ? BUSY_WAIT_MS :
+        IDLE_WAIT_MS;
+      wait = scheduler.wait(view.animating(), wait);
+      bool haveEvent = SDL_WaitEventTimeout(&e, wait) != 0;
+      for (; haveEvent; haveEvent = SDL_PollEvent(&e) != 0)
         {
           if (e.type == SDL_QUIT) quit = true;
 
+          //The window needs showing again, or lost what was drawn to it
+          if (e.type == SDL_WINDOWEVENT &&
+              (e.window.event == SDL_WINDOWEVENT_EXPOSED ||
+               e.window.event == SDL_WINDOWEVENT_SIZE_CHANGED))
+            {
+              view.expose();
+            }
+          if (e.type == SDL_RENDER_TARGETS_RESET) view.invalidate();
+
+          if (e.type == SDL_KEYDOWN && e.key.keysym.sym == SDLK_a &&
+              !e.key.repeat)
+            {
+              toggleAnalysis = true;
+            }
+
           //Nothing happens on mouse down, but the click as a whole only
           //happens if both down and up are on the same tile
           if (e.type == SDL_MOUSEBUTTONDOWN)
@@ -358,6 +450,7 @@ int main(int argc, char* argv[])
                       //First, clear moves to be consistent with "only show
                       //moves when a piece is clicked"
                       moves.clear();
+                      highlighter.cancel();
 
                       //Actually handle the click
                       SidebarClickResponse mouseUpClick;
@@ -387,24 +480,88 @@ int main(int argc, char* argv[])
           
         }
 
-      //Check keys and clicks
-      //CURRENTLY NONE TO CHECK--ALL MOUSE!
+      //Any change to the game, made by us or the other player, starts the
+      //highlighter on the new turn's moves so they're ready before a piece
+      //is clicked. Highlights from before no longer apply.
+      if (ng.state() >= GameStateType::WHITE_MOVE)
+        {
+          std::uint64_t hash = ng.hash();
+          if (hash != turnHash)
+            {
+              turnHash = hash;
+              highlighter.newTurn(ng.snapshot());
+              highlightPending = false;
+              moves.clear();
+            }
+        }
+
+      //Turning analysis off only interrupts the search, so it never waits
+      //on the analyzer's thread
+      if (toggleAnalysis)
+        {
+          analyzing = !analyzing;
+          if (analyzing && !analyzer) analyzer.reset(new Analyzer);
+          if (!analyzing)
+            {
+              analyzer->stop();
+              view.clearAnalysis();
+            }
+          analyzedHash = 0;
+        }
+
+      //Each change to the game restarts the analysis on the new position,
+      //and what was shown for the last one goes
+      if (analyzing && ng.state() >= GameStateType::WHITE_MOVE)
+        {
+          std::uint64_t hash = ng.hash();
+          if (hash != analyzedHash || ng.state() != analyzedState)
+            {
+              analyzedHash = hash;
+              analyzedState = ng.state();
+              analyzer->analyze(ng.snapshot(), hash);
+              view.clearAnalysis();
+            }
+
+          Analysis analysis;
+          if (analyzer->latest(analysis) && analysis.position == analyzedHash)
+            {
+              view.setAnalysis(analysis);
+            }
+        }
+
+      //Check clicks
 
       //Left click changes the selected piece or interacts with sidebar
       if (lClick)
         {
           Position clickPos(mouseLX+1, 8-mouseLY);
-          selectedPiece = board(clickPos);
+          selectedPiece = shown(clickPos);
           if (clickPos.isValid() && selectedPiece.type() != PieceType::NONE)
             {
-              moves = ng.possibleMoves(selectedPiece.pos());
+              //Before the start there's nothing to search, so ask directly
+              if (ng.state() < GameStateType::WHITE_MOVE)
+                {
+                  moves = ng.possibleMoves(selectedPiece.pos());
+                }
+              else if (!highlighter.request(selectedPiece, moves))
+                {
+                  moves.clear();
+                  highlightPending = true;
+                }
             }
           else
             {
               moves.clear();
+              highlighter.cancel();
             }
         }
 
+      //Pick up highlights the highlighter couldn't give straight away
+      if (highlightPending && highlighter.result(moves))
+        {
+          highlightPending = false;
+        }
+
       //Right click attempts to make a move
       if (rClick)
         {
@@ -419,6 +576,7 @@ int main(int argc, char* argv[])
               if (result == GameReturnType::SUCCESS)
                 {
                   moves.clear();
+                  highlighter.cancel();
                 }
             }
         }
@@ -458,10 +616,11 @@ int main(int argc, char* argv[])
               //Set all appearnaces to unselected except for this one
               for (size_t i = 0; i < mouseDownClick.sbo->size(); i++)
                 {
-                  mouseDownClick.sbo->setTexture(i, armyTex[i]);
+                  mouseDownClick.sbo->setTexture(i, view.armySprite(i, false));
                 }
-              mouseDownClick.sbo->setTexture(mouseDownClick.texture,
-                                             armySelTex[mouseDownClick.texture]);
+              int picked = mouseDownClick.texture;
+              mouseDownClick.sbo->setTexture(picked,
+                                             view.armySprite(picked, true));
 
               if (mouseDownClick.sbo->id() == "whiteArmy")
                 {
@@ -500,62 +659,89 @@ int main(int argc, char* argv[])
                     }
 
                   //Move him to the special position in order to skip the turn
-                  Position king = board.getKing(kingside)[0];
+                  Position king = shown.getKing(kingside)[0];
                   ng.move(Move(king, KINGMOVE_SKIP_POS, PieceType::TKG_WARRKING,
                                kingside));
                 }
             }
         }
 
-      //Perform any per-frame sidebar updates
-      //Update sidebar status depending on state
-      Sidebar::iterator statusObject = sidebar.object("state");
-      statusObject->setTexture(1, statusTex[num(ng.state())]);
-      if (ng.state() == GameStateType::WHITE_MOVE)
-        {
-          int armyIndex = num(ng.army(SideType::WHITE));
-          statusObject->setTexture(0, armySelTex[armyIndex]);
-          armyIndex = num(ng.army(SideType::BLACK));
-          statusObject->setTexture(2, armyTex[armyIndex]);
-        }
-      else if (ng.state() == GameStateType::BLACK_MOVE)
+      //The bot's army is set as soon as the game will take it
+      if (bot.running() && ng.state() < GameStateType::WHITE_MOVE &&
+          ng.army(botSide) == ArmyType::NONE)
         {
-          int armyIndex = num(ng.army(SideType::WHITE));
-          statusObject->setTexture(0, armyTex[armyIndex]);
-          armyIndex = num(ng.army(SideType::BLACK));
-          statusObject->setTexture(2, armySelTex[armyIndex]);
+          ng.setArmy(botSide, botArmy);
         }
-      statusObject->respace(SpacingType::UNIFORM);
 
-      //If we are in a king move, the sidebar skip button needs to be visible
-      if ((ng.state() == GameStateType::WHITE_KINGMOVE && whiteControl) ||
-          (ng.state() == GameStateType::BLACK_KINGMOVE && blackControl))
+      //Each change to the game gives the bot a new position to decide on
+      //or drops what it was deciding, and its calls are made as they come.
+      //Calls for a position that has since changed are ignored.
+      if (bot.running() && ng.state() >= GameStateType::WHITE_MOVE)
         {
-          sidebar.object("skipking")->setVisibility(true);
-        }
-      else
-        {
-          sidebar.object("skipking")->setVisibility(false);
-        }
+          if (ng.hash() != botHash || ng.state() != botState)
+            {
+              botHash = ng.hash();
+              botState = ng.state();
+              botThinking = bot.toDecide(botState);
+              if (botThinking) bot.think(ng.snapshot(), botHash);
+              else bot.stop();
+            }
 
-      //Update number of stones
-      for (size_t i = 0; i < ng.stones(SideType::WHITE); i++)
-        {
-          sidebar.object(17, "whitestones")->setTexture(i, stoneWhiteTex);
-        }
-      for (size_t i = ng.stones(SideType::WHITE); i < 6; i++)
-        {
-          sidebar.object(17, "whitestones")->setTexture(i, stoneNoneTex);
-        }
-      for (size_t i = 0; i < ng.stones(SideType::BLACK); i++)
-        {
-          sidebar.object(16, "blackstones")->setTexture(i, stoneBlackTex);
-        }
-      for (size_t i = ng.stones(SideType::BLACK); i < 6; i++)
-        {
-          sidebar.object(16, "blackstones")->setTexture(i, stoneNoneTex);
+          GameEvent call;
+          std::uint64_t position;
+          while (bot.decision(call, position))
+            {
+              if (position != botHash || ng.state() != botState) continue;
+              botThinking = false;
+
+              //A call that doesn't go through is logged and the position
+              //handed over again. The search would likely come back with
+              //the same call, so after a few tries the first choice the
+              //game takes is made instead. If there is none, the bot waits
+              //for the position to change.
+              if (succeeded(makeCall(ng, call))) continue;
+              std::cerr << "The game refused the bot's " << callText(call)
+                        << std::endl;
+              if (position != refusedHash)
+                {
+                  refusedHash = position;
+                  refused = 0;
+                }
+              if (++refused < BOT_CALL_TRIES)
+                {
+                  botHash = 0;
+                  continue;
+                }
+
+              BitBoard fallbackBoard;
+              Game fallback(&fallbackBoard);
+              bool made = false;
+              if (succeeded(fallback.restore(ng.snapshot())))
+                {
+                  std::vector<GameEvent> choices = gameChoices(fallback,
+                                                               botSide);
+                  for (std::size_t i = 0; i < choices.size() && !made; i++)
+                    {
+                      made = succeeded(makeCall(ng, choices[i]));
+                    }
+                }
+              if (!made)
+                {
+                  std::cerr << "None of the bot's choices went through"
+                            << std::endl;
+                }
+            }
         }
 
+      //Perform any per-frame sidebar updates
+      ViewState viewState;
+      viewState.state = ng.state();
+      viewState.whiteArmy = ng.army(SideType::WHITE);
+      viewState.blackArmy = ng.army(SideType::BLACK);
+      viewState.whiteStones = ng.stones(SideType::WHITE);
+      viewState.blackStones = ng.stones(SideType::BLACK);
+      view.update(viewState);
+
       //Depending on game state, we may need to do other things
       //Accept/decline duel
       if ((ng.state() == GameStateType::WHITE_DUEL && whiteControl) ||
@@ -626,155 +812,42 @@ int main(int argc, char* argv[])
 
       //Win states come AFTER drawing so we can see the result
 
-      //Draw board
-      SDL_Rect boardDst = {0, 0, BOARD_WIDTH, BOARD_HEIGHT};
-      SDL_RenderCopy(rend, boardTex.get(), NULL, &boardDst);
-
-      //Draw pieces
-      std::list<Position> pieces = board.getPieces(SideType::WHITE);
-      pieces.splice(pieces.end(), board.getPieces(SideType::BLACK));
-      for (Position i : pieces)
+      //The board shown is only copied again when the game has changed, and
+      //clicks next frame pick from what was drawn
+      std::uint64_t gameHash = ng.hash();
+      if (gameHash != shownHash)
         {
-          Piece p = board(i);
-
-          //Convert position to screen coordinates
-          SDL_Rect destRec;
-          destRec.x = (i.x()-1) * TILE_SIZE + BORDER_WIDTH;
-          destRec.y = (8-i.y()) * TILE_SIZE + BORDER_WIDTH;
-
-          //Get location of piece in image
-          SDL_Rect srcRec;
-          switch (p.type())
-            {
-              //Simple king sprite
-            case PieceType::CLA_KING:
-            case PieceType::ANY_KING:
-              srcRec.x = 0;
-              srcRec.y = 0;
-              break;
-
-              //Fancy king sprite
-            case PieceType::TKG_WARRKING:
-              srcRec.x = 0;
-              srcRec.y = 2;
-              break;
-
-              //Simple queen sprite
-            case PieceType::CLA_QUEEN:
-            case PieceType::EMP_QUEEN:
-              srcRec.x = 1;
-              srcRec.y = 0;
-              break;
-
-              //Fancy queen sprite
-            case PieceType::NEM_QUEEN:
-            case PieceType::RPR_REAPER:
-            case PieceType::ANI_JUNGQUEEN:
-              srcRec.x = 1;
-              srcRec.y = 2;
-              break;
-
-              //Simple rook sprite
-            case PieceType::CLA_ROOK:
-              srcRec.x = 2;
-              srcRec.y = 0;
-              break;
-
-              //Fancy rook sprite
-            case PieceType::EMP_ROOK:
-            case PieceType::RPR_GHOST:
-            case PieceType::ANI_ELEPHANT:
-              srcRec.x = 2;
-              srcRec.y = 2;
-              break;
-
-              //Simple bishop sprite
-            case PieceType::CLA_BISHOP:
-              srcRec.x = 3;
-              srcRec.y = 0;
-              break;
-
-              //Fancy bishop sprite
-            case PieceType::EMP_BISHOP:
-            case PieceType::ANI_TIGER:
-              srcRec.x = 3;
-              srcRec.y = 2;
-              break;
-
-              //Simple knight sprite
-            case PieceType::CLA_KNIGHT:
-              srcRec.x = 4;
-              srcRec.y = 0;
-              break;
-
-              //Fancy knight sprite
-            case PieceType::EMP_KNIGHT:
-            case PieceType::ANI_WILDHORSE:
-              srcRec.x = 4;
-              srcRec.y = 2;
-              break;
-
-              //Simple pawn sprite
-            case PieceType::CLA_PAWN:
-              srcRec.x = 5;
-              srcRec.y = 0;
-              break;
-
-              //Fancy pawn sprite
-            case PieceType::NEM_PAWN:
-              srcRec.x = 5;
-              srcRec.y = 2;
-              break;
-
-            default: //NOTE: If you see glitchy simple white kings, check this!
-              srcRec.x = 0;
-              srcRec.y = 0;
-              break;
-            }
-          if (p.side() == SideType::BLACK)
-            {
-              srcRec.y++;
-            }
-          srcRec.x *= TILE_SIZE;
-          srcRec.y *= TILE_SIZE;
-          destRec.w = destRec.h = srcRec.w = srcRec.h = TILE_SIZE;
-          SDL_RenderCopy(rend, pieceTex.get(), &srcRec, &destRec);
+          shownHash = gameHash;
+          GameSnapshot s = ng.snapshot();
+          shown.clear();
+          for (const Piece& p : s.pieces) shown.place(p);
         }
 
-      //Draw possible moves
-      for (Position i : moves)
+      //Draw whatever changed, keeping animations to the display's pace
+      if (scheduler.due(view.animating()) && view.draw(shown, moves))
         {
-          SDL_Rect srcRec;
-          srcRec.x = 0;
-          srcRec.y = 0;
-          SDL_Rect destRec;
-          destRec.x = (i.x()-1) * TILE_SIZE + BORDER_WIDTH;
-          destRec.y = (8-i.y()) * TILE_SIZE + BORDER_WIDTH;
-          srcRec.w = srcRec.h = destRec.w = destRec.h = TILE_SIZE;
-          SDL_RenderCopy(rend, moveTex.get(), &srcRec, &destRec);
+          scheduler.shown();
         }
 
-      //Draw sidebar
-      sidebar.render(rend, BOARD_WIDTH, 0);
-      
-      //Finalize drawing
-      SDL_RenderPresent(rend);
-
-      //Check for win state now that final configuration is displayed
-      if (ng.state() == GameStateType::WHITE_WIN_CHECKMATE ||
-          ng.state() == GameStateType::WHITE_WIN_MIDLINE)
+      //Check for win state now that final configuration is displayed and
+      //done moving
+      bool settled = !view.animating();
+      if (settled && (ng.state() == GameStateType::WHITE_WIN_CHECKMATE ||
+                      ng.state() == GameStateType::WHITE_WIN_MIDLINE))
         {
           dialogBox("White wins!", {"Woohoo!", "Boo"}, screen, 1, 2);
           quit = true;
         }
-      else if (ng.state() == GameStateType::BLACK_WIN_CHECKMATE ||
-                ng.state() == GameStateType::BLACK_WIN_MIDLINE)
+      else if (settled &&
+               (ng.state() == GameStateType::BLACK_WIN_CHECKMATE ||
+                ng.state() == GameStateType::BLACK_WIN_MIDLINE))
         {
           dialogBox("Black wins!", {"Woohoo!", "Boo"}, screen, 1, 2);
           quit = true;
         }
-      else if (ng.state() == GameStateType::DRAW_THREEFOLD ||
-               ng.state() == GameStateType::DRAW_FIFTYMOVE)
+      else if (settled &&
+               (ng.state() == GameStateType::DRAW_THREEFOLD ||
+                ng.state() == GameStateType::DRAW_FIFTYMOVE))
         {
           dialogBox("Draw!", {"Woohoo!", "Boo"}, screen, 1, 2);
           quit = true;
@@ -793,18 +866,11 @@ int main(int argc, char* argv[])
           quit = true;
         }
 
-      //Cap FPS at 30
-      int newtimer = SDL_GetTicks();
-      if (newtimer - timer < 1000.0/30.)
-        {
-          SDL_Delay(1000./30. - (newtimer-timer));
-        }
-      timer = newtimer;
     }
 
   //Clean up
-  SDL_DestroyRenderer(rend);
-  SDL_DestroyWindow(screen);
+  viewPtr.reset();
+  renderer.reset();
   IMG_Quit();
   SDL_Quit();
   return 0;
@@ -0,0 +1,588 @@
+/*
+  Copyright (c) 2014 Auston Sterling
+  See license.txt for copying permission.
+
+  -----Searcher Class Implementation-----
+  Auston Sterling
+  austonst@gmail.com
+
+  A computer player, searching with alpha-beta and iterative deepening.
+*/
+
+#include "search.hpp"
+
+#include <algorithm>
+
+namespace c2
+{
+
+  static const int INF_SCORE = MATE_SCORE + 1;
+
+  //Scores at least this far from 0 are wins found by the search
+  static const int MATE_BOUND = MATE_SCORE - 1000;
+
+  static const unsigned MAX_DEPTH = 64;
+
+  //Moves left in the game, when the clock doesn't say
+  static const unsigned DEFAULT_MOVES_TO_GO = 25;
+
+  //Limits on stretching the soft deadline while the best choice is unstable
+  static const double MAX_STRETCH = 3.0;
+  static const double STRETCH_GROWTH = 1.5;
+  static const double STRETCH_DECAY = 0.8;
+
+  //An iteration is only started if it is likely to finish by the soft
+  //deadline, as each takes a few times longer than the one before
+  static const double ITERATION_CUTOFF = 0.5;
+
+  static const std::uint8_t BOUND_EXACT = 0;
+  static const std::uint8_t BOUND_LOWER = 1;
+  static const std::uint8_t BOUND_UPPER = 2;
+  static const std::uint8_t NO_BEST = 0xFF;
+
+  static const int PIECE_VALUE[5] = {0, 100, 300, 500, 900};
+  static const int STONE_VALUE = 50;
+
+  //A king is worth this much more for each row it is past its own back two
+  static const int KING_ADVANCE_VALUE = 15;
+
+  //The same simple generator the Zobrist keys come from
+  static std::uint64_t splitmix(std::uint64_t& state)
+  {
+    std::uint64_t z = (state += 0x9E3779B97F4A7C15ULL);
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+    return z ^ (z >> 31);
+  }
+
+  bool sameEvent(const GameEvent& a, const GameEvent& b)
+  {
+    if (a.type != b.type) return false;
+    switch (a.type)
+      {
+      case EventType::MOVE: return packMove(a.move) == packMove(b.move);
+      case EventType::BID: return a.side == b.side && a.value == b.value;
+      default: return a.value == b.value;
+      }
+  }
+
+  //Mate scores are stored relative to the node so they can be reused at
+  //any distance from the root
+  static int toTable(int score, unsigned ply)
+  {
+    if (score > MATE_BOUND) return score + ply;
+    if (score < -MATE_BOUND) return score - ply;
+    return score;
+  }
+
+  static int fromTable(int score, unsigned ply)
+  {
+    if (score > MATE_BOUND) return score - ply;
+    if (score < -MATE_BOUND) return score + ply;
+    return score;
+  }
+
+  SideType decidingSide(GameStateType s, SideType bidFirst)
+  {
+    switch (s)
+      {
+      case GameStateType::WHITE_MOVE:
+      case GameStateType::WHITE_KINGMOVE:
+      case GameStateType::WHITE_DUEL:
+      case GameStateType::WHITE_BID:
+      case GameStateType::WHITE_PROMOTE:
+        return SideType::WHITE;
+      case GameStateType::BLACK_MOVE:
+      case GameStateType::BLACK_KINGMOVE:
+      case GameStateType::BLACK_DUEL:
+      case GameStateType::BLACK_BID:
+      case GameStateType::BLACK_PROMOTE:
+        return SideType::BLACK;
+      case GameStateType::BOTH_BID:
+        return bidFirst;
+      default:
+        return SideType::NONE;
+      }
+  }
+
+  std::vector<GameEvent> gameChoices(Game& g, SideType bidFirst)
+  {
+    std::vector<GameEvent> ret;
+    GameStateType s = g.state();
+    SideType side = decidingSide(s, bidFirst);
+    GameEvent e;
+    e.side = side;
+    e.value = 0;
+    if (isMoveState(s))
+      {
+        std::vector<Move> legal = g.legalMoves();
+        e.type = EventType::MOVE;
+        for (std::size_t i = 0; i < legal.size(); i++)
+          {
+            e.move = legal[i];
+            ret.push_back(e);
+          }
+      }
+    else if (isDuelState(s))
+      {
+        e.type = EventType::DUEL;
+        ret.push_back(e);
+        e.value = 1;
+        ret.push_back(e);
+      }
+    else if (isBidState(s))
+      {
+        e.type = EventType::BID;
+        std::uint8_t most = std::min<std::uint8_t>(g.stones(side), 2);
+        for (std::uint8_t i = 0; i <= most; i++)
+          {
+            e.value = i;
+            ret.push_back(e);
+          }
+      }
+    else if (isPromoteState(s))
+      {
+        //Best pieces first
+        const std::set<PieceType>& types = ARMY_PROMOTE[num(g.army(side))];
+        e.type = EventType::PROMOTE;
+        for (std::set<PieceType>::const_iterator it = types.begin();
+             it != types.end(); ++it)
+          {
+            e.value = num(*it);
+            ret.push_back(e);
+          }
+        std::stable_sort(ret.begin(), ret.end(),
+                         [](const GameEvent& a, const GameEvent& b)
+                         {
+                           return pieceRank(static_cast<PieceType>(a.value)) >
+                             pieceRank(static_cast<PieceType>(b.value));
+                         });
+      }
+    return ret;
+  }
+
+  TimeControl::TimeControl(std::uint64_t remaining, std::uint64_t increment,
+                           unsigned movesToGo) :
+    remaining(remaining), increment(increment), movesToGo(movesToGo) {}
+
+  SearchLimits::SearchLimits() : moveTime(0), maxDepth(0), overhead(20) {}
+
+  TimeManager::TimeManager() :
+    _soft(0), _hard(0), _stretch(1.0), _lastCheck(0), _slowestStep(0) {}
+
+  void TimeManager::start(const SearchLimits& limits)
+  {
+    _start = std::chrono::steady_clock::now();
+    _stretch = 1.0;
+    _soft = _hard = 0;
+    _lastCheck = _slowestStep = 0;
+
+    const TimeControl& c = limits.clock;
+    if (limits.moveTime)
+      {
+        _soft = _hard = limits.moveTime;
+      }
+    else if (c.remaining)
+      {
+        //An even share of what's left, plus most of what comes back, but
+        //never so much that a few bad moves use up the clock
+        unsigned togo = c.movesToGo ? c.movesToGo : DEFAULT_MOVES_TO_GO;
+        _soft = c.remaining / togo + c.increment * 3 / 4;
+        _hard = std::min(_soft * 4, c.remaining / 3 + c.increment);
+        _hard = std::min(_hard, c.remaining);
+        _soft = std::min(_soft, _hard);
+      }
+    else
+      {
+        return;
+      }
+
+    //Leave time to get the move back to the game
+    _soft = _soft > limits.overhead ? _soft - limits.overhead : 1;
+    _hard = _hard > limits.overhead ? _hard - limits.overhead : 1;
+  }
+
+  std::uint64_t TimeManager::elapsed() const
+  {
+    return std::chrono::duration_cast<std::chrono::milliseconds>
+      (std::chrono::steady_clock::now() - _start).count();
+  }
+
+  bool TimeManager::outOfTime()
+  {
+    if (!_hard) return false;
+    std::uint64_t now = elapsed();
+    _slowestStep = std::max(_slowestStep, now - _lastCheck);
+    _lastCheck = now;
+    return now + _slowestStep >= _hard;
+  }
+
+  bool TimeManager::nextIteration(bool bestChanged)
+  {
+    if (bestChanged) _stretch = std::min(_stretch * STRETCH_GROWTH, MAX_STRETCH);
+    else _stretch = std::max(_stretch * STRETCH_DECAY, 1.0);
+
+    if (!_soft) return true;
+    double limit = std::min(_soft * _stretch, double(_hard));
+    return elapsed() < limit * ITERATION_CUTOFF;
+  }
+
+  //Runs the search of a ponder until told to stop
+  void* ponder_thread(void* data)
+  {
+    Searcher* s = static_cast<Searcher*>(data);
+    SearchResult r = s->iterate(SearchLimits(), true);
+    s->_ponderBest = r.best;
+    s->_ponderHasBest = r.depth > 0;
+    return NULL;
+  }
+
+  Searcher::Searcher(std::size_t tableEntries) :
+    _book(nullptr), _tablebase(nullptr), _observer(nullptr), _game(&_board),
+    _side(SideType::WHITE), _nodes(0), _stop(false),
+    _aborted(false), _pondering(false), _ponderStop(false),
+    _ponderHasBest(false)
+  {
+    //Round down to a power of two so keys can be masked into an index
+    std::size_t size = 1;
+    while (size * 2 <= tableEntries) size *= 2;
+    _table.resize(size);
+    clear();
+
+    _random = std::chrono::steady_clock::now().time_since_epoch().count();
+  }
+
+  Searcher::~Searcher()
+  {
+    stopPondering();
+  }
+
+  void Searcher::clear()
+  {
+    stopPondering();
+    TableEntry empty = {0, 0, 0, 0, NO_BEST};
+    std::fill(_table.begin(), _table.end(), empty);
+    _ponderHasBest = false;
+  }
+
+  SearchResult Searcher::search(const Game& g, SideType side,
+                                const SearchLimits& limits)
+  {
+    stopPondering();
+    _side = side;
+    _game.restore(g.snapshot());
+    SearchResult r = iterate(limits, false);
+    return r;
+  }
+
+  SearchResult Searcher::analyze(const GameSnapshot& g,
+                                 const SearchLimits& limits)
+  {
+    stopPondering();
+    _game.restore(g);
+    _side = decidingSide(g.state);
+    if (_side == SideType::NONE)
+      {
+        SearchResult none = SearchResult();
+        none.best.side = SideType::NONE;
+        return none;
+      }
+    return iterate(limits, true);
+  }
+
+  void Searcher::ponder(const Game& g, SideType side)
+  {
+    stopPondering();
+    _ponderHasBest = false;
+    SideType decider = decidingSide(g.state(), side);
+    if (decider == SideType::NONE || decider == side) return;
+
+    _side = side;
+    _game.restore(g.snapshot());
+    _pondering = pthread_create(&_ponderThread, NULL, &ponder_thread,
+                                this) == 0;
+  }
+
+  void Searcher::stopPondering()
+  {
+    if (!_pondering) return;
+    _ponderStop = true;
+    pthread_join(_ponderThread, NULL);
+    _pondering = false;
+    _ponderStop = false;
+  }
+
+  bool Searcher::ponderHit(const GameEvent& made) const
+  {
+    return _ponderHasBest && sameEvent(_ponderBest, made);
+  }
+
+  SearchResult Searcher::iterate(const SearchLimits& limits, bool pondering)
+  {
+    _time.start(limits);
+    _nodes = 0;
+    _aborted = false;
+
+    SearchResult result;
+    result.score = 0;
+    result.depth = 0;
+    result.nodes = 0;
+    result.elapsed = 0;
+    result.fromBook = result.fromTablebase = result.onlyChoice = false;
+    result.best.type = EventType::MOVE;
+    result.best.side = SideType::NONE;
+    result.best.value = 0;
+
+    GameSnapshot root = _game.snapshot();
+    std::vector<Move> legal = _game.legalMoves();
+    const std::vector<Move>* rootLegal = isMoveState(root.state) ? &legal :
+      nullptr;
+
+    //Legal moves always go through, but a duel or bid might not be allowed
+    std::vector<GameEvent> choices = gameChoices(_game, _side);
+    if (!rootLegal)
+      {
+        std::vector<GameEvent> all;
+        all.swap(choices);
+        for (std::size_t i = 0; i < all.size(); i++)
+          {
+            _game.restore(root, rootLegal);
+            if (succeeded(applyEvent(_game, all[i]))) choices.push_back(all[i]);
+          }
+        _game.restore(root, rootLegal);
+      }
+    if (choices.empty()) return result;
+    result.best = choices[0];
+
+    if (!pondering)
+      {
+        Move m;
+        if (choices.size() == 1)
+          {
+            result.onlyChoice = true;
+            return result;
+          }
+        if (_book && _book->choose(_game, m, splitmix(_random)))
+          {
+            result.best.move = m;
+            result.fromBook = true;
+            return result;
+          }
+        if (_tablebase && _tablebase->size() &&
+            _tablebase->bestMove(_game, m))
+          {
+            result.best.move = m;
+            result.fromTablebase = true;
+            return result;
+          }
+      }
+
+    unsigned maxDepth = limits.maxDepth ? std::min(limits.maxDepth, MAX_DEPTH) :
+      MAX_DEPTH;
+    for (unsigned depth = 1; depth <= maxDepth; depth++)
+      {
+        //The best choice so far is searched first, which is what makes
+        //iterative deepening pay off
+        int alpha = -INF_SCORE;
+        std::size_t best = 0;
+        for (std::size_t i = 0; i < choices.size(); i++)
+          {
+            int score;
+            _game.restore(root, rootLegal);
+            if (!child(choices[i], depth, alpha, INF_SCORE, 0, score)) continue;
+            if (shouldStop()) break;
+            if (score > alpha)
+              {
+                alpha = score;
+                best = i;
+              }
+          }
+        _game.restore(root, rootLegal);
+
+        //A partly searched iteration can't be trusted
+        if (_aborted || _stop || _ponderStop) break;
+
+        bool changed = depth > 1 && best != 0;
+        std::rotate(choices.begin(), choices.begin() + best,
+                    choices.begin() + best + 1);
+        result.best = choices[0];
+        result.score = alpha;
+        result.depth = depth;
+        if (_observer)
+          {
+            result.nodes = _nodes;
+            result.elapsed = _time.elapsed();
+            _observer->iterationDone(result);
+          }
+
+        //A forced result won't change with more depth
+        if (alpha > MATE_BOUND || alpha < -MATE_BOUND) break;
+        if (!_time.nextIteration(changed)) break;
+      }
+
+    result.nodes = _nodes;
+    result.elapsed = _time.elapsed();
+    return result;
+  }
+
+  bool Searcher::child(const GameEvent& e, unsigned depth, int alpha, int beta,
+                       unsigned ply, int& score)
+  {
+    GameStateType before = _game.state();
+    SideType me = decidingSide(before, _side);
+    if (!succeeded(applyEvent(_game, e))) return false;
+    _nodes++;
+
+    //Only moves count towards depth, so a whole duel is searched as one step
+    if (isMoveState(before)) depth--;
+
+    GameStateType after = _game.state();
+    if (isGameOver(after))
+      {
+        SideType winner = SideType::NONE;
+        if (after == GameStateType::WHITE_WIN_CHECKMATE ||
+            after == GameStateType::WHITE_WIN_MIDLINE)
+          {
+            winner = SideType::WHITE;
+          }
+        else if (after == GameStateType::BLACK_WIN_CHECKMATE ||
+                 after == GameStateType::BLACK_WIN_MIDLINE)
+          {
+            winner = SideType::BLACK;
+          }
+        if (winner == SideType::NONE) score = 0;
+        else if (winner == me) score = MATE_SCORE - ply - 1;
+        else score = -MATE_SCORE + ply + 1;
+        return true;
+      }
+
+    //The sign only flips when the other side decides next
+    if (decidingSide(after, _side) == me)
+      {
+        score = search(depth, alpha, beta, ply + 1);
+      }
+    else
+      {
+        score = -search(depth, -beta, -alpha, ply + 1);
+      }
+    return true;
+  }
+
+  int Searcher::search(unsigned depth, int alpha, int beta, unsigned ply)
+  {
+    if (shouldStop()) return 0;
+    GameStateType state = _game.state();
+    bool moveState = isMoveState(state);
+
+    if (moveState && _tablebase && _tablebase->size())
+      {
+        TableResult r = _tablebase->probe(_game);
+        switch (r.type)
+          {
+          case TableResultType::DRAW: return 0;
+          case TableResultType::WIN: return MATE_SCORE - ply - r.plies;
+          case TableResultType::LOSS: return -MATE_SCORE + ply + r.plies;
+          default: break;
+          }
+      }
+
+    if (depth == 0 && moveState) return evaluate();
+
+    std::uint64_t key = _game.transpositionHash();
+    TableEntry& entry = _table[key & (_table.size() - 1)];
+    std::uint8_t tableBest = NO_BEST;
+    if (entry.key == key)
+      {
+        tableBest = entry.best;
+        int s = fromTable(entry.score, ply);
+        if (entry.depth >= depth &&
+            (entry.bound == BOUND_EXACT ||
+             (entry.bound == BOUND_LOWER && s >= beta) ||
+             (entry.bound == BOUND_UPPER && s <= alpha)))
+          {
+            return s;
+          }
+      }
+
+    GameSnapshot here = _game.snapshot();
+    std::vector<Move> legal;
+    if (moveState) legal = _game.legalMoves();
+    const std::vector<Move>* hereLegal = moveState ? &legal : nullptr;
+    std::vector<GameEvent> choices = gameChoices(_game, _side);
+    if (tableBest < choices.size())
+      {
+        std::swap(choices[0], choices[tableBest]);
+      }
+
+    int bestScore = -INF_SCORE;
+    std::uint8_t best = NO_BEST;
+    int startAlpha = alpha;
+    for (std::size_t i = 0; i < choices.size(); i++)
+      {
+        int score;
+        _game.restore(here, hereLegal);
+        if (!child(choices[i], depth, alpha, beta, ply, score)) continue;
+        if (shouldStop()) return 0;
+        if (score > bestScore)
+          {
+            bestScore = score;
+
+            //Undo the swap to store the index in choice order
+            std::size_t index = i;
+            if (tableBest < choices.size())
+              {
+                if (i == 0) index = tableBest;
+                else if (i == tableBest) index = 0;
+              }
+            best = index < NO_BEST ? index : NO_BEST;
+          }
+        if (score > alpha) alpha = score;
+        if (alpha >= beta) break;
+      }
+
+    //Nothing could be done, which the rules shouldn't allow
+    if (best == NO_BEST && bestScore == -INF_SCORE) return evaluate();
+
+    entry.key = key;
+    entry.score = toTable(bestScore, ply);
+    entry.depth = std::min(depth, 255u);
+    entry.bound = bestScore <= startAlpha ? BOUND_UPPER :
+      bestScore >= beta ? BOUND_LOWER : BOUND_EXACT;
+    entry.best = best;
+    return bestScore;
+  }
+
+  int Searcher::evaluate()
+  {
+    GameSnapshot s = _game.snapshot();
+    int white = STONE_VALUE * (int(s.whiteStones) - int(s.blackStones));
+    for (std::size_t i = 0; i < s.pieces.size(); i++)
+      {
+        const Piece& p = s.pieces[i];
+        int value = PIECE_VALUE[pieceRank(p.type())];
+
+        //Kings win by crossing the midline
+        if (isKing(p.type()))
+          {
+            int rows = p.side() == SideType::WHITE ? p.pos().y() - 2 :
+              7 - p.pos().y();
+            value = KING_ADVANCE_VALUE * std::max(rows, 0);
+          }
+        white += p.side() == SideType::WHITE ? value : -value;
+      }
+    SideType side = decidingSide(s.state, _side);
+    return side == SideType::BLACK ? -white : white;
+  }
+
+  bool Searcher::shouldStop()
+  {
+    //Nodes are slow enough next to reading the clock to check every time
+    if (_stop || _ponderStop) return true;
+    if (!_aborted && _time.outOfTime())
+      {
+        _aborted = true;
+      }
+    return _aborted;
+  }
+
+} //Namespace
@@ -0,0 +1,258 @@
+/*
+  Copyright (c) 2014 Auston Sterling
+  See license.txt for copying permission.
+
+  -----Searcher Class Header-----
+  Auston Sterling
+  austonst@gmail.com
+
+  A computer player. It searches every decision a game asks for: moves,
+  whether to duel, bids and promotions. Bids are searched as if the other
+  side could see the searcher's bid before making its own, which is the
+  worst case for the searcher.
+
+  Time is budgeted from a clock, like a human player's: a soft deadline that
+  is stretched while the best choice keeps changing between iterations, and
+  a hard deadline that is never passed. While the opponent is deciding, the
+  searcher can ponder their position so its next search starts warm.
+*/
+
+#ifndef _search_hpp_
+#define _search_hpp_
+
+#include <atomic>
+#include <chrono>
+#include <pthread.h>
+
+#include "bitboard.hpp"
+#include "gamerecord.hpp"
+#include "book.hpp"
+#include "tablebase.hpp"
+
+namespace c2
+{
+
+  //The side that has to make the next call in a state. When both sides are
+  //yet to bid, bidFirst is taken to bid first.
+  SideType decidingSide(GameStateType s, SideType bidFirst = SideType::WHITE);
+
+  //Checks if two calls are the same, looking only at what each type uses
+  bool sameEvent(const GameEvent& a, const GameEvent& b);
+
+  //Every call that could be made next in a game, in the order searched
+  std::vector<GameEvent> gameChoices(Game& g,
+                                     SideType bidFirst = SideType::WHITE);
+
+  //A clock for one side. All times are in milliseconds.
+  struct TimeControl
+  {
+    //Constructors
+    TimeControl(std::uint64_t remaining = 0, std::uint64_t increment = 0,
+                unsigned movesToGo = 0);
+
+    //Time left on the clock, 0 for no clock
+    std::uint64_t remaining;
+
+    //Time added after each move
+    std::uint64_t increment;
+
+    //Moves until the clock is next topped up, 0 for the rest of the game
+    unsigned movesToGo;
+  };
+
+  struct SearchLimits
+  {
+    //Constructors
+    SearchLimits();
+
+    TimeControl clock;
+
+    //Fixed time for this decision, overriding the clock if set
+    std::uint64_t moveTime;
+
+    //Deepest iteration to run, counted in moves
+    unsigned maxDepth;
+
+    //Kept off every deadline, for the time it takes to send the move
+    std::uint64_t overhead;
+  };
+
+  struct SearchResult
+  {
+    //The call to make
+    GameEvent best;
+
+    //Score for the deciding side in centipawns, or near MATE_SCORE
+    int score;
+
+    //Deepest iteration finished
+    unsigned depth;
+
+    std::uint64_t nodes;
+    std::uint64_t elapsed;
+
+    //Where the choice came from, if not the search
+    bool fromBook;
+    bool fromTablebase;
+    bool onlyChoice;
+  };
+
+  const int MATE_SCORE = 30000;
+
+  //Implement this to follow a search as it deepens. Called from the thread
+  //searching, after each iteration that finished, with the result so far.
+  class SearchObserver
+  {
+  public:
+    virtual ~SearchObserver() {};
+    virtual void iterationDone(const SearchResult& /*r*/) {}
+  };
+
+  //Soft and hard deadlines for one decision, worked out from the clock
+  class TimeManager
+  {
+  public:
+    //Constructors
+    TimeManager();
+
+    //Sets the deadlines and starts timing
+    void start(const SearchLimits& limits);
+
+    //Time since start()
+    std::uint64_t elapsed() const;
+
+    //Called after each iteration with whether the best choice changed.
+    //Returns true if another iteration should be started.
+    bool nextIteration(bool bestChanged);
+
+    //Whether the search has to stop now, called between steps of the search.
+    //Allows for the next step taking as long as the slowest one so far, so
+    //the hard deadline is only passed by a step much slower than the rest.
+    bool outOfTime();
+
+    std::uint64_t soft() const {return _soft;}
+    std::uint64_t hard() const {return _hard;}
+
+  private:
+    std::chrono::steady_clock::time_point _start;
+
+    //Deadlines, 0 for none
+    std::uint64_t _soft;
+    std::uint64_t _hard;
+
+    //How far past the soft deadline to go, from how unsettled the search is
+    double _stretch;
+
+    //Time at the last outOfTime() and the longest gap between calls
+    std::uint64_t _lastCheck;
+    std::uint64_t _slowestStep;
+  };
+
+  class Searcher
+  {
+  public:
+    //Constructors
+    //The transposition table takes about 16 bytes per entry
+    Searcher(std::size_t tableEntries = 1 << 20);
+    ~Searcher();
+    Searcher(const Searcher&) = delete;
+    Searcher& operator=(const Searcher&) = delete;
+
+    //Optional sources of instant answers, which are not owned
+    void setBook(const OpeningBook* book) {_book = book;}
+    void setTablebase(const Tablebase* tb) {_tablebase = tb;}
+
+    //Told about each finished iteration, if set. Not owned.
+    void setObserver(SearchObserver* o) {_observer = o;}
+
+    //Finds the best call for side in g, which must be a side that is yet to
+    //decide. g is left as it was. Stops any pondering first.
+    SearchResult search(const Game& g, SideType side,
+                        const SearchLimits& limits);
+
+    //Starts searching g in the background while the opponent of side
+    //decides, so the next search finds much of its work already done.
+    //Does nothing if side has to decide in g.
+    void ponder(const Game& g, SideType side);
+
+    //Stops pondering, if it is going
+    void stopPondering();
+
+    //Whether the last ponder expected the call the opponent made
+    bool ponderHit(const GameEvent& made) const;
+
+    //Searches g for whichever side has to decide there, without using the
+    //book or tablebase, until the limits are reached or interrupt() is
+    //called. Returns an empty result if nobody has to decide.
+    SearchResult analyze(const GameSnapshot& g, const SearchLimits& limits);
+
+    //Makes a search or analysis running on another thread return as soon
+    //as it can, with the last finished iteration. It stays interrupted,
+    //returning straight away, until resume() is called.
+    void interrupt() {_stop = true;}
+    void resume() {_stop = false;}
+
+    //Clears everything learned so far, for a new game
+    void clear();
+
+  private:
+    struct TableEntry
+    {
+      std::uint64_t key;
+      std::int16_t score;
+      std::uint8_t depth;
+      std::uint8_t bound;
+      std::uint8_t best;
+    };
+
+    //Iterative deepening from the position in _game until stopped or out
+    //of time. Book and tablebase answers are only used if not pondering.
+    SearchResult iterate(const SearchLimits& limits, bool pondering);
+
+    //Alpha-beta search of the position in _game, scored for the side
+    //deciding there
+    int search(unsigned depth, int alpha, int beta, unsigned ply);
+
+    //Makes a call on _game and scores the result for the side that made it
+    //Returns false if the call couldn't be made
+    bool child(const GameEvent& e, unsigned depth, int alpha, int beta,
+               unsigned ply, int& score);
+
+    //Static score of the position in _game for the side deciding
+    int evaluate();
+
+    //Whether to give up on the current iteration
+    bool shouldStop();
+
+    friend void* ponder_thread(void* data);
+
+    std::vector<TableEntry> _table;
+    const OpeningBook* _book;
+    const Tablebase* _tablebase;
+    SearchObserver* _observer;
+
+    //Where the search plays out positions
+    BitBoard _board;
+    Game _game;
+
+    //The side searching, which bids first
+    SideType _side;
+
+    TimeManager _time;
+    std::uint64_t _nodes;
+    std::atomic<bool> _stop;
+    bool _aborted;
+    std::uint64_t _random;
+
+    //Pondering state. Pondering is stopped with its own flag, so stopping
+    //it never undoes an interrupt().
+    pthread_t _ponderThread;
+    bool _pondering;
+    std::atomic<bool> _ponderStop;
+    GameEvent _ponderBest;
+    bool _ponderHasBest;
+  };
+
+} //Namespace
+
+#endif
@@ -0,0 +1,1413 @@
+/*
+  Copyright (c) 2014 Auston Sterling
+  See license.txt for copying permission.
+
+  -----GameServer Class Implementation-----
+  Auston Sterling
+  austonst@gmail.com
+
+  A server hosting many games at once over the NetGame protocol.
+*/
+
+#include "server.hpp"
+
+#include <sys/socket.h>
+#include <sys/epoll.h>
+#include <sys/uio.h>
+#include <sys/eventfd.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <netdb.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <cerrno>
+#include <cstring>
+#include <algorithm>
+
+namespace c2
+{
+
+  //Events handled per epoll_wait
+  static const int SERVER_MAX_EVENTS = 256;
+
+  //Buffers written to a spectator at a time
+  static const std::size_t SPECTATOR_MAX_IOV = 64;
+
+  //Tags in epoll data for the descriptors that aren't players. Players are
+  //tagged with their game and side, and spectators with themselves, which
+  //never look like these.
+  static const std::uint64_t WAKE_TAG = 0;
+  static const std::uint64_t LISTEN_TAG = 1;
+  static const std::uint64_t WAITING_TAG = 2;
+  static const std::uint64_t SPECTATE_TAG = 3;
+  static const std::uint64_t SPECTATOR_BIT = 2;
+  static const std::uint64_t NEWCOMER_BIT = 4;
+  static const std::uint64_t SEEKER_BIT = 8;
+
+  //Connections that haven't spoken yet or are in the lobby are tagged with
+  //their descriptor
+  static std::uint64_t newcomerTag(int fd)
+  {
+    return (std::uint64_t(fd) << 4) | NEWCOMER_BIT;
+  }
+
+  static std::uint64_t seekerTag(int fd)
+  {
+    return (std::uint64_t(fd) << 4) | SEEKER_BIT | NEWCOMER_BIT;
+  }
+
+  static std::uint64_t playerTag(ServerGame* g, std::size_t side)
+  {
+    //Games are at least 8 byte aligned, leaving the low bit for the side
+    return reinterpret_cast<std::uintptr_t>(g) | side;
+  }
+
+  static std::uint64_t spectatorTag(ServerSpectator* s)
+  {
+    return reinterpret_cast<std::uintptr_t>(s) | SPECTATOR_BIT;
+  }
+
+  static bool setNonBlocking(int fd)
+  {
+    int flags = fcntl(fd, F_GETFL, 0);
+    return flags >= 0 && fcntl(fd, F_SETFL, flags | O_NONBLOCK) == 0;
+  }
+
+  //Readies an accepted socket, closing it if that fails
+  static bool prepare(int fd)
+  {
+    if (!setNonBlocking(fd))
+      {
+        ::close(fd);
+        return false;
+      }
+    int yes = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &yes, sizeof(yes));
+    return true;
+  }
+
+  static int openListener(const std::string& port)
+  {
+    //Set up addrinfo struct
+    addrinfo hints;
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    hints.ai_flags = AI_PASSIVE;
+    addrinfo* results;
+    if (getaddrinfo(nullptr, port.c_str(), &hints, &results) != 0)
+      {
+        return -1;
+      }
+
+    //Try each of the provided addresses
+    int fd = -1;
+    for (addrinfo* p = results; p != nullptr; p = p->ai_next)
+      {
+        fd = socket(p->ai_family, p->ai_socktype, p->ai_protocol);
+        if (fd < 0) continue;
+
+        int yes = 1;
+        setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &yes, sizeof(yes));
+        if (bind(fd, p->ai_addr, p->ai_addrlen) == 0 &&
+            ::listen(fd, SOMAXCONN) == 0 && setNonBlocking(fd))
+          {
+            break;
+          }
+        ::close(fd);
+        fd = -1;
+      }
+    freeaddrinfo(results);
+    return fd;
+  }
+
+  static std::uint32_t getBE32(const std::uint8_t* in)
+  {
+    return (std::uint32_t(in[0]) << 24) | (std::uint32_t(in[1]) << 16) |
+      (std::uint32_t(in[2]) << 8) | in[3];
+  }
+
+  static void putBE(std::uint8_t* out, std::uint64_t v, std::size_t bytes)
+  {
+    for (std::size_t i = bytes; i > 0; i--)
+      {
+        out[i-1] = v & 0xFF;
+        v >>= 8;
+      }
+  }
+
+  //Every spectator is greeted the same way, so they all share one buffer
+  static const SharedMessages& spectatorGreeting()
+  {
+    static const SharedMessages greeting = std::make_shared<const Message>
+      (Message{MAGIC_NUM, 0x07, 2, NET_VERSION >> 8, NET_VERSION & 0xFF});
+    return greeting;
+  }
+
+  void* shard_thread(void* data)
+  {
+    static_cast<ServerShard*>(data)->run();
+    return nullptr;
+  }
+
+  GameServer::GameServer() :
+    _listenFd(-1), _spectateFd(-1), _numShards(1), _waiting(-1),
+    _seeking(0), _matched(0), _nextShard(0), _paired(0), _stop(false)
+  {
+    long cores = sysconf(_SC_NPROCESSORS_ONLN);
+    if (cores > 0) _numShards = cores;
+  }
+
+  GameServer::~GameServer()
+  {
+    dropWaiting();
+    if (_listenFd >= 0) ::close(_listenFd);
+    if (_spectateFd >= 0) ::close(_spectateFd);
+  }
+
+  bool GameServer::listen(std::string port)
+  {
+    if (_listenFd >= 0) ::close(_listenFd);
+    _listenFd = openListener(port);
+    return _listenFd >= 0;
+  }
+
+  bool GameServer::listenSpectators(std::string port)
+  {
+    if (_spectateFd >= 0) ::close(_spectateFd);
+    _spectateFd = openListener(port);
+    return _spectateFd >= 0;
+  }
+
+  bool GameServer::run()
+  {
+    if (_listenFd < 0) return false;
+    _stop = false;
+    _shards.clear();
+    for (std::size_t i = 0; i < _numShards; i++)
+      {
+        _shards.push_back(std::unique_ptr<ServerShard>(new ServerShard(this)));
+        if (!_shards.back()->init()) return false;
+      }
+
+    //The first shard also accepts connections
+    if (!_shards[0]->watch(_listenFd, EPOLLIN, LISTEN_TAG)) return false;
+    if (_spectateFd >= 0 &&
+        !_shards[0]->watch(_spectateFd, EPOLLIN, SPECTATE_TAG))
+      {
+        return false;
+      }
+
+    //Every other shard gets a thread of its own
+    std::vector<pthread_t> tids(_numShards);
+    std::size_t started = 1;
+    while (started < _numShards &&
+           pthread_create(&tids[started], NULL, &shard_thread,
+                          _shards[started].get()) == 0)
+      {
+        started++;
+      }
+    if (started == _numShards) _shards[0]->run();
+    else _stop = true;
+
+    for (std::size_t i = 1; i < started; i++)
+      {
+        _shards[i]->wake();
+        pthread_join(tids[i], NULL);
+      }
+    _shards[0]->unwatch(_listenFd);
+    if (_spectateFd >= 0) _shards[0]->unwatch(_spectateFd);
+    dropWaiting();
+    return started == _numShards;
+  }
+
+  void GameServer::stop()
+  {
+    _stop = true;
+    if (!_shards.empty()) _shards[0]->wake();
+  }
+
+  ServerStats GameServer::stats() const
+  {
+    ServerStats s;
+    s.games = s.gamesHosted = s.spectators = 0;
+    s.messages = s.resyncs = 0;
+    for (std::size_t i = 0; i < _shards.size(); i++)
+      {
+        s.games += _shards[i]->games();
+        s.gamesHosted += _shards[i]->gamesHosted();
+        s.spectators += _shards[i]->spectators();
+        s.resyncs += _shards[i]->resyncs();
+        s.messages += _shards[i]->messages();
+      }
+    s.seeking = _seeking;
+    s.matched = _matched;
+    return s;
+  }
+
+  void GameServer::accepted(int fd)
+  {
+    if (!prepare(fd)) return;
+
+    //Edge triggered, as the first message is only looked at until it has
+    //all arrived
+    if (!_shards[0]->watch(fd, EPOLLIN | EPOLLRDHUP | EPOLLET,
+                           newcomerTag(fd)))
+      {
+        ::close(fd);
+        return;
+      }
+    _newcomers.insert(fd);
+  }
+
+  void GameServer::heardFrom(int fd)
+  {
+    //Only a resume or seek message is taken off the socket here, anything
+    //else is left for the player's shard
+    std::uint8_t m[HEADER_SIZE + 16];
+    ssize_t got = recv(fd, m, sizeof(m), MSG_PEEK);
+    if (got < 0 && (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR))
+      {
+        return;
+      }
+    std::uint8_t type = got >= ssize_t(HEADER_SIZE) ? m[1] : 0;
+    ssize_t wanted = 0;
+    if (type == 0x0E || type == 0x0F) wanted = messageLength(type);
+    if (got < wanted) return;
+
+    _newcomers.erase(fd);
+    _shards[0]->unwatch(fd);
+    if (got <= 0 || m[0] != MAGIC_NUM ||
+        (wanted && (m[2] != wanted - HEADER_SIZE ||
+                    recv(fd, m, wanted, 0) != wanted)))
+      {
+        ::close(fd);
+        return;
+      }
+
+    if (type == 0x0E) shardFor(getBE32(m + HEADER_SIZE))->adopt(fd, m + HEADER_SIZE);
+    else if (type == 0x0F) seek(fd, m + HEADER_SIZE);
+    else pair(fd);
+  }
+
+  void GameServer::pair(int fd)
+  {
+    if (_waiting < 0)
+      {
+        //Nothing more is read until there is an opponent, but hang ups are
+        //watched for so a dead connection is never paired
+        _waiting = fd;
+        _shards[0]->watch(fd, EPOLLRDHUP, WAITING_TAG);
+        return;
+      }
+
+    int first = _waiting;
+    _shards[0]->unwatch(first);
+    _waiting = -1;
+    startGame(first, fd, ArmyType::NONE, ArmyType::NONE);
+  }
+
+  void GameServer::seek(int fd, const std::uint8_t* m)
+  {
+    std::uint16_t rating = (m[0] << 8) | m[1];
+    ArmyType army = toArmy(m[2]);
+    if (army > ArmyType::NONE)
+      {
+        ::close(fd);
+        return;
+      }
+
+    Seeker opponent;
+    if (!_lobby.seek(fd, rating, army, opponent))
+      {
+        //As with _waiting, only hang ups are watched for until matched
+        if (!_shards[0]->watch(fd, EPOLLRDHUP, seekerTag(fd)))
+          {
+            _lobby.leave(fd);
+            ::close(fd);
+          }
+        _seeking = _lobby.waiting();
+        return;
+      }
+
+    //Whoever waited plays white
+    _shards[0]->unwatch(opponent.fd);
+    _seeking = _lobby.waiting();
+    _matched++;
+    startGame(opponent.fd, fd, opponent.army, army);
+  }
+
+  void GameServer::leftLobby(int fd)
+  {
+    _shards[0]->unwatch(fd);
+    ::close(fd);
+    _lobby.leave(fd);
+    _seeking = _lobby.waiting();
+  }
+
+  int GameServer::matchLobby()
+  {
+    if (_lobby.waiting() < 2) return -1;
+    std::chrono::steady_clock::time_point now =
+      std::chrono::steady_clock::now();
+    if (now >= _nextLobbyMatch)
+      {
+        //Whoever waited longest plays white
+        Seeker first, second;
+        while (_lobby.match(first, second))
+          {
+            _shards[0]->unwatch(first.fd);
+            _shards[0]->unwatch(second.fd);
+            _matched++;
+            startGame(first.fd, second.fd, first.army, second.army);
+          }
+        _seeking = _lobby.waiting();
+        _nextLobbyMatch = now + LOBBY_MATCH_INTERVAL;
+        if (_lobby.waiting() < 2) return -1;
+      }
+    return std::chrono::duration_cast<std::chrono::milliseconds>
+      (_nextLobbyMatch - now).count() + 1;
+  }
+
+  void GameServer::startGame(int first, int second, ArmyType white,
+                             ArmyType black)
+  {
+    //The load is only a hint, as the shards change it as we look. Starting
+    //from where the last search left off spreads out pairs when it's even.
+    std::size_t n = _shards.size();
+    std::size_t best = _nextShard;
+    for (std::size_t i = 1; i < n; i++)
+      {
+        std::size_t s = (_nextShard + i) % n;
+        if (_shards[s]->load() < _shards[best]->load()) best = s;
+      }
+    _nextShard = (best + 1) % n;
+
+    //Ids are made so that shardFor() finds the shard from them alone
+    _paired++;
+    std::uint32_t id = _paired * n + best;
+    _shards[best]->adopt(first, second, id, white, black);
+  }
+
+  ServerShard* GameServer::shardFor(std::uint32_t id)
+  {
+    return _shards[id % _shards.size()].get();
+  }
+
+  void GameServer::dropWaiting()
+  {
+    for (std::unordered_set<int>::iterator it = _newcomers.begin();
+         it != _newcomers.end(); ++it)
+      {
+        if (!_shards.empty()) _shards[0]->unwatch(*it);
+        ::close(*it);
+      }
+    _newcomers.clear();
+
+    std::vector<int> seekers;
+    _lobby.clear(seekers);
+    for (std::size_t i = 0; i < seekers.size(); i++)
+      {
+        if (!_shards.empty()) _shards[0]->unwatch(seekers[i]);
+        ::close(seekers[i]);
+      }
+    _seeking = 0;
+
+    if (_waiting < 0) return;
+    if (!_shards.empty()) _shards[0]->unwatch(_waiting);
+    ::close(_waiting);
+    _waiting = -1;
+  }
+
+  ServerShard::ServerShard(GameServer* server) :
+    _server(server), _epollFd(-1), _wakeFd(-1), _gameCount(0),
+    _incoming(0), _gamesHosted(0), _messages(0), _resyncs(0),
+    _spectatorCount(0)
+  {
+    pthread_mutex_init(&_pendingLock, NULL);
+  }
+
+  ServerShard::~ServerShard()
+  {
+    //Spectators first, as they point into the games
+    for (std::list<std::unique_ptr<ServerSpectator> >::iterator it =
+           _spectators.begin(); it != _spectators.end(); ++it)
+      {
+        close(it->get());
+      }
+    for (std::size_t i = 0; i < _pendingSpectators.size(); i++)
+      {
+        ::close(_pendingSpectators[i].first->fd);
+        delete _pendingSpectators[i].first;
+      }
+    for (std::size_t i = 0; i < _pendingResumes.size(); i++)
+      {
+        ::close(_pendingResumes[i].fd);
+      }
+    while (!_games.empty())
+      {
+        close(_games.front().get());
+        _games.pop_front();
+      }
+    for (std::size_t i = 0; i < _pending.size(); i++)
+      {
+        ::close(_pending[i].first);
+        ::close(_pending[i].second);
+      }
+    if (_wakeFd >= 0) ::close(_wakeFd);
+    if (_epollFd >= 0) ::close(_epollFd);
+    pthread_mutex_destroy(&_pendingLock);
+  }
+
+  bool ServerShard::init()
+  {
+    _epollFd = epoll_create1(0);
+    _wakeFd = eventfd(0, EFD_NONBLOCK);
+    if (_epollFd < 0 || _wakeFd < 0) return false;
+
+    return watch(_wakeFd, EPOLLIN, WAKE_TAG);
+  }
+
+  bool ServerShard::watch(int fd, std::uint32_t events, std::uint64_t tag)
+  {
+    epoll_event ev;
+    ev.events = events;
+    ev.data.u64 = tag;
+    return epoll_ctl(_epollFd, EPOLL_CTL_ADD, fd, &ev) == 0;
+  }
+
+  void ServerShard::unwatch(int fd)
+  {
+    epoll_ctl(_epollFd, EPOLL_CTL_DEL, fd, nullptr);
+  }
+
+  void ServerShard::adopt(int first, int second, std::uint32_t id,
+                          ArmyType white, ArmyType black)
+  {
+    PendingGame p;
+    p.first = first;
+    p.second = second;
+    p.id = id;
+    p.armies[0] = white;
+    p.armies[1] = black;
+    pthread_mutex_lock(&_pendingLock);
+    _pending.push_back(p);
+    pthread_mutex_unlock(&_pendingLock);
+    _incoming++;
+    wake();
+  }
+
+  void ServerShard::adopt(std::unique_ptr<ServerSpectator> s, std::uint32_t id)
+  {
+    pthread_mutex_lock(&_pendingLock);
+    _pendingSpectators.push_back(std::make_pair(s.release(), id));
+    pthread_mutex_unlock(&_pendingLock);
+    wake();
+  }
+
+  void ServerShard::adopt(int fd, const std::uint8_t* resume)
+  {
+    PendingResume p;
+    p.fd = fd;
+    memcpy(p.resume, resume, sizeof(p.resume));
+    pthread_mutex_lock(&_pendingLock);
+    _pendingResumes.push_back(p);
+    pthread_mutex_unlock(&_pendingLock);
+    wake();
+  }
+
+  void ServerShard::wake()
+  {
+    std::uint64_t one = 1;
+    ssize_t r = write(_wakeFd, &one, sizeof(one));
+    (void)r;
+  }
+
+  void ServerShard::run()
+  {
+    epoll_event events[SERVER_MAX_EVENTS];
+    int timeout = -1;
+    while (!_server->_stop)
+      {
+        //Only held seats and the lobby need waking up for
+        int n = epoll_wait(_epollFd, events, SERVER_MAX_EVENTS, timeout);
+        if (n < 0 && errno != EINTR) break;
+
+        for (int i = 0; i < n; i++)
+          {
+            std::uint64_t tag = events[i].data.u64;
+            std::uint32_t what = events[i].events;
+            if (tag == WAKE_TAG)
+              {
+                std::uint64_t count;
+                ssize_t r = read(_wakeFd, &count, sizeof(count));
+                (void)r;
+                takePending();
+              }
+            else if (tag == LISTEN_TAG)
+              {
+                int fd;
+                while ((fd = accept(_server->_listenFd, nullptr, nullptr)) >= 0)
+                  {
+                    _server->accepted(fd);
+                  }
+              }
+            else if (tag == WAITING_TAG)
+              {
+                _server->dropWaiting();
+              }
+            else if (tag == SPECTATE_TAG)
+              {
+                int fd;
+                while ((fd = accept(_server->_spectateFd, nullptr, nullptr)) >= 0)
+                  {
+                    if (!prepare(fd)) continue;
+                    ServerSpectator* s = new ServerSpectator;
+                    s->fd = fd;
+                    take(s, 0);
+                  }
+              }
+            else if (tag & NEWCOMER_BIT)
+              {
+                if (tag & SEEKER_BIT) _server->leftLobby(tag >> 4);
+                else _server->heardFrom(tag >> 4);
+              }
+            else if (tag & SPECTATOR_BIT)
+              {
+                ServerSpectator* s =
+                  reinterpret_cast<ServerSpectator*>(tag & ~SPECTATOR_BIT);
+                if (!s->closed && (what & EPOLLOUT)) writable(s);
+                if (!s->closed && (what & (EPOLLIN | EPOLLHUP | EPOLLERR)))
+                  {
+                    readable(s);
+                  }
+              }
+            else
+              {
+                ServerGame* g = reinterpret_cast<ServerGame*>(tag & ~1ULL);
+                std::size_t side = tag & 1;
+                if (!g->closed && (what & EPOLLOUT)) writable(g, side);
+                if (!g->closed && (what & (EPOLLIN | EPOLLHUP | EPOLLERR)))
+                  {
+                    readable(g, side);
+                  }
+              }
+          }
+
+        flushDirty();
+        handOver();
+        timeout = expireSessions();
+
+        //The first shard runs the lobby, and wakes up to match players who
+        //have waited long enough to accept each other
+        if (this == _server->_shards[0].get())
+          {
+            int lobby = _server->matchLobby();
+            if (lobby >= 0 && (timeout < 0 || lobby < timeout)) timeout = lobby;
+          }
+
+        //Now nothing can point to them, clean up finished games. Their
+        //spectators stay until they have been sent everything.
+        for (std::list<std::unique_ptr<ServerGame> >::iterator it =
+               _games.begin(); it != _games.end(); )
+          {
+            ServerGame* g = it->get();
+            if (!g->closed)
+              {
+                ++it;
+                continue;
+              }
+            for (std::size_t i = 0; i < g->spectators.size(); i++)
+              {
+                ServerSpectator* s = g->spectators[i];
+                s->game = nullptr;
+                s->ended = true;
+                if (s->out.empty()) close(s);
+              }
+            _byId.erase(g->id);
+            std::list<std::unique_ptr<ServerGame> >::iterator next = it;
+            ++next;
+            if (_pool.size() < SERVER_POOL_SIZE)
+              {
+                _pool.splice(_pool.end(), _games, it);
+              }
+            else
+              {
+                _games.erase(it);
+              }
+            it = next;
+          }
+        _gameCount = _games.size();
+
+        for (std::list<std::unique_ptr<ServerSpectator> >::iterator it =
+               _spectators.begin(); it != _spectators.end(); )
+          {
+            if ((*it)->closed) it = _spectators.erase(it);
+            else ++it;
+          }
+        _spectatorCount = _spectators.size();
+      }
+  }
+
+  void ServerShard::takePending()
+  {
+    std::vector<PendingGame> pairs;
+    std::vector<std::pair<ServerSpectator*, std::uint32_t> > spectators;
+    std::vector<PendingResume> resumes;
+    pthread_mutex_lock(&_pendingLock);
+    pairs.swap(_pending);
+    spectators.swap(_pendingSpectators);
+    resumes.swap(_pendingResumes);
+    pthread_mutex_unlock(&_pendingLock);
+
+    for (std::size_t i = 0; i < pairs.size(); i++)
+      {
+        ServerGame* g = newGame();
+        g->players[0].fd = pairs[i].first;
+        g->players[1].fd = pairs[i].second;
+        g->id = pairs[i].id;
+        for (std::size_t side = 0; side < 2; side++)
+          {
+            if (!watch(g->players[side].fd, EPOLLIN, playerTag(g, side)))
+              {
+                g->closed = true;
+              }
+          }
+        if (g->closed)
+          {
+            close(g);
+            continue;
+          }
+        _gamesHosted++;
+        _byId[g->id] = g;
+        for (std::size_t side = 0; side < 2; side++)
+          {
+            g->players[side].secret =
+              (std::uint64_t(_random()) << 32) | _random();
+            greet(g, side);
+          }
+
+        //Armies asked for in the lobby
+        for (std::size_t side = 0; side < 2 && !g->closed; side++)
+          {
+            if (pairs[i].armies[side] == ArmyType::NONE) continue;
+            std::uint8_t m[] = {MAGIC_NUM, 0x00, 2, std::uint8_t(side),
+                                num(pairs[i].armies[side])};
+            call(g, m, sizeof(m));
+          }
+      }
+    _gameCount = _games.size();
+    _incoming -= pairs.size();
+
+    for (std::size_t i = 0; i < spectators.size(); i++)
+      {
+        take(spectators[i].first, spectators[i].second);
+      }
+    _spectatorCount = _spectators.size();
+
+    for (std::size_t i = 0; i < resumes.size(); i++)
+      {
+        rejoin(resumes[i].fd, resumes[i].resume);
+      }
+  }
+
+  ServerGame* ServerShard::newGame()
+  {
+    if (_pool.empty())
+      {
+        _games.push_back(std::unique_ptr<ServerGame>(new ServerGame));
+        return _games.back().get();
+      }
+
+    //Everything goes back to how the constructor left it, keeping buffers
+    //unless a long game left them large
+    _games.splice(_games.end(), _pool, _pool.begin());
+    ServerGame* g = _games.back().get();
+    g->game = Game(&g->board);
+    for (std::size_t side = 0; side < 2; side++)
+      {
+        ServerConnection& c = g->players[side];
+        c.fd = -1;
+        c.in.clear();
+        if (c.out.capacity() > SERVER_READ_SIZE) Message().swap(c.out);
+        c.out.clear();
+        c.outPos = 0;
+        c.watchingOut = false;
+        c.dirty = false;
+        c.secret = 0;
+        c.drops = 0;
+      }
+    g->id = 0;
+    g->calls = 0;
+    g->historySize = 0;
+    g->feed.clear();
+    g->snapshot.reset();
+    g->spectators.clear();
+    g->closed = false;
+    return g;
+  }
+
+  void ServerShard::call(ServerGame* g, const std::uint8_t* m,
+                         std::size_t size)
+  {
+    g->snapshot.reset();
+    if (!succeeded(applyMessage(g->game, m))) return;
+    record(g, m, size);
+    g->calls++;
+    if (!g->spectators.empty())
+      {
+        if (g->feed.empty()) _feeding.push_back(g);
+        g->feed.insert(g->feed.end(), m, m + size);
+      }
+    send(g, 0, m, size);
+    if (!g->closed) send(g, 1, m, size);
+  }
+
+  void ServerShard::greet(ServerGame* g, std::size_t side)
+  {
+    //Our version, as a client would, then which game it is for spectators
+    //to ask for, then the token to resume it with
+    std::uint8_t m[] =
+      {MAGIC_NUM, 0x07, 2, NET_VERSION >> 8, NET_VERSION & 0xFF,
+       MAGIC_NUM, 0x09, 4, 0, 0, 0, 0,
+       MAGIC_NUM, 0x0D, 12, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0};
+    putBE(m + 8, g->id, 4);
+    putBE(m + 15, g->id, 4);
+    putBE(m + 19, g->players[side].secret, 8);
+    send(g, side, m, sizeof(m));
+  }
+
+  void ServerShard::record(ServerGame* g, const std::uint8_t* m,
+                           std::size_t size)
+  {
+    MessageSlot& slot = g->history[g->calls % SESSION_HISTORY];
+    slot.size = size;
+    memcpy(slot.data, m, size);
+    if (g->historySize < SESSION_HISTORY) g->historySize++;
+  }
+
+  void ServerShard::drop(ServerGame* g, std::size_t side)
+  {
+    //Nobody is coming back to a finished game
+    if (isGameOver(g->game.state()) || g->players[1 - side].fd < 0)
+      {
+        close(g);
+        return;
+      }
+
+    ServerConnection& c = g->players[side];
+    if (c.fd >= 0)
+      {
+        unwatch(c.fd);
+        ::close(c.fd);
+      }
+    std::uint64_t secret = c.secret;
+    std::uint32_t drops = c.drops + 1;
+    c = ServerConnection();
+    c.secret = secret;
+    c.drops = drops;
+
+    Session s;
+    s.id = g->id;
+    s.side = side;
+    s.drops = drops;
+    s.expires = std::chrono::steady_clock::now() + SESSION_TIMEOUT;
+    _sessions.push_back(s);
+
+    //Make room by giving up on the longest held seat
+    if (_sessions.size() > SERVER_MAX_SESSIONS)
+      {
+        _sessions.front().expires = s.expires - SESSION_TIMEOUT;
+      }
+  }
+
+  void ServerShard::rejoin(int fd, const std::uint8_t* resume)
+  {
+    std::uint32_t id = getBE32(resume);
+    std::uint64_t secret = (std::uint64_t(getBE32(resume + 4)) << 32) |
+      getBE32(resume + 8);
+    std::uint32_t calls = getBE32(resume + 12);
+
+    //The secret has to be right
+    std::unordered_map<std::uint32_t, ServerGame*>::iterator it =
+      _byId.find(id);
+    ServerGame* g = it == _byId.end() ? nullptr : it->second;
+    std::size_t side = 0;
+    while (g && side < 2 && g->players[side].secret != secret) side++;
+    if (!g || g->closed || side == 2)
+      {
+        ::close(fd);
+        return;
+      }
+
+    //The old connection may not have been noticed dropping yet, in which
+    //case it is replaced
+    ServerConnection& c = g->players[side];
+    if (c.fd >= 0)
+      {
+        unwatch(c.fd);
+        ::close(c.fd);
+        std::uint32_t drops = c.drops + 1;
+        c = ServerConnection();
+        c.secret = secret;
+        c.drops = drops;
+      }
+    if (!watch(fd, EPOLLIN, playerTag(g, side)))
+      {
+        ::close(fd);
+        drop(g, side);
+        return;
+      }
+    c.fd = fd;
+    greet(g, side);
+
+    //Send the calls it missed if we still have them, or the whole game.
+    //A player ahead of us made calls we never got, and sends them again
+    //on seeing the hash below.
+    if (calls <= g->calls && g->calls - calls <= g->historySize)
+      {
+        for (std::uint32_t i = calls; i < g->calls; i++)
+          {
+            const MessageSlot& slot = g->history[i % SESSION_HISTORY];
+            send(g, side, slot.data, slot.size);
+          }
+      }
+    else if (calls < g->calls)
+      {
+        resync(g, side);
+      }
+
+    //Then a hash, which says how far we got
+    std::uint8_t m[HEADER_SIZE + 12] = {MAGIC_NUM, 0x0B, 12};
+    putBE(m + HEADER_SIZE, g->calls, 4);
+    putBE(m + HEADER_SIZE + 4, g->game.hash(), 8);
+    send(g, side, m, sizeof(m));
+  }
+
+  int ServerShard::expireSessions()
+  {
+    std::chrono::steady_clock::time_point now =
+      std::chrono::steady_clock::now();
+    while (!_sessions.empty())
+      {
+        //Seats taken back or in games already over are just dropped
+        const Session& s = _sessions.front();
+        std::unordered_map<std::uint32_t, ServerGame*>::iterator it =
+          _byId.find(s.id);
+        ServerGame* g = it == _byId.end() ? nullptr : it->second;
+        bool held = g && !g->closed && g->players[s.side].fd < 0 &&
+          g->players[s.side].drops == s.drops;
+        if (held && s.expires > now)
+          {
+            std::chrono::milliseconds left =
+              std::chrono::duration_cast<std::chrono::milliseconds>
+              (s.expires - now);
+            return left.count() + 1;
+          }
+        if (held) close(g);
+        _sessions.pop_front();
+      }
+    return -1;
+  }
+
+  void ServerShard::readable(ServerGame* g, std::size_t side)
+  {
+    ServerConnection& c = g->players[side];
+    while (true)
+      {
+        ssize_t got = c.in.fill(c.fd);
+        if (got < 0 && errno == EINTR) continue;
+        if (got < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) break;
+        if (got <= 0)
+          {
+            //The player hung up or the connection failed
+            drop(g, side);
+            return;
+          }
+
+        //Handle every whole frame received, which also makes room for more
+        std::size_t size;
+        const std::uint8_t* m;
+        while ((m = c.in.next(size)))
+          {
+            //Known messages must be the right size, others are skipped
+            std::size_t length = messageLength(m[1]);
+            if (length == 0) continue;
+            if (length != size)
+              {
+                close(g);
+                return;
+              }
+            _messages++;
+
+            const std::uint8_t* p = m + HEADER_SIZE;
+            switch (m[1])
+              {
+              case 6: //state
+                {
+                  if (p[0] != num(g->game.state()))
+                    {
+                      close(g);
+                      return;
+                    }
+                  break;
+                }
+
+              case 7: //version
+                {
+                  std::uint16_t otherVer = (p[0] << 8) + p[1];
+                  if (NET_VERSION != otherVer)
+                    {
+                      close(g);
+                      return;
+                    }
+                  break;
+                }
+
+              case 11: //hash
+                {
+                  //Only comparable once both have made the same calls
+                  std::uint32_t calls = getBE32(p);
+                  std::uint64_t hash =
+                    (std::uint64_t(getBE32(p + 4)) << 32) | getBE32(p + 8);
+                  if (calls == g->calls && hash != g->game.hash())
+                    {
+                      resync(g, side);
+                      if (g->closed) return;
+                    }
+                  break;
+                }
+
+              case 12: //resync
+                {
+                  resync(g, side);
+                  if (g->closed) return;
+                  break;
+                }
+
+              default:
+                {
+                  //Only calls that go through on our game reach the opponent.
+                  //A player whose game differs is resynced after the hash
+                  //that follows a call, but a call that can't be made here
+                  //is still refused.
+                  g->snapshot.reset();
+                  if (!succeeded(applyMessage(g->game, m)))
+                    {
+                      close(g);
+                      return;
+                    }
+                  record(g, m, length);
+                  g->calls++;
+
+                  //And the spectators, once the batch is over
+                  if (!g->spectators.empty())
+                    {
+                      if (g->feed.empty()) _feeding.push_back(g);
+                      g->feed.insert(g->feed.end(), m, m + length);
+                    }
+                  send(g, 1 - side, m, length);
+                  if (g->closed) return;
+                  break;
+                }
+              }
+          }
+        if (c.in.corrupt())
+          {
+            close(g);
+            return;
+          }
+      }
+  }
+
+  void ServerShard::writable(ServerGame* g, std::size_t side)
+  {
+    ServerConnection& c = g->players[side];
+    if (!flush(c))
+      {
+        drop(g, side);
+        return;
+      }
+    if (c.outPos == c.out.size()) watchOut(g, side, false);
+  }
+
+  void ServerShard::send(ServerGame* g, std::size_t side,
+                         const std::uint8_t* data, std::size_t size)
+  {
+    ServerConnection& c = g->players[side];
+
+    //A player who is away catches up when they resume
+    if (c.fd < 0) return;
+    if (c.out.size() - c.outPos + size > SERVER_MAX_BACKLOG)
+      {
+        close(g);
+        return;
+      }
+    c.out.insert(c.out.end(), data, data + size);
+    if (!c.dirty)
+      {
+        c.dirty = true;
+        _dirty.push_back(std::make_pair(g, side));
+      }
+  }
+
+  void ServerShard::resync(ServerGame* g, std::size_t side)
+  {
+    std::uint8_t m[HEADER_SIZE + 4 + MAX_FRAME_SIZE] = {MAGIC_NUM, 0x0C, 4};
+    putBE(m + HEADER_SIZE, g->calls, 4);
+    std::size_t size = snapshotFrame(g->game.snapshot(), m + HEADER_SIZE + 4);
+    send(g, side, m, HEADER_SIZE + 4 + size);
+    _resyncs++;
+  }
+
+  void ServerShard::flushDirty()
+  {
+    for (std::size_t i = 0; i < _dirty.size(); i++)
+      {
+        ServerGame* g = _dirty[i].first;
+        std::size_t side = _dirty[i].second;
+        ServerConnection& c = g->players[side];
+        c.dirty = false;
+
+        //A socket already waiting to drain is flushed by writable()
+        if (g->closed || c.fd < 0 || c.watchingOut) continue;
+        if (!flush(c))
+          {
+            drop(g, side);
+            continue;
+          }
+
+        //Whatever didn't fit waits for the socket to drain
+        if (c.outPos < c.out.size()) watchOut(g, side, true);
+      }
+    _dirty.clear();
+
+    //Each game's messages are copied once, then shared by its spectators
+    for (std::size_t i = 0; i < _feeding.size(); i++)
+      {
+        ServerGame* g = _feeding[i];
+        SharedMessages m = std::make_shared<const Message>(std::move(g->feed));
+        g->feed.clear();
+
+        //Sending can close a spectator, which takes it off the list
+        std::vector<ServerSpectator*> watching(g->spectators);
+        for (std::size_t j = 0; j < watching.size(); j++)
+          {
+            send(watching[j], m);
+          }
+      }
+    _feeding.clear();
+
+    for (std::size_t i = 0; i < _dirtySpectators.size(); i++)
+      {
+        ServerSpectator* s = _dirtySpectators[i];
+        s->dirty = false;
+        if (s->closed) continue;
+        if (s->behind) catchUp(s);
+        if (s->watchingOut) continue;
+        if (!flush(s))
+          {
+            close(s);
+            continue;
+          }
+        if (!s->out.empty()) watchOut(s, true);
+        else if (s->ended) close(s);
+      }
+    _dirtySpectators.clear();
+  }
+
+  void ServerShard::take(ServerSpectator* s, std::uint32_t id)
+  {
+    _spectators.push_back(std::unique_ptr<ServerSpectator>(s));
+    std::uint32_t events = s->out.empty() ? EPOLLIN : EPOLLIN | EPOLLOUT;
+    s->watchingOut = !s->out.empty();
+    if (!watch(s->fd, events, spectatorTag(s)))
+      {
+        close(s);
+        return;
+      }
+    if (id == 0) send(s, spectatorGreeting());
+    else attach(s, id);
+  }
+
+  void ServerShard::attach(ServerSpectator* s, std::uint32_t id)
+  {
+    std::unordered_map<std::uint32_t, ServerGame*>::iterator it =
+      _byId.find(id);
+    if (it == _byId.end() || it->second->closed)
+      {
+        close(s);
+        return;
+      }
+    s->game = it->second;
+    s->game->spectators.push_back(s);
+    s->behind = true;
+    markDirty(s);
+  }
+
+  void ServerShard::readable(ServerSpectator* s)
+  {
+    while (true)
+      {
+        ssize_t got = s->in.fill(s->fd);
+        if (got < 0 && errno == EINTR) continue;
+        if (got < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) break;
+        if (got <= 0)
+          {
+            close(s);
+            return;
+          }
+
+        //Spectators only say which version they are and what to watch
+        std::size_t size;
+        const std::uint8_t* m;
+        while ((m = s->in.next(size)))
+          {
+            if (size != messageLength(m[1])) continue;
+            const std::uint8_t* p = m + HEADER_SIZE;
+            if (m[1] == 7) //version
+              {
+                std::uint16_t otherVer = (p[0] << 8) + p[1];
+                if (NET_VERSION != otherVer)
+                  {
+                    close(s);
+                    return;
+                  }
+              }
+            else if (m[1] == 10 && !s->game && !s->ended) //watch
+              {
+                std::uint32_t id = getBE32(p);
+                if (_server->shardFor(id) == this)
+                  {
+                    attach(s, id);
+                    if (s->closed) return;
+                  }
+                else
+                  {
+                    //Anything else it sent goes unread, as there is nothing
+                    //more for it to say
+                    _leaving.push_back(std::make_pair(s, id));
+                    return;
+                  }
+              }
+          }
+        if (s->in.corrupt())
+          {
+            close(s);
+            return;
+          }
+      }
+  }
+
+  void ServerShard::writable(ServerSpectator* s)
+  {
+    if (!flush(s))
+      {
+        close(s);
+        return;
+      }
+    if (!s->out.empty()) return;
+    watchOut(s, false);
+    if (s->ended) close(s);
+  }
+
+  void ServerShard::send(ServerSpectator* s, const SharedMessages& m)
+  {
+    if (s->closed || s->behind) return;
+    if (s->outSize + m->size() > SPECTATOR_MAX_BACKLOG)
+      {
+        //Rather than fall further behind, skip ahead to where the game is
+        //now, unless that has already been tried
+        if (s->skipped)
+          {
+            close(s);
+            return;
+          }
+        s->skipped = true;
+        s->behind = true;
+      }
+    else
+      {
+        s->out.push_back(m);
+        s->outSize += m->size();
+      }
+    markDirty(s);
+  }
+
+  void ServerShard::catchUp(ServerSpectator* s)
+  {
+    s->behind = false;
+    if (!s->game) return;
+
+    //Anything partly written has to be finished to keep the frames whole
+    while (s->out.size() > (s->outPos > 0 ? 1u : 0u))
+      {
+        s->outSize -= s->out.back()->size();
+        s->out.pop_back();
+      }
+
+    //Spectators catching up together share one snapshot
+    ServerGame* g = s->game;
+    if (!g->snapshot)
+      {
+        std::uint8_t frame[MAX_FRAME_SIZE];
+        std::size_t size = snapshotFrame(g->game.snapshot(), frame);
+        g->snapshot = std::make_shared<const Message>(frame, frame + size);
+      }
+    s->out.push_back(g->snapshot);
+    s->outSize += g->snapshot->size();
+  }
+
+  void ServerShard::markDirty(ServerSpectator* s)
+  {
+    if (s->dirty) return;
+    s->dirty = true;
+    _dirtySpectators.push_back(s);
+  }
+
+  bool ServerShard::flush(ServerSpectator* s)
+  {
+    while (!s->out.empty())
+      {
+        //Point straight at the shared buffers
+        iovec iov[SPECTATOR_MAX_IOV];
+        std::size_t count = 0;
+        for (std::deque<SharedMessages>::const_iterator it = s->out.begin();
+             it != s->out.end() && count < SPECTATOR_MAX_IOV; ++it, ++count)
+          {
+            std::size_t skip = count == 0 ? s->outPos : 0;
+            iov[count].iov_base = const_cast<std::uint8_t*>(&(**it)[skip]);
+            iov[count].iov_len = (*it)->size() - skip;
+          }
+        msghdr msg;
+        memset(&msg, 0, sizeof(msg));
+        msg.msg_iov = iov;
+        msg.msg_iovlen = count;
+
+        ssize_t sent = sendmsg(s->fd, &msg, MSG_NOSIGNAL);
+        if (sent < 0 && errno == EINTR) continue;
+        if (sent < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) break;
+        if (sent <= 0) return false;
+
+        //Let go of every buffer fully written
+        s->outSize -= sent;
+        std::size_t done = sent;
+        while (done > 0)
+          {
+            std::size_t left = s->out.front()->size() - s->outPos;
+            if (done < left)
+              {
+                s->outPos += done;
+                break;
+              }
+            done -= left;
+            s->out.pop_front();
+            s->outPos = 0;
+          }
+      }
+    if (s->out.empty()) s->skipped = false;
+    return true;
+  }
+
+  void ServerShard::watchOut(ServerSpectator* s, bool watch)
+  {
+    if (s->watchingOut == watch) return;
+    epoll_event ev;
+    ev.events = watch ? EPOLLIN | EPOLLOUT : EPOLLIN;
+    ev.data.u64 = spectatorTag(s);
+    epoll_ctl(_epollFd, EPOLL_CTL_MOD, s->fd, &ev);
+    s->watchingOut = watch;
+  }
+
+  void ServerShard::handOver()
+  {
+    for (std::size_t i = 0; i < _leaving.size(); i++)
+      {
+        ServerSpectator* s = _leaving[i].first;
+        if (s->closed) continue;
+        unwatch(s->fd);
+        s->watchingOut = false;
+        for (std::list<std::unique_ptr<ServerSpectator> >::iterator it =
+               _spectators.begin(); it != _spectators.end(); ++it)
+          {
+            if (it->get() != s) continue;
+            std::unique_ptr<ServerSpectator> moving(it->release());
+            _spectators.erase(it);
+            _server->shardFor(_leaving[i].second)->adopt
+              (std::move(moving), _leaving[i].second);
+            break;
+          }
+      }
+    _leaving.clear();
+  }
+
+  bool ServerShard::flush(ServerConnection& c)
+  {
+    while (c.outPos < c.out.size())
+      {
+        ssize_t sent = ::send(c.fd, &c.out[c.outPos], c.out.size() - c.outPos,
+                              MSG_NOSIGNAL);
+        if (sent > 0)
+          {
+            c.outPos += sent;
+            continue;
+          }
+        if (sent < 0 && errno == EINTR) continue;
+        if (sent < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) break;
+        return false;
+      }
+
+    //Only move the data down once it has all gone, or grown large
+    if (c.outPos == c.out.size())
+      {
+        c.out.clear();
+        c.outPos = 0;
+      }
+    else if (c.outPos > SERVER_MAX_BACKLOG / 4)
+      {
+        c.out.erase(c.out.begin(), c.out.begin() + c.outPos);
+        c.outPos = 0;
+      }
+    return true;
+  }
+
+  void ServerShard::watchOut(ServerGame* g, std::size_t side, bool watch)
+  {
+    ServerConnection& c = g->players[side];
+    if (c.watchingOut == watch) return;
+    epoll_event ev;
+    ev.events = watch ? EPOLLIN | EPOLLOUT : EPOLLIN;
+    ev.data.u64 = playerTag(g, side);
+    epoll_ctl(_epollFd, EPOLL_CTL_MOD, c.fd, &ev);
+    c.watchingOut = watch;
+  }
+
+  void ServerShard::close(ServerGame* g)
+  {
+    g->closed = true;
+    for (std::size_t side = 0; side < 2; side++)
+      {
+        ServerConnection& c = g->players[side];
+        if (c.fd < 0) continue;
+        unwatch(c.fd);
+        ::close(c.fd);
+        c.fd = -1;
+      }
+  }
+
+  void ServerShard::close(ServerSpectator* s)
+  {
+    if (s->closed) return;
+    s->closed = true;
+    if (s->game)
+      {
+        std::vector<ServerSpectator*>& list = s->game->spectators;
+        list.erase(std::remove(list.begin(), list.end(), s), list.end());
+        s->game = nullptr;
+      }
+    unwatch(s->fd);
+    ::close(s->fd);
+    s->fd = -1;
+  }
+
+} //Namespace
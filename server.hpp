@@ -0,0 +1,503 @@
+/*
+  Copyright (c) 2014 Auston Sterling
+  See license.txt for copying permission.
+
+  -----GameServer Class Header-----
+  Auston Sterling
+  austonst@gmail.com
+
+  A server hosting many games at once over the NetGame protocol.
+
+  Players connect exactly as they would to another client. Connections are
+  paired in the order they first send something, which for a NetGame is
+  its version straight away, and each pair gets a Game of its own on the
+  server. Every message is checked against that Game before it is passed
+  on to the other player, and a player sending anything that doesn't apply
+  is disconnected along with their opponent. Hash messages from players
+  are checked against the server's game, and a player whose game differs
+  is resynced to it.
+
+  Each player is also sent a session message with a token for their seat.
+  If their connection drops, the seat is held for them as a session, until
+  it expires or the table of sessions fills up and it is the oldest. A
+  connection whose first message is a resume message with the token takes
+  the seat back. It is sent the calls it missed if they are among the last
+  few made, or a snapshot if not, and then a hash to check against. A
+  player who made calls the server never got sends them again on seeing
+  the hash's call count, and they are played as usual.
+
+  A connection whose first message is a seek message goes into the lobby
+  instead, to be matched with a player of about the same rating. The
+  server then sets both armies to the ones asked for.
+
+  The sockets are multiplexed by a small number of shards, each an epoll
+  loop on its own thread with its own games, so nothing is shared between
+  shards except the handing over of new pairs. Each new pair goes to the
+  shard with the fewest games. Shards keep finished games to reuse, so
+  starting a game doesn't allocate one. The first shard also accepts
+  connections, runs the lobby and runs on the thread that calls run().
+
+  Spectators connect to a port of their own and send a watch message with
+  the id of a game, which players are told in a game message when they are
+  paired. They are sent a snapshot of the game followed by every message
+  the game passes on. Each batch of messages is built once per game and the
+  same buffer is queued for every spectator. A spectator that falls too far
+  behind has its queue dropped and is sent a fresh snapshot instead, and is
+  disconnected if it is still behind the next time.
+*/
+
+#ifndef _server_hpp_
+#define _server_hpp_
+
+#include <atomic>
+#include <chrono>
+#include <deque>
+#include <list>
+#include <memory>
+#include <random>
+#include <unordered_map>
+#include <unordered_set>
+#include <pthread.h>
+
+#include "netgame.hpp"
+#include "bitboard.hpp"
+#include "lobby.hpp"
+
+namespace c2
+{
+
+  //Largest amount of unsent data a player can fall behind by before the
+  //server gives up on them
+  const std::size_t SERVER_MAX_BACKLOG = 1 << 16;
+
+  //Largest amount of unsent data a spectator can fall behind by before
+  //being skipped ahead to a snapshot
+  const std::size_t SPECTATOR_MAX_BACKLOG = 1 << 14;
+
+  //Room for received data on each connection
+  const std::size_t SERVER_READ_SIZE = 4096;
+
+  //How long a dropped player's seat is held, and the most seats held at
+  //once on each shard
+  const std::chrono::seconds SESSION_TIMEOUT(120);
+  const std::size_t SERVER_MAX_SESSIONS = 1 << 14;
+
+  //Calls kept for each game, to send to a player who resumes
+  const std::size_t SESSION_HISTORY = 32;
+
+  //Most finished games each shard keeps to reuse
+  const std::size_t SERVER_POOL_SIZE = 1024;
+
+  //Messages built once and queued for any number of spectators
+  typedef std::shared_ptr<const Message> SharedMessages;
+
+  class ServerShard;
+  struct ServerGame;
+
+  //One player's socket on the server
+  struct ServerConnection
+  {
+    //Constructors
+    ServerConnection() :
+      fd(-1), in(SERVER_READ_SIZE), outPos(0), watchingOut(false),
+      dirty(false), secret(0), drops(0) {}
+
+    //-1 while the player is away
+    int fd;
+
+    //Data received but not yet handed out as frames
+    FrameReader in;
+
+    //Data waiting to be written, from outPos on
+    Message out;
+    std::size_t outPos;
+
+    //Whether epoll is watching for the socket becoming writable
+    bool watchingOut;
+
+    //Whether data was queued since the last flush
+    bool dirty;
+
+    //The secret half of the session token, and how many times the
+    //connection has dropped
+    std::uint64_t secret;
+    std::uint32_t drops;
+  };
+
+  //A connection watching a game
+  struct ServerSpectator
+  {
+    //Constructors
+    ServerSpectator() :
+      fd(-1), in(0), game(nullptr), outPos(0), outSize(0), watchingOut(false),
+      dirty(false), behind(false), skipped(false), ended(false),
+      closed(false) {}
+
+    int fd;
+
+    //Data received but not yet handed out as frames
+    FrameReader in;
+
+    //The game being watched, or null if not chosen yet or over
+    ServerGame* game;
+
+    //Data waiting to be written, from outPos in the first buffer on
+    std::deque<SharedMessages> out;
+    std::size_t outPos;
+    std::size_t outSize;
+
+    //Whether epoll is watching for the socket becoming writable
+    bool watchingOut;
+
+    //Whether it needs flushing at the end of this batch
+    bool dirty;
+
+    //Set when the next thing to send is a snapshot, not the latest messages
+    bool behind;
+
+    //Set when skipped ahead since the queue last emptied
+    bool skipped;
+
+    //Set when the game is over, so it closes once everything is sent
+    bool ended;
+
+    //Set when waiting to be cleaned up
+    bool closed;
+  };
+
+  //A game between two connections
+  struct ServerGame
+  {
+    //Constructors
+    ServerGame() : game(&board), id(0), calls(0), historySize(0),
+                   closed(false) {}
+
+    BitBoard board;
+    Game game;
+    ServerConnection players[2];
+    std::uint32_t id;
+
+    //Calls made on the game, for matching up hash messages
+    std::uint32_t calls;
+
+    //The last calls made, oldest first from calls % SESSION_HISTORY
+    MessageSlot history[SESSION_HISTORY];
+    std::size_t historySize;
+
+    //Messages passed on during this batch, for the spectators
+    Message feed;
+
+    //A snapshot message for spectators catching up, until the game changes
+    SharedMessages snapshot;
+
+    std::vector<ServerSpectator*> spectators;
+
+    //Set when the game is over and waiting to be cleaned up
+    bool closed;
+  };
+
+  //Totals for the whole server
+  struct ServerStats
+  {
+    std::size_t games;
+    std::size_t gamesHosted;
+    std::size_t spectators;
+    std::size_t seeking;
+    std::size_t matched;
+    std::uint64_t messages;
+    std::uint64_t resyncs;
+  };
+
+  class GameServer
+  {
+  public:
+    //Constructors
+    GameServer();
+    ~GameServer();
+    GameServer(const GameServer&) = delete;
+    GameServer& operator=(const GameServer&) = delete;
+
+    //Number of event loops, which is best kept to the number of cores
+    //Only takes effect before run()
+    void setShards(std::size_t shards) {_numShards = shards ? shards : 1;}
+
+    //Opens the listening socket
+    bool listen(std::string port = DEFAULT_PORT);
+
+    //Opens a second listening socket for spectators
+    bool listenSpectators(std::string port);
+
+    //Serves games until stop() is called. Returns false if the event loops
+    //couldn't be set up.
+    bool run();
+
+    //Makes run() return. Safe to call from a signal handler.
+    void stop();
+
+    ServerStats stats() const;
+
+  private:
+    //Watches accepted connections until they send something, then pairs
+    //them up and hands them to the shards, or hands resuming ones to the
+    //shard with their game
+    void accepted(int fd);
+    void heardFrom(int fd);
+    void pair(int fd);
+    void dropWaiting();
+
+    //Puts a connection that sent a seek message into the lobby, or starts
+    //its game if it is matched straight away
+    void seek(int fd, const std::uint8_t* m);
+
+    //Forgets a connection that hung up while in the lobby
+    void leftLobby(int fd);
+
+    //Starts games for players in the lobby who have waited long enough to
+    //accept each other, if a pass is due. Returns the milliseconds until
+    //the next one, or -1 if nobody is waiting.
+    int matchLobby();
+
+    //Hands a pair to the shard with the fewest games, with the armies to
+    //give them, or NONE to leave them to choose
+    void startGame(int first, int second, ArmyType white, ArmyType black);
+
+    //The shard hosting the game with an id
+    ServerShard* shardFor(std::uint32_t id);
+
+    friend class ServerShard;
+    friend void* shard_thread(void* data);
+
+    int _listenFd;
+    int _spectateFd;
+    std::size_t _numShards;
+    std::vector<std::unique_ptr<ServerShard> > _shards;
+
+    //A connection waiting for an opponent, or -1
+    int _waiting;
+
+    //Connections that haven't sent anything yet
+    std::unordered_set<int> _newcomers;
+
+    //Connections waiting to be matched by rating
+    Lobby _lobby;
+    std::atomic<std::size_t> _seeking;
+    std::atomic<std::size_t> _matched;
+    std::chrono::steady_clock::time_point _nextLobbyMatch;
+
+    //The shard checked first for the next pair, so ties are spread around
+    std::size_t _nextShard;
+
+    //Games paired so far, which makes up their ids
+    std::uint32_t _paired;
+
+    std::atomic<bool> _stop;
+  };
+
+  //One event loop and the games it runs
+  class ServerShard
+  {
+  public:
+    //Constructors
+    ServerShard(GameServer* server);
+    ~ServerShard();
+
+    //Creates the epoll instance and wakeup descriptor
+    bool init();
+
+    //Runs the loop until the server stops
+    void run();
+
+    //Hands a pair of connected sockets to this shard, to play the game with
+    //an id. Armies other than NONE are set for them. Can be called from any
+    //thread.
+    void adopt(int first, int second, std::uint32_t id,
+               ArmyType white = ArmyType::NONE,
+               ArmyType black = ArmyType::NONE);
+
+    //Hands over a spectator wanting to watch the game with an id on this
+    //shard. Can be called from any thread.
+    void adopt(std::unique_ptr<ServerSpectator> s, std::uint32_t id);
+
+    //Hands over a connection resuming a seat in a game on this shard, from
+    //the token and call count in its resume message. Can be called from
+    //any thread.
+    void adopt(int fd, const std::uint8_t* resume);
+
+    //Wakes the loop up so it notices stop() or new pairs
+    void wake();
+
+    //Adds a descriptor to the loop with a tag to know it by, or removes it
+    bool watch(int fd, std::uint32_t events, std::uint64_t tag);
+    void unwatch(int fd);
+
+    //Number of games in progress on this shard
+    std::size_t games() const {return _gameCount;}
+
+    //Games in progress or handed over and not yet started
+    std::size_t load() const {return _gameCount + _incoming;}
+
+    std::size_t gamesHosted() const {return _gamesHosted;}
+    std::size_t spectators() const {return _spectatorCount;}
+    std::uint64_t messages() const {return _messages;}
+    std::uint64_t resyncs() const {return _resyncs;}
+
+  private:
+    //Takes on the pairs and spectators handed over by adopt()
+    void takePending();
+
+    //A fresh game from the pool, or a new one if the pool is empty, placed
+    //at the end of _games
+    ServerGame* newGame();
+
+    //Makes a call on behalf of the server, telling both players
+    void call(ServerGame* g, const std::uint8_t* m, std::size_t size);
+
+    //Handles a socket becoming readable or writable
+    void readable(ServerGame* g, std::size_t side);
+    void writable(ServerGame* g, std::size_t side);
+
+    //Queues data for a player, to be sent by flushDirty()
+    void send(ServerGame* g, std::size_t side, const std::uint8_t* data,
+              std::size_t size);
+
+    //Queues a resync message and a snapshot of the game for a player
+    void resync(ServerGame* g, std::size_t side);
+
+    //Queues the version, game and session messages for a new connection
+    void greet(ServerGame* g, std::size_t side);
+
+    //Keeps a call for players who resume
+    void record(ServerGame* g, const std::uint8_t* m, std::size_t size);
+
+    //Holds a seat after a player's connection drops, or ends the game if
+    //it is over anyway
+    void drop(ServerGame* g, std::size_t side);
+
+    //Gives a held seat back to a resuming connection
+    void rejoin(int fd, const std::uint8_t* resume);
+
+    //Ends games whose players didn't come back in time, and returns the
+    //milliseconds until the next one should, or -1 if none
+    int expireSessions();
+
+    //Sends everything queued during a batch of events, so each player gets
+    //at most one write per batch however many messages it holds
+    void flushDirty();
+
+    //Spectator counterparts of the above
+    void readable(ServerSpectator* s);
+    void writable(ServerSpectator* s);
+    void send(ServerSpectator* s, const SharedMessages& m);
+    bool flush(ServerSpectator* s);
+    void watchOut(ServerSpectator* s, bool watch);
+
+    //Takes ownership of a spectator and adds it to the loop. Newly accepted
+    //ones have an id of 0 and are greeted, others are attached.
+    void take(ServerSpectator* s, std::uint32_t id);
+
+    //Starts a spectator watching a game on this shard, or closes it if the
+    //game isn't here
+    void attach(ServerSpectator* s, std::uint32_t id);
+
+    //Replaces what a spectator has queued with a snapshot of its game
+    void catchUp(ServerSpectator* s);
+
+    //Marks a spectator to be flushed at the end of this batch
+    void markDirty(ServerSpectator* s);
+
+    //Moves spectators that asked for another shard's game over to it
+    void handOver();
+
+    //Ends a spectator's connection
+    void close(ServerSpectator* s);
+
+    //Writes as much queued data as the socket takes. Returns false if the
+    //connection failed.
+    bool flush(ServerConnection& c);
+
+    //Changes whether epoll watches for a socket becoming writable
+    void watchOut(ServerGame* g, std::size_t side, bool watch);
+
+    //Ends a game and closes both sockets
+    void close(ServerGame* g);
+
+    GameServer* _server;
+    int _epollFd;
+    int _wakeFd;
+
+    //Every game on this shard. Closed games are removed after each batch
+    //of events, as later events in the batch may still point to them.
+    std::list<std::unique_ptr<ServerGame> > _games;
+    std::atomic<std::size_t> _gameCount;
+
+    //Finished games to reuse. They are spliced between the lists, so
+    //moving them doesn't allocate either.
+    std::list<std::unique_ptr<ServerGame> > _pool;
+
+    //Pairs handed over but not yet taken on
+    std::atomic<std::size_t> _incoming;
+    std::atomic<std::size_t> _gamesHosted;
+    std::atomic<std::uint64_t> _messages;
+    std::atomic<std::uint64_t> _resyncs;
+
+    //Games by id, for spectators to find them
+    std::unordered_map<std::uint32_t, ServerGame*> _byId;
+
+    //Every spectator on this shard, cleaned up like games
+    std::list<std::unique_ptr<ServerSpectator> > _spectators;
+    std::atomic<std::size_t> _spectatorCount;
+
+    //Players with data queued since the last flushDirty()
+    std::vector<std::pair<ServerGame*, std::size_t> > _dirty;
+
+    //Games with messages for their spectators since the last flushDirty()
+    std::vector<ServerGame*> _feeding;
+
+    //Spectators with data queued since the last flushDirty()
+    std::vector<ServerSpectator*> _dirtySpectators;
+
+    //Spectators wanting a game on another shard, with its id
+    std::vector<std::pair<ServerSpectator*, std::uint32_t> > _leaving;
+
+    //A pair of players handed over, with the id of their game
+    struct PendingGame
+    {
+      int first;
+      int second;
+      std::uint32_t id;
+      ArmyType armies[2];
+    };
+
+    //A resuming connection handed over, with its resume message payload
+    struct PendingResume
+    {
+      int fd;
+      std::uint8_t resume[16];
+    };
+
+    //A held seat. Seats are held for the same time, so the oldest is
+    //always the first to expire.
+    struct Session
+    {
+      std::uint32_t id;
+      std::size_t side;
+      std::uint32_t drops;
+      std::chrono::steady_clock::time_point expires;
+    };
+    std::deque<Session> _sessions;
+
+    //For session secrets
+    std::random_device _random;
+
+    //Pairs, spectators and resuming connections handed over from other
+    //shards
+    pthread_mutex_t _pendingLock;
+    std::vector<PendingGame> _pending;
+    std::vector<std::pair<ServerSpectator*, std::uint32_t> >
+    _pendingSpectators;
+    std::vector<PendingResume> _pendingResumes;
+  };
+
+} //Namespace
+
+#endif
@@ -0,0 +1,112 @@
+/*
+  Copyright (c) 2014 Auston Sterling
+  See license.txt for copying permission.
+
+  -----Game Server Tool-----
+  Auston Sterling
+  austonst@gmail.com
+
+  Hosts games for any number of clients until interrupted.
+
+  chess2-server [-p port] [-s shards] [-w spectator port]
+*/
+
+#include "server.hpp"
+
+#include <iostream>
+#include <cstdlib>
+#include <csignal>
+#include <sys/resource.h>
+
+using namespace c2;
+
+static GameServer* running = nullptr;
+
+static void interrupted(int)
+{
+  if (running) running->stop();
+}
+
+static void usage()
+{
+  std::cerr << "Usage:\n"
+            << "  chess2-server [-p port] [-s shards] [-w spectator port]\n";
+}
+
+int main(int argc, char* argv[])
+{
+  GameServer server;
+  std::string port = DEFAULT_PORT;
+  std::string spectatePort;
+  for (int i = 1; i < argc; i++)
+    {
+      std::string arg = argv[i];
+      if (arg == "-p" && i+1 < argc)
+        {
+          port = argv[++i];
+        }
+      else if (arg == "-w" && i+1 < argc)
+        {
+          spectatePort = argv[++i];
+        }
+      else if (arg == "-s" && i+1 < argc)
+        {
+          long v = std::atol(argv[++i]);
+          server.setShards(v > 0 ? v : 1);
+        }
+      else
+        {
+          usage();
+          return 1;
+        }
+    }
+
+  //Every game needs two descriptors, so take as many as we're allowed
+  rlimit files;
+  if (getrlimit(RLIMIT_NOFILE, &files) == 0 && files.rlim_cur < files.rlim_max)
+    {
+      files.rlim_cur = files.rlim_max;
+      setrlimit(RLIMIT_NOFILE, &files);
+    }
+
+  if (!server.listen(port))
+    {
+      std::cerr << "Could not listen on port " << port << "\n";
+      return 1;
+    }
+  if (!spectatePort.empty() && !server.listenSpectators(spectatePort))
+    {
+      std::cerr << "Could not listen on port " << spectatePort << "\n";
+      return 1;
+    }
+
+  running = &server;
+  std::signal(SIGINT, interrupted);
+  std::signal(SIGTERM, interrupted);
+  std::signal(SIGPIPE, SIG_IGN);
+
+  std::cout << "Serving games on port " << port;
+  if (!spectatePort.empty())
+    {
+      std::cout << ", spectators on port " << spectatePort;
+    }
+  std::cout << std::endl;
+  bool ok = server.run();
+  running = nullptr;
+
+  ServerStats stats = server.stats();
+  std::cout << stats.gamesHosted << " games hosted, " << stats.messages
+            << " messages, " << stats.resyncs << " resyncs\n";
+  if (stats.matched)
+    {
+      std::cout << stats.matched << " games matched in the lobby\n";
+    }
+  std::cout << "Legal move cache: " << moveCache().hits() << " hits, "
+            << moveCache().misses() << " misses\n";
+  if (!ok)
+    {
+      std::cerr << "Could not start the event loops\n";
+      return 1;
+    }
+  return 0;
+}
@@ -8,10 +8,16 @@
 
 #include "sidebar.hpp"
 
+#include <algorithm>
+#include <iterator>
+
 Sidebar::Sidebar() :
   width_(0),
   height_(0),
-  spacing_(0)
+  spacing_(0),
+  layoutChanged_(true),
+  layoutStale_(true),
+  hitsStale_(true)
 {
   bgColor_ = {0,0,0,255};
 }
@@ -19,14 +25,17 @@ Sidebar::Sidebar() :
 Sidebar::Sidebar(int w, int h, SDL_Color bg, int spacing) :
   width_(w),
   height_(h),
-  spacing_(spacing)
+  spacing_(spacing),
+  layoutChanged_(true),
+  layoutStale_(true),
+  hitsStale_(true)
 {
   bgColor_ = bg;
 }
 
 void Sidebar::insertObject(const SidebarObject& sbo)
 {
-  object_.insert(sbo);
+  place(sbo);
 }
 
 void Sidebar::insertObject(SidebarObject& sbo, int weight,
@@ -41,15 +50,32 @@ Sidebar::iterator Sidebar::createObject(int weight, const std::string& id)
   SidebarObject sbo;
   sbo.setMaxWidth(width_);
   sbo.prepareForInsert(weight, id);
-  insertObject(sbo);
-  return object_.find(sbo);
+  place(sbo);
+  return object(weight, id);
 }
 
 void Sidebar::deleteObject(int w, const std::string& id)
 {
-  SidebarObject sboSearch;
-  sboSearch.prepareForInsert(w, id);
-  object_.erase(sboSearch);
+  iterator it = object(w, id);
+  if (it == object_.end()) return;
+
+  //If this was the object found by its ID, another with the ID may take over
+  std::unordered_map<std::string, iterator>::iterator found = byID_.find(id);
+  bool indexed = found->second == it;
+  object_.erase(it);
+  if (indexed)
+    {
+      byID_.erase(found);
+      for (iterator i = object_.begin(); i != object_.end(); i++)
+        {
+          if (i->id() == id)
+            {
+              byID_[id] = i;
+              break;
+            }
+        }
+    }
+  layoutChanged_ = layoutStale_ = hitsStale_ = true;
 }
 
 Sidebar::iterator Sidebar::object(int w, const std::string& id)
@@ -61,73 +87,178 @@ Sidebar::iterator Sidebar::object(int w, const std::string& id)
 
 Sidebar::iterator Sidebar::object(const std::string& id)
 {
-  //Linear time search since objects are sorted primarily by weight
-  for (iterator i = object_.begin(); i != object_.end(); i++)
-    {
-      if (i->id() == id) return i;
-    }
+  std::unordered_map<std::string, iterator>::const_iterator found =
+    byID_.find(id);
 
   //None found, end is our "not in here" iterator
-  return object_.end();
+  if (found == byID_.end()) return object_.end();
+  return found->second;
 }
 
-bool Sidebar::isValid(const_iterator it) const
-{
-  if (it == object_.end() || object_.find(*it) == object_.end())
-    {
-      return false;
-    }
-  return true;
-}
-
-void Sidebar::render(SDL_Renderer* rend, int x, int y) const
+void Sidebar::render(SpriteBatch& batch, int x, int y) const
 {
   //Fill background
-  SDL_SetRenderDrawColor(rend, bgColor_.r, bgColor_.g, bgColor_.b, bgColor_.a);
   SDL_Rect bgRect;
   bgRect.x = x;
   bgRect.y = y;
   bgRect.w = width_;
   bgRect.h = height_;
-  SDL_RenderFillRect(rend, &bgRect);
+  batch.fill(bgRect, bgColor_);
+
+  placeObjects();
+  for (iterator sbo : layout_)
+    {
+      sbo->render(batch, x, y + sbo->top_);
+    }
+
+  //Everything is drawn as it is now, invisible objects included
+  for (const SidebarObject& sbo : object_)
+    {
+      sbo.clean();
+    }
+  changed_.clear();
+  layoutChanged_ = false;
+}
+
+bool Sidebar::renderChanges(SpriteBatch& batch, int x, int y) const
+{
+  //Anything moving around means everything has to be drawn again
+  if (layoutChanged_)
+    {
+      render(batch, x, y);
+      return true;
+    }
+
+  bool drawn = false;
+  for (const SidebarObject* sbo : changed_)
+    {
+      if (sbo->visible())
+        {
+          //Whatever the object looked like before has to go first
+          SDL_Rect area = {x, y + sbo->top_, width_, sbo->height()};
+          batch.fill(area, bgColor_);
+          sbo->render(batch, x, y + sbo->top_);
+          drawn = true;
+        }
+      sbo->clean();
+    }
+  changed_.clear();
+  return drawn;
+}
+
+bool Sidebar::dirty() const
+{
+  return layoutChanged_ || !changed_.empty();
+}
+
+Sidebar::iterator Sidebar::place(const SidebarObject& sbo)
+{
+  std::pair<iterator, bool> in = object_.insert(sbo);
+  if (!in.second) return object_.end();
+  in.first->owner_.sidebar = this;
+
+  //Keep the lightest object with this ID for lookups by ID
+  sboLighterThan sboComp;
+  std::unordered_map<std::string, iterator>::iterator found =
+    byID_.find(sbo.id());
+  if (found == byID_.end())
+    {
+      byID_.emplace(sbo.id(), in.first);
+    }
+  else if (sboComp(*in.first, *found->second))
+    {
+      found->second = in.first;
+    }
 
-  //Render each floating object
+  layoutChanged_ = layoutStale_ = hitsStale_ = true;
+  return in.first;
+}
+
+void Sidebar::objectChanged(const SidebarObject& sbo, bool first,
+                            bool resize) const
+{
+  hitsStale_ = true;
+  if (resize)
+    {
+      layoutChanged_ = layoutStale_ = hitsStale_ = true;
+    }
+  else if (first)
+    {
+      changed_.push_back(&sbo);
+    }
+}
+
+void Sidebar::placeObjects() const
+{
+  if (!layoutStale_) return;
+  layout_.clear();
+
+  //Place each floating object
   iterator fwd;
-  int yStep = y;
+  int yStep = 0;
   for (fwd = object_.begin();
        fwd != object_.end() && fwd->weight() < SIDEBAR_SINK_CUTOFF;
        fwd++)
     {
-      //Do not render if the object is invisible
+      //Invisible objects take up no space
       if (!fwd->visible()) continue;
       
-      //Perform the rendering
-      fwd->render(rend, x, yStep);
+      fwd->top_ = yStep;
+      layout_.push_back(fwd);
 
       //Update the y value of the next object
       yStep += spacing_ + fwd->height();
     }
 
-  //Render each sinking object, going from the bottom up until we reach
+  //Place each sinking object, going from the bottom up until we reach
   //the forward iterator
+  std::size_t floaters = layout_.size();
   sboLighterThan sboComp;
-  yStep = y + height_;
-  for (std::set<SidebarObject, sboLighterThan>::reverse_iterator back = object_.rbegin();
+  yStep = height_;
+  for (std::set<SidebarObject, sboLighterThan>::reverse_iterator back =
+         object_.rbegin();
        fwd != object_.end() && back != object_.rend() && !sboComp(*back, *fwd);
        back++)
     {
-      //Do not render if the object is invisible
+      //Invisible objects take up no space
       if (!back->visible()) continue;
       
       //Need the top left corner of the object
       yStep -= back->height();
+      back->top_ = yStep;
 
-      //Render it
-      back->render(rend, x, yStep);
+      //Reverse iterators are funky and their "base" pointer is actually
+      //one later than you would think. This corrects that issue.
+      layout_.push_back(std::prev(back.base()));
 
       //Insert spacing
       yStep -= spacing_;
     }
+
+  //The sinkers went in bottom up
+  std::reverse(layout_.begin() + floaters, layout_.end());
+  layoutStale_ = false;
+}
+
+void Sidebar::placeHits() const
+{
+  if (!hitsStale_) return;
+  placeObjects();
+  hit_.clear();
+  hitStart_.clear();
+  for (iterator sbo : layout_)
+    {
+      //Objects give their rectangles in object space
+      std::size_t start = hit_.size();
+      hitStart_.push_back(start);
+      sbo->textureRects(hit_);
+      for (std::size_t i = start; i < hit_.size(); i++)
+        {
+          hit_[i].y += sbo->top_;
+        }
+    }
+  hitStart_.push_back(hit_.size());
+  hitsStale_ = false;
 }
 
 SidebarClickResponse Sidebar::click(int x, int y) const
@@ -143,76 +274,34 @@ SidebarClickResponse Sidebar::click(int x, int y) const
     {
       return sbcr;
     }
-    
-  //Step through the floating objects and check for an object hit
-  iterator fwd;
-  int yStep;
-  for (fwd = object_.begin(), yStep = 0;
-       fwd != object_.end() && fwd->weight() < SIDEBAR_SINK_CUTOFF;
-       fwd++)
-    {
-      //If the object is invisible, it doesn't show itself or its spacing
-      if (!fwd->visible()) continue;
-      
-      //yStep is currently at the top of this object; see if we hit it
-      if ((yStep += fwd->height()) > y)
-        {
-          //Get details from the object
-          SidebarObjectClickResponse sbocr = fwd->click(x, yStep - y);
-
-          //Build up the struct and finish up
-          sbcr.sbo = fwd;
-          sbcr.texture = sbocr.texture;
-          sbcr.texX = sbocr.texX;
-          sbcr.texY = sbocr.texY;
-          return sbcr;
-        }
+  placeHits();
 
-      //See if we hit the spacing between objects
-      if ((yStep += spacing_) > y)
-        {
-          //Miss, finish up
-          sbcr.sbo = fwd;
-          return sbcr;
-        }
+  //Find the last object starting at or above y, and see if y is inside it
+  std::vector<iterator>::const_iterator below =
+    std::upper_bound(layout_.begin(), layout_.end(), y,
+                     [](int y, iterator sbo) {return y < sbo->top_;});
+  if (below == layout_.begin()) return sbcr;
+  std::size_t i = (below - layout_.begin()) - 1;
+  iterator sbo = layout_[i];
+  if (y >= sbo->top_ + sbo->height())
+    {
+      //Missed it, into the spacing below
+      return sbcr;
     }
+  sbcr.sbo = sbo;
 
-  //Step through each sinking object, going from the bottom up until we reach
-  //the forward iterator
-  sboLighterThan sboComp;
-  yStep = height_;
-  for (std::set<SidebarObject, sboLighterThan>::reverse_iterator back = object_.rbegin();
-       fwd != object_.end() && back != object_.rend() && !sboComp(*back, *fwd);
-       back++)
+  //See which of its textures was hit, if any
+  for (std::size_t j = hitStart_[i]; j < hitStart_[i+1]; j++)
     {
-      //If the object is invisible, it doesn't show itself or its spacing
-      if (!back->visible()) continue;
-      
-      //See if we jump over y when moving up
-      if ((yStep -= back->height()) < y)
+      const SDL_Rect& rect = hit_[j];
+      if (x >= rect.x && x < rect.x + rect.w &&
+          y >= rect.y && y < rect.y + rect.h)
         {
-          //Get details from the object
-          SidebarObjectClickResponse sbocr = back->click(x, y - yStep);
-
-          //Build up the struct and finish up
-          //Reverse iterators are funky and their "base" pointer is actually
-          //one earlier than you would think. This corrects that issue.
-          back++;
-          sbcr.sbo = back.base();
-          sbcr.texture = sbocr.texture;
-          sbcr.texX = sbocr.texX;
-          sbcr.texY = sbocr.texY;
-          return sbcr;
-        }
-
-      //See if we hit the spacing
-      if ((yStep -= spacing_) < y)
-        {
-          //Miss, finish up
-          return sbcr;
+          sbcr.texture = j - hitStart_[i];
+          sbcr.texX = x - rect.x;
+          sbcr.texY = y - rect.y;
+          break;
         }
     }
-
-  //It must be in the spacing inbetween the floaters and sinkers
   return sbcr;
 }
@@ -18,7 +18,22 @@
 
   Clicks are handled by returning a struct containing an iterator to the
   clicked object, the index of the clicked texture, and the coordinates of the
-  click in the *texture's* coordinate space.
+  click in the *texture's* coordinate space. The rectangle of every visible
+  texture is kept from the last time anything changed, so a click is a search
+  over y for the object and a look through that object's few rectangles.
+
+  Iterators to objects stay valid until the object is deleted, so they can be
+  kept as handles instead of looking an object up each time it changes. An ID
+  lookup is a hash lookup either way.
+
+  Where each object goes is worked out when objects come, go, resize or
+  change visibility, and kept until the next such change. A sidebar that is
+  drawn somewhere that keeps its contents, like a target texture, can be
+  brought up to date with renderChanges(), which only draws the objects that
+  changed since they were last drawn. Objects report their own changes, so
+  neither costs anything for the objects that didn't change.
+
+  Drawing goes into a SpriteBatch, which is left for the caller to flush.
 */
 
 #ifndef _sidebar_hpp_
@@ -27,6 +42,7 @@
 #include "sidebarobject.hpp"
 
 #include <set>
+#include <unordered_map>
 
 const int SIDEBAR_SINK_CUTOFF = 1000;
 
@@ -44,12 +60,17 @@ public:
   Sidebar();
   Sidebar(int w, int h, SDL_Color bg, int spacing = 0);
 
+  //Objects point back at the sidebar they are in, so it can't be copied
+  Sidebar(const Sidebar&) = delete;
+  Sidebar& operator=(const Sidebar&) = delete;
+
   //Accessors and mutators for simple variables
-  void setWidth(int w) {width_ = w;}
+  void setWidth(int w) {width_ = w; layoutChanged_ = true;}
   int width() const {return width_;}
-  void setHeight(int h) {height_ = h;}
+  void setHeight(int h)
+  {height_ = h; layoutChanged_ = layoutStale_ = hitsStale_ = true;}
   int height() const {return height_;}
-  void setBGColor(SDL_Color bg) {bgColor_ = bg;}
+  void setBGColor(SDL_Color bg) {bgColor_ = bg; layoutChanged_ = true;}
   SDL_Color bgColor() const {return bgColor_;}
 
   //Object management
@@ -70,15 +91,24 @@ public:
   //Retrieves an iterator to an object given the weight and ID
   iterator object(int w, const std::string& id);
 
-  //Retrieves an iterator to one of the possibly many objects with the given ID
+  //Retrieves an iterator to the lightest of the possibly many objects with
+  //the given ID
   iterator object(const std::string& id);
 
   //Other functions
-  //Checks if an iterator is valid and can be dereferenced
-  bool isValid(const_iterator it) const;
+  //Checks if an iterator from this sidebar is valid and can be dereferenced.
+  //An iterator to a deleted object can't be checked and must not be kept.
+  bool isValid(const_iterator it) const {return it != object_.end();}
     
-  //Draws the object to the given SDL_Renderer given the top left coords
-  void render(SDL_Renderer* rend, int x, int y) const;
+  //Queues the sidebar to be drawn given the top left coords
+  void render(SpriteBatch& batch, int x, int y) const;
+
+  //Queues only what changed since the last render, over what was drawn
+  //then. Returns true if anything was queued.
+  bool renderChanges(SpriteBatch& batch, int x, int y) const;
+
+  //Checks if anything changed since the last render
+  bool dirty() const;
 
   //Given the coordinates of a click in sidebar space, returns more detailed
   //information about what was clicked on
@@ -96,6 +126,43 @@ private:
 
   //The amount of vertical spacing to put between each object
   int spacing_;
+
+  //Set when objects come, go or move, or the sidebar itself changes, so the
+  //next render has to be a full one
+  mutable bool layoutChanged_;
+
+  //The lightest object with each ID
+  std::unordered_map<std::string, iterator> byID_;
+
+  //The visible objects from top to bottom, each with its top_ set. Only
+  //redone when layoutStale_ is set.
+  mutable std::vector<iterator> layout_;
+  mutable bool layoutStale_;
+
+  //Where each texture of the objects in layout_ is, in sidebar space. The
+  //textures of layout_[i] run in order from hitStart_[i] to hitStart_[i+1].
+  //Redone when anything at all changes.
+  mutable std::vector<SDL_Rect> hit_;
+  mutable std::vector<std::size_t> hitStart_;
+  mutable bool hitsStale_;
+
+  //Objects that changed since the last render without moving anything.
+  //Ignored, and maybe deleted, when layoutChanged_ is set.
+  mutable std::vector<const SidebarObject*> changed_;
+
+  //Inserts an object, returning where it went or end() if it was already in
+  iterator place(const SidebarObject& sbo);
+
+  //Called by an object in the sidebar when it changes. first is set if it
+  //hadn't changed since it was last drawn.
+  void objectChanged(const SidebarObject& sbo, bool first, bool resize) const;
+  friend class SidebarObject;
+
+  //Works out where the visible objects go, if anything moved
+  void placeObjects() const;
+
+  //Works out where the visible textures are, if anything changed
+  void placeHits() const;
 };
 
 struct SidebarClickResponse
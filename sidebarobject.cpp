@@ -7,23 +7,30 @@
 */
 
 #include "sidebarobject.hpp"
+#include "sidebar.hpp"
 
 SidebarObject::SidebarObject() :
   width_(0),
   height_(0),
   align_(VertAlignType::FLUSH_UP),
   weight_(0),
-  visible_(true)
+  visible_(true),
+  dirty_(true),
+  resized_(true),
+  top_(0)
 {}
 
-SidebarObject::SidebarObject(const std::vector<std::shared_ptr<SDL_Texture> >& image,
+SidebarObject::SidebarObject(const std::vector<Sprite>& image,
                              int sidebarWidth, SpacingType space,
                              int interspace, VertAlignType align) :
   image_(image),
   width_(sidebarWidth),
   align_(align),
   weight_(0),
-  visible_(true)
+  visible_(true),
+  dirty_(true),
+  resized_(true),
+  top_(0)
 {
   respace(space, interspace);
   computeHeight();
@@ -34,33 +41,47 @@ SidebarObject::SidebarObject(std::size_t n, int sidebarWidth) :
   height_(0),
   align_(VertAlignType::FLUSH_UP),
   weight_(0),
-  visible_(true)
+  visible_(true),
+  dirty_(true),
+  resized_(true),
+  top_(0)
 {
-  image_.resize(n, nullptr);
+  image_.resize(n);
   space_.resize(n, 0);
 }
 
-void SidebarObject::setTexture(std::size_t i, std::shared_ptr<SDL_Texture> t) const
+void SidebarObject::setTexture(std::size_t i, const Sprite& t) const
 {
   //Update value
-  if (i >= image_.size()) return;
+  if (i >= image_.size() || image_[i] == t) return;
   image_[i] = t;
+  changed(false);
 
   //Check for max height increase
-  int texW = 0, texH = 0;
-  if (t != nullptr)
+  int oldHeight = height_;
+  if (t.rect.h > height_)
     {
-      SDL_QueryTexture(t.get(), NULL, NULL, &texW, &texH);
-    }
-  
-  if (texH > height_)
-    {
-      height_ = texH;
+      height_ = t.rect.h;
     }
   else
     {
       computeHeight();
     }
+  if (height_ != oldHeight) changed(true);
+}
+
+void SidebarObject::setVertAlign(VertAlignType vat) const
+{
+  if (align_ == vat) return;
+  align_ = vat;
+  changed(false);
+}
+
+void SidebarObject::setVisibility(bool vis) const
+{
+  if (visible_ == vis) return;
+  visible_ = vis;
+  changed(true);
 }
 
 void SidebarObject::prepareForInsert(int w, const std::string& id)
@@ -72,11 +93,26 @@ void SidebarObject::prepareForInsert(int w, const std::string& id)
 void SidebarObject::resizeAndRespace(std::size_t n, SpacingType space,
                                      int interspace) const
 {
-  image_.resize(n, nullptr);
+  if (n != image_.size())
+    {
+      image_.resize(n);
+      int oldHeight = height_;
+      computeHeight();
+      changed(height_ != oldHeight);
+    }
   respace(space, interspace);
 }
 
 void SidebarObject::respace(SpacingType space, int interspace) const
+{
+  //Only a change in spacing needs a redraw
+  std::vector<int> oldSpace;
+  oldSpace.swap(space_);
+  placeTextures(space, interspace);
+  if (space_ != oldSpace) changed(false);
+}
+
+void SidebarObject::placeTextures(SpacingType space, int interspace) const
 {
   //In most cases, most spaces are interspace
   space_ = std::vector<int>(image_.size(), interspace);
@@ -84,14 +120,9 @@ void SidebarObject::respace(SpacingType space, int interspace) const
 
   //Find the total width of all textures
   int texWidth = 0;
-  for (std::shared_ptr<SDL_Texture> im : image_)
+  for (const Sprite& im : image_)
     {
-      int texW = 0, texH = 0;
-      if (im != nullptr)
-        {
-          SDL_QueryTexture(im.get(), NULL, NULL, &texW, &texH);
-        }
-      texWidth += texW;
+      texWidth += im.rect.w;
     }
 
   //Find the total width of the spaces between (but not before) textures
@@ -121,9 +152,12 @@ void SidebarObject::respace(SpacingType space, int interspace) const
       //Align the leftmost texture with the side, allocate extra space evenly
       //When space cannot be allocated perfectly evenly, add one more pixel
       //to some of the spaces so the numbers come out right
+      //With one texture or no room to spare, this is just SQUISH_LEFT
       space_[0] = 0;
-      int newspace = interspace + extraSpace/(space_.size()-1);
-      std::size_t addOneMoreUntil = (extraSpace % (space_.size()-1)) + 1;
+      if (space_.size() < 2 || extraSpace <= 0) break;
+      int gaps = space_.size() - 1;
+      int newspace = interspace + extraSpace/gaps;
+      std::size_t addOneMoreUntil = (extraSpace % gaps) + 1;
       for (std::size_t i = 1; i < addOneMoreUntil; i++)
         {
           space_[i] = newspace + 1;
@@ -136,21 +170,16 @@ void SidebarObject::respace(SpacingType space, int interspace) const
     }
 }
 
-void SidebarObject::render(SDL_Renderer* rend, int x, int y) const
+void SidebarObject::render(SpriteBatch& batch, int x, int y) const
 {
   int offX = 0;
   for (std::size_t i = 0; i < image_.size(); i++)
     {
       //Get texture dimensions
-      int texW = 0, texH = 0;
-      if (image_[i] != nullptr)
-        {
-          SDL_QueryTexture(image_[i].get(), NULL, NULL, &texW, &texH);
-        }
+      int texW = image_[i].rect.w, texH = image_[i].rect.h;
         
       //Set up rectangles
       offX += space_[i];
-      SDL_Rect srcRec = {0, 0, texW, texH};
       SDL_Rect destRec = {x+offX, y, texW, texH};
 
       //Align vertically
@@ -164,7 +193,7 @@ void SidebarObject::render(SDL_Renderer* rend, int x, int y) const
         }
 
       //Render
-      SDL_RenderCopy(rend, image_[i].get(), &srcRec, &destRec);
+      batch.draw(image_[i], destRec);
 
       //Step down to the next one
       offX += texW;
@@ -188,11 +217,7 @@ SidebarObjectClickResponse SidebarObject::click(int x, int y) const
   for (std::size_t i = 0; i < image_.size(); i++)
     {
       //Get texture dimensions
-      int texW = 0, texH = 0;
-      if (image_[i] != nullptr)
-        {
-          SDL_QueryTexture(image_[i].get(), NULL, NULL, &texW, &texH);
-        }
+      int texW = image_[i].rect.w, texH = image_[i].rect.h;
         
       //Check if it it the spacing on the left side
       if ((offX += space_[i]) > x)
@@ -234,17 +259,49 @@ SidebarObjectClickResponse SidebarObject::click(int x, int y) const
   return sbocr;
 }
 
-void SidebarObject::computeHeight() const
+void SidebarObject::textureRects(std::vector<SDL_Rect>& rects) const
 {
-  height_ = 0;
-  for (std::shared_ptr<SDL_Texture> im : image_)
+  int offX = 0;
+  for (std::size_t i = 0; i < image_.size(); i++)
     {
-      int texW = 0, texH = 0;
-      if (im != nullptr)
+      //Laid out just as render() draws them
+      int texW = image_[i].rect.w, texH = image_[i].rect.h;
+      offX += space_[i];
+      SDL_Rect rect = {offX, 0, texW, texH};
+      if (align_ == VertAlignType::FLUSH_DOWN)
+        {
+          rect.y = height_ - texH;
+        }
+      else if (align_ == VertAlignType::CENTER)
         {
-          SDL_QueryTexture(im.get(), NULL, NULL, &texW, &texH);
+          rect.y = (height_ - texH)/2;
         }
-      height_ = std::max(height_, texH);
+      rects.push_back(rect);
+      offX += texW;
+    }
+}
+
+void SidebarObject::changed(bool resize) const
+{
+  //The sidebar only needs telling once between draws
+  bool wasClean = !dirty_ && !resized_;
+  if (resize)
+    {
+      resized_ = true;
+    }
+  else
+    {
+      dirty_ = true;
+    }
+  if (owner_.sidebar) owner_.sidebar->objectChanged(*this, wasClean, resize);
+}
+
+void SidebarObject::computeHeight() const
+{
+  height_ = 0;
+  for (const Sprite& im : image_)
+    {
+      height_ = std::max(height_, im.rect.h);
     }
 }
 
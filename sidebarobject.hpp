@@ -4,11 +4,11 @@
   austonst@gmail.com
 
   An object to be included in a Sidebar. An object consists of multiple
-  SDL_Textures laid out horizontally across the sidebar. Objects can handle
+  Sprites laid out horizontally across the sidebar. Objects can handle
   being clicked on.
 
-  This class takes no ownership over its SDL_Texture*s. They must be provided
-  from an external source and freed by an external source.
+  This class takes no ownership over its sprites' textures. They must be
+  provided from an external source and freed by an external source.
 
   As this class is designed to be used in a std::set within the corresponding
   Sidebar class, most variables are marked mutable. A "const" sidebar object
@@ -20,17 +20,23 @@
   the center, in which case the images will be spaced by the given number of
   pixels. If the spacing type is uniform, the inter-texture spacing is
   automatically determined to "justify" the images.
+
+  Objects remember whether they've changed since they were last drawn, so a
+  sidebar can redraw only those. Setting something to the value it already
+  has is not a change. An object inside a sidebar tells the sidebar the first
+  time it changes after a draw, so the sidebar never has to go looking.
 */
 
 #ifndef _sidebarobject_hpp_
 #define _sidebarobject_hpp_
 
-#include <SDL.h>
-#include <SDL_image.h>
+#include "sprite.hpp"
+
 #include <vector>
 #include <cstdint>
 #include <string>
-#include <memory>
+
+class Sidebar;
 
 //Defines the ways in which textures can be horizontally spaced
 enum class SpacingType : std::uint8_t
@@ -67,7 +73,7 @@ public:
   SidebarObject();
 
   //Sets up the given textures
-  SidebarObject(const std::vector<std::shared_ptr<SDL_Texture> >& image,
+  SidebarObject(const std::vector<Sprite>& image,
                 int sidebarWidth,
                 SpacingType space = SpacingType::SQUISH_CENTER,
                 int interspace = 0,
@@ -80,20 +86,26 @@ public:
   //Changing a texture without respacing may cause the spacing to be incorrect
   //if the width changes. Only SQUISH_LEFT is guaranteed to stay correct.
   std::size_t size() const {return image_.size();}
-  void setTexture(std::size_t i, std::shared_ptr<SDL_Texture> t) const;
-  std::shared_ptr<SDL_Texture> texture(std::size_t i) const {return image_[i];}
+  void setTexture(std::size_t i, const Sprite& t) const;
+  const Sprite& texture(std::size_t i) const {return image_[i];}
   void setMaxWidth(int w) const {width_ = w;}
   int maxWidth() const {return width_;}
   int height() const {return height_;}
-  void setVertAlign(VertAlignType vat) const {align_ = vat;}
+  void setVertAlign(VertAlignType vat) const;
   VertAlignType vertAlign() const {return align_;}
   //Changing the weight or ID of an object already in a sidebar will break!
   //There are NO checks on this; so don't be stupid!
   void prepareForInsert(int w, const std::string& id);
   int weight() const {return weight_;}
-  std::string id() const {return id_;}
+  const std::string& id() const {return id_;}
   bool visible() const {return visible_;}
-  void setVisibility(bool vis) const {visible_ = vis;}
+  void setVisibility(bool vis) const;
+
+  //Whether the object needs drawing again, and whether its visibility or
+  //height changed, which moves the objects around it too
+  bool dirty() const {return dirty_ || resized_;}
+  bool resized() const {return resized_;}
+  void clean() const {dirty_ = resized_ = false;}
 
   //Higher level functions
   //Changes the number of images, which requires a respacing
@@ -105,16 +117,19 @@ public:
   void respace(SpacingType space = SpacingType::SQUISH_CENTER,
                int interspace = 0) const;
 
-  //Draws the object to the given SDL_Renderer given the top left coords
-  void render(SDL_Renderer* rend, int x, int y) const;
+  //Queues the object to be drawn given the top left coords
+  void render(SpriteBatch& batch, int x, int y) const;
 
   //Given coordinates of a click in object space, returns a struct detailing
   //what that click hit
   SidebarObjectClickResponse click(int x, int y) const;
+
+  //Appends where each texture is drawn, in object space and in order
+  void textureRects(std::vector<SDL_Rect>& rects) const;
     
 private:
   //The images to lay out horizontally
-  mutable std::vector<std::shared_ptr<SDL_Texture> > image_;
+  mutable std::vector<Sprite> image_;
 
   //The spacing between images. This is the same size as image_ and says
   //how many pixels are left of the corresponding image.
@@ -127,6 +142,9 @@ private:
   mutable int height_;
   void computeHeight() const;
 
+  //Fills in space_ for respace(), which checks whether it changed
+  void placeTextures(SpacingType space, int interspace) const;
+
   //The vertical aligning style to be used when rendering
   mutable VertAlignType align_;
 
@@ -139,6 +157,28 @@ private:
 
   //A flag determining if the object is visible
   mutable bool visible_;
+
+  //Flags for changes since the object was last drawn
+  mutable bool dirty_;
+  mutable bool resized_;
+
+  //Sets a change flag and tells the sidebar holding the object, if any
+  void changed(bool resize) const;
+
+  //The sidebar holding this object. A copy is not in any sidebar, so this
+  //is never copied.
+  struct Owner
+  {
+    Owner() : sidebar(nullptr) {}
+    Owner(const Owner&) : sidebar(nullptr) {}
+    Owner& operator=(const Owner&) {return *this;}
+    const Sidebar* sidebar;
+  };
+  mutable Owner owner_;
+
+  //Where the sidebar last placed the top of the object, in sidebar space
+  mutable int top_;
+  friend class Sidebar;
 };
 
 class sboLighterThan
@@ -0,0 +1,151 @@
+/*
+  -----Sprite Class Implementation-----
+  Auston Sterling
+  austonst@gmail.com
+
+  Implementation of the Sprite and SpriteBatch classes.
+*/
+
+#include "sprite.hpp"
+
+Sprite::Sprite() :
+  texture(nullptr)
+{
+  rect = {0, 0, 0, 0};
+}
+
+Sprite::Sprite(SDL_Texture* t, const SDL_Rect& r) :
+  texture(t),
+  rect(r)
+{}
+
+Sprite Sprite::part(const SDL_Rect& r) const
+{
+  SDL_Rect sub = {rect.x + r.x, rect.y + r.y, r.w, r.h};
+  return Sprite(texture, sub);
+}
+
+bool operator==(const Sprite& s1, const Sprite& s2)
+{
+  return s1.texture == s2.texture &&
+    s1.rect.x == s2.rect.x && s1.rect.y == s2.rect.y &&
+    s1.rect.w == s2.rect.w && s1.rect.h == s2.rect.h;
+}
+
+bool operator!=(const Sprite& s1, const Sprite& s2)
+{
+  return !(s1 == s2);
+}
+
+SpriteBatch::SpriteBatch(SDL_Renderer* rend) :
+  rend_(rend),
+  texture_(nullptr),
+  drawCalls_(0),
+  textureSwitches_(0),
+  sprites_(0)
+{}
+
+void SpriteBatch::draw(const Sprite& s, const SDL_Rect& dest, Uint8 alpha)
+{
+  if (!s.valid()) return;
+  SDL_Color white = {255, 255, 255, alpha};
+  queue(s.texture, s.rect, dest, white);
+}
+
+void SpriteBatch::fill(const SDL_Rect& dest, SDL_Color color)
+{
+  if (white_.valid())
+    {
+      //Sample the middle of the white area so filtering can't pick up
+      //anything around it
+      SDL_Rect src = {white_.rect.x + white_.rect.w/2,
+                      white_.rect.y + white_.rect.h/2, 1, 1};
+      queue(white_.texture, src, dest, color);
+      return;
+    }
+
+  //Has to be drawn on its own, after everything before it
+  flush();
+  SDL_SetRenderDrawColor(rend_, color.r, color.g, color.b, color.a);
+  SDL_RenderFillRect(rend_, &dest);
+  drawCalls_++;
+}
+
+void SpriteBatch::queue(SDL_Texture* t, const SDL_Rect& src,
+                        const SDL_Rect& dest, SDL_Color color)
+{
+  if (t != texture_)
+    {
+      flush();
+      texture_ = t;
+      textureSwitches_++;
+    }
+  Quad q = {src, dest, color};
+  quad_.push_back(q);
+}
+
+void SpriteBatch::flush()
+{
+  if (quad_.empty()) return;
+
+#if SDL_VERSION_ATLEAST(2, 0, 18)
+  //Texture coordinates are fractions of the texture's size
+  int texW = 1, texH = 1;
+  SDL_QueryTexture(texture_, NULL, NULL, &texW, &texH);
+  float scaleX = 1.0f / texW;
+  float scaleY = 1.0f / texH;
+
+  //Two triangles per quad, sharing the corners on the diagonal
+  vertex_.resize(quad_.size() * 4);
+  index_.resize(quad_.size() * 6);
+  for (std::size_t i = 0; i < quad_.size(); i++)
+    {
+      const Quad& q = quad_[i];
+      float left = q.dest.x;
+      float top = q.dest.y;
+      float right = q.dest.x + q.dest.w;
+      float bottom = q.dest.y + q.dest.h;
+      float u0 = q.src.x * scaleX;
+      float v0 = q.src.y * scaleY;
+      float u1 = (q.src.x + q.src.w) * scaleX;
+      float v1 = (q.src.y + q.src.h) * scaleY;
+
+      SDL_Vertex* v = &vertex_[i*4];
+      v[0].position.x = left;  v[0].position.y = top;
+      v[0].tex_coord.x = u0;   v[0].tex_coord.y = v0;
+      v[1].position.x = right; v[1].position.y = top;
+      v[1].tex_coord.x = u1;   v[1].tex_coord.y = v0;
+      v[2].position.x = right; v[2].position.y = bottom;
+      v[2].tex_coord.x = u1;   v[2].tex_coord.y = v1;
+      v[3].position.x = left;  v[3].position.y = bottom;
+      v[3].tex_coord.x = u0;   v[3].tex_coord.y = v1;
+      for (int c = 0; c < 4; c++) v[c].color = q.color;
+
+      int* index = &index_[i*6];
+      int first = i*4;
+      index[0] = first;
+      index[1] = first + 1;
+      index[2] = first + 2;
+      index[3] = first;
+      index[4] = first + 2;
+      index[5] = first + 3;
+    }
+  SDL_RenderGeometry(rend_, texture_, &vertex_[0], vertex_.size(),
+                     &index_[0], index_.size());
+  drawCalls_++;
+#else
+  for (std::size_t i = 0; i < quad_.size(); i++)
+    {
+      const Quad& q = quad_[i];
+      SDL_SetTextureColorMod(texture_, q.color.r, q.color.g, q.color.b);
+      SDL_SetTextureAlphaMod(texture_, q.color.a);
+      SDL_RenderCopy(rend_, texture_, &q.src, &q.dest);
+      drawCalls_++;
+    }
+  SDL_SetTextureColorMod(texture_, 255, 255, 255);
+  SDL_SetTextureAlphaMod(texture_, 255);
+#endif
+
+  sprites_ += quad_.size();
+  quad_.clear();
+}
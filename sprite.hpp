@@ -0,0 +1,105 @@
+/*
+  -----Sprite Class Header-----
+  Auston Sterling
+  austonst@gmail.com
+
+  A part of a texture to be drawn, and a batch which collects many of them
+  so they can be drawn together.
+
+  Sprites take no ownership over their SDL_Texture*s. They usually come from
+  a TextureAtlas, which holds the texture for as long as it lives.
+
+  A SpriteBatch queues everything to be drawn in order and sends it all to
+  the renderer at once as triangles with one SDL_RenderGeometry call, so a
+  frame costs one draw call as long as its sprites share a texture. Queuing
+  a sprite from another texture sends what came before first. Solid
+  rectangles are drawn with a white sprite tinted to the wanted colour, so
+  they don't break up a batch either. With SDL older than 2.0.18, which has
+  no SDL_RenderGeometry, the batch draws each sprite on its own instead.
+*/
+
+#ifndef _sprite_hpp_
+#define _sprite_hpp_
+
+#include <SDL.h>
+#include <vector>
+
+struct Sprite
+{
+  //Constructors
+  //An empty sprite, which draws nothing
+  Sprite();
+  Sprite(SDL_Texture* t, const SDL_Rect& r);
+
+  //Checks if there is anything to draw
+  bool valid() const {return texture != nullptr;}
+
+  //Part of this sprite, given relative to its top left corner
+  Sprite part(const SDL_Rect& r) const;
+
+  SDL_Texture* texture;
+  SDL_Rect rect;
+};
+
+bool operator==(const Sprite& s1, const Sprite& s2);
+bool operator!=(const Sprite& s1, const Sprite& s2);
+
+class SpriteBatch
+{
+public:
+  //Constructors
+  SpriteBatch(SDL_Renderer* rend);
+
+  //Sets the sprite used for solid rectangles. It must be opaque white.
+  void setFillSprite(const Sprite& white) {white_ = white;}
+
+  //Queues a sprite to be drawn stretched over dest, faded by alpha
+  void draw(const Sprite& s, const SDL_Rect& dest, Uint8 alpha = 255);
+
+  //Queues a solid rectangle. Without a fill sprite it is drawn on its own.
+  void fill(const SDL_Rect& dest, SDL_Color color);
+
+  //Draws everything queued
+  void flush();
+
+  //Accessors
+  SDL_Renderer* renderer() const {return rend_;}
+
+  //The number of draw calls made so far, the number of times they changed
+  //texture, and the number of sprites drawn
+  std::size_t drawCalls() const {return drawCalls_;}
+  std::size_t textureSwitches() const {return textureSwitches_;}
+  std::size_t sprites() const {return sprites_;}
+
+private:
+  struct Quad
+  {
+    SDL_Rect src;
+    SDL_Rect dest;
+    SDL_Color color;
+  };
+
+  //Queues a quad, sending what is queued first if it is from another texture
+  void queue(SDL_Texture* t, const SDL_Rect& src, const SDL_Rect& dest,
+             SDL_Color color);
+
+  SDL_Renderer* rend_;
+
+  //The texture everything queued comes from, and what to draw from it
+  SDL_Texture* texture_;
+  std::vector<Quad> quad_;
+
+  //Kept between flushes so they're only allocated once
+#if SDL_VERSION_ATLEAST(2, 0, 18)
+  std::vector<SDL_Vertex> vertex_;
+  std::vector<int> index_;
+#endif
+
+  Sprite white_;
+
+  std::size_t drawCalls_;
+  std::size_t textureSwitches_;
+  std::size_t sprites_;
+};
+
+#endif
@@ -0,0 +1,974 @@
+/*
+  Copyright (c) 2014 Auston Sterling
+  See license.txt for copying permission.
+
+  -----Tablebase Class Implementation-----
+  Auston Sterling
+  austonst@gmail.com
+
+  Endgame tablebases for positions with up to four pieces.
+*/
+
+#include "tablebase.hpp"
+#include "gamerecord.hpp"
+#include "bitboard.hpp"
+
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <pthread.h>
+#include <cstdio>
+#include <cstring>
+#include <algorithm>
+
+namespace c2
+{
+
+  static const char TB_MAGIC[4] = {'C', '2', 'T', 'B'};
+
+  //Entry values, see the header
+  static const std::uint8_t TB_DRAW = 0;
+  static const std::uint8_t TB_INVALID = 128;
+  static const std::uint8_t TB_MAX_PLIES = 127;
+
+  //Results are compared as scores for the side that moved: quick wins are
+  //best, then slow wins, draws, slow losses and quick losses
+  static const int WIN_SCORE = 1000;
+  static const int NO_SCORE = -2000;
+
+  //Positions handed to a worker at a time
+  static const std::size_t TB_CHUNK = 4096;
+
+  static std::uint64_t squaresPerTurn(std::size_t pieces)
+  {
+    return 1ULL << (6 * pieces);
+  }
+
+  static std::uint8_t square(Position p)
+  {
+    return (p.y()-1)*8 + (p.x()-1);
+  }
+
+  static SideType sideToMove(GameStateType s)
+  {
+    if (s == GameStateType::WHITE_MOVE || s == GameStateType::WHITE_KINGMOVE)
+      {
+        return SideType::WHITE;
+      }
+    return SideType::BLACK;
+  }
+
+  //0-3 for the move states, as in the index, 4 for anything else
+  static std::uint8_t turnOf(GameStateType s)
+  {
+    switch (s)
+      {
+      case GameStateType::WHITE_MOVE: return 0;
+      case GameStateType::BLACK_MOVE: return 1;
+      case GameStateType::WHITE_KINGMOVE: return 2;
+      case GameStateType::BLACK_KINGMOVE: return 3;
+      default: return 4;
+      }
+  }
+
+  static GameStateType stateOf(std::uint8_t turn)
+  {
+    const GameStateType states[4] =
+      {GameStateType::WHITE_MOVE, GameStateType::BLACK_MOVE,
+       GameStateType::WHITE_KINGMOVE, GameStateType::BLACK_KINGMOVE};
+    return states[turn];
+  }
+
+  static TableResult makeResult(TableResultType type, std::uint8_t plies)
+  {
+    TableResult r;
+    r.type = type;
+    r.plies = plies;
+    return r;
+  }
+
+  static TableResult fromValue(std::uint8_t v)
+  {
+    if (v == TB_DRAW) return makeResult(TableResultType::DRAW, 0);
+    if (v == TB_INVALID) return makeResult(TableResultType::NOT_FOUND, 0);
+    if (v < TB_INVALID) return makeResult(TableResultType::WIN, v);
+    return makeResult(TableResultType::LOSS, v - 128);
+  }
+
+  static bool isWinScore(int score)
+  {
+    return score >= WIN_SCORE - TB_MAX_PLIES;
+  }
+
+  static bool isLossScore(int score)
+  {
+    return score > NO_SCORE && score <= -WIN_SCORE + TB_MAX_PLIES;
+  }
+
+  //The score of a result one ply later, for the side that made that ply.
+  //flip is set if the result is for the other side.
+  static int moverScore(TableResult r, bool flip)
+  {
+    if (r.type != TableResultType::WIN && r.type != TableResultType::LOSS)
+      {
+        return 0;
+      }
+    //Results too long to store are left as draws
+    if (r.plies >= TB_MAX_PLIES) return 0;
+    bool win = (r.type == TableResultType::WIN) != flip;
+    return win ? WIN_SCORE - (r.plies + 1) : -WIN_SCORE + (r.plies + 1);
+  }
+
+  //The score of a finished game for the side that ended it
+  static int gameOverScore(GameStateType s, SideType mover)
+  {
+    SideType winner = SideType::NONE;
+    if (s == GameStateType::WHITE_WIN_CHECKMATE ||
+        s == GameStateType::WHITE_WIN_MIDLINE)
+      {
+        winner = SideType::WHITE;
+      }
+    else if (s == GameStateType::BLACK_WIN_CHECKMATE ||
+             s == GameStateType::BLACK_WIN_MIDLINE)
+      {
+        winner = SideType::BLACK;
+      }
+    if (winner == SideType::NONE) return 0;
+    return winner == mover ? WIN_SCORE - 1 : -WIN_SCORE + 1;
+  }
+
+  TableSpec::TableSpec()
+  {
+    army[0] = army[1] = ArmyType::NONE;
+  }
+
+  TableSpec::TableSpec(const GameSnapshot& s)
+  {
+    army[0] = s.whiteArmy;
+    army[1] = s.blackArmy;
+    for (std::size_t i = 0; i < s.pieces.size(); i++)
+      {
+        add(s.pieces[i].side(), s.pieces[i].type());
+      }
+  }
+
+  void TableSpec::add(SideType side, PieceType type)
+  {
+    if (side == SideType::NONE) return;
+    std::vector<PieceType>& p = pieces[num(side)];
+    p.insert(std::upper_bound(p.begin(), p.end(), type), type);
+  }
+
+  bool TableSpec::isValid() const
+  {
+    if (size() > TB_MAX_PIECES) return false;
+    for (std::size_t side = 0; side < 2; side++)
+      {
+        if (army[side] == ArmyType::NONE) return false;
+        std::size_t kings = 0;
+        PieceType king = corresponding(PieceType::CLA_KING, army[side]);
+        const std::set<PieceType>& others = ARMY_PROMOTE[num(army[side])];
+        for (std::size_t i = 0; i < pieces[side].size(); i++)
+          {
+            PieceType t = pieces[side][i];
+            if (t == king) kings++;
+            else if (others.find(t) == others.end()) return false;
+          }
+        if (kings != (army[side] == ArmyType::TWOKINGS ? 2u : 1u))
+          {
+            return false;
+          }
+      }
+    return true;
+  }
+
+  std::uint8_t TableSpec::stoneCap() const
+  {
+    //Only a side with something other than kings can be in a duel, and it
+    //takes both sides to have a duel
+    for (std::size_t side = 0; side < 2; side++)
+      {
+        bool others = false;
+        for (std::size_t i = 0; i < pieces[side].size(); i++)
+          {
+            if (!isKing(pieces[side][i])) others = true;
+          }
+        if (!others) return 0;
+      }
+    return 3;
+  }
+
+  std::string TableSpec::name() const
+  {
+    std::string name;
+    for (std::size_t side = 0; side < 2; side++)
+      {
+        if (side == 1) name += "_";
+        if (army[side] != ArmyType::NONE)
+          {
+            const std::string& a = ARMY_NAME[num(army[side])];
+            for (std::size_t i = 0; i < a.size(); i++)
+              {
+                if (a[i] != ' ') name += a[i];
+              }
+          }
+        name += "-";
+        for (std::size_t i = 0; i < pieces[side].size(); i++)
+          {
+            name += PIECE_LETTER[num(pieces[side][i])];
+          }
+      }
+    return name + ".c2tb";
+  }
+
+  std::uint64_t TableSpec::key() const
+  {
+    std::uint64_t k = num(army[0]) | (num(army[1]) << 4);
+    for (std::size_t side = 0; side < 2; side++)
+      {
+        k = (k << 3) | pieces[side].size();
+        for (std::size_t i = 0; i < pieces[side].size(); i++)
+          {
+            k = (k << 5) | num(pieces[side][i]);
+          }
+      }
+    return k;
+  }
+
+  //Which stone slot a pair of stone counts is folded into
+  static std::uint64_t stoneSlot(const TableSpec& spec, std::uint8_t white,
+                                 std::uint8_t black)
+  {
+    std::uint8_t cap = spec.stoneCap();
+    return std::min(white, cap) * (cap + 1) + std::min(black, cap);
+  }
+
+  //The index of a position within its stone slot, assuming the snapshot
+  //matches spec
+  static std::uint64_t slotIndex(const TableSpec& spec, const GameSnapshot& s)
+  {
+    //Pair each piece with its square, then sort to match the spec order
+    std::vector<std::pair<PieceType, std::uint8_t> > side[2];
+    for (std::size_t i = 0; i < s.pieces.size(); i++)
+      {
+        const Piece& p = s.pieces[i];
+        side[num(p.side())].push_back(std::make_pair(p.type(), square(p.pos())));
+      }
+
+    std::uint64_t index = 0, scale = 1;
+    for (std::size_t i = 0; i < 2; i++)
+      {
+        std::sort(side[i].begin(), side[i].end());
+        for (std::size_t j = 0; j < side[i].size(); j++)
+          {
+            index += side[i][j].second * scale;
+            scale *= 64;
+          }
+      }
+    return turnOf(s.state) * squaresPerTurn(spec.size()) + index;
+  }
+
+  //Sets up the position at an index within a stone slot. Returns false if
+  //it can't be reached in a game.
+  static bool slotPosition(const TableSpec& spec, std::uint8_t slot,
+                           std::uint64_t index, GameSnapshot& s)
+  {
+    std::size_t n = spec.size();
+    std::uint8_t turn = index / squaresPerTurn(n);
+    if (turn > 1 && !hasKingTurn(spec.army[turn - 2])) return false;
+
+    s.state = stateOf(turn);
+    s.whiteArmy = spec.army[0];
+    s.blackArmy = spec.army[1];
+    std::uint8_t cap = spec.stoneCap();
+    s.whiteStones = slot / (cap + 1);
+    s.blackStones = slot % (cap + 1);
+    s.whiteBet = s.blackBet = 3;
+    s.whiteKingCastle = s.whiteQueenCastle = false;
+    s.blackKingCastle = s.blackQueenCastle = false;
+    s.isKingTurn = turn > 1;
+    s.fiftyMoveRule = 0;
+    s.touched = ~0ULL;
+    s.lastMove = Move();
+    s.currentMove = Move();
+    s.justTaken = Piece();
+    s.pieces.clear();
+
+    std::uint64_t used = 0;
+    std::uint64_t squares = index % squaresPerTurn(n);
+    bool kingsAcross[2] = {true, true};
+    for (std::size_t side = 0; side < 2; side++)
+      {
+        const std::vector<PieceType>& types = spec.pieces[side];
+        for (std::size_t i = 0; i < types.size(); i++)
+          {
+            std::uint8_t sq = squares % 64;
+            squares /= 64;
+            if (used & (1ULL << sq)) return false;
+            used |= 1ULL << sq;
+
+            //Identical pieces are only stored in square order
+            if (i > 0 && types[i] == types[i-1] &&
+                sq < square(s.pieces.back().pos()))
+              {
+                return false;
+              }
+
+            Position pos(sq % 8 + 1, sq / 8 + 1);
+            SideType owner = side == 0 ? SideType::WHITE : SideType::BLACK;
+            s.pieces.push_back(Piece(types[i], pos, owner));
+            if (isKing(types[i]) &&
+                ((side == 0 && pos.y() < 5) || (side == 1 && pos.y() > 4)))
+              {
+                kingsAcross[side] = false;
+              }
+          }
+      }
+
+    //The game would already be over
+    return !kingsAcross[0] && !kingsAcross[1];
+  }
+
+  //Scores a position reached at the end of a turn for the side that moved,
+  //looking it up if the game is still going
+  static bool leafScore(const Game& g, SideType mover, const Tablebase& tb,
+                        int& score)
+  {
+    GameStateType s = g.state();
+    if (isGameOver(s))
+      {
+        score = gameOverScore(s, mover);
+        return true;
+      }
+    if (!isMoveState(s)) return false;
+    TableResult r = tb.probe(g);
+    if (r.type == TableResultType::NOT_FOUND) return false;
+    score = moverScore(r, sideToMove(s) != mover);
+    return true;
+  }
+
+  //What one move leads to, for the side making it
+  struct MoveOutcome
+  {
+    //The move leads to another position in the table being built
+    bool sameTable;
+    std::uint64_t index;
+    bool flip;
+
+    //Otherwise, the worst and best the mover can be held to
+    int low;
+    int high;
+  };
+
+  //Plays m, one of the legal moves from a position, and works out where it
+  //leads. Duels are scored so that low is what the mover can force and high
+  //is what the defender can hold the mover to. With current set, positions
+  //in that table are left to the caller rather than looked up.
+  static bool evaluateMove(Game& g, const GameSnapshot& before,
+                           const std::vector<Move>& legal, const Move& m,
+                           const TableSpec* current, const Tablebase& tb,
+                           MoveOutcome& out)
+  {
+    out.sameTable = false;
+    g.restore(before, &legal);
+    if (!succeeded(g.move(m))) return false;
+
+    GameStateType s = g.state();
+    if (current && isMoveState(s))
+      {
+        GameSnapshot after = g.snapshot();
+        TableSpec spec(after);
+        if (spec.key() == current->key())
+          {
+            out.sameTable = true;
+            out.index = slotIndex(spec, after);
+            out.flip = sideToMove(s) != m.side;
+            return true;
+          }
+      }
+
+    if (!isDuelState(s))
+      {
+        if (!leafScore(g, m.side, tb, out.low)) return false;
+        out.high = out.low;
+        return true;
+      }
+
+    //The defender picks whether to duel
+    GameSnapshot duel = g.snapshot();
+    if (!succeeded(g.startDuel(false)) || !leafScore(g, m.side, tb, out.low))
+      {
+        return false;
+      }
+    out.high = out.low;
+
+    g.restore(duel);
+    if (!succeeded(g.startDuel(true))) return true;
+    if (!isBidState(g.state()))
+      {
+        //Resolved right away by forced bids
+        int score;
+        if (!leafScore(g, m.side, tb, score)) return false;
+        out.low = std::min(out.low, score);
+        out.high = std::min(out.high, score);
+        return true;
+      }
+
+    //Bids are made blind, so the mover can only count on the best bid
+    //against every reply, and the defender likewise
+    GameSnapshot bids = g.snapshot();
+    SideType attacker = m.side;
+    SideType defender = otherSide(attacker);
+    std::uint8_t maxAttack = std::min<std::uint8_t>(g.stones(attacker), 2);
+    std::uint8_t maxDefend = std::min<std::uint8_t>(g.stones(defender), 2);
+    int score[3][3];
+    for (std::uint8_t a = 0; a <= maxAttack; a++)
+      {
+        for (std::uint8_t d = 0; d <= maxDefend; d++)
+          {
+            g.restore(bids);
+            if (!succeeded(g.bid(attacker, a)) ||
+                !succeeded(g.bid(defender, d)) ||
+                !leafScore(g, m.side, tb, score[a][d]))
+              {
+                return false;
+              }
+          }
+      }
+    int forced = NO_SCORE;
+    for (std::uint8_t a = 0; a <= maxAttack; a++)
+      {
+        int worst = score[a][0];
+        for (std::uint8_t d = 1; d <= maxDefend; d++)
+          {
+            worst = std::min(worst, score[a][d]);
+          }
+        forced = std::max(forced, worst);
+      }
+    int held = -NO_SCORE;
+    for (std::uint8_t d = 0; d <= maxDefend; d++)
+      {
+        int best = score[0][d];
+        for (std::uint8_t a = 1; a <= maxAttack; a++)
+          {
+            best = std::max(best, score[a][d]);
+          }
+        held = std::min(held, best);
+      }
+    out.low = std::min(out.low, forced);
+    out.high = std::min(out.high, held);
+    return true;
+  }
+
+  Tablebase::Tablebase() {}
+
+  Tablebase::~Tablebase()
+  {
+    close();
+  }
+
+  bool Tablebase::open(const std::string& dir)
+  {
+    close();
+    DIR* d = opendir(dir.c_str());
+    if (!d) return false;
+    struct dirent* ent;
+    while ((ent = readdir(d)) != nullptr)
+      {
+        std::string name = ent->d_name;
+        if (name.size() > 5 && name.substr(name.size() - 5) == ".c2tb")
+          {
+            add(dir + "/" + name);
+          }
+      }
+    closedir(d);
+    return !_tables.empty();
+  }
+
+  bool Tablebase::add(const std::string& path)
+  {
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0) return false;
+
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size < static_cast<off_t>(TB_HEADER_SIZE))
+      {
+        ::close(fd);
+        return false;
+      }
+
+    void* map = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    ::close(fd);
+    if (map == MAP_FAILED) return false;
+
+    Table t;
+    t.map = static_cast<const std::uint8_t*>(map);
+    t.mapSize = st.st_size;
+    t.blocks = getLE(t.map + 24, 8);
+    t.spec.army[0] = toArmy(t.map[8]);
+    t.spec.army[1] = toArmy(t.map[9]);
+    bool ok = memcmp(t.map, TB_MAGIC, 4) == 0 &&
+      getLE(t.map + 4, 2) == TB_VERSION && t.map[8] < NUM_ARMIES &&
+      t.map[9] < NUM_ARMIES && t.map[10] + t.map[11] <= TB_MAX_PIECES;
+    for (std::size_t i = 0; ok && i < std::size_t(t.map[10] + t.map[11]); i++)
+      {
+        if (t.map[12 + i] >= PIECE_TYPES) ok = false;
+        else t.spec.add(i < t.map[10] ? SideType::WHITE : SideType::BLACK,
+                        static_cast<PieceType>(t.map[12 + i]));
+      }
+
+    //The blocks must cover every entry and the offsets must fit
+    if (ok)
+      {
+        std::uint64_t slots = (t.spec.stoneCap() + 1) * (t.spec.stoneCap() + 1);
+        std::uint64_t entries = slots * 4 * squaresPerTurn(t.spec.size());
+        ok = t.spec.isValid() && t.map[16] == t.spec.stoneCap() &&
+          t.blocks == (entries + TB_BLOCK_ENTRIES - 1) / TB_BLOCK_ENTRIES &&
+          (t.mapSize - TB_HEADER_SIZE) / 8 >= t.blocks + 1 &&
+          getLE(t.map + TB_HEADER_SIZE + t.blocks*8, 8) <= t.mapSize;
+      }
+    if (!ok)
+      {
+        munmap(map, t.mapSize);
+        return false;
+      }
+
+    //Probes jump all over the table
+    madvise(map, t.mapSize, MADV_RANDOM);
+    std::map<std::uint64_t, Table>::iterator old = _tables.find(t.spec.key());
+    if (old != _tables.end())
+      {
+        munmap(const_cast<std::uint8_t*>(old->second.map), old->second.mapSize);
+        _tables.erase(old);
+      }
+    _tables[t.spec.key()] = t;
+    return true;
+  }
+
+  void Tablebase::close()
+  {
+    for (std::map<std::uint64_t, Table>::iterator i = _tables.begin();
+         i != _tables.end(); ++i)
+      {
+        munmap(const_cast<std::uint8_t*>(i->second.map), i->second.mapSize);
+      }
+    _tables.clear();
+  }
+
+  bool Tablebase::has(const TableSpec& spec) const
+  {
+    return _tables.find(spec.key()) != _tables.end();
+  }
+
+  std::uint8_t Tablebase::value(const Table& t, std::uint64_t index) const
+  {
+    std::uint64_t block = index / TB_BLOCK_ENTRIES;
+    std::uint64_t skip = index % TB_BLOCK_ENTRIES;
+    if (block >= t.blocks) return TB_INVALID;
+    std::size_t pos = getLE(t.map + TB_HEADER_SIZE + block*8, 8);
+    std::size_t end = getLE(t.map + TB_HEADER_SIZE + (block+1)*8, 8);
+    if (end > t.mapSize) return TB_INVALID;
+
+    //Walk the runs until the one holding the entry
+    while (pos < end)
+      {
+        std::uint8_t v = t.map[pos++];
+        std::uint64_t run;
+        if (!getVarint(t.map, end, pos, run)) break;
+        if (skip < run) return v;
+        skip -= run;
+      }
+    return TB_INVALID;
+  }
+
+  TableResult Tablebase::probe(const Game& g) const
+  {
+    if (!isMoveState(g.state()))
+      {
+        return makeResult(TableResultType::NOT_FOUND, 0);
+      }
+    return probe(g.snapshot());
+  }
+
+  TableResult Tablebase::probe(const GameSnapshot& s) const
+  {
+    TableSpec spec(s);
+    std::map<std::uint64_t, Table>::const_iterator t = _tables.find(spec.key());
+    if (turnOf(s.state) > 3 || t == _tables.end())
+      {
+        return makeResult(TableResultType::NOT_FOUND, 0);
+      }
+    std::uint64_t slot = stoneSlot(spec, s.whiteStones, s.blackStones);
+    std::uint64_t index = slot * 4 * squaresPerTurn(spec.size()) +
+      slotIndex(spec, s);
+    return fromValue(value(t->second, index));
+  }
+
+  bool Tablebase::bestMove(const Game& g, Move& m) const
+  {
+    GameSnapshot s = g.snapshot();
+    if (!isMoveState(s.state)) return false;
+    if (probe(s).type == TableResultType::NOT_FOUND) return false;
+
+    BitBoard board;
+    Game scratch(&board);
+    if (scratch.restore(s) != GameReturnType::SUCCESS) return false;
+    std::vector<Move> legal = scratch.legalMoves();
+    int best = NO_SCORE;
+    for (std::size_t i = 0; i < legal.size(); i++)
+      {
+        MoveOutcome out;
+        if (!evaluateMove(scratch, s, legal, legal[i], nullptr, *this, out)) continue;
+        if (out.low > best)
+          {
+            best = out.low;
+            m = legal[i];
+          }
+      }
+    return best != NO_SCORE;
+  }
+
+  //Per position data while solving one stone slot. Moves that leave the
+  //table are folded into low and high; moves that stay in it are listed as
+  //successors, with the top bit set if the same side moves again after.
+  struct SolveChunk
+  {
+    std::vector<std::uint32_t> start;
+    std::vector<std::uint32_t> next;
+  };
+
+  struct SolveWork
+  {
+    const TableSpec* spec;
+    std::uint8_t slot;
+    const Tablebase* tables;
+    std::vector<std::uint8_t>* values;
+    std::vector<std::int16_t>* low;
+    std::vector<std::int16_t>* high;
+    std::vector<SolveChunk>* chunks;
+
+    //The current pass, 0 for the first
+    std::uint8_t level;
+
+    //Hands out chunks to workers, until a move can't be followed
+    pthread_mutex_t lock;
+    std::size_t nextChunk;
+    bool failed;
+  };
+
+  //What one worker found in a pass after the first
+  struct SolveThread
+  {
+    SolveWork* work;
+    std::vector<std::pair<std::uint32_t, std::uint8_t> > updates;
+  };
+
+  static const std::uint32_t SAME_SIDE = 0x80000000;
+
+  static bool takeChunk(SolveWork* w, std::size_t& c)
+  {
+    pthread_mutex_lock(&w->lock);
+    c = w->failed ? w->chunks->size() : w->nextChunk++;
+    pthread_mutex_unlock(&w->lock);
+    return c < w->chunks->size();
+  }
+
+  //First pass: play every move from every position once
+  static void* solveMoves(void* arg)
+  {
+    SolveThread* t = static_cast<SolveThread*>(arg);
+    SolveWork* w = t->work;
+    BitBoard board;
+    Game g(&board);
+    g.setShareMoves(false);
+    GameSnapshot s;
+    std::size_t c;
+    while (takeChunk(w, c))
+      {
+        SolveChunk& chunk = (*w->chunks)[c];
+        for (std::size_t p = c * TB_CHUNK; p < (c+1) * TB_CHUNK; p++)
+          {
+            chunk.start.push_back(chunk.next.size());
+            (*w->low)[p] = (*w->high)[p] = NO_SCORE;
+            if (!slotPosition(*w->spec, w->slot, p, s))
+              {
+                (*w->values)[p] = TB_INVALID;
+                continue;
+              }
+            g.restore(s);
+            std::vector<Move> legal = g.legalMoves();
+
+            //On a normal turn, having no moves or being able to take a king
+            //means the game ended on the last turn
+            bool reachable = s.isKingTurn || !legal.empty();
+            for (std::size_t i = 0; reachable && i < legal.size(); i++)
+              {
+                for (std::size_t j = 0; j < s.pieces.size(); j++)
+                  {
+                    if (!s.isKingTurn && s.pieces[j].pos() == legal[i].end &&
+                        s.pieces[j].side() != legal[i].side &&
+                        isKing(s.pieces[j].type()))
+                      {
+                        reachable = false;
+                      }
+                  }
+              }
+            if (!reachable)
+              {
+                (*w->values)[p] = TB_INVALID;
+                continue;
+              }
+
+            int low = NO_SCORE, high = NO_SCORE;
+            for (std::size_t i = 0; i < legal.size(); i++)
+              {
+                MoveOutcome out;
+                if (!evaluateMove(g, s, legal, legal[i], w->spec, *w->tables, out))
+                  {
+                    //Something the tables can't follow, so nothing solved
+                    //from here could be trusted
+                    pthread_mutex_lock(&w->lock);
+                    w->failed = true;
+                    pthread_mutex_unlock(&w->lock);
+                    return NULL;
+                  }
+                if (out.sameTable)
+                  {
+                    chunk.next.push_back(out.index | (out.flip ? 0 : SAME_SIDE));
+                  }
+                else
+                  {
+                    low = std::max(low, out.low);
+                    high = std::max(high, out.high);
+                  }
+              }
+            (*w->low)[p] = low;
+            (*w->high)[p] = high;
+          }
+        chunk.start.push_back(chunk.next.size());
+      }
+    return NULL;
+  }
+
+  //Later passes: settle every position whose result takes w->level plies
+  static void* solveLevel(void* arg)
+  {
+    SolveThread* t = static_cast<SolveThread*>(arg);
+    SolveWork* w = t->work;
+    const std::vector<std::uint8_t>& values = *w->values;
+    std::size_t c;
+    while (takeChunk(w, c))
+      {
+        const SolveChunk& chunk = (*w->chunks)[c];
+        for (std::size_t i = 0; i < TB_CHUNK; i++)
+          {
+            std::size_t p = c * TB_CHUNK + i;
+            if (values[p] != TB_DRAW) continue;
+
+            int low = (*w->low)[p], high = (*w->high)[p];
+            bool known = true;
+            for (std::uint32_t j = chunk.start[i]; j < chunk.start[i+1]; j++)
+              {
+                std::uint32_t n = chunk.next[j];
+                std::uint8_t v = values[n & ~SAME_SIDE];
+                if (v == TB_DRAW || v == TB_INVALID)
+                  {
+                    known = false;
+                    continue;
+                  }
+                int score = moverScore(fromValue(v), !(n & SAME_SIDE));
+                low = std::max(low, score);
+                high = std::max(high, score);
+              }
+
+            if (isWinScore(low) && WIN_SCORE - low <= w->level)
+              {
+                t->updates.push_back(std::make_pair(p, WIN_SCORE - low));
+              }
+            else if (known && isLossScore(high) &&
+                     high + WIN_SCORE <= w->level)
+              {
+                t->updates.push_back(std::make_pair(p, 128 + high + WIN_SCORE));
+              }
+          }
+      }
+    return NULL;
+  }
+
+  //Runs a pass on every thread
+  static void runPass(SolveWork& w, std::vector<SolveThread>& threads,
+                      void* (*fn)(void*))
+  {
+    w.nextChunk = 0;
+    std::vector<pthread_t> tids(threads.size());
+    std::vector<bool> started(threads.size(), false);
+    for (std::size_t i = 0; i < threads.size(); i++)
+      {
+        threads[i].work = &w;
+        threads[i].updates.clear();
+        started[i] = pthread_create(&tids[i], NULL, fn, &threads[i]) == 0;
+      }
+    for (std::size_t i = 0; i < threads.size(); i++)
+      {
+        if (started[i]) pthread_join(tids[i], NULL);
+      }
+
+    //Make sure every chunk got done even if threads couldn't be started
+    if (w.nextChunk < w.chunks->size()) fn(&threads[0]);
+  }
+
+  TableGenerator::TableGenerator(const std::string& dir) :
+    _dir(dir), _threads(1)
+  {
+    _tables.open(_dir);
+  }
+
+  bool TableGenerator::generate(const TableSpec& spec)
+  {
+    if (!spec.isValid()) return false;
+    if (_tables.has(spec)) return true;
+
+    //Every capture leads into a table with one piece fewer
+    for (std::size_t side = 0; side < 2; side++)
+      {
+        for (std::size_t i = 0; i < spec.pieces[side].size(); i++)
+          {
+            if (isKing(spec.pieces[side][i])) continue;
+            if (i > 0 && spec.pieces[side][i] == spec.pieces[side][i-1])
+              {
+                continue;
+              }
+            TableSpec smaller = spec;
+            smaller.pieces[side].erase(smaller.pieces[side].begin() + i);
+            if (!generate(smaller)) return false;
+          }
+      }
+
+    //Solve and compress one stone slot at a time
+    std::uint8_t cap = spec.stoneCap();
+    std::vector<std::uint8_t> data;
+    std::vector<std::uint64_t> offsets;
+    std::vector<std::uint8_t> values;
+    for (std::uint8_t slot = 0; slot < (cap + 1) * (cap + 1); slot++)
+      {
+        if (!solve(spec, slot, values)) return false;
+        for (std::size_t b = 0; b < values.size(); b += TB_BLOCK_ENTRIES)
+          {
+            offsets.push_back(data.size());
+            std::size_t end = std::min(b + TB_BLOCK_ENTRIES, values.size());
+            std::size_t i = b;
+            while (i < end)
+              {
+                std::size_t run = 1;
+                while (i + run < end && values[i + run] == values[i]) run++;
+                data.push_back(values[i]);
+                putVarint(data, run);
+                i += run;
+              }
+          }
+      }
+    offsets.push_back(data.size());
+
+    //Header, then offsets made relative to the start of the file
+    std::vector<std::uint8_t> head(TB_HEADER_SIZE + offsets.size() * 8, 0);
+    memcpy(&head[0], TB_MAGIC, 4);
+    putLE(&head[4], TB_VERSION, 2);
+    head[8] = num(spec.army[0]);
+    head[9] = num(spec.army[1]);
+    head[10] = spec.pieces[0].size();
+    head[11] = spec.pieces[1].size();
+    for (std::size_t i = 0; i < TB_MAX_PIECES; i++)
+      {
+        std::size_t w = spec.pieces[0].size();
+        if (i < w) head[12 + i] = num(spec.pieces[0][i]);
+        else if (i < spec.size()) head[12 + i] = num(spec.pieces[1][i - w]);
+        else head[12 + i] = num(PieceType::NONE);
+      }
+    head[16] = cap;
+    putLE(&head[24], offsets.size() - 1, 8);
+    for (std::size_t i = 0; i < offsets.size(); i++)
+      {
+        putLE(&head[TB_HEADER_SIZE + i*8], head.size() + offsets[i], 8);
+      }
+
+    //Write to a temporary name so a half written table is never opened
+    std::string path = _dir + "/" + spec.name();
+    std::string temp = path + ".tmp";
+    std::FILE* f = std::fopen(temp.c_str(), "wb");
+    if (!f) return false;
+    bool ok = std::fwrite(&head[0], 1, head.size(), f) == head.size() &&
+      (data.empty() || std::fwrite(&data[0], 1, data.size(), f) == data.size());
+    if (std::fclose(f) != 0) ok = false;
+    if (!ok || std::rename(temp.c_str(), path.c_str()) != 0)
+      {
+        std::remove(temp.c_str());
+        return false;
+      }
+
+    if (!_tables.add(path)) return false;
+    _written.push_back(spec.name());
+    return true;
+  }
+
+  bool TableGenerator::solve(const TableSpec& spec, std::uint8_t slot,
+                             std::vector<std::uint8_t>& values)
+  {
+    std::size_t count = 4 * squaresPerTurn(spec.size());
+    values.assign(count, TB_DRAW);
+    std::vector<std::int16_t> low(count), high(count);
+    std::vector<SolveChunk> chunks(count / TB_CHUNK);
+
+    SolveWork w;
+    w.spec = &spec;
+    w.slot = slot;
+    w.tables = &_tables;
+    w.values = &values;
+    w.low = &low;
+    w.high = &high;
+    w.chunks = &chunks;
+    w.level = 0;
+    w.failed = false;
+    pthread_mutex_init(&w.lock, NULL);
+    std::vector<SolveThread> threads(_threads);
+
+    //Play out every move once
+    runPass(w, threads, &solveMoves);
+    if (w.failed)
+      {
+        pthread_mutex_destroy(&w.lock);
+        return false;
+      }
+
+    //Results through other tables can settle a position at any level, so
+    //keep going until there are none of those left to wait on
+    int lastFixed = 0;
+    for (std::size_t p = 0; p < count; p++)
+      {
+        if (isWinScore(low[p])) lastFixed = std::max(lastFixed, WIN_SCORE - low[p]);
+        if (isLossScore(high[p])) lastFixed = std::max(lastFixed, high[p] + WIN_SCORE);
+      }
+
+    //Then settle positions in order of plies to the end, so each result
+    //is the quickest win or slowest loss
+    for (w.level = 1; w.level <= TB_MAX_PLIES; w.level++)
+      {
+        runPass(w, threads, &solveLevel);
+        bool changed = false;
+        for (std::size_t i = 0; i < threads.size(); i++)
+          {
+            for (std::size_t j = 0; j < threads[i].updates.size(); j++)
+              {
+                values[threads[i].updates[j].first] = threads[i].updates[j].second;
+                changed = true;
+              }
+          }
+        if (!changed && w.level >= lastFixed) break;
+      }
+
+    pthread_mutex_destroy(&w.lock);
+    return true;
+  }
+
+} //Namespace
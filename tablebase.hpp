@@ -0,0 +1,183 @@
+/*
+  Copyright (c) 2014 Auston Sterling
+  See license.txt for copying permission.
+
+  -----Tablebase Class Header-----
+  Auston Sterling
+  austonst@gmail.com
+
+  Endgame tablebases for positions with up to four pieces, kings included,
+  built by retrograde analysis and probed straight from mapped files.
+
+  A table covers one set of material: the two armies and every piece on
+  each side. Pawns are not supported. Each entry is the result for the side
+  to move with the fewest plies to the end, assuming the worst for that side
+  in any duel: a win is only a win if no choice of bids can save the other
+  side. Castling rights are assumed lost and the fifty move rule is ignored.
+
+  Stones only matter to the defender of a duel, and with four pieces there
+  can be at most one duel before one side has nothing but kings. Stone
+  counts above 3 are therefore the same as 3, and are folded into the index
+  as min(stones, 3) for each side, or dropped when a side has only kings.
+
+  index = ((stones * 4 + turn) * 64^n) + square[0] + 64*square[1] + ...
+  where turn is white move, black move, white king move, black king move,
+  and pieces go white then black, each side sorted by PieceType.
+  Squares are (y-1)*8 + (x-1). Identical pieces are kept in square order.
+
+  All integers are little-endian.
+  header 32B  - 4B magic "C2TB", 2B version, 2B reserved, 1B white army,
+                1B black army, 1B white pieces, 1B black pieces,
+                4B PieceTypes (white then black, NONE padded),
+                1B stone cap, 7B reserved, 8B block count
+  offsets     - (count+1) 8B file offsets; block i spans [off[i], off[i+1])
+  blocks      - TB_BLOCK_ENTRIES entries each, as runs of
+                1B value, varint run length
+  Values are 0 for a draw, 1-127 for a win in that many plies, 129-255 for
+  a loss in (value-128) plies, and 128 for a position that can't happen.
+*/
+
+#ifndef _tablebase_hpp_
+#define _tablebase_hpp_
+
+#include <string>
+#include <vector>
+#include <map>
+
+#include "game.hpp"
+
+namespace c2
+{
+
+  const std::uint16_t TB_VERSION = 1;
+  const std::size_t TB_HEADER_SIZE = 32;
+  const std::size_t TB_MAX_PIECES = 4;
+  const std::size_t TB_BLOCK_ENTRIES = 4096;
+
+  enum class TableResultType : std::uint8_t
+  {
+    NOT_FOUND,
+    DRAW,
+    WIN,
+    LOSS
+  };
+
+  //A result for the side to move
+  struct TableResult
+  {
+    TableResultType type;
+
+    //Plies until the game ends, for wins and losses
+    std::uint8_t plies;
+  };
+
+  //The material a table covers
+  struct TableSpec
+  {
+    //Constructors
+    TableSpec();
+
+    //Describes the material in a game position
+    TableSpec(const GameSnapshot& s);
+
+    //Adds a piece to a side, keeping the pieces sorted
+    void add(SideType side, PieceType type);
+
+    //Whether there is a table for this: kings as the armies have them, no
+    //pawns, and no more than TB_MAX_PIECES pieces
+    bool isValid() const;
+
+    //Number of pieces on both sides
+    std::size_t size() const {return pieces[0].size() + pieces[1].size();}
+
+    //Number of values per side that stones are folded into, minus one
+    std::uint8_t stoneCap() const;
+
+    //A file name for the table, such as Classic-QK_Reaper-K.c2tb
+    std::string name() const;
+
+    //A number unique to this material, for looking up tables
+    std::uint64_t key() const;
+
+    ArmyType army[2];
+    std::vector<PieceType> pieces[2];
+  };
+
+  class Tablebase
+  {
+  public:
+    //Constructors
+    Tablebase();
+    ~Tablebase();
+    Tablebase(const Tablebase&) = delete;
+    Tablebase& operator=(const Tablebase&) = delete;
+
+    //Maps every table in a directory, returning false if none were found
+    bool open(const std::string& dir);
+
+    //Maps one more table file
+    bool add(const std::string& path);
+
+    void close();
+
+    //Number of tables mapped
+    std::size_t size() const {return _tables.size();}
+
+    //Whether there is a table for some material
+    bool has(const TableSpec& spec) const;
+
+    //Looks up a position. Only positions waiting on a move are in tables.
+    TableResult probe(const Game& g) const;
+    TableResult probe(const GameSnapshot& s) const;
+
+    //Finds the best move in a position covered by the tables.
+    //g is left as it was. Returns false if the position isn't covered.
+    bool bestMove(const Game& g, Move& m) const;
+
+  private:
+    struct Table
+    {
+      TableSpec spec;
+      const std::uint8_t* map;
+      std::size_t mapSize;
+      std::uint64_t blocks;
+    };
+
+    //Reads one entry of a table
+    std::uint8_t value(const Table& t, std::uint64_t index) const;
+
+    std::map<std::uint64_t, Table> _tables;
+  };
+
+  class TableGenerator
+  {
+  public:
+    //Constructors
+    //Tables are written to and read from dir
+    TableGenerator(const std::string& dir);
+
+    //Number of worker threads
+    void setThreads(std::size_t threads) {_threads = threads ? threads : 1;}
+
+    //Writes the table for spec, first making any smaller tables it needs.
+    //Returns false if spec is not valid, a move couldn't be followed into
+    //the smaller tables or a file couldn't be written.
+    bool generate(const TableSpec& spec);
+
+    //Names of the tables written so far
+    const std::vector<std::string>& written() const {return _written;}
+
+  private:
+    //Works out every value for one stone count of a table
+    bool solve(const TableSpec& spec, std::uint8_t stones,
+               std::vector<std::uint8_t>& values);
+
+    std::string _dir;
+    std::size_t _threads;
+    Tablebase _tables;
+    std::vector<std::string> _written;
+  };
+
+} //Namespace
+
+#endif
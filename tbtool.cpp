@@ -0,0 +1,127 @@
+/*
+  Copyright (c) 2014 Auston Sterling
+  See license.txt for copying permission.
+
+  -----Tablebase Tool-----
+  Auston Sterling
+  austonst@gmail.com
+
+  Generates endgame tables and shows which ones a directory holds.
+
+  chess2-tb gen <dir> <white army> <black army> <white> <black> [-t threads]
+  chess2-tb list <dir>
+
+  Pieces other than kings are given as letters, such as Q or RN, or - for
+  none. Kings are added to match each army.
+*/
+
+#include "tablebase.hpp"
+
+#include <iostream>
+#include <cstdlib>
+#include <unistd.h>
+
+using namespace c2;
+
+static void usage()
+{
+  std::cerr << "Usage:\n"
+            << "  chess2-tb gen <dir> <white army> <black army> <white pieces> "
+            << "<black pieces> [-t threads]\n"
+            << "  chess2-tb list <dir>\n";
+}
+
+static ArmyType armyByName(const std::string& name)
+{
+  for (std::size_t i = 0; i < NUM_ARMIES; i++)
+    {
+      if (ARMY_NAME[i] == name) return toArmy(i);
+    }
+  return ArmyType::NONE;
+}
+
+//Adds an army's kings and lettered pieces to one side of spec
+static bool addPieces(TableSpec& spec, SideType side, const std::string& letters)
+{
+  ArmyType army = spec.army[num(side)];
+  PieceType king = corresponding(PieceType::CLA_KING, army);
+  spec.add(side, king);
+  if (army == ArmyType::TWOKINGS) spec.add(side, king);
+  if (letters == "-") return true;
+
+  const std::set<PieceType>& types = ARMY_PROMOTE[num(army)];
+  for (std::size_t i = 0; i < letters.size(); i++)
+    {
+      PieceType type = PieceType::NONE;
+      for (auto t = types.begin(); t != types.end(); t++)
+        {
+          if (PIECE_LETTER[num(*t)] == letters[i]) type = *t;
+        }
+      if (type == PieceType::NONE) return false;
+      spec.add(side, type);
+    }
+  return true;
+}
+
+static int generate(int argc, char* argv[])
+{
+  TableSpec spec;
+  spec.army[0] = armyByName(argv[3]);
+  spec.army[1] = armyByName(argv[4]);
+  if (spec.army[0] == ArmyType::NONE || spec.army[1] == ArmyType::NONE)
+    {
+      std::cerr << "Unknown army\n";
+      return 1;
+    }
+  if (!addPieces(spec, SideType::WHITE, argv[5]) ||
+      !addPieces(spec, SideType::BLACK, argv[6]) || !spec.isValid())
+    {
+      std::cerr << "Those pieces can't make a table, at most "
+                << TB_MAX_PIECES << " pieces including kings\n";
+      return 1;
+    }
+
+  std::size_t threads = sysconf(_SC_NPROCESSORS_ONLN);
+  for (int i = 7; i < argc; i++)
+    {
+      if (std::string(argv[i]) == "-t" && i+1 < argc)
+        {
+          threads = std::atol(argv[++i]);
+        }
+    }
+
+  TableGenerator gen(argv[2]);
+  gen.setThreads(threads);
+  bool ok = gen.generate(spec);
+  for (std::size_t i = 0; i < gen.written().size(); i++)
+    {
+      std::cout << "Wrote " << gen.written()[i] << "\n";
+    }
+  if (!ok)
+    {
+      std::cerr << "Could not generate " << spec.name() << "\n";
+      return 1;
+    }
+  return 0;
+}
+
+static int list(char* argv[])
+{
+  Tablebase tb;
+  if (!tb.open(argv[2]))
+    {
+      std::cerr << "No tables in " << argv[2] << "\n";
+      return 1;
+    }
+  std::cout << tb.size() << " tables\n";
+  return 0;
+}
+
+int main(int argc, char* argv[])
+{
+  std::string cmd = argc > 1 ? argv[1] : "";
+  if (cmd == "gen" && argc > 6) return generate(argc, argv);
+  if (cmd == "list" && argc == 3) return list(argv);
+  usage();
+  return 1;
+}